@@ -0,0 +1,603 @@
+"""Benchmark suite of the I/O and effects hot paths, with machine-readable results.
+
+Covers `load` (`read_audio_file`, whole files and crops at several offsets), `info`
+(`get_info`), `save` (`write_audio_file`), `SoxEffectsChain` (`build_flow_effects`) and
+`load_and_augment` (`read_audio_file_augment`) over a matrix of formats, durations and
+thread counts, and every specialized path against what it replaces, e.g. `load_batch`
+against a loop of `load` or `load_features` against `load` and `transforms.MEL2`.  Every
+fixture is generated in a temporary directory, so runs on different machines and releases
+read the same audio.  Threaded cases run the same call from several Python threads at once
+(the extension releases the GIL) and report the aggregate rate; cases that run on the
+extension's thread pool run from one Python thread, with `pool_threads` pool threads.
+Cases over many files (`load_batch`, `info_batch`, `shard`, `save_batch`) run on `--files`
+copies of the fixtures of at most 10 s.
+
+Results are written as JSON: the environment, then one record per case with the best,
+median and mean time of a call and the audio seconds processed per second.  A `variant`
+names the alternatives timed under one case.  Pass the JSON of an earlier run to
+`--compare` to list the cases that got slower; the exit status is 1 if any did.
+
+Usage:
+    python setup.py bench [--quick] [--cases load,load_batch] [--output results.json]
+                          [--compare baseline.json]
+    python benchmarks/bench_suite.py [--formats wav,flac,mp3] [--durations 1,60,3600]
+                                     [--threads 1,4] [--cases load,info] [--files 256]
+                                     [--output results.json]
+"""
+from __future__ import division, print_function
+import argparse
+import json
+import math
+import os
+import platform
+import random
+import shutil
+import sys
+import tempfile
+import threading
+import time
+
+import torch
+import torchaudio
+import torchaudio.transforms as transforms
+
+# crops read by the offset cases, and where in the file they start
+CROP_SECONDS = 5
+CROP_POSITIONS = [0.1, 0.5, 0.9]
+EFFECTS = [("gain", ["-3"]), ("rate", ["8000"])]
+AUGMENT = ["tempo", "1.1", "gain", "-3"]
+CORE_CASES = ["load", "load_crop", "info", "save", "effects", "augment"]
+# fixtures copied for the cases over many files are at most this long
+CORPUS_SECONDS = 10
+# cases that slide over a signal in small steps skip longer fixtures
+STREAM_SECONDS = 60
+RESAMPLE_RATES = [8000, 22050, 44100]
+FEATURES = [("ws=400 n_mels=40", {}), ("ws=512 hop=160 n_mels=80", dict(ws=512, hop=160, n_mels=80))]
+ONLINE_FEATURES = dict(ws=400, hop=160, n_mels=40)
+PACKET_MS = 20
+SEGMENTS = 50
+LOAD_INTO_BATCH = 64
+QUANTIZATION_CHANNELS = 256
+# record entries that are measurements, everything else identifies the case
+MEASUREMENTS = {"rounds", "seconds", "audio_seconds_per_second"}
+
+
+def log(*args):
+    print(*args, file=sys.stderr)
+    sys.stderr.flush()
+
+
+def make_signal(seconds, rate):
+    # a tone under noise, so that the compressed formats have something to encode
+    torch.manual_seed(0)
+    t = torch.arange(0, int(seconds * rate)).float() / rate
+    x = 0.3 * torch.sin(2 * math.pi * 440 * t) + 0.05 * torch.randn(t.numel())
+    return x.unsqueeze(0)
+
+
+def make_fixtures(tmpdir, formats, durations, rate):
+    """Writes one file per format and duration; formats libsox cannot write are skipped."""
+    fixtures = {}
+    for duration in durations:
+        x = make_signal(duration, rate)
+        for fmt in formats:
+            path = os.path.join(tmpdir, "{}s.{}".format(duration, fmt))
+            try:
+                torchaudio.save(path, x, rate)
+            except RuntimeError as e:
+                log("skipping {}: {}".format(fmt, e))
+                continue
+            fixtures[fmt, duration] = path
+    return fixtures
+
+
+def corpus(path, files):
+    """Copies `path` `files` times, so that every read of a case over many files touches a
+    distinct file.  The copies are made once and shared by all such cases."""
+    directory = path + ".corpus"
+    stem, ext = os.path.splitext(os.path.basename(path))
+    paths = [os.path.join(directory, "{}-{:05d}{}".format(stem, i, ext)) for i in range(files)]
+    if not os.path.isdir(directory):
+        os.mkdir(directory)
+        for dst in paths:
+            shutil.copyfile(path, dst)
+    return paths
+
+
+def time_calls(call, threads, repeat, min_time):
+    """Times `call` run by `threads` threads at once, until `repeat` rounds or `min_time`
+    seconds, whichever comes first (at least one round after a warm-up call)."""
+    call()
+    times = []
+    while len(times) < repeat and (not times or sum(times) < min_time):
+        workers = [threading.Thread(target=call) for _ in range(threads)]
+        start = time.time()
+        for worker in workers:
+            worker.start()
+        for worker in workers:
+            worker.join()
+        times.append(time.time() - start)
+    return sorted(times)
+
+
+def load_unfused(path):
+    # the three passes that the fused decode replaced: raw values, conversion, scaling
+    x, _ = torchaudio.load(path, torch.IntTensor(), normalization=False)
+    x = x.float()
+    x /= 1 << 31
+    return x
+
+
+def without_seek_index(load):
+    # set_seek_index drops the indices; the reads that use them rebuild them in their warm-up call
+    def call():
+        torchaudio.set_seek_index(False)
+        try:
+            return load()
+        finally:
+            torchaudio.set_seek_index(True)
+    return call
+
+
+def effects_chain():
+    chain = torchaudio.sox_effects.SoxEffectsChain()
+    for name, args in EFFECTS:
+        chain.append_effect_to_chain(name, args)
+    return chain
+
+
+def core_cases(params, path, tmpdir, args):
+    fmt, duration = params["format"], params["duration"]
+    yield "load", params, duration, lambda path=path: torchaudio.load(path)
+    yield "load", dict(params, variant="unfused"), duration, lambda path=path: load_unfused(path)
+    if duration > CROP_SECONDS:
+        frames = duration * args.rate
+        for position in CROP_POSITIONS:
+            offset = min(int(frames * position), frames - CROP_SECONDS * args.rate)
+            crop = dict(params, position=position, crop=CROP_SECONDS)
+
+            def load_crop(path=path, offset=offset):
+                return torchaudio.load(path, offset=offset, num_frames=CROP_SECONDS * args.rate)
+            yield "load_crop", crop, CROP_SECONDS, load_crop
+            if fmt == "mp3":
+                # the index switch is global, so these run from one thread
+                yield ("load_crop", dict(crop, threads=1, variant="no seek index"), CROP_SECONDS,
+                       without_seek_index(load_crop))
+    yield "info", params, duration, lambda path=path: torchaudio.info(path)
+
+    x = make_signal(duration, args.rate)
+
+    def save(fmt=fmt, x=x):
+        # every thread writes its own file
+        out_path = os.path.join(tmpdir, "out-{}.{}".format(threading.current_thread().ident, fmt))
+        torchaudio.save(out_path, x, args.rate)
+    yield "save", params, duration, save
+
+    def effects(path=path):
+        chain = effects_chain()
+        chain.set_input_file(path)
+        return chain.sox_build_flow_effects()
+    yield "effects", params, duration, effects
+
+    chains = threading.local()
+
+    def compiled_effects(path=path, chains=chains):
+        # a chain per thread, compiled by its first call and reused for every file after it
+        if not hasattr(chains, "chain"):
+            chains.chain = effects_chain()
+        chains.chain.set_input_file(path)
+        return chains.chain.sox_build_flow_effects()
+    yield "effects", dict(params, variant="compiled"), duration, compiled_effects
+    yield "augment", params, duration, lambda path=path: torchaudio.load_and_augment(path, AUGMENT)
+
+
+def load_batch_cases(params, path, tmpdir, args):
+    if params["duration"] > CORPUS_SECONDS:
+        return
+    paths = corpus(path, args.files)
+    params = dict(params, files=len(paths))
+    audio_seconds = len(paths) * params["duration"]
+    yield "load_batch", dict(params, variant="load loop"), audio_seconds, lambda: [torchaudio.load(p) for p in paths]
+    for threads in args.thread_counts:
+        yield ("load_batch", dict(params, threads=1, pool_threads=threads), audio_seconds,
+               lambda threads=threads: torchaudio.load_batch(paths, num_threads=threads))
+
+
+def rate_chain(effect, new_rate, flags=()):
+    chain = torchaudio.sox_effects.SoxEffectsChain()
+    chain.append_effect_to_chain(effect, list(flags) + [new_rate])
+    return chain.compile()
+
+
+def resample_cases(params, x, tmpdir, args):
+    duration = params["duration"]
+    if duration > STREAM_SECONDS:
+        return
+    apply_effects = torchaudio.sox_effects.apply_effects_tensor
+    for new_rate in RESAMPLE_RATES:
+        rates = dict(params, new_rate=new_rate)
+        polyphase_chain = rate_chain("polyphase_rate", new_rate)
+        sox_chain = rate_chain("rate", new_rate, ["-h"])
+        yield ("resample", dict(rates, variant="resample"), duration,
+               lambda new_rate=new_rate: torchaudio.resample(x, args.rate, new_rate))
+        yield ("resample", dict(rates, variant="polyphase_rate"), duration,
+               lambda chain=polyphase_chain: apply_effects(x, args.rate, chain))
+        yield ("resample", dict(rates, variant="rate -h"), duration,
+               lambda chain=sox_chain: apply_effects(x, args.rate, chain))
+
+
+def mel_features(path, kwargs):
+    x, sr = torchaudio.load(path)
+    return transforms.MEL2(sr=sr, **kwargs)(x)
+
+
+def features_cases(params, path, tmpdir, args):
+    for label, kwargs in FEATURES:
+        features = dict(params, features=label)
+        yield ("features", dict(features, variant="load + MEL2"), params["duration"],
+               lambda kwargs=kwargs: mel_features(path, kwargs))
+        yield ("features", dict(features, variant="load_features"), params["duration"],
+               lambda kwargs=kwargs: torchaudio.load_features(path, **kwargs))
+
+
+def stream_features(x, rate, packet):
+    extractor = torchaudio.OnlineFeatureExtractor(rate, max_chunk=packet, **ONLINE_FEATURES)
+    for position in range(0, x.size(1), packet):
+        extractor.accept(x[:, position:position + packet])
+    extractor.flush()
+
+
+def sliding_features(x, rate, packet):
+    # MEL2 of the last `ws - hop + packet` samples at every packet, the way an online
+    # recognizer would do without OnlineFeatureExtractor
+    mel = transforms.MEL2(sr=rate, **ONLINE_FEATURES)
+    context = ONLINE_FEATURES["ws"] - ONLINE_FEATURES["hop"]
+    for position in range(0, x.size(1), packet):
+        window = x[:, max(position - context, 0):position + packet]
+        if window.size(1) >= ONLINE_FEATURES["ws"]:
+            mel(window)
+
+
+def online_features_cases(params, x, tmpdir, args):
+    duration = params["duration"]
+    if duration > STREAM_SECONDS:
+        return
+    packet = args.rate * PACKET_MS // 1000
+    params = dict(params, packet_ms=PACKET_MS)
+    yield ("online_features", dict(params, variant="OnlineFeatureExtractor"), duration,
+           lambda: stream_features(x, args.rate, packet))
+    yield ("online_features", dict(params, variant="sliding MEL2"), duration,
+           lambda: sliding_features(x, args.rate, packet))
+
+
+def shard_cases(params, path, tmpdir, args):
+    if params["duration"] > CORPUS_SECONDS:
+        return
+    paths = corpus(path, args.files)
+    shard_path = path + ".shard"
+    with torchaudio.ShardWriter(shard_path) as writer:
+        for p in paths:
+            writer.add_file(p)
+    shard = torchaudio.ShardReader(shard_path)
+    order = list(range(len(paths)))
+    random.Random(0).shuffle(order)
+    params = dict(params, files=len(paths))
+    audio_seconds = len(paths) * params["duration"]
+    yield ("shard", dict(params, variant="files, random"), audio_seconds,
+           lambda: [torchaudio.load(paths[i]) for i in order])
+    yield "shard", dict(params, variant="shard, random"), audio_seconds, lambda: [shard.load(i) for i in order]
+    yield ("shard", dict(params, variant="shard, iterated"), audio_seconds,
+           lambda: sum(1 for _ in torchaudio.ShardReader(shard_path, sequential=True)))
+
+
+def info_batch_cases(params, path, tmpdir, args):
+    if params["duration"] > CORPUS_SECONDS:
+        return
+    paths = corpus(path, args.files)
+    index = path + ".index"
+    params = dict(params, files=len(paths))
+    audio_seconds = len(paths) * params["duration"]
+    yield "info_batch", dict(params, variant="info loop"), audio_seconds, lambda: [torchaudio.info(p) for p in paths]
+    for threads in args.thread_counts:
+        pooled = dict(params, threads=1, pool_threads=threads)
+        yield ("info_batch", pooled, audio_seconds,
+               lambda threads=threads: torchaudio.info_batch(paths, num_threads=threads))
+        # the warm-up call writes the index, the timed ones read it
+        yield ("info_batch", dict(pooled, variant="index"), audio_seconds,
+               lambda threads=threads: torchaudio.info_batch(paths, index, threads))
+
+
+def load_bytes_cases(params, path, tmpdir, args):
+    fmt, duration = params["format"], params["duration"]
+    if duration > CORPUS_SECONDS:
+        return
+    with open(path, "rb") as f:
+        blob = f.read()
+
+    def spill():
+        # what a blob read from a tar shard or a key-value store needed before load_bytes
+        with tempfile.NamedTemporaryFile(suffix="." + fmt, dir=tmpdir) as f:
+            f.write(blob)
+            f.flush()
+            return torchaudio.load(f.name)
+    yield "load_bytes", dict(params, variant="temp file"), duration, spill
+    yield ("load_bytes", dict(params, variant="load_bytes"), duration,
+           lambda: torchaudio.load_bytes(blob, filetype=fmt))
+
+
+def segments_cases(params, path, tmpdir, args):
+    duration = params["duration"]
+    if duration <= CROP_SECONDS:
+        return
+    rng = random.Random(0)
+    frames, length = duration * args.rate, CROP_SECONDS * args.rate
+    segments = [(rng.randrange(0, frames - length), length) for _ in range(SEGMENTS)]
+    params = dict(params, segments=SEGMENTS, crop=CROP_SECONDS)
+    yield ("segments", dict(params, variant="load per segment"), SEGMENTS * CROP_SECONDS,
+           lambda: [torchaudio.load(path, offset=offset, num_frames=n) for offset, n in segments])
+    yield ("segments", dict(params, variant="load_segments"), SEGMENTS * CROP_SECONDS,
+           lambda: torchaudio.load_segments(path, segments))
+
+
+def load_into_cases(params, path, tmpdir, args):
+    frames, length = params["duration"] * args.rate, CROP_SECONDS * args.rate
+    # crops from offsets spread over the file, the last ones padded
+    offsets = [frames * i // LOAD_INTO_BATCH for i in range(LOAD_INTO_BATCH)]
+    pad_trim = transforms.PadTrim(length)
+
+    def stack():
+        return torch.stack([pad_trim(torchaudio.load(path, offset=offset, num_frames=length)[0])
+                            for offset in offsets])
+
+    def load_into():
+        batch = torch.empty(LOAD_INTO_BATCH, 1, length)
+        for i, offset in enumerate(offsets):
+            torchaudio.load_into(path, batch[i], offset=offset)
+        return batch
+    params = dict(params, batch=LOAD_INTO_BATCH, crop=CROP_SECONDS)
+    yield "load_into", dict(params, variant="load + PadTrim + stack"), LOAD_INTO_BATCH * CROP_SECONDS, stack
+    yield "load_into", dict(params, variant="load_into"), LOAD_INTO_BATCH * CROP_SECONDS, load_into
+
+
+def save_batch_cases(params, path, tmpdir, args):
+    fmt, duration = params["format"], params["duration"]
+    if duration > CORPUS_SECONDS:
+        return
+    tensors = [make_signal(duration, args.rate)] * args.files
+    paths = [os.path.join(tmpdir, "batch-{:05d}.{}".format(i, fmt)) for i in range(len(tensors))]
+    params = dict(params, files=len(tensors))
+    audio_seconds = len(tensors) * duration
+
+    def save_loop():
+        # every thread writes its own files
+        thread = threading.current_thread().ident
+        for i, x in enumerate(tensors):
+            torchaudio.save(os.path.join(tmpdir, "out-{}-{:05d}.{}".format(thread, i, fmt)), x, args.rate)
+    yield "save_batch", dict(params, variant="save loop"), audio_seconds, save_loop
+    yield ("save_batch", dict(params, variant="encode_to_bytes loop"), audio_seconds,
+           lambda: [torchaudio.encode_to_bytes(x, args.rate, fmt) for x in tensors])
+    for threads in args.thread_counts:
+        yield ("save_batch", dict(params, threads=1, pool_threads=threads), audio_seconds,
+               lambda threads=threads: torchaudio.save_batch(paths, tensors, args.rate, num_threads=threads))
+
+
+def torch_mu_law_encode(x, qc):
+    # the full tensor ops that MuLawEncoding ran before the extension's kernels
+    mu = torch.tensor(qc - 1., dtype=x.dtype)
+    x_mu = torch.sign(x) * torch.log1p(mu * torch.abs(x)) / torch.log1p(mu)
+    return ((x_mu + 1) / 2 * mu + 0.5).long()
+
+
+def torch_mu_law_expand(x_mu, qc):
+    # the full tensor ops that MuLawExpanding ran before the extension's kernels
+    x_mu = x_mu.to(torch.float)
+    mu = torch.tensor(qc - 1., dtype=x_mu.dtype)
+    x = ((x_mu) / mu) * 2 - 1.
+    return torch.sign(x) * (torch.exp(torch.abs(x) * torch.log1p(mu)) - 1.) / mu
+
+
+def mu_law_cases(params, x, tmpdir, args):
+    duration, qc = params["duration"], QUANTIZATION_CHANNELS
+    codes = torch_mu_law_encode(x, qc)
+    encode, expand = transforms.MuLawEncoding(qc), transforms.MuLawExpanding(qc)
+    params = dict(params, quantization_channels=qc)
+    yield "mu_law", dict(params, variant="encode, torch ops"), duration, lambda: torch_mu_law_encode(x, qc)
+    yield "mu_law", dict(params, variant="encode, MuLawEncoding"), duration, lambda: encode(x)
+    yield "mu_law", dict(params, variant="expand, torch ops"), duration, lambda: torch_mu_law_expand(codes, qc)
+    yield "mu_law", dict(params, variant="expand, MuLawExpanding"), duration, lambda: expand(codes)
+
+
+def load_mu_law_cases(params, path, tmpdir, args):
+    duration, qc = params["duration"], QUANTIZATION_CHANNELS
+    encode = transforms.MuLawEncoding(qc)
+    params = dict(params, quantization_channels=qc)
+    yield ("mu_law", dict(params, variant="load + MuLawEncoding"), duration,
+           lambda: encode(torchaudio.load(path)[0]))
+    yield "mu_law", dict(params, variant="load_mu_law"), duration, lambda: torchaudio.load_mu_law(path, qc)
+
+
+def make_bursts(seconds, rate):
+    """Bursts of a tone with noise, 0.3 to 2 s long, between silences of 0.2 to 1 s."""
+    torch.manual_seed(0)
+    parts = []
+    total = int(seconds * rate)
+    length = 0
+    while length < total:
+        n = int(rate * (0.2 + 0.8 * torch.rand(1).item()))
+        parts.append(torch.zeros(n))
+        n = int(rate * (0.3 + 1.7 * torch.rand(1).item()))
+        t = torch.arange(0, n).float() / rate
+        parts.append(0.3 * torch.sin(2 * math.pi * 180 * t) + 0.02 * torch.randn(n))
+        length += parts[-2].numel() + n
+    return torch.cat(parts)[:total].unsqueeze(0)
+
+
+def torch_trim(x, rate, threshold_db=-40., frame_ms=10.):
+    # the frame energy analysis in PyTorch ops that trimming ran before load_voiced
+    frame = int(rate * frame_ms / 1000)
+    frames = x.mean(0)[:x.size(1) // frame * frame].view(-1, frame)
+    voiced = (frames.pow(2).mean(1) >= 10 ** (threshold_db / 10)).nonzero()
+    if voiced.numel() == 0:
+        return x[:, :0]
+    return x[:, voiced[0].item() * frame:(voiced[-1].item() + 1) * frame]
+
+
+def vad_cases(params, path, tmpdir, args):
+    fmt, duration = params["format"], params["duration"]
+    # the tone of the fixtures has no silence to find
+    bursts_path = os.path.join(tmpdir, "bursts-{}s.{}".format(duration, fmt))
+    torchaudio.save(bursts_path, make_bursts(duration, args.rate), args.rate)
+    chain = torchaudio.sox_effects.SoxEffectsChain()
+    chain.set_input_file(bursts_path)
+    chain.append_effect_to_chain("energy_vad", ["segments"])
+    yield ("vad", dict(params, variant="load + torch trim"), duration,
+           lambda: torch_trim(torchaudio.load(bursts_path)[0], args.rate))
+    yield "vad", dict(params, variant="load_voiced, trim"), duration, lambda: torchaudio.load_voiced(bursts_path)
+    yield ("vad", dict(params, variant="load_voiced, segments"), duration,
+           lambda: torchaudio.load_voiced(bursts_path, mode='segments'))
+    yield "vad", dict(params, variant="energy_vad effect"), duration, chain.sox_build_flow_effects
+
+
+# groups of cases run on every fixture file, under the name that --cases selects
+FILE_CASES = [
+    ("load_batch", load_batch_cases),
+    ("features", features_cases),
+    ("shard", shard_cases),
+    ("info_batch", info_batch_cases),
+    ("load_bytes", load_bytes_cases),
+    ("segments", segments_cases),
+    ("load_into", load_into_cases),
+    ("save_batch", save_batch_cases),
+    ("mu_law", load_mu_law_cases),
+    ("vad", vad_cases),
+]
+# groups of cases run on a generated signal of every duration
+TENSOR_CASES = [
+    ("resample", resample_cases),
+    ("online_features", online_features_cases),
+    ("mu_law", mu_law_cases),
+]
+
+
+def case_names():
+    names = list(CORE_CASES)
+    for name, _ in FILE_CASES + TENSOR_CASES:
+        if name not in names:
+            names.append(name)
+    return names
+
+
+def cases(fixtures, tmpdir, args, selected):
+    """Yields `(name, params, audio seconds per call, call)` for every selected case."""
+    for (fmt, duration), path in sorted(fixtures.items()):
+        params = {"format": fmt, "duration": duration}
+        for case in core_cases(params, path, tmpdir, args):
+            if case[0] in selected:
+                yield case
+        for name, generate in FILE_CASES:
+            if name in selected:
+                for case in generate(params, path, tmpdir, args):
+                    yield case
+    for duration in sorted(set(duration for _, duration in fixtures)):
+        x = make_signal(duration, args.rate)
+        for name, generate in TENSOR_CASES:
+            if name in selected:
+                for case in generate({"duration": duration}, x, tmpdir, args):
+                    yield case
+
+
+def environment(args):
+    return {
+        "torch": torch.__version__,
+        "python": platform.python_version(),
+        "platform": platform.platform(),
+        "processor": platform.processor(),
+        "cpu_count": os.cpu_count() if hasattr(os, "cpu_count") else None,
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "rate": args.rate,
+        "repeat": args.repeat,
+        "min_time": args.min_time,
+        "files": args.files,
+    }
+
+
+def case_key(record):
+    return tuple(sorted((k, v) for k, v in record.items() if k not in MEASUREMENTS))
+
+
+def describe(key):
+    return " ".join("{}={}".format(k, v) for k, v in key if k not in ("case", "threads"))
+
+
+def compare(results, baseline_path, threshold):
+    """Prints the cases slower than in `baseline_path` by more than `threshold`, returns their number."""
+    with open(baseline_path) as f:
+        baseline = {case_key(record): record for record in json.load(f)["results"]}
+    slower = 0
+    for record in results:
+        before = baseline.get(case_key(record))
+        if before is None:
+            continue
+        ratio = record["seconds"]["best"] / before["seconds"]["best"]
+        if ratio > threshold:
+            slower += 1
+            log("slower x{:.2f}: {} {}".format(ratio, record["case"], describe(case_key(record))))
+    log("{} of {} cases slower than {} by more than x{}".format(slower, len(results), baseline_path, threshold))
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--formats", default="wav,flac,mp3")
+    parser.add_argument("--durations", default="1,60,3600", help="seconds, comma separated")
+    parser.add_argument("--threads", default="1,4", help="thread counts, comma separated")
+    parser.add_argument("--cases", default=",".join(case_names()))
+    parser.add_argument("--quick", action="store_true", help="durations of 1 and 10 s only")
+    parser.add_argument("--rate", type=int, default=16000)
+    parser.add_argument("--files", type=int, default=256, help="copies of a fixture in the cases over many files")
+    parser.add_argument("--repeat", type=int, default=5, help="rounds per case at most")
+    parser.add_argument("--min-time", type=float, default=2., help="seconds per case after which to stop")
+    parser.add_argument("--output", help="JSON file for the results, standard output if not given")
+    parser.add_argument("--compare", help="JSON results of an earlier run to compare against")
+    parser.add_argument("--threshold", type=float, default=1.1, help="slowdown reported by --compare")
+    args = parser.parse_args()
+
+    formats = args.formats.split(",")
+    durations = [1, 10] if args.quick else [int(d) for d in args.durations.split(",")]
+    args.thread_counts = [int(t) for t in args.threads.split(",")]
+    selected = set(args.cases.split(","))
+
+    tmpdir = tempfile.mkdtemp()
+    try:
+        log("generating fixtures in {}".format(tmpdir))
+        fixtures = make_fixtures(tmpdir, formats, durations, args.rate)
+        results = []
+        for name, params, audio_seconds, call in cases(fixtures, tmpdir, args, selected):
+            # cases on the extension's thread pool, or on global state, set their thread count
+            for threads in [params["threads"]] if "threads" in params else args.thread_counts:
+                times = time_calls(call, threads, args.repeat, args.min_time)
+                record = dict(params, case=name, threads=threads, rounds=len(times), seconds={
+                    "best": times[0],
+                    "median": times[len(times) // 2],
+                    "mean": sum(times) / len(times),
+                }, audio_seconds_per_second=threads * audio_seconds / times[0])
+                results.append(record)
+                log("{:<15} {:<60} {:>3} threads {:>10.4f} s {:>10.1f} x realtime".format(
+                    name, describe(case_key(dict(params, threads=threads))), threads,
+                    times[0], record["audio_seconds_per_second"]))
+    finally:
+        shutil.rmtree(tmpdir)
+
+    report = {"environment": environment(args), "results": results}
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+    else:
+        json.dump(report, sys.stdout, indent=2, sort_keys=True)
+        print()
+    if args.compare and compare(results, args.compare, args.threshold) > 0:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,8 +1,10 @@
 #!/usr/bin/env python
 import os
 import platform
+import subprocess
+import sys
 
-from setuptools import setup, find_packages
+from setuptools import setup, find_packages, Command
 from torch.utils.cpp_extension import BuildExtension, CppExtension
 
 
@@ -19,6 +21,44 @@ if DEBUG:
         eca += ['-O0', '-g']
         ela += ['-O0', '-g']
 
+
+class Benchmark(Command):
+    """Builds the extension in place and runs benchmarks/bench_suite.py."""
+    description = "run the benchmark suite of the I/O and effects hot paths"
+    user_options = [
+        ('quick', 'q', "durations of 1 and 10 s only"),
+        ('cases=', None, "comma separated cases to run, all if not given"),
+        ('output=', 'o', "JSON file for the results"),
+        ('compare=', 'c', "JSON results of an earlier run to compare against"),
+    ]
+    boolean_options = ['quick']
+
+    def initialize_options(self):
+        self.quick = False
+        self.cases = None
+        self.output = None
+        self.compare = None
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        self.reinitialize_command('build_ext', inplace=1)
+        self.run_command('build_ext')
+        args = [sys.executable, os.path.join('benchmarks', 'bench_suite.py')]
+        if self.quick:
+            args.append('--quick')
+        if self.cases:
+            args += ['--cases', self.cases]
+        if self.output:
+            args += ['--output', self.output]
+        if self.compare:
+            args += ['--compare', self.compare]
+        env = dict(os.environ, PYTHONPATH=os.pathsep.join(
+            [os.getcwd()] + [p for p in [os.environ.get('PYTHONPATH')] if p]))
+        subprocess.check_call(args, env=env)
+
+
 setup(
     name="torchaudio",
     version="0.2",
@@ -31,9 +71,20 @@ setup(
     ext_modules=[
         CppExtension(
             '_torch_sox',
-            ['torchaudio/torch_sox.cpp'],
+            ['torchaudio/torch_sox.cpp',
+             'torchaudio/wav_reader.cpp',
+             'torchaudio/resample.cpp',
+             'torchaudio/feature_extractor.cpp',
+             'torchaudio/cache.cpp',
+             'torchaudio/shard.cpp',
+             'torchaudio/header_info.cpp',
+             'torchaudio/seek_index.cpp',
+             'torchaudio/stats.cpp',
+             'torchaudio/stream_writer.cpp',
+             'torchaudio/mu_law.cpp',
+             'torchaudio/vad.cpp'],
             libraries=['sox'],
             extra_compile_args=eca,
             extra_link_args=ela),
     ],
-    cmdclass={'build_ext': BuildExtension})
+    cmdclass={'build_ext': BuildExtension, 'bench': Benchmark})
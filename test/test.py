@@ -3,6 +3,9 @@ import torch
 import torchaudio
 import math
 import os
+import resource
+import shutil
+import time
 
 
 class Test_LoadSave(unittest.TestCase):
@@ -169,5 +172,574 @@ class Test_LoadSave(unittest.TestCase):
         self.assertEqual(si.rate, rate)
         self.assertEqual(ei.bits_per_sample, precision)
 
+    def test_6_load_normalization(self):
+        # normalization is fused into the decode, it must match dividing afterwards
+        x_raw, _ = torchaudio.load(self.test_filepath, normalization=False)
+        x_norm, _ = torchaudio.load(self.test_filepath, normalization=True)
+        self.assertTrue(x_norm.equal(x_raw / (1 << 31)))
+        x_norm, _ = torchaudio.load(self.test_filepath, normalization=12345.)
+        self.assertTrue(x_norm.equal(x_raw / 12345.))
+        x_norm, _ = torchaudio.load(self.test_filepath, normalization=lambda x: x.abs().max())
+        self.assertEqual(x_norm.abs().max().item(), 1.)
+
+        # integer outputs decode the raw sox values without a staging buffer
+        x_int, _ = torchaudio.load(self.test_filepath, torch.IntTensor(), normalization=False)
+        self.assertTrue(x_int.float().equal(x_raw))
+
+        # a previously returned (transposed) output tensor can be reused
+        x_reuse, _ = torchaudio.load(self.test_filepath, x_norm, normalization=False)
+        self.assertTrue(x_reuse.equal(x_raw))
+
+    def test_7_load_batch(self):
+        input_sine_path = os.path.join(self.test_dirpath, 'assets', 'sinewave.wav')
+        x_sine, sr_sine = torchaudio.load(input_sine_path)
+        paths = [input_sine_path] * 3
+        offsets = [0, 100, 2000]
+        num_frames = [0, 500, 0]
+        x, lengths, rates = torchaudio.load_batch(paths, num_frames=num_frames, offsets=offsets)
+        self.assertEqual(x.size(), (3, 1, x_sine.size(1)))
+        self.assertEqual(lengths.tolist(), [x_sine.size(1), 500, x_sine.size(1) - 2000])
+        self.assertEqual(rates, [sr_sine] * 3)
+        for i, (offset, n) in enumerate(zip(offsets, lengths.tolist())):
+            self.assertTrue(x[i, :, :n].equal(x_sine[:, offset:offset + n]))
+            self.assertEqual(x[i, :, n:].abs().sum().item(), 0.)
+
+        # length first and a single thread give the same result
+        x_lf, _, _ = torchaudio.load_batch(paths, channels_first=False, num_frames=num_frames,
+                                           offsets=offsets, num_threads=1)
+        self.assertTrue(x_lf.transpose(1, 2).equal(x))
+
+        # a callable normalizes every file on its own, as `load` does
+        peak = lambda x: x.abs().max()
+        for channels_first in [True, False]:
+            x_peak, lengths, _ = torchaudio.load_batch(paths, normalization=peak, num_frames=num_frames,
+                                                       offsets=offsets, channels_first=channels_first)
+            for i, (offset, n) in enumerate(zip(offsets, lengths.tolist())):
+                y, _ = torchaudio.load(input_sine_path, normalization=peak, num_frames=num_frames[i],
+                                       offset=offset, channels_first=channels_first)
+                item = x_peak[i, :, :n] if channels_first else x_peak[i, :n]
+                self.assertTrue(item.equal(y))
+
+        # mixing mono and stereo files is an error
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_batch([input_sine_path, self.test_filepath])
+        with self.assertRaises(ValueError):
+            torchaudio.load_batch(paths, offsets=[0])
+
+    def test_8_batch_fork(self):
+        # a forked child loads batches on a thread pool of its own, opening at most one file per
+        # thread at a time however large the batch
+        paths = [self.test_filepath] * 300
+        num_frames = [1000 + i for i in range(len(paths))]
+        x, _ = torchaudio.load(self.test_filepath, num_frames=len(paths) + 999)
+        torchaudio.load_batch(paths[:4], num_frames=num_frames[:4])
+        pid = os.fork()
+        if pid == 0:
+            status = 1
+            try:
+                _, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+                resource.setrlimit(resource.RLIMIT_NOFILE, (64, hard))
+                batch, lengths, _ = torchaudio.load_batch(paths, num_frames=num_frames)
+                if lengths.tolist() == num_frames and all(
+                        batch[i, :, :n].equal(x[:, :n]) for i, n in enumerate(num_frames)):
+                    status = 0
+            finally:
+                os._exit(status)
+        self.assertEqual(os.waitpid(pid, 0)[1], 0)
+
+    def test_9_stream_reader(self):
+        x, sr = torchaudio.load(self.test_filepath)
+        block_size = 10000
+        reader = torchaudio.StreamReader(self.test_filepath, block_size=block_size)
+        self.assertEqual(reader.sample_rate, sr)
+        self.assertEqual(reader.channels, x.size(0))
+        blocks = [block.clone() for block in reader]
+        self.assertTrue(all(b.size(1) == block_size for b in blocks[:-1]))
+        self.assertTrue(torch.cat(blocks, 1).equal(x))
+        self.assertEqual(reader.read().numel(), 0)
+
+    def test_10_stream_reader_effects(self):
+        torchaudio.initialize_sox()
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.set_input_file(self.test_filepath)
+        E.append_effect_to_chain("rate", [16000])
+        E.append_effect_to_chain("channels", [1])
+        x, sr = E.sox_build_flow_effects()
+
+        reader = torchaudio.StreamReader(self.test_filepath, block_size=4096, effects=E)
+        self.assertEqual(reader.sample_rate, sr)
+        x_stream = torch.cat([block.clone() for block in reader], 1)
+        self.assertEqual(x_stream.size(), x.size())
+        self.assertTrue(x_stream.allclose(x, atol=1e-4))
+
+        # stopping early must not hang on the background chain
+        reader = torchaudio.StreamReader(self.test_filepath, block_size=256, effects=E)
+        reader.read()
+        del reader
+
+        # a buffer that cannot grow to a block is raised before the chain starts flowing
+        out = torch.from_numpy(torch.zeros(16).numpy())
+        with self.assertRaises(RuntimeError):
+            torchaudio.StreamReader(self.test_filepath, block_size=4096, effects=E, out=out)
+
+    def test_11_load_mapped_wav(self):
+        x, sr = torchaudio.load(self.test_filepath, normalization=False)
+        raw_path = os.path.join(self.test_dirpath, 'test.raw')
+        for precision in [8, 16, 24, 32]:
+            wav_path = os.path.join(self.test_dirpath, 'test.wav')
+            torchaudio.save(wav_path, x, sr, precision)
+            # wave files are read from a memory mapping, a signal override goes through libsox
+            si, _ = torchaudio.info(wav_path)
+            x_mapped, sr_mapped = torchaudio.load(wav_path)
+            x_sox, sr_sox = torchaudio.load(wav_path, signalinfo=si)
+            self.assertEqual(sr_mapped, sr_sox)
+            self.assertTrue(x_mapped.equal(x_sox))
+            x_crop, _ = torchaudio.load(wav_path, torch.IntTensor(), num_frames=1000, offset=12345,
+                                        normalization=False)
+            self.assertTrue(x_crop.float().equal(x_sox[:, 12345:13345] * (1 << 31)))
+            x_batch, _, _ = torchaudio.load_batch([wav_path, self.test_filepath], offsets=[10, 0])
+            self.assertTrue(x_batch[0, :, :x_mapped.size(1) - 10].equal(x_mapped[:, 10:]))
+            with self.assertRaises(RuntimeError):
+                torchaudio.load(wav_path, offset=x.size(1) + 1)
+
+            # headerless files with the same samples
+            raw_ei = torchaudio.sox_encodinginfo_t()
+            raw_ei.encoding = torchaudio.get_sox_encoding_t(2 if precision == 8 else 1)
+            raw_ei.bits_per_sample = precision
+            torchaudio.save_encinfo(raw_path, x, signalinfo=si, encodinginfo=raw_ei)
+            x_raw, _ = torchaudio.load(raw_path, signalinfo=si, encodinginfo=raw_ei, filetype="raw")
+            self.assertTrue(x_raw.equal(x_mapped))
+            os.unlink(wav_path)
+            os.unlink(raw_path)
+
+    def test_12_cache(self):
+        cache_dir = os.path.join(self.test_dirpath, 'cache')
+        torchaudio.set_cache(cache_dir, max_size=64 * 1024 ** 2)
+        try:
+            torchaudio.clear_cache()
+            torchaudio.cache_stats(reset=True)
+            x, sr = torchaudio.load(self.test_filepath)
+            x_cached, sr_cached = torchaudio.load(self.test_filepath)
+            self.assertEqual(sr_cached, sr)
+            self.assertTrue(x_cached.equal(x))
+            # other arguments are other entries
+            x_crop, _ = torchaudio.load(self.test_filepath, num_frames=1000, offset=500, channels_first=False)
+            self.assertTrue(x_crop.equal(x[:, 500:1500].t()))
+            E = torchaudio.sox_effects.SoxEffectsChain()
+            E.set_input_file(self.test_filepath)
+            E.append_effect_to_chain("rate", [16000])
+            y, _ = E.sox_build_flow_effects()
+            y_cached, _ = E.sox_build_flow_effects()
+            self.assertTrue(y_cached.equal(y))
+            features, _ = torchaudio.load_features(self.test_filepath)
+            self.assertTrue(torchaudio.load_features(self.test_filepath)[0].equal(features))
+            stats = torchaudio.cache_stats()
+            self.assertEqual((stats['hits'], stats['misses'], stats['entries']), (3, 4, 4))
+
+            # a modified file is decoded again
+            flac_path = os.path.join(self.test_dirpath, 'test_cache.flac')
+            torchaudio.save(flac_path, x, sr)
+            self.assertEqual(torchaudio.load(flac_path)[0].size(), x.size())
+            torchaudio.save(flac_path, x[:, :1000], sr)
+            self.assertEqual(torchaudio.load(flac_path)[0].size(1), 1000)
+            os.unlink(flac_path)
+
+            # the least recently used entries are evicted first
+            torchaudio.clear_cache()
+            torchaudio.load(self.test_filepath)
+            entry_size = torchaudio.cache_stats()['bytes']
+            torchaudio.set_cache(cache_dir, max_size=int(2.5 * entry_size))
+            torchaudio.cache_stats(reset=True)
+            for kwargs in [dict(num_frames=1000), dict(normalization=False), dict(), dict(normalization=1 << 30)]:
+                time.sleep(0.05)  # apart by more than the resolution of modification times
+                torchaudio.load(self.test_filepath, **kwargs)
+            stats = torchaudio.cache_stats(reset=True)
+            self.assertEqual((stats['hits'], stats['evictions'], stats['entries']), (1, 2, 2))
+            torchaudio.load(self.test_filepath)
+            torchaudio.load(self.test_filepath, normalization=False)
+            stats = torchaudio.cache_stats()
+            self.assertEqual((stats['hits'], stats['misses']), (1, 1))
+            torchaudio.clear_cache()
+            self.assertEqual(torchaudio.cache_stats()['entries'], 0)
+        finally:
+            torchaudio.set_cache(None)
+            shutil.rmtree(cache_dir)
+        self.assertEqual(torchaudio.cache_stats(), {})
+
+    def test_13_cache_processes(self):
+        # a relative directory with a missing parent, shared by forked processes that insert the same
+        # entries at the same time
+        parent = os.path.join(self.test_dirpath, 'cache_processes')
+        cache_dir = os.path.relpath(os.path.join(parent, 'cache'))
+        torchaudio.set_cache(cache_dir)
+        try:
+            torchaudio.clear_cache()
+            frames = list(range(1000, 17000, 1000))
+            pids = []
+            for i in range(4):
+                pid = os.fork()
+                if pid == 0:
+                    status = 1
+                    try:
+                        for n in frames[i:] + frames[:i]:
+                            torchaudio.load(self.test_filepath, num_frames=n)
+                        status = 0
+                    finally:
+                        os._exit(status)
+                pids.append(pid)
+            for pid in pids:
+                self.assertEqual(os.waitpid(pid, 0)[1], 0)
+
+            stats = torchaudio.cache_stats()
+            self.assertEqual(stats['hits'] + stats['misses'], 4 * len(frames))
+            entries = [os.path.join(dirpath, name) for dirpath, _, names in os.walk(cache_dir)
+                       for name in names if name.endswith('.entry')]
+            self.assertEqual(stats['entries'], len(frames))
+            self.assertEqual(len(entries), len(frames))
+            self.assertEqual(stats['bytes'], sum(os.path.getsize(path) for path in entries))
+        finally:
+            torchaudio.set_cache(None)
+            shutil.rmtree(parent)
+
+    def test_14_shard(self):
+        x, sr = torchaudio.load(self.test_filepath)
+        wav_path = os.path.join(self.test_dirpath, 'test_shard.wav')
+        shard_path = os.path.join(self.test_dirpath, 'test.shard')
+        torchaudio.save(wav_path, x, sr)
+        x_wav, _ = torchaudio.load(wav_path)
+        with torchaudio.ShardWriter(shard_path) as writer:
+            self.assertEqual(writer.add_file(self.test_filepath), 0)
+            self.assertEqual(writer.add_file(wav_path, name='wav'), 1)
+            for precision in [8, 16, 24, 32]:
+                writer.add('pcm{}'.format(precision), x, sr, precision)
+        os.unlink(wav_path)
+
+        shard = torchaudio.ShardReader(shard_path)
+        self.assertEqual(len(shard), 6)
+        self.assertEqual(shard.names[:2], ['steam-train-whistle-daniel_simon', 'wav'])
+        self.assertEqual(shard.index('pcm16'), 3)
+        x_mp3, sr_mp3 = shard[0]
+        self.assertEqual(sr_mp3, sr)
+        self.assertTrue(x_mp3.equal(x))
+        self.assertTrue(shard.load(1)[0].equal(x_wav))
+        self.assertTrue(shard[3][0].equal(x_wav))
+        self.assertEqual(shard.info(3).channels, 2)
+        for i, precision in enumerate([8, 16, 24, 32]):
+            self.assertTrue(shard[2 + i][0].allclose(x, atol=2. ** (1 - precision)))
+        # crops of either kind of utterance
+        x_crop, _ = shard.load(0, num_frames=1000, offset=500, channels_first=False)
+        self.assertTrue(x_crop.equal(x[:, 500:1500].t()))
+        self.assertTrue(shard.load(3, num_frames=1000, offset=500)[0].equal(x_wav[:, 500:1500]))
+        # raw samples without a copy
+        view = shard.view(3)
+        self.assertEqual(view.dtype, torch.int16)
+        self.assertTrue(view.float().t().div(1 << 15).equal(x_wav))
+        with self.assertRaises(RuntimeError):
+            shard.view(0)
+        names = [name for name, _, _ in torchaudio.ShardReader(shard_path, sequential=True, readahead=2)]
+        self.assertEqual(names, shard.names)
+        del view, shard
+        os.unlink(shard_path)
+
+    def test_15_info_batch(self):
+        x, sr = torchaudio.load(self.test_filepath)
+        paths = [self.test_filepath, os.path.join(self.test_dirpath, 'assets', 'sinewave.wav')]
+        for ext in ['flac', 'wav', 'aiff']:
+            paths.append(os.path.join(self.test_dirpath, 'test_info_batch.' + ext))
+            torchaudio.save(paths[-1], x, sr)
+        rates, channels, lengths, precisions = torchaudio.info_batch(paths)
+        self.assertEqual(rates.size(), torch.Size([len(paths)]))
+        for i, path in enumerate(paths):
+            si, _ = torchaudio.info(path)
+            self.assertEqual(rates[i].item(), si.rate)
+            self.assertEqual(channels[i].item(), si.channels)
+            self.assertEqual(lengths[i].item(), si.length)
+            self.assertEqual(precisions[i].item(), si.precision)
+
+        # a persistent index gives the same and is updated for changed files
+        index_path = os.path.join(self.test_dirpath, 'test_info_batch.index')
+        for _ in range(2):
+            info_indexed = torchaudio.info_batch(paths, index=index_path)
+            self.assertTrue(all(a.equal(b) for a, b in zip(info_indexed, (rates, channels, lengths, precisions))))
+        torchaudio.save(paths[-1], x[:1, :1000], sr)
+        os.utime(paths[-1], (0, 0))
+        _, channels, lengths, _ = torchaudio.info_batch(paths, index=index_path)
+        self.assertEqual((channels[-1].item(), lengths[-1].item()), (1, 1000))
+        with self.assertRaises(OSError):
+            torchaudio.info_batch(paths + ['no_such_file.wav'])
+        for path in paths[2:] + [index_path]:
+            os.unlink(path)
+
+    def test_16_load_bytes(self):
+        wav_path = os.path.join(self.test_dirpath, 'assets', 'sinewave.wav')
+        for path in [self.test_filepath, wav_path]:
+            x, sr = torchaudio.load(path)
+            with open(path, 'rb') as f:
+                data = f.read()
+            for buf in [data, bytearray(data), memoryview(data)]:
+                x_bytes, sr_bytes = torchaudio.load_bytes(buf)
+                self.assertEqual(sr_bytes, sr)
+                self.assertTrue(x_bytes.equal(x))
+            x_crop, _ = torchaudio.load_bytes(data, num_frames=100, offset=200, channels_first=False)
+            self.assertTrue(x_crop.equal(x[:, 200:300].t()))
+        # raw samples need their format
+        x, sr = torchaudio.load(wav_path)
+        si, _ = torchaudio.info(wav_path)
+        ei = torchaudio.sox_encodinginfo_t()
+        ei.encoding = torchaudio.get_sox_encoding_t(1)
+        ei.bits_per_sample = 16
+        raw = (x * (1 << 15)).round().short().numpy().tobytes()
+        x_raw, _ = torchaudio.load_bytes(raw, signalinfo=si, encodinginfo=ei, filetype='raw')
+        self.assertTrue(x_raw.allclose(x, atol=2. ** -15))
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_bytes(b'not audio')
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_bytes(memoryview(data)[::2])
+
+    def test_17_load_segments(self):
+        wav_path = os.path.join(self.test_dirpath, 'assets', 'sinewave.wav')
+        segments = [(50000, 10000), (0, 1000), (500, 2000), (20000, 0), (0, 0)]
+        for path in [self.test_filepath, wav_path]:
+            x, sr = torchaudio.load(path)
+            xs, sr_segments = torchaudio.load_segments(path, segments)
+            self.assertEqual(sr_segments, sr)
+            self.assertEqual(len(xs), len(segments))
+            for (offset, num_frames), x_segment in zip(segments, xs):
+                end = offset + num_frames if num_frames > 0 else x.size(1)
+                self.assertTrue(x_segment.equal(x[:, offset:end]))
+
+            out, lengths, _ = torchaudio.load_segments(path, segments, padded=True, channels_first=False)
+            self.assertEqual(out.size(), torch.Size([len(segments), x.size(1), x.size(0)]))
+            for i, x_segment in enumerate(xs):
+                self.assertEqual(lengths[i].item(), x_segment.size(1))
+                self.assertTrue(out[i, :lengths[i]].equal(x_segment.t()))
+                self.assertEqual(out[i, lengths[i]:].abs().sum().item(), 0)
+
+            # a callable normalizes every segment on its own
+            peak = lambda x: x.abs().max()
+            xs, _ = torchaudio.load_segments(path, segments, normalization=peak)
+            out, lengths, _ = torchaudio.load_segments(path, segments, normalization=peak, padded=True)
+            for i, x_segment in enumerate(xs):
+                self.assertTrue(out[i, :, :lengths[i]].equal(x_segment))
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_segments(wav_path, [(0, 100), (10 ** 9, 100)])
+
+    def test_18_seek_index(self):
+        x, sr = torchaudio.load(self.test_filepath)
+        index_dir = os.path.join(self.test_dirpath, 'seek_index')
+        try:
+            for directory in [None, index_dir]:
+                torchaudio.set_seek_index(directory=directory)
+                for offset, num_frames in [(1, 100), (1152 * 7 + 5, 5000), (200000, 0)]:
+                    x_crop, sr_crop = torchaudio.load(self.test_filepath, offset=offset, num_frames=num_frames)
+                    end = offset + num_frames if num_frames > 0 else x.size(1)
+                    self.assertEqual(sr_crop, sr)
+                    self.assertTrue(x_crop.equal(x[:, offset:end]))
+            self.assertTrue(os.listdir(index_dir))
+
+            # without an index, libsox seeks, with the same lengths
+            torchaudio.set_seek_index(False)
+            x_crop, _ = torchaudio.load(self.test_filepath, offset=200000, num_frames=5000)
+            self.assertEqual(x_crop.size(), torch.Size([x.size(0), 5000]))
+        finally:
+            torchaudio.set_seek_index()
+            shutil.rmtree(index_dir)
+
+    def test_19_seek_index_lsf(self):
+        # MPEG-2 frames hold a single granule of 576 samples, priming takes two frames
+        t = torch.arange(0, 22050 * 5).float() / 22050
+        x = (0.4 * torch.sin(2 * math.pi * 440 * t) * torch.sin(2 * math.pi * 3 * t)).unsqueeze(0)
+        mp3_path = os.path.join(self.test_dirpath, 'test_lsf.mp3')
+        torchaudio.save(mp3_path, x, 22050)
+        try:
+            torchaudio.set_seek_index()
+            y, sr = torchaudio.load(mp3_path)
+            self.assertEqual(sr, 22050)
+            for offset, num_frames in [(1, 100), (576 + 3, 1000), (576 * 2, 576), (576 * 37 + 100, 5000),
+                                       (80000, 0)]:
+                y_crop, _ = torchaudio.load(mp3_path, offset=offset, num_frames=num_frames)
+                end = offset + num_frames if num_frames > 0 else y.size(1)
+                self.assertTrue(y_crop.equal(y[:, offset:end]))
+        finally:
+            os.unlink(mp3_path)
+
+    def test_20_load_into(self):
+        wav_path = os.path.join(self.test_dirpath, 'assets', 'sinewave.wav')
+        for path in [self.test_filepath, wav_path]:
+            x, sr = torchaudio.load(path)
+            channels, frames = x.size()
+
+            # a crop, and the end of the file padded each way, into a channels first batch
+            batch = torch.empty(4, channels, 3000)
+            data_ptr = batch.data_ptr()
+            self.assertEqual(torchaudio.load_into(path, batch[0], offset=100), (3000, sr))
+            self.assertTrue(batch[0].equal(x[:, 100:3100]))
+            tail = x[:, frames - 1000:]
+            for i, pad_mode in enumerate(['constant', 'wrap', 'edge'], 1):
+                length, _ = torchaudio.load_into(path, batch[i], offset=frames - 1000, pad_mode=pad_mode,
+                                                 fill_value=-2)
+                self.assertEqual(length, 1000)
+                self.assertTrue(batch[i, :, :1000].equal(tail))
+            self.assertEqual(batch.data_ptr(), data_ptr)
+            self.assertTrue((batch[1, :, 1000:] == -2).all())
+            # wrapping repeats the frames read from the offset, not the start of the file
+            self.assertTrue(batch[2, :, 1000:2000].equal(tail))
+            self.assertTrue(batch[2, :, 2000:].equal(tail))
+            self.assertTrue(batch[3, :, 1000:].equal(tail[:, -1:].expand(channels, 2000)))
+
+            # length first
+            batch = torch.zeros(2, 500, channels)
+            torchaudio.load_into(path, batch[1], offset=7, channels_first=False)
+            self.assertTrue(batch[1].equal(x[:, 7:507].t()))
+            self.assertEqual(batch[0].abs().sum().item(), 0)
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_into(wav_path, torch.empty(x.size(0) + 1, 100))
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_into(wav_path, torch.empty(x.size(0), 100), pad_mode='reflect')
+
+    def test_21_stats(self):
+        torchaudio.reset_stats()
+        torchaudio.load(self.test_filepath)
+        self.assertEqual(torchaudio.get_stats()['counters']['files'], 0)
+
+        torchaudio.set_stats_enabled()
+        try:
+            x, _ = torchaudio.load(self.test_filepath)
+            with self.assertRaises(RuntimeError):
+                torchaudio.load_bytes(b'not audio')
+            stats = torchaudio.get_stats(reset=True)
+        finally:
+            torchaudio.set_stats_enabled(False)
+        self.assertTrue(stats['enabled'])
+        self.assertEqual(stats['counters']['files'], 2)
+        self.assertEqual(stats['counters']['errors'], 1)
+        self.assertEqual(stats['counters']['samples_decoded'], x.numel())
+        for stage in ['open', 'decode', 'convert', 'resize']:
+            self.assertGreater(stats['stages'][stage]['count'], 0)
+            self.assertEqual(sum(stats['stages'][stage]['histogram']), stats['stages'][stage]['count'])
+        self.assertEqual(torchaudio.get_stats()['counters']['files'], 0)
+
+    def test_22_stream_writer(self):
+        x, sr = torchaudio.load(self.test_filepath)
+        expected_path = os.path.join(self.test_dirpath, "test_expected.wav")
+        torchaudio.save(expected_path, x, sr)
+        expected, _ = torchaudio.load(expected_path)
+
+        for background in [False, True]:
+            path = os.path.join(self.test_dirpath, "test_stream.wav")
+            with torchaudio.StreamWriter(path, sr, x.size(0), background=background) as writer:
+                # uneven chunks, alternately channels first and last, the latter strided
+                for i, start in enumerate(range(0, x.size(1), 10007)):
+                    chunk = x[:, start:start + 10007]
+                    if i % 2:
+                        writer.write(chunk.t(), channels_first=False)
+                    else:
+                        writer.write(chunk)
+                self.assertEqual(writer.frames, x.size(1))
+            y, y_sr = torchaudio.load(path)
+            self.assertEqual(y_sr, sr)
+            self.assertTrue(y.equal(expected))
+            os.unlink(path)
+
+        # samples out of range are saturated and counted
+        path = os.path.join(self.test_dirpath, "test_stream.wav")
+        with torchaudio.StreamWriter(path, sr, 1) as writer:
+            self.assertEqual(writer.write(torch.tensor([0.5, 2., -2.])), 2)
+        y, _ = torchaudio.load(path)
+        self.assertEqual(y[0, 1].item(), 32767. / 32768.)
+        self.assertEqual(y[0, 2].item(), -1.)
+        with self.assertRaises(RuntimeError):
+            with torchaudio.StreamWriter(path, sr, 2) as writer:
+                writer.write(torch.zeros(1, 100))
+        os.unlink(path)
+        os.unlink(expected_path)
+
+    def test_23_save_batch_and_encode_to_bytes(self):
+        x, sr = torchaudio.load(self.test_filepath)
+        tensors = [x, x[:, :10000], x[:, 5000:].t()]
+        paths = [os.path.join(self.test_dirpath, "test_batch{}.wav".format(i)) for i in range(3)]
+        torchaudio.save_batch(paths[:2], tensors[:2], sr)
+        torchaudio.save_batch(paths[2:], tensors[2:], [sr], channels_first=False)
+        for path, src in zip(paths, tensors):
+            y, y_sr = torchaudio.load(path, channels_first=path != paths[2])
+            expected_path = os.path.join(self.test_dirpath, "test_expected.wav")
+            torchaudio.save(expected_path, src, sr, channels_first=path != paths[2])
+            expected, _ = torchaudio.load(expected_path, channels_first=path != paths[2])
+            self.assertEqual(y_sr, sr)
+            self.assertTrue(y.equal(expected))
+
+            # encoded in memory, the same file
+            with open(expected_path, 'rb') as f:
+                self.assertEqual(
+                    torchaudio.encode_to_bytes(src, sr, 'wav', channels_first=path != paths[2]), f.read())
+            os.unlink(path)
+            os.unlink(expected_path)
+
+        flac = torchaudio.encode_to_bytes(x, sr, 'flac')
+        y, _ = torchaudio.load_bytes(flac)
+        self.assertEqual(y.size(), x.size())
+        with self.assertRaises(RuntimeError):
+            torchaudio.save_batch([os.path.join(self.test_dirpath, "test_batch.unknown")], [x], sr)
+
+    def test_24_load_mu_law(self):
+        encode = torchaudio.transforms.MuLawEncoding(256)
+        # in double precision, which holds every sample exactly
+        x, sr = torchaudio.load(self.test_filepath, out=torch.DoubleTensor())
+        codes, codes_sr = torchaudio.load_mu_law(self.test_filepath)
+        self.assertEqual(codes_sr, sr)
+        self.assertEqual(codes.dtype, torch.long)
+        self.assertTrue(codes.equal(encode(x)))
+
+        # a range of a wave file, read from the mapping, into bytes
+        wav_path = os.path.join(self.test_dirpath, "test_mu_law.wav")
+        torchaudio.save(wav_path, x, sr)
+        y, _ = torchaudio.load(wav_path, out=torch.DoubleTensor(), offset=1000, num_frames=5000,
+                               channels_first=False)
+        codes, _ = torchaudio.load_mu_law(wav_path, out=torch.ByteTensor(), offset=1000, num_frames=5000,
+                                          channels_first=False)
+        self.assertEqual(codes.size(), y.size())
+        self.assertTrue(codes.long().equal(encode(y)))
+        os.unlink(wav_path)
+
+        # codes 128 to 255 would wrap around in a CharTensor
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_mu_law(self.test_filepath, out=torch.CharTensor())
+
+    def test_25_load_voiced(self):
+        # 0.5 s of silence, 0.4 s of tone, 0.5 s of silence, 0.3 s of tone, 0.5 s of silence
+        sr = 16000
+        t = torch.arange(0, 0.4 * sr) / sr
+        tone = 0.3 * torch.sin(2 * math.pi * 440 * t)
+        silence = torch.zeros(int(0.5 * sr))
+        x = torch.cat([silence, tone, silence, tone[:int(0.3 * sr)], silence]).unsqueeze(0)
+        wav_path = os.path.join(self.test_dirpath, "test_vad.wav")
+        torchaudio.save(wav_path, x, sr)
+        y, _ = torchaudio.load(wav_path)
+
+        trimmed, trimmed_sr, segments = torchaudio.load_voiced(wav_path)
+        self.assertEqual(trimmed_sr, sr)
+        # padded by 50 ms on either side
+        self.assertEqual(segments, [(7200, 15200), (21600, 28000)])
+        self.assertTrue(trimmed.equal(y[:, 7200:28000]))
+
+        voiced, _, voiced_segments = torchaudio.load_voiced(wav_path, mode='segments', channels_first=False)
+        self.assertEqual(voiced_segments, segments)
+        self.assertTrue(voiced.equal(torch.cat([y[:, 7200:15200], y[:, 21600:28000]], 1).t()))
+
+        # segments are in frames of the file, gaps shorter than min_silence_ms are bridged
+        _, _, offset_segments = torchaudio.load_voiced(wav_path, offset=8000)
+        self.assertEqual(offset_segments, [(8000, 15200), (21600, 28000)])
+        _, _, bridged = torchaudio.load_voiced(wav_path, min_silence_ms=600.)
+        self.assertEqual(bridged, [(7200, 28000)])
+
+        # the same through an effects chain
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.set_input_file(wav_path)
+        E.append_effect_to_chain("energy_vad", ["segments"])
+        z, _ = E.sox_build_flow_effects()
+        self.assertEqual(z.size(), (1, voiced.size(0)))
+        self.assertTrue(torch.allclose(z, voiced.t(), atol=1e-4))
+        os.unlink(wav_path)
+
 if __name__ == '__main__':
     unittest.main()
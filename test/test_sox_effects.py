@@ -3,6 +3,7 @@ import torch
 import torchaudio
 import math
 import os
+from multiprocessing.pool import ThreadPool
 
 
 class Test_SoxEffectsChain(unittest.TestCase):
@@ -60,6 +61,21 @@ class Test_SoxEffectsChain(unittest.TestCase):
         self.assertLess(x.unique().size(0), 2**8 + 1)
         self.assertEqual(x.numel(), si_in.length)
 
+        # an effect failing to start with the file is raised, the encoded output is cleaned up
+        E.append_effect_to_chain("remix", ["9"])
+        for _ in range(3):
+            with self.assertRaises(RuntimeError):
+                E.sox_build_flow_effects()
+        E.clear_chain()
+        y, _ = E.sox_build_flow_effects()
+        self.assertTrue(x.equal(y))
+
+        # outputs longer than the signal lengths tell are decoded to their end
+        E.append_effect_to_chain("repeat", [3])
+        y, _ = E.sox_build_flow_effects()
+        self.assertEqual(y.size(), (x.size(0), 4 * x.size(1)))
+        self.assertTrue(y.equal(x.repeat(1, 4)))
+
     def test_band_chorus(self):
         si_in, ei_in = torchaudio.info(self.test_filepath)
         ei_in.encoding = torchaudio.get_sox_encoding_t(1)
@@ -218,6 +234,231 @@ class Test_SoxEffectsChain(unittest.TestCase):
         with self.assertRaises(RuntimeError):
             E.sox_build_flow_effects()
 
+    def test_compiled_chain(self):
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.append_effect_to_chain("gain", ["-3"])
+        E.append_effect_to_chain("rate", [8000])
+        compiled = E.compile()
+        self.assertEqual(len(compiled), 2)
+        # the compiled chain is cached until the chain changes
+        self.assertIs(E.compile(), compiled)
+        for fn in [fn_sine, self.test_filepath, fn_sine]:
+            E.set_input_file(fn)
+            x, sr = E.sox_build_flow_effects()
+            y = torch.FloatTensor()
+            sr_compiled = compiled.apply(fn, y, True, None, None, "raw", 1.)
+            self.assertEqual(sr, 8000)
+            self.assertEqual(sr_compiled, sr)
+            self.assertTrue(x.equal(y / (1 << 31)))
+        E.append_effect_to_chain("channels", [1])
+        self.assertIsNot(E.compile(), compiled)
+
+        # invalid options are reported when compiling, before any file is opened
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.append_effect_to_chain("compand", ["0.3", "1", "6:-70,-60,-20", "-5", "-90", "0.2"])
+        with self.assertRaises(RuntimeError):
+            E.compile()
+
+    def test_input_bytes(self):
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.append_effect_to_chain("rate", [16000])
+        E.append_effect_to_chain("channels", [1])
+        E.set_input_file(self.test_filepath)
+        x, sr = E.sox_build_flow_effects()
+        with open(self.test_filepath, "rb") as f:
+            data = f.read()
+        for filetype in [None, "mp3"]:
+            E.set_input_bytes(data, filetype)
+            x_bytes, sr_bytes = E.sox_build_flow_effects()
+            self.assertEqual(sr_bytes, sr)
+            self.assertTrue(x_bytes.equal(x))
+        y = torch.FloatTensor()
+        sr_free = torchaudio._torch_sox.build_flow_effects_bytes(
+            bytearray(data), None, y, True, None, None, "raw", E.chain, float(1 << 31))
+        self.assertEqual(sr_free, sr)
+        self.assertTrue(y.equal(x))
+
+    def test_tensor_sink(self):
+        # linear PCM outputs are collected straight from the chain, with the
+        # values an encode to the target precision gives
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        x_sine, sr_sine = torchaudio.load(fn_sine)
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.set_input_file(fn_sine)
+        E.append_effect_to_chain("vol", [1])
+        x, sr = E.sox_build_flow_effects()
+        self.assertEqual(sr, sr_sine)
+        self.assertTrue(x.equal(x_sine))
+
+        # the output length is exactly what the chain produced
+        E = torchaudio.sox_effects.SoxEffectsChain(normalization=False)
+        E.set_input_file(fn_sine)
+        E.append_effect_to_chain("trim", [0, "12345s"])
+        x, _ = E.sox_build_flow_effects(torch.IntTensor())
+        self.assertEqual(x.size(), (1, 12345))
+        self.assertEqual(x.remainder(1 << 16).abs().sum().item(), 0)
+
+        # 8-bit targets are quantized like the encoded output
+        ei_out = torchaudio.sox_encodinginfo_t()
+        ei_out.encoding = torchaudio.get_sox_encoding_t(1)
+        ei_out.bits_per_sample = 8
+        E = torchaudio.sox_effects.SoxEffectsChain(normalization=False, out_encinfo=ei_out)
+        E.set_input_file(fn_sine)
+        E.append_effect_to_chain("vol", [1])
+        x, _ = E.sox_build_flow_effects()
+        self.assertEqual(x.remainder(1 << 24).abs().sum().item(), 0)
+        self.assertTrue(x.sub(x_sine * (1 << 31)).abs().max().item() <= 1 << 23)
+
+    def test_apply_effects_tensor(self):
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        x_sine, sr_sine = torchaudio.load(fn_sine)
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.set_input_file(fn_sine)
+        E.append_effect_to_chain("gain", ["-3"])
+        E.append_effect_to_chain("rate", [8000])
+        x, sr = E.sox_build_flow_effects()
+
+        # the same chain on the decoded tensor gives the same audio, without 16-bit quantization
+        y, sr_tensor = torchaudio.sox_effects.apply_effects_tensor(x_sine, sr_sine, E)
+        self.assertEqual(sr_tensor, sr)
+        self.assertEqual(y.size(), x.size())
+        self.assertTrue(y.allclose(x, atol=1e-4))
+
+        # lists of effects, 1D and length first inputs
+        y_list, _ = torchaudio.sox_effects.apply_effects_tensor(x_sine[0], sr_sine, E.chain)
+        self.assertTrue(y_list.equal(y))
+        y_lf, _ = torchaudio.sox_effects.apply_effects_tensor(x_sine.t(), sr_sine, E.compile(),
+                                                              channels_first=False)
+        self.assertTrue(y_lf.t().equal(y))
+
+        # no effects is the identity
+        y_id, _ = torchaudio.sox_effects.apply_effects_tensor(x_sine, sr_sine, [])
+        self.assertTrue(y_id.equal(x_sine))
+
+    def test_resample(self):
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        x, sr = torchaudio.load(fn_sine)
+        for new_sr in [8000, 22050, 44100, 48000]:
+            y = torchaudio.resample(x, sr, new_sr)
+            self.assertEqual(y.size(), (1, int(x.size(1) * new_sr / sr + .5)))
+
+            # a polyphase_rate effect runs the same resampler
+            E = torchaudio.sox_effects.SoxEffectsChain()
+            E.append_effect_to_chain("polyphase_rate", [new_sr])
+            y_rate, sr_rate = torchaudio.sox_effects.apply_effects_tensor(x, sr, E)
+            self.assertEqual(sr_rate, new_sr)
+            self.assertTrue(y_rate.allclose(y, atol=1e-6))
+
+            # a plain rate effect is the SoX resampler at its default (high) quality, which agrees away
+            # from the edges
+            E = torchaudio.sox_effects.SoxEffectsChain()
+            E.append_effect_to_chain("rate", [new_sr])
+            y_sox, sr_sox = torchaudio.sox_effects.apply_effects_tensor(x, sr, E)
+            E = torchaudio.sox_effects.SoxEffectsChain()
+            E.append_effect_to_chain("rate", ["-h", new_sr])
+            self.assertTrue(torchaudio.sox_effects.apply_effects_tensor(x, sr, E)[0].equal(y_sox))
+            self.assertEqual(sr_sox, new_sr)
+            self.assertEqual(y_sox.size(), y.size())
+            n = y.size(1)
+            self.assertTrue(y_sox[:, n // 4:3 * n // 4].allclose(y[:, n // 4:3 * n // 4], atol=2e-3))
+
+        # 1D, length first and stereo inputs
+        y = torchaudio.resample(x, sr, 8000)
+        self.assertTrue(torchaudio.resample(x[0], sr, 8000).equal(y[0]))
+        self.assertTrue(torchaudio.resample(x.t(), sr, 8000, channels_first=False).t().equal(y))
+        y_stereo = torchaudio.resample(torch.cat([x, -x]), sr, 8000)
+        self.assertTrue(y_stereo[0].equal(y[0]) and y_stereo[1].equal(-y[0]))
+        self.assertTrue(torchaudio.resample(x, sr, sr).equal(x))
+        with self.assertRaises(RuntimeError):
+            torchaudio.resample(x, sr, 16001)
+
+    def test_augment_params(self):
+        x, sr = torchaudio.load_and_augment(self.test_filepath, ["tempo", "1.1", "gain", "-3"])
+        chain = torchaudio.compile_augment_params(["tempo", "1.1", "gain", "-3"])
+        self.assertEqual(len(chain), 2)
+        y, sr_compiled = torchaudio.load_and_augment(self.test_filepath, chain)
+        self.assertEqual(sr, sr_compiled)
+        self.assertTrue(x.equal(y))
+        # unsupported names are skipped
+        self.assertEqual(len(torchaudio.compile_augment_params(["reverse", "tempo", "0.9"])), 1)
+        x, _ = torchaudio.load_and_augment(self.test_filepath, ["volume", "0.5"])
+        self.assertEqual(x.size(1), 1)
+
+    def test_augment_threads(self):
+        params = [["speed", "0.9"], ["tempo", "1.1", "gain", "-3"], ["pitch", "100"]] * 4
+        expected = [torchaudio.load_and_augment(self.test_filepath, p)[0] for p in params]
+        pool = ThreadPool(4)
+        try:
+            results = pool.map(lambda p: torchaudio.load_and_augment(self.test_filepath, p)[0], params)
+        finally:
+            pool.close()
+            pool.join()
+        for x, y in zip(expected, results):
+            self.assertTrue(x.equal(y))
+
+        # errors are raised, not printed
+        with self.assertRaises(RuntimeError):
+            torchaudio.load_and_augment(self.test_filepath, ["tempo", "fast"])
+
+    def test_augment_multi(self):
+        params = [["speed", "0.9"], ["tempo", "1.0"], ["tempo", "1.1", "gain", "-3"]]
+        expected = [torchaudio.load_and_augment(self.test_filepath, p, normalization=True)[0] for p in params]
+        xs, sr = torchaudio.load_and_augment_multi(self.test_filepath, params, normalization=True)
+        self.assertEqual(len(xs), len(params))
+        for x, y in zip(expected, xs):
+            self.assertTrue(x.equal(y))
+
+        x, lengths, sr_padded = torchaudio.load_and_augment_multi(self.test_filepath, params, padded=True)
+        self.assertEqual(sr_padded, sr)
+        self.assertEqual(lengths.tolist(), [y.size(0) for y in xs])
+        self.assertEqual(x.size(), (len(params), max(lengths.tolist())))
+        for i, n in enumerate(lengths.tolist()):
+            self.assertTrue(x[i, :n].equal(xs[i].view(-1) * (1 << 31)))
+            self.assertEqual(x[i, n:].abs().sum().item(), 0.)
+
+        # callables normalize every variant, like load_and_augment
+        peak = lambda x: x.abs().max()
+        expected = [torchaudio.load_and_augment(self.test_filepath, p, normalization=peak)[0] for p in params]
+        xs, _ = torchaudio.load_and_augment_multi(self.test_filepath, params, normalization=peak)
+        for x, y in zip(expected, xs):
+            self.assertTrue(x.equal(y))
+        x, lengths, _ = torchaudio.load_and_augment_multi(self.test_filepath, params, normalization=peak, padded=True)
+        for i, n in enumerate(lengths.tolist()):
+            self.assertTrue(x[i, :n].equal(xs[i].view(-1)))
+
+    def test_augment_multi_unknown_length(self):
+        # a Sun audio file that leaves its data size unspecified, as when written to a pipe
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        x, sr = torchaudio.load(fn_sine)
+        new_filepath = os.path.join(self.test_dirpath, "test_unknown_length.au")
+        torchaudio.save(new_filepath, x, sr)
+        with open(new_filepath, "r+b") as f:
+            f.seek(8)
+            f.write(b"\xff\xff\xff\xff")
+        params = [["speed", "0.9"], ["gain", "-3"]]
+        expected = [torchaudio.load_and_augment(new_filepath, p)[0] for p in params]
+        xs, _ = torchaudio.load_and_augment_multi(new_filepath, params)
+        os.unlink(new_filepath)
+        self.assertEqual(expected[1].size(0), x.numel())
+        for x, y in zip(expected, xs):
+            self.assertTrue(x.equal(y))
+
+    def test_shutdown_reinitialize(self):
+        E = torchaudio.sox_effects.SoxEffectsChain()
+        E.set_input_file(self.test_filepath)
+        E.append_effect_to_chain("vol", [0.5])
+        x, sr = E.sox_build_flow_effects()
+        torchaudio.shutdown_sox()
+        self.assertEqual(torchaudio.initialize_sox(), 0)
+        y, sr_y = E.sox_build_flow_effects()
+        self.assertEqual(sr_y, sr)
+        self.assertTrue(x.equal(y))
+        # loading initializes the formats again on its own
+        torchaudio.shutdown_sox()
+        z, _ = torchaudio.load(self.test_filepath)
+        self.assertEqual(z.size(1), x.size(1))
+
 
 if __name__ == '__main__':
     torchaudio.initialize_sox()
@@ -151,6 +151,38 @@ class Tester(unittest.TestCase):
         repr_test = transforms.MuLawExpanding(quantization_channels)
         self.assertTrue(repr_test.__repr__())
 
+    def test_mu_law_native(self):
+        quantization_channels = 256
+        sig = self.sig.double() / self.sig.abs().max().double()
+        sig = torch.cat([sig, torch.tensor([[-1.], [1.], [0.], [-1e-12]], dtype=torch.double)])
+        encode = transforms.MuLawEncoding(quantization_channels)
+        expand = transforms.MuLawExpanding(quantization_channels)
+
+        # the extension matches the formula computed by numpy in double precision
+        for x in [sig, sig.float(), sig.t()]:
+            sig_mu = encode(x)
+            self.assertEqual(sig_mu.dtype, torch.long)
+            self.assertEqual(sig_mu.size(), x.size())
+            expected = encode(x.double().numpy())
+            self.assertTrue((sig_mu.numpy() == expected).all())
+
+        sig_mu = encode(sig)
+        for codes in [sig_mu, sig_mu.to(torch.uint8), sig_mu.float()]:
+            sig_exp = expand(codes)
+            expected = expand(sig_mu.double().numpy())
+            self.assertTrue(np.allclose(sig_exp.numpy(), expected, atol=1e-6))
+
+        # values out of range saturate
+        self.assertEqual(encode(torch.tensor([-2., 2.])).tolist(), [0, quantization_channels - 1])
+
+        # values between two SoX samples on either side of a code boundary
+        mu = quantization_channels - 1.
+        y = (np.arange(1, quantization_channels) - 0.5) / mu * 2 - 1
+        edges = np.sign(y) * np.expm1(np.abs(y) * np.log1p(mu)) / mu
+        edges = np.concatenate([edges + d for d in [-1e-10, -1e-12, 0., 1e-12, 1e-10]])
+        for x in [torch.from_numpy(edges), torch.from_numpy(edges).float()]:
+            self.assertTrue((encode(x).numpy() == encode(x.double().numpy())).all())
+
     def test_mel2(self):
         audio_orig = self.sig.clone()  # (16000, 1)
         audio_scaled = transforms.Scale()(audio_orig)  # (16000, 1)
@@ -188,5 +220,58 @@ class Tester(unittest.TestCase):
         self.assertTrue(fb_matrix_transform.fb.sum(1).ge(0.).all())
         self.assertEqual(fb_matrix_transform.fb.size(), (400, 100))
 
+    def test_load_features(self):
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        for fn in [fn_sine, self.test_filepath]:
+            x, sr = torchaudio.load(fn)
+            for kwargs in [{}, dict(pad=10, ws=500, hop=125, n_fft=800, n_mels=50)]:
+                expected = transforms.MEL2(sr=sr, **kwargs)(x)
+                features, sr_features = torchaudio.load_features(fn, **kwargs)
+                self.assertEqual(sr_features, sr)
+                self.assertEqual(features.size(), expected.size())
+                self.assertTrue(features.allclose(expected, atol=5e-2))
+            # the power spectrogram without mel filters
+            expected = transforms.SPECTROGRAM(n_fft=512)(x)
+            features, _ = torchaudio.load_features(fn, n_fft=512, n_mels=0, log=False)
+            self.assertEqual(features.size(), expected.size())
+            self.assertTrue(features.allclose(expected, rtol=1e-3, atol=1e-10))
+
+    def test_online_feature_extractor(self):
+        fn_sine = os.path.join(self.test_dirpath, "assets", "sinewave.wav")
+        chunk_sizes = [160, 1, 1600, 37, 800, 400, 0, 1023]
+        for fn in [fn_sine, self.test_filepath]:
+            x, sr = torchaudio.load(fn)
+            for kwargs in [dict(log=False), dict(pad=10, ws=500, hop=125, n_fft=800, n_mels=50)]:
+                for channels_first in [True, False]:
+                    signal = x if channels_first else x.t()
+                    extractor = torchaudio.OnlineFeatureExtractor(sr, x.size(0), max_chunk=1600,
+                                                                  channels_first=channels_first, **kwargs)
+                    frames = []
+                    position, i = 0, 0
+                    while position < x.size(1):
+                        n = chunk_sizes[i % len(chunk_sizes)]
+                        chunk = signal.narrow(1 if channels_first else 0, position, min(n, x.size(1) - position))
+                        frames.append(extractor.accept(chunk).clone())
+                        position += n
+                        i += 1
+                    frames.append(extractor.flush().clone())
+                    online = torch.cat(frames, 1)
+                    # bit for bit the offline features; log ones are not relative to the maximum
+                    expected, _ = torchaudio.load_features(fn, **kwargs)
+                    if kwargs.get("log", True):
+                        online = (online - online.max()).clamp(min=-80.)
+                    self.assertTrue(torch.equal(online, expected))
+
+        # the output buffer is reused once it fits the largest chunk
+        x, sr = torchaudio.load(fn_sine)
+        extractor = torchaudio.OnlineFeatureExtractor(sr, max_chunk=1600)
+        first = extractor.accept(x[:, :1600]).clone()
+        data_ptr = extractor.accept(x[:, 1600:3200]).data_ptr()
+        for position in range(3200, x.size(1) - 1600, 1600):
+            self.assertEqual(extractor.accept(x[:, position:position + 1600]).data_ptr(), data_ptr)
+        # and a reset starts over
+        extractor.reset()
+        self.assertTrue(torch.equal(extractor.accept(x[:, :1600]), first))
+
 if __name__ == '__main__':
     unittest.main()
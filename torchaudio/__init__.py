@@ -14,7 +14,47 @@ def check_input(src):
         raise TypeError('Expected a CPU based tensor, got %s' % type(src))
 
 
+_AUGMENT_CACHE_SIZE = 256
+_augment_cache = {}
+
+
+def compile_augment_params(augment_params):
+    """Compile a flat list of `name, value` augmentation parameters (e.g.
+    ``["tempo", "1.1", "gain", "-3"]``) into a reusable effects chain.
+    Supported augmentations are volume, tempo, pitch, speed and gain.
+
+    Returns: CompiledEffectChain
+    """
+    if isinstance(augment_params, _torch_sox.CompiledEffectChain):
+        return augment_params
+    key = tuple(str(p) for p in augment_params)
+    chain = _augment_cache.get(key)
+    if chain is None:
+        if len(_augment_cache) >= _AUGMENT_CACHE_SIZE:
+            _augment_cache.clear()
+        chain = _augment_cache[key] = _torch_sox.compile_augment_params(list(key))
+    return chain
+
+
 def load_and_augment(filepath, augment_params, out=None, normalization=None):
+    """Loads an audio file through a chain of augmentation effects.
+
+    Args:
+        filepath (string): path to audio file
+        augment_params (list[str] or CompiledEffectChain): flat list of `name, value` pairs, see
+                                                           `compile_augment_params`, or a compiled chain
+        out (Tensor, optional): an output Tensor to use instead of creating one
+        normalization (bool, number, or callable, optional): see `load`
+
+    Returns: tuple(Tensor, int)
+       - Tensor: output Tensor of size `[L x 1]`
+       - int: the sample rate of the audio
+
+    The GIL is released while decoding, so it is safe and worthwhile to call this from
+    several threads at once, e.g. a thread pool in a data loader.  SoX effects that share
+    state across threads (``rate`` and the DFT filters, e.g. ``sinc``) run one call at a time;
+    ``tempo``, ``pitch``, ``speed``, ``gain``, ``vol`` and ``polyphase_rate`` run in parallel.
+    """
     if not os.path.isfile(filepath):
         raise OSError("{} not found or is a directory".format(filepath))
 
@@ -24,15 +64,58 @@ def load_and_augment(filepath, augment_params, out=None, normalization=None):
     else:
         out = torch.FloatTensor()
 
-    sample_rate = _torch_sox.read_audio_file_augment(filepath, out, augment_params)
-    # normalize if needed
-    if isinstance(normalization, bool) and normalization:
-        out /= 1 << 31  # assuming 16-bit depth
-    elif isinstance(normalization, (float, int)):
-        out /= normalization  # normalize with custom value
-
+    chain = compile_augment_params(augment_params)
+    sample_rate = _torch_sox.read_audio_file_augment(filepath, out, chain)
+    _audio_normalization(out, normalization)
     return out, sample_rate
 
+
+def load_and_augment_multi(filepath, augment_params_list, normalization=None, padded=False, num_threads=0):
+    """Decodes an audio file once and applies several augmentation chains to it in parallel,
+    e.g. the speed perturbations of one utterance.  This costs about one decode instead of
+    one per variant, which is most of the work for compressed files.
+
+    Args:
+        filepath (string): path to audio file
+        augment_params_list (list): one entry per variant, each a list of `name, value` pairs
+                                    or a compiled chain, see `load_and_augment`
+        normalization (bool, number, or callable, optional): see `load`
+        padded (bool, optional): return a single zero-padded Tensor instead of a list.  Default: ``False``
+        num_threads (int, optional): number of threads, 0 for all cores.  Default: ``0``
+
+    Returns: tuple(list[Tensor], int) or tuple(Tensor, Tensor, int)
+       - list[Tensor]: one output Tensor of size `[L x 1]` per variant, see `load_and_augment`
+       - or Tensor, Tensor: if `padded`, a `[K x L]` Tensor with the variants zero-padded to the
+         longest one and a `[K]` LongTensor with their lengths
+       - int: the sample rate of the audio
+
+    The whole file is decoded, however long its header says it is.
+    """
+    if not os.path.isfile(filepath):
+        raise OSError("{} not found or is a directory".format(filepath))
+
+    chains = [compile_augment_params(p) for p in augment_params_list]
+    if padded:
+        out = torch.FloatTensor()
+        lengths = torch.LongTensor()
+        divisor, normalization = _split_normalization(out, normalization)
+        sample_rate = _torch_sox.read_audio_file_augment_multi_padded(filepath,
+                                                                      chains,
+                                                                      out,
+                                                                      lengths,
+                                                                      divisor,
+                                                                      num_threads)
+        _padded_normalization(out, lengths, normalization, 0)
+        return out, lengths, sample_rate
+
+    outs = [torch.FloatTensor() for _ in chains]
+    divisor, normalization = _split_normalization(torch.FloatTensor(), normalization)
+    sample_rate = _torch_sox.read_audio_file_augment_multi(filepath, outs, chains, divisor, num_threads)
+    for x in outs:
+        _audio_normalization(x, normalization)
+    return outs, sample_rate
+
+
 def load(filepath,
          out=None,
          normalization=True,
@@ -42,7 +125,7 @@ def load(filepath,
          signalinfo=None,
          encodinginfo=None,
          filetype=None):
-"""Loads an audio file from disk into a Tensor
+    """Loads an audio file from disk into a Tensor
 
     Args:
         filepath (string): path to audio file
@@ -94,6 +177,8 @@ def load(filepath,
     if offset < 0:
         raise ValueError("Expected positive offset value")
 
+    # constant normalization is applied by the extension while decoding
+    divisor, normalization = _split_normalization(out, normalization)
     sample_rate = _torch_sox.read_audio_file(filepath,
                                              out,
                                              channels_first,
@@ -101,7 +186,8 @@ def load(filepath,
                                              offset,
                                              signalinfo,
                                              encodinginfo,
-                                             filetype)
+                                             filetype,
+                                             divisor)
 
     # normalize if needed
     _audio_normalization(out, normalization)
@@ -109,6 +195,824 @@ def load(filepath,
     return out, sample_rate
 
 
+def load_mu_law(filepath,
+                quantization_channels=256,
+                out=None,
+                channels_first=True,
+                num_frames=0,
+                offset=0,
+                signalinfo=None,
+                encodinginfo=None,
+                filetype=None):
+    """Loads an audio file from disk straight into mu-law codes, the same as `load` followed by
+    `transforms.MuLawEncoding`, in a single pass: every chunk of samples is encoded as soon as it is
+    decoded, with no Tensor of values in between.  The audio cache and MP3 seek indices are not used.
+
+    Args:
+        filepath (string): path to audio file
+        quantization_channels (int, optional): number of codes.  Default: ``256``
+        out (Tensor, optional): an output Tensor to use instead of creating one, of any type that holds
+                                every code (e.g. not a CharTensor for 256 codes)
+
+    The other arguments are the same as for `load`.
+
+    Returns: tuple(Tensor, int)
+       - Tensor: LongTensor of codes from 0 to `quantization_channels - 1`, of size `[C x L]` or `[L x C]`
+       - int: the sample rate of the audio (as listed in the metadata of the file)
+
+    Example::
+
+        >>> codes, sample_rate = torchaudio.load_mu_law('foo.wav', out=torch.ByteTensor())
+
+    """
+    if not os.path.isfile(filepath):
+        raise OSError("{} not found or is a directory".format(filepath))
+
+    if out is not None:
+        check_input(out)
+    else:
+        out = torch.LongTensor()
+
+    if num_frames < -1:
+        raise ValueError("Expected value for num_samples -1 (entire file) or >=0")
+    if offset < 0:
+        raise ValueError("Expected positive offset value")
+
+    sample_rate = _torch_sox.read_audio_file_mu_law(filepath,
+                                                    out,
+                                                    channels_first,
+                                                    num_frames,
+                                                    offset,
+                                                    signalinfo,
+                                                    encodinginfo,
+                                                    filetype,
+                                                    quantization_channels)
+    return out, sample_rate
+
+
+def load_voiced(filepath,
+                mode='trim',
+                threshold_db=-40.,
+                zcr_threshold=0.25,
+                min_speech_ms=100.,
+                min_silence_ms=300.,
+                pad_ms=50.,
+                out=None,
+                normalization=True,
+                channels_first=True,
+                num_frames=0,
+                offset=0,
+                signalinfo=None,
+                encodinginfo=None,
+                filetype=None):
+    """Loads only the voiced part of an audio file, found by voice activity detection on the frame energy
+    and zero-crossing rate of the mean of all channels.  Every chunk is analyzed as soon as it is decoded, so
+    the silence that is dropped never reaches the output Tensor.  Frames of 10 ms with an energy of at least
+    `threshold_db` are voiced; frames up to 15 dB quieter that cross zero at least `zcr_threshold` times per
+    sample (e.g. fricatives) extend an interval, or start the one of a voiced frame within 200 ms.
+    The audio cache and MP3 seek indices are not used.
+
+    Args:
+        filepath (string): path to audio file
+        mode (str, optional): ``'trim'`` to keep everything from the first voiced interval to the last one,
+                              i.e. to drop leading and trailing silence, or ``'segments'`` to keep only the voiced
+                              intervals, back to back.  Default: ``'trim'``
+        threshold_db (float, optional): energy of voiced frames, in dB relative to a full scale square wave.
+                                        Default: ``-40``
+        zcr_threshold (float, optional): zero crossings per sample of weak frames.  Default: ``0.25``
+        min_speech_ms (float, optional): voiced intervals shorter than this are dropped.  Default: ``100``
+        min_silence_ms (float, optional): shorter silences do not end a voiced interval.  Default: ``300``
+        pad_ms (float, optional): silence kept on either side of every voiced interval, at most
+                                  `min_silence_ms`.  Default: ``50``
+
+    The other arguments are the same as for `load`.
+
+    Returns: tuple(Tensor, int, list[tuple(int, int)])
+       - Tensor: the voiced frames, of size `[C x L]` or `[L x C]`
+       - int: the sample rate of the audio (as listed in the metadata of the file)
+       - list: the voiced intervals `(start, end)`, padded, in frames of the file
+
+    Example::
+
+        >>> data, sample_rate, segments = torchaudio.load_voiced('foo.wav', mode='segments')
+
+    """
+    if not os.path.isfile(filepath):
+        raise OSError("{} not found or is a directory".format(filepath))
+    if mode not in ('trim', 'segments'):
+        raise ValueError("Expected mode 'trim' or 'segments', got {}".format(mode))
+
+    if out is not None:
+        check_input(out)
+    else:
+        out = torch.FloatTensor()
+
+    if num_frames < -1:
+        raise ValueError("Expected value for num_samples -1 (entire file) or >=0")
+    if offset < 0:
+        raise ValueError("Expected positive offset value")
+
+    options = _torch_sox.VadOptions()
+    options.mode = getattr(_torch_sox.VadMode, mode)
+    options.threshold_db = threshold_db
+    options.zcr_threshold = zcr_threshold
+    options.min_speech_ms = min_speech_ms
+    options.min_silence_ms = min_silence_ms
+    options.pad_ms = pad_ms
+    divisor, normalization = _split_normalization(out, normalization)
+    sample_rate, segments = _torch_sox.read_audio_file_vad(filepath,
+                                                           out,
+                                                           channels_first,
+                                                           num_frames,
+                                                           offset,
+                                                           signalinfo,
+                                                           encodinginfo,
+                                                           filetype,
+                                                           divisor,
+                                                           options)
+    _audio_normalization(out, normalization)
+    return out, sample_rate, segments
+
+
+def load_bytes(buf,
+               out=None,
+               normalization=True,
+               channels_first=True,
+               num_frames=0,
+               offset=0,
+               signalinfo=None,
+               encodinginfo=None,
+               filetype=None):
+    """Loads an audio file held in memory into a Tensor, e.g. read from a tar shard or a key-value
+    store, without writing it to a temporary file.  Any contiguous buffer (`bytes`, `bytearray`,
+    `memoryview`, numpy array) is decoded in place, without a copy.
+
+    Args:
+        buf (buffer): the contents of an audio file
+        filetype (str, optional): the type of the data (e.g. ``'mp3'``) if sox cannot determine it from
+                                  the data itself
+
+    The other arguments and the result are the same as for `load`.
+
+    Example::
+
+        >>> with open('foo.mp3', 'rb') as f:
+        >>>     data, sample_rate = torchaudio.load_bytes(f.read())
+
+    """
+    if out is not None:
+        check_input(out)
+    else:
+        out = torch.FloatTensor()
+
+    if num_frames < -1:
+        raise ValueError("Expected value for num_samples -1 (entire file) or >=0")
+    if offset < 0:
+        raise ValueError("Expected positive offset value")
+
+    divisor, normalization = _split_normalization(out, normalization)
+    sample_rate = _torch_sox.read_audio_bytes(buf,
+                                              out,
+                                              channels_first,
+                                              num_frames,
+                                              offset,
+                                              signalinfo,
+                                              encodinginfo,
+                                              filetype,
+                                              divisor)
+    _audio_normalization(out, normalization)
+
+    return out, sample_rate
+
+
+def load_into(filepath, out, offset=0, pad_mode='constant', fill_value=0, normalization=True, channels_first=True):
+    """Loads exactly as many frames of an audio file as `out` holds, from `offset`, straight into
+    `out`, e.g. a slice of a preallocated batch, and pads it in place past the end of the file.  It
+    replaces `load`, `transforms.PadTrim` and `torch.stack` without allocating anything per file.
+
+    Args:
+        filepath (string): path to audio file
+        out (Tensor): a 2-D tensor of size (c x n) (n x c if not `channels_first`) with any strides,
+                      e.g. ``batch[i]``.  It is never resized, `c` must be the number of channels of
+                      the file
+        offset (int, optional): number of frames from the start of the file to begin data loading
+        pad_mode (str, optional): ``'constant'`` pads with `fill_value`, ``'wrap'`` with the frames read
+                                  from `offset` on, repeated, and ``'edge'`` with the last frame
+        fill_value (number, optional): the value of constant padding, not normalized
+        normalization (bool, number, or callable, optional): as for `load`
+        channels_first (bool): Set channels first or length first in result.  Default: ``True``
+
+    Returns:
+        Tuple[int, int]: number of frames read from the file (the others are padding), and the
+        sample rate of the audio
+
+    Example::
+
+        >>> batch = torch.empty(len(paths), 2, 16000)
+        >>> for i, path in enumerate(paths):
+        >>>     length, sample_rate = torchaudio.load_into(path, batch[i])
+    """
+    check_input(out)
+    if offset < 0:
+        raise ValueError("Expected positive offset value")
+
+    divisor, normalization = _split_normalization(out, normalization)
+    sample_rate, length = _torch_sox.read_audio_into(filepath,
+                                                     out,
+                                                     channels_first,
+                                                     offset,
+                                                     pad_mode,
+                                                     fill_value,
+                                                     divisor)
+    # constant padding is left as it is, other padding is made of samples
+    if pad_mode == 'constant':
+        _audio_normalization(out.narrow(int(channels_first), 0, length), normalization)
+    else:
+        _audio_normalization(out, normalization)
+
+    return length, sample_rate
+
+
+def load_segments(filepath,
+                  segments,
+                  normalization=True,
+                  channels_first=True,
+                  padded=False,
+                  out=None,
+                  lengths=None):
+    """Loads several segments of one audio file, e.g. the labelled events of an AudioSet clip.  The
+    file is opened once and decoded in a single forward pass over the segments in order of offset,
+    seeking over long gaps where the format allows it, instead of opening and seeking the file again
+    for every segment.  Segments may be given in any order and may overlap.
+
+    Args:
+        filepath (string): path to audio file
+        segments (list[tuple(int, int)]): `(offset, num_frames)` of every segment, in frames.
+                                          `num_frames` 0 loads everything after the offset.
+        normalization (bool or number, optional): see `load`
+        channels_first (bool): Set channels first or length first in result.  Default: ``True``
+        padded (bool, optional): return a single zero-padded Tensor instead of a list.  Default: ``False``
+        out (Tensor, optional): if `padded`, an output Tensor to use instead of creating one
+        lengths (Tensor, optional): if `padded`, an output LongTensor for the lengths instead of creating one
+
+    Returns: tuple(list[Tensor], int) or tuple(Tensor, Tensor, int)
+       - list[Tensor]: one Tensor of size `[C x L]` or `[L x C]` per segment, in the given order
+       - or Tensor, Tensor: if `padded`, a `[B x C x L]` or `[B x L x C]` Tensor with the segments
+         zero-padded to the longest one and a `[B]` LongTensor with their lengths in frames
+       - int: the sample rate of the audio
+
+    Example::
+
+        >>> si, _ = torchaudio.info('clip.flac')
+        >>> segments = [(int(start * si.rate), int((end - start) * si.rate)) for start, end in events]
+        >>> xs, sample_rate = torchaudio.load_segments('clip.flac', segments)
+
+    """
+    if not os.path.isfile(filepath):
+        raise OSError("{} not found or is a directory".format(filepath))
+    offsets = [offset for offset, _ in segments]
+    num_frames = [frames for _, frames in segments]
+    if any(offset < 0 for offset in offsets):
+        raise ValueError("Expected positive offset value")
+
+    if padded:
+        if out is not None:
+            check_input(out)
+        else:
+            out = torch.FloatTensor()
+        if lengths is not None:
+            check_input(lengths)
+        else:
+            lengths = torch.LongTensor()
+        divisor, normalization = _split_normalization(out, normalization)
+        sample_rate = _torch_sox.read_audio_segments_padded(filepath,
+                                                            offsets,
+                                                            num_frames,
+                                                            out,
+                                                            lengths,
+                                                            channels_first,
+                                                            divisor)
+        _padded_normalization(out, lengths, normalization, int(channels_first))
+        return out, lengths, sample_rate
+
+    outs = [torch.FloatTensor() for _ in segments]
+    divisor, normalization = _split_normalization(outs[0] if outs else torch.FloatTensor(), normalization)
+    sample_rate = _torch_sox.read_audio_segments(filepath, offsets, num_frames, outs, channels_first, divisor)
+    for x in outs:
+        _audio_normalization(x, normalization)
+    return outs, sample_rate
+
+
+def load_batch(filepaths,
+               out=None,
+               lengths=None,
+               normalization=True,
+               channels_first=True,
+               num_frames=None,
+               offsets=None,
+               num_threads=0):
+    """Loads a list of audio files into one zero-padded batch Tensor. The files are
+    decoded in parallel by the extension with the GIL released, so this can be
+    called from DataLoader worker threads without serializing on the interpreter.
+
+    Args:
+        filepaths (list[string]): paths to audio files, all with the same number of channels
+        out (Tensor, optional): an output Tensor to use instead of creating one
+        lengths (Tensor, optional): an output LongTensor for the lengths instead of creating one
+        normalization (bool, number, or callable, optional): see `load`
+        channels_first (bool): Set channels first or length first in result.  Default: ``True``
+        num_frames (list[int], optional): number of frames to load per file.  0 to load everything
+                                          after the offset.
+        offsets (list[int], optional): number of frames from the start of each file to begin data loading.
+        num_threads (int, optional): maximum number of decoding threads.  0 uses all hardware threads.
+
+    Returns: tuple(Tensor, Tensor, list[int])
+       - Tensor: output Tensor of size `[B x C x L]` or `[B x L x C]` where L is the number of frames
+                 of the longest file, shorter files are padded with zeros
+       - Tensor: LongTensor of size `[B]` with the number of frames read from each file
+       - list[int]: the sample rate of each file
+
+    Example::
+
+        >>> data, lengths, rates = torchaudio.load_batch(['foo.wav', 'bar.wav'])
+        >>> print(data.size(), lengths)
+        torch.Size([2, 1, 48000]) tensor([48000, 32000])
+
+    """
+    for filepath in filepaths:
+        if not os.path.isfile(filepath):
+            raise OSError("{} not found or is a directory".format(filepath))
+    for values in (num_frames, offsets):
+        if values is not None and len(values) != len(filepaths):
+            raise ValueError("Expected one value per file, got {} for {} files".format(
+                len(values), len(filepaths)))
+
+    if out is not None:
+        check_input(out)
+    else:
+        out = torch.FloatTensor()
+    if lengths is not None:
+        check_input(lengths)
+    else:
+        lengths = torch.LongTensor()
+
+    divisor, normalization = _split_normalization(out, normalization)
+    sample_rates = _torch_sox.read_audio_files_batch(filepaths,
+                                                     out,
+                                                     lengths,
+                                                     channels_first,
+                                                     num_frames or [],
+                                                     offsets or [],
+                                                     divisor,
+                                                     num_threads)
+    _padded_normalization(out, lengths, normalization, int(channels_first))
+
+    return out, lengths, sample_rates
+
+
+def load_features(filepath, ws=400, hop=None, n_fft=None, pad=0, n_mels=40, f_min=0., f_max=None,
+                  top_db=-80., log=True, normalization=True, out=None):
+    """Loads an audio file straight into mel spectrogram features, the same as
+    `transforms.MEL2` (and `transforms.SPECTROGRAM` for ``n_mels=0``) applied to the
+    output of `load`.  The file is decoded in chunks and the features of each frame are
+    computed as its samples arrive, so neither the waveform nor the spectrogram is held
+    in memory in full.  Windows (periodic Hann), FFT plans and filter banks are cached.
+
+    Args:
+        filepath (string): path to audio file
+        ws (int): window size
+        hop (int, optional): length of hop between STFT windows. default: `ws` // 2
+        n_fft (int, optional): size of fft, creates n_fft // 2 + 1 bins. default: `ws`
+        pad (int): two sided padding of signal
+        n_mels (int): number of MEL bins, 0 for the spectrogram without mel filters
+        f_min (float): minimum frequency of the mel filters
+        f_max (float, optional): maximum frequency of the mel filters. default: `sr` // 2
+        top_db (float, optional): minimum negative cut-off in decibels, see `transforms.SPEC2DB`.
+                                  ``None`` for none
+        log (bool): decibels relative to the maximum (see `transforms.SPEC2DB`) instead of power
+        normalization (bool or number, optional): see `load`, callables are not supported
+        out (FloatTensor, optional): an output Tensor to use instead of creating one
+
+    Returns: tuple(Tensor, int)
+       - Tensor: features of size `[C x L x F]`, where L is the number of frames and F the
+         number of mel bins (or `n_fft // 2 + 1`)
+       - int: the sample rate of the audio
+
+    Example::
+
+        >>> spec_mel, sample_rate = torchaudio.load_features('foo.wav', n_mels=40)
+
+    """
+    if not os.path.isfile(filepath):
+        raise OSError("{} not found or is a directory".format(filepath))
+    if callable(normalization):
+        raise TypeError("load_features only supports bool or number normalization")
+    if out is not None:
+        check_input(out)
+        if out.dtype != torch.float32:
+            raise TypeError("Expected a FloatTensor, got %s" % out.type())
+    else:
+        out = torch.FloatTensor()
+    divisor, _ = _split_normalization(out, normalization)
+    hop = hop if hop is not None else ws // 2
+    n_fft = n_fft if n_fft is not None else ws
+    top_db = float("-inf") if top_db is None else top_db
+    sample_rate = _torch_sox.load_features(filepath, out, ws, hop, n_fft, pad, n_mels, f_min, f_max or 0.,
+                                           log, top_db, divisor)
+    return out, sample_rate
+
+
+class OnlineFeatureExtractor(object):
+    """Computes the features of `load_features` for a live signal that arrives in
+    chunks of any length, e.g. the 10-100 ms packets of a streaming recognizer.  The
+    overlap between frames, the FFT plan and the filter bank are kept between calls and
+    every call returns only the frames completed by its chunk, bit for bit the same as
+    the frames computed over the whole signal at once.
+
+    Args:
+        sample_rate (int): sample rate of the signal
+        channels (int): number of channels of the signal
+        ws, hop, n_fft, pad, n_mels, f_min, f_max: see `load_features`
+        log (bool): decibels (`10 log10` of the power) instead of power.  Unlike
+                    `load_features` they are not relative to the maximum of the signal,
+                    which is not known before its end, and not floored
+        max_chunk (int): largest expected chunk in frames; buffers are reserved for it so
+                         that chunks up to this size never allocate
+        channels_first (bool): chunks are `[C x L]` rather than `[L x C]`.  Default: ``True``
+
+    The features are written into a buffer of size `[C x N x F]` that is reused by the
+    next call, clone them to keep them around.  Not safe to share between threads.
+
+    Example::
+
+        >>> extractor = torchaudio.OnlineFeatureExtractor(16000, n_mels=40)
+        >>> for packet in packets:  # FloatTensors of [1 x 160] to [1 x 1600]
+        >>>     frames = extractor.accept(packet)
+        >>> frames = extractor.flush()
+
+    """
+
+    def __init__(self, sample_rate, channels=1, ws=400, hop=None, n_fft=None, pad=0, n_mels=40,
+                 f_min=0., f_max=None, log=True, max_chunk=16000, channels_first=True):
+        hop = hop if hop is not None else ws // 2
+        n_fft = n_fft if n_fft is not None else ws
+        self.channels_first = channels_first
+        self._extractor = _torch_sox.OnlineFeatureExtractor(sample_rate, channels, ws, hop, n_fft, pad, n_mels,
+                                                            f_min, f_max or 0., log, max_chunk)
+        self._out = torch.FloatTensor()
+
+    @property
+    def channels(self):
+        return self._extractor.channels
+
+    @property
+    def num_features(self):
+        return self._extractor.num_features
+
+    def accept(self, chunk):
+        """Queues a FloatTensor chunk of audio and returns the frames it completes.
+        """
+        self._extractor.accept(chunk, self._out, self.channels_first)
+        return self._out
+
+    def flush(self):
+        """Ends the signal and returns the frames of the end padding.
+        """
+        self._extractor.flush(self._out)
+        return self._out
+
+    def reset(self):
+        """Starts a new signal.
+        """
+        self._extractor.reset()
+
+
+class StreamReader(object):
+    """Reads an audio file in fixed-size blocks with bounded memory, optionally through
+    a SoX effects chain that is applied incrementally as the file is read.
+
+    Args:
+        filepath (string): path to audio file
+        block_size (int, optional): number of frames per block.  Default: ``16000``
+        effects (SoxEffectsChain or list[SoxEffect], optional): effects applied to the stream.
+                                                                Requires `initialize_sox`.
+        out (Tensor, optional): buffer Tensor to use instead of creating one
+        normalization (bool or number, optional): see `load`, callables are not supported
+        channels_first (bool): Set channels first or length first in result.  Default: ``True``
+
+    Every block is a view of a buffer that is reused by the next block, clone it to
+    keep it around.  The last block may be shorter than `block_size`.
+
+    Example::
+
+        >>> reader = torchaudio.StreamReader('foo.mp3', block_size=16000)
+        >>> for block in reader:
+        >>>     print(block.size(), reader.sample_rate)
+        torch.Size([2, 16000]) 44100
+
+    """
+
+    def __init__(self, filepath, block_size=16000, effects=None, out=None, normalization=True,
+                 channels_first=True):
+        if not os.path.isfile(filepath):
+            raise OSError("{} not found or is a directory".format(filepath))
+        if callable(normalization):
+            raise TypeError("StreamReader only supports bool or number normalization")
+
+        if out is not None:
+            check_input(out)
+        else:
+            out = torch.FloatTensor()
+        if effects is None:
+            effects = []
+        elif isinstance(effects, sox_effects.SoxEffectsChain):
+            effects = effects.chain
+
+        divisor, normalization = _split_normalization(out, normalization)
+        self.normalization = normalization
+        self._reader = _torch_sox.StreamReader(filepath, out, block_size, effects, channels_first, divisor)
+
+    @property
+    def sample_rate(self):
+        return self._reader.sample_rate
+
+    @property
+    def channels(self):
+        return self._reader.channels
+
+    def read(self):
+        """Reads the next block, returns an empty Tensor at the end of the stream.
+        """
+        block = self._reader.read()
+        _audio_normalization(block, self.normalization)
+        return block
+
+    def __iter__(self):
+        return self
+
+    def __next__(self):
+        block = self.read()
+        if block.numel() == 0:
+            raise StopIteration
+        return block
+
+    next = __next__
+
+
+class StreamWriter(object):
+    """Writes an audio file a chunk at a time, e.g. audio that is generated or augmented on
+    the fly, with memory for a few blocks only.  Chunks are converted into SoX samples one
+    block at a time, whatever their type and layout, and with `background` the blocks are
+    encoded and written by a thread of their own while the next ones are converted.
+
+    Args:
+        filepath (string): path to audio file
+        sample_rate (int): sample rate of the audio
+        channels (int): number of channels of every chunk
+        precision (int, optional): bits per sample.  Default: ``16``
+        encodinginfo (sox_encodinginfo_t, optional): see `save_encinfo`
+        filetype (str, optional): a filetype or extension to be set if sox cannot determine it automatically
+        normalized (bool, optional): floating point chunks are in [-1, 1], as returned by `load`.
+                                     Default: ``True``
+        background (bool, optional): encode and write in a background thread.  Default: ``False``
+
+    Samples out of range are saturated.  The file gets its final header when the writer
+    is closed.
+
+    Example::
+
+        >>> with torchaudio.StreamWriter('foo.wav', 16000, 1) as writer:
+        >>>     for chunk in generate():
+        >>>         writer.write(chunk)
+
+    """
+
+    def __init__(self, filepath, sample_rate, channels, precision=16, encodinginfo=None, filetype=None,
+                 normalized=True, background=False):
+        abs_dirpath = os.path.dirname(os.path.abspath(filepath))
+        if not os.path.isdir(abs_dirpath):
+            raise OSError("Directory does not exist: {}".format(abs_dirpath))
+        si = sox_signalinfo_t()
+        si.rate = float(sample_rate)
+        si.channels = channels
+        si.precision = precision
+        extension = os.path.splitext(filepath)[1]
+        filetype = extension[1:] if len(extension) > 0 else filetype
+        self.normalized = normalized
+        self._writer = _torch_sox.StreamWriter(filepath, si, encodinginfo, filetype, background)
+
+    @property
+    def frames(self):
+        """Number of frames written so far.
+        """
+        return self._writer.frames
+
+    def write(self, src, channels_first=True):
+        """Appends a chunk of shape `[C x L]` (`[L x C]` if not `channels_first`), or `[L]`
+        if mono.  Returns the number of samples that were saturated.
+        """
+        check_input(src)
+        if src.dim() == 1:
+            src = src.unsqueeze(0 if channels_first else 1)
+        scale = float(1 << 31) if self.normalized and src.dtype.is_floating_point else 1.
+        return self._writer.write(src, channels_first, scale)
+
+    def close(self):
+        """Writes the blocks left and finalizes the file.
+        """
+        self._writer.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+
+class ShardWriter(object):
+    """Writes many utterances into a single shard file, to be read with `ShardReader`
+    instead of opening thousands of small files.  Utterances are either PCM samples
+    (Tensors, and the samples of wave files as they are) or whole encoded files (e.g. flac
+    or mp3), and an index of their offsets, formats and names is written at the end.  The
+    shard is written under a temporary name and only appears once it is closed.
+
+    Args:
+        filepath (string): path of the shard
+
+    Example::
+
+        >>> with torchaudio.ShardWriter('vctk-000.shard') as writer:
+        >>>     for path in paths:
+        >>>         writer.add_file(path)
+
+    """
+
+    def __init__(self, filepath):
+        self._writer = _torch_sox.ShardWriter(filepath)
+
+    def add_file(self, filepath, name=None):
+        """Adds an audio file, named after the file without its extension by default.
+        Returns the index of the utterance.
+        """
+        if not os.path.isfile(filepath):
+            raise OSError("{} not found or is a directory".format(filepath))
+        if name is None:
+            name = os.path.splitext(os.path.basename(filepath))[0]
+        return self._writer.add_file(name, filepath)
+
+    def add(self, name, src, sample_rate, precision=16, channels_first=True):
+        """Adds a Tensor of audio, see `save`, as `precision`-bit PCM (8, 16, 24 or 32).
+        Returns the index of the utterance.
+        """
+        check_input(src)
+        if src.dim() == 1:
+            src = src.unsqueeze(1 if channels_first else 0)
+        if channels_first:
+            src = src.t()
+        scale = float(1 << 31) if src.dtype.is_floating_point else 1.
+        return self._writer.add_samples(name, src, sample_rate, precision, scale)
+
+    def close(self):
+        """Writes the index and moves the shard into place.
+        """
+        self._writer.close()
+
+    def __len__(self):
+        return len(self._writer)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        if exc_type is None:
+            self.close()
+        else:
+            # the unfinished shard is removed
+            self._writer = None
+
+
+class ShardReader(object):
+    """Reads the utterances of a shard written by `ShardWriter`.  The shard is mapped into
+    memory once, so loading any utterance takes no system call: PCM utterances are decoded
+    straight from the mapping and encoded ones by SoX from memory.
+
+    Args:
+        filepath (string): path of the shard
+        sequential (bool): the shard is mostly read in order, let the kernel read ahead
+                           aggressively.  Default: ``False``
+        readahead (int): number of utterances prefetched ahead when iterating.  Default: ``64``
+
+    Iterating yields `(name, Tensor, sample_rate)` in order, prefetching the next
+    utterances in the background.
+
+    Example::
+
+        >>> shard = torchaudio.ShardReader('vctk-000.shard')
+        >>> x, sample_rate = shard[123]
+        >>> for name, x, sample_rate in shard:
+        >>>     print(name, x.size())
+
+    """
+
+    def __init__(self, filepath, sequential=False, readahead=64):
+        if not os.path.isfile(filepath):
+            raise OSError("{} not found or is a directory".format(filepath))
+        self._reader = _torch_sox.ShardReader(filepath, sequential)
+        self.readahead = readahead
+        self._names = None
+        self._index = None
+
+    def __len__(self):
+        return len(self._reader)
+
+    @property
+    def names(self):
+        if self._names is None:
+            self._names = self._reader.names()
+        return self._names
+
+    def index(self, name):
+        """Gets the index of the utterance `name`.
+        """
+        if self._index is None:
+            self._index = {n: i for i, n in enumerate(self.names)}
+        return self._index[name]
+
+    def info(self, i):
+        """Gets the sox_signalinfo_t of utterance `i`, see `info`.  The length is 0 for
+        encoded utterances whose header has none.
+        """
+        return self._reader.signal(i)
+
+    def load(self, i, out=None, normalization=True, channels_first=True, num_frames=0, offset=0):
+        """Loads utterance `i`, see `load` for the arguments.
+
+        Returns: tuple(Tensor, int)
+        """
+        if out is not None:
+            check_input(out)
+        else:
+            out = torch.FloatTensor()
+        if i < 0:
+            i += len(self)
+        divisor, normalization = _split_normalization(out, normalization)
+        sample_rate = _torch_sox.read_shard(self._reader, i, out, channels_first, num_frames, offset, divisor)
+        _audio_normalization(out, normalization)
+        return out, sample_rate
+
+    def view(self, i):
+        """Gets the stored samples of a PCM utterance as a `[L x C]` Tensor over the
+        mapping of the shard, without a copy: a ByteTensor (unsigned) for 8 bits, a
+        ShortTensor for 16 and an IntTensor for 32.
+        """
+        if i < 0:
+            i += len(self)
+        return self._reader.view(i)
+
+    def __getitem__(self, i):
+        return self.load(i)
+
+    def __iter__(self):
+        n = len(self)
+        self._reader.prefetch(0, 2 * self.readahead)
+        for i in range(n):
+            if i > 0 and i % self.readahead == 0:
+                self._reader.prefetch(i + self.readahead, self.readahead)
+            x, sample_rate = self.load(i)
+            yield self._reader.name(i), x, sample_rate
+
+
+def resample(src, orig_freq, new_freq, channels_first=True, out=None):
+    """Resamples a Tensor of audio with the built-in polyphase resampler, a windowed-sinc
+    low-pass filter with about 90 dB of stop band attenuation.  Both rates must be
+    integers whose ratio is reasonably simple, which covers all the usual rates
+    (8k, 16k, 22.05k, 44.1k, 48k, ...).  The output has `round(L * new_freq / orig_freq)`
+    frames, like the SoX `rate` effect.  Effects chains run the same resampler for a
+    ``polyphase_rate`` effect, which takes the output rate like ``rate``.
+
+    Args:
+        src (Tensor): audio of shape `[C x L]` or `[L x C]`, or 1D for mono
+        orig_freq (int): sample rate of `src`
+        new_freq (int): sample rate of the result
+        channels_first (bool): Set channels first or length first in `src` and the result.
+                               Default: ``True``
+        out (FloatTensor, optional): an output Tensor to use instead of creating one
+
+    Returns: FloatTensor
+
+    Example::
+
+        >>> data, sample_rate = torchaudio.load('foo.wav')
+        >>> data_16k = torchaudio.resample(data, sample_rate, 16000)
+
+    """
+    check_input(src)
+    if out is None:
+        out = torch.FloatTensor()
+    _torch_sox.resample(src, out, orig_freq, new_freq, channels_first)
+    return out
+
+
 def save(filepath, src, sample_rate, precision=16, channels_first=True):
     """Convenience function for `save_encinfo`.
 
@@ -176,19 +1080,80 @@ def save_encinfo(filepath,
             signalinfo.precision = int(signalinfo.precision)
         else:
             raise TypeError('Bit precision should be an integer')
-    # programs such as librosa normalize the signal, unnormalize if detected
-    if src.min() >= -1.0 and src.max() <= 1.0:
-        src = src * (1 << 31)
-        src = src.long()
     # set filetype and allow for files with no extensions
     extension = os.path.splitext(filepath)[1]
     filetype = extension[1:] if len(extension) > 0 else filetype
-    # transpose from C x L -> L x C
-    if channels_first:
-        src = src.transpose(1, 0)
-    # save data to file
-    src = src.contiguous()
-    _torch_sox.write_audio_file(filepath, src, signalinfo, encodinginfo, filetype)
+    # save data to file, the samples are converted in blocks whatever their layout
+    _torch_sox.write_audio_file(filepath, src, signalinfo, encodinginfo, filetype, channels_first,
+                                _unnormalization_scale(src))
+
+
+def save_batch(filepaths, tensors, sample_rate, precision=16, channels_first=True, encodinginfo=None,
+               num_threads=0):
+    """Saves a list of Tensors of audio signals to disk like `save`, encoding the files in parallel
+    with the GIL released, e.g. to export an augmented dataset.
+
+    Args:
+        filepaths (list[string]): paths to audio files, the format of each is given by its extension
+        tensors (list[Tensor]): input 1D or 2D Tensors of shape `[C x L]` or `[L x C]`, see `save`
+        sample_rate (int or list[int]): the sample rate of every signal, or of each of them
+        precision (int, optional): bits per sample.  Default: ``16``
+        channels_first (bool): Set channels first or length first in the inputs.  Default: ``True``
+        encodinginfo (sox_encodinginfo_t, optional): see `save_encinfo`
+        num_threads (int, optional): maximum number of encoding threads.  0 uses all hardware threads.
+
+    Example::
+
+        >>> torchaudio.save_batch(['foo.flac', 'bar.flac'], [foo, bar], 16000)
+
+    """
+    if len(tensors) != len(filepaths):
+        raise ValueError("Expected one Tensor per file, got {} for {} files".format(
+            len(tensors), len(filepaths)))
+    sample_rates = sample_rate if isinstance(sample_rate, (list, tuple)) else [sample_rate] * len(filepaths)
+    if len(sample_rates) != len(filepaths):
+        raise ValueError("Expected one sample rate per file, got {} for {} files".format(
+            len(sample_rates), len(filepaths)))
+
+    srcs, signals, scales = [], [], []
+    for filepath, src, rate in zip(filepaths, tensors, sample_rates):
+        abs_dirpath = os.path.dirname(os.path.abspath(filepath))
+        if not os.path.isdir(abs_dirpath):
+            raise OSError("Directory does not exist: {}".format(abs_dirpath))
+        src = _prepare_save(src, channels_first)
+        srcs.append(src)
+        signals.append(_save_signalinfo(src, rate, precision, channels_first))
+        scales.append(_unnormalization_scale(src))
+    _torch_sox.write_audio_files_batch(filepaths, srcs, signals, encodinginfo, [], channels_first, scales,
+                                       num_threads)
+
+
+def encode_to_bytes(src, sample_rate, filetype, precision=16, channels_first=True, encodinginfo=None):
+    """Encodes a Tensor of an audio signal into the contents of an audio file, e.g. to upload it
+    to an object store, without writing it to disk.
+
+    Args:
+        src (Tensor): an input 1D or 2D Tensor of shape `[C x L]` or `[L x C]`, see `save`
+        sample_rate (int): sample rate of the signal
+        filetype (str): the format to encode into, e.g. ``'wav'``, ``'flac'`` or ``'mp3'``
+        precision (int, optional): bits per sample.  Default: ``16``
+        channels_first (bool): Set channels first or length first in the input.  Default: ``True``
+        encodinginfo (sox_encodinginfo_t, optional): see `save_encinfo`
+
+    Returns: bytes
+        The encoded file, which `load_bytes` reads back.
+
+    Example::
+
+        >>> data, sample_rate = torchaudio.load('foo.wav')
+        >>> flac = torchaudio.encode_to_bytes(data, sample_rate, 'flac')
+
+    """
+    src = _prepare_save(src, channels_first)
+    # the stream cannot seek back to fix the header, which gets the length from here
+    si = _save_signalinfo(src, sample_rate, precision, channels_first)
+    return _torch_sox.encode_audio(src, si, encodinginfo, filetype, channels_first,
+                                   _unnormalization_scale(src))
 
 
 def info(filepath):
@@ -208,6 +1173,188 @@ def info(filepath):
     return _torch_sox.get_info(filepath)
 
 
+def info_batch(filepaths, index=None, num_threads=0):
+    """Gets the sample rate, channels, length and precision of many audio files at once, e.g. to
+    bucket a corpus by duration.  Headers of wave, FLAC and MP3 (with a Xing frame) files are
+    parsed directly, other files are opened with SoX, in parallel with the GIL released.
+
+    With `index`, the metadata is also kept in that file (written with `torch.save`): files whose
+    size and modification time did not change since they were indexed are not read again, so
+    scanning a corpus again only costs a `stat` per file.
+
+    Args:
+        filepaths (list[string]): paths to audio files
+        index (string, optional): path of a metadata index to read and update
+        num_threads (int, optional): maximum number of threads.  0 uses all hardware threads.
+
+    Returns: tuple(Tensor, Tensor, Tensor, Tensor)
+       - Tensor: LongTensor of size `[B]` with the sample rate of each file
+       - Tensor: LongTensor of size `[B]` with the number of channels of each file
+       - Tensor: LongTensor of size `[B]` with the length in samples (all channels) of each file,
+                 0 if unknown, like `si.length`
+       - Tensor: LongTensor of size `[B]` with the precision in bits of each file
+
+    Example::
+
+        >>> rates, channels, lengths, _ = torchaudio.info_batch(paths, index='corpus.info')
+        >>> seconds = lengths.double() / channels.double() / rates.double()
+
+    """
+    stamps = []
+    for filepath in filepaths:
+        if not os.path.isfile(filepath):
+            raise OSError("{} not found or is a directory".format(filepath))
+        if index is not None:
+            st = os.stat(filepath)
+            stamps.append((st.st_size, st.st_mtime))
+
+    # look up files that did not change since they were indexed, scan the others
+    rows = {}
+    if index is not None and os.path.isfile(index):
+        saved = torch.load(index)
+        for filepath, stamp, row in zip(saved['paths'], saved['stamps'].tolist(), saved['info'].tolist()):
+            rows[filepath] = (tuple(stamp), row)
+    stale = [i for i, filepath in enumerate(filepaths)
+             if index is None or rows.get(filepath, (None,))[0] != stamps[i]]
+    out = torch.LongTensor()
+    _torch_sox.get_info_batch([filepaths[i] for i in stale], out, num_threads)
+    if index is None:
+        return tuple(out.t().contiguous())
+
+    for i, row in zip(stale, out.tolist()):
+        rows[filepaths[i]] = (stamps[i], row)
+    if stale:
+        paths = list(rows)
+        temp_path = "{}.tmp{}".format(index, os.getpid())
+        torch.save({'paths': paths,
+                    'stamps': torch.DoubleTensor([rows[filepath][0] for filepath in paths]),
+                    'info': torch.LongTensor([rows[filepath][1] for filepath in paths])}, temp_path)
+        os.rename(temp_path, index)
+    out = torch.LongTensor([rows[filepath][1] for filepath in filepaths]).view(-1, 4)
+    return tuple(out.t().contiguous())
+
+
+def set_cache(directory, max_size=10 * 1024 ** 3):
+    """Caches decoded audio on disk, so that loading the same file the same way again is
+    a single copy out of the page cache instead of a decode.  Used by `load` (for files
+    that are not plain wave or raw PCM, which are read from a memory mapping anyway),
+    `SoxEffectsChain.sox_build_flow_effects` and `load_features`.  Entries are
+    keyed by the real path, size and modification time of the file and all the
+    arguments, so modified files are decoded again.  Random augmentation chains give a
+    new key every time and only fill the cache; `load_and_augment` bypasses it.
+
+    The cache can be shared by any number of processes, e.g. DataLoader workers: entries
+    are written aside and renamed into place, and the least recently used ones are
+    evicted once the cache exceeds `max_size`.  Call it before creating the workers.
+
+    Args:
+        directory (string): directory of the cache, created if needed.  ``None`` disables
+                            the cache
+        max_size (int): size limit in bytes.  Default: 10 GiB
+
+    Example::
+
+        >>> torchaudio.set_cache('/tmp/torchaudio_cache')
+        >>> x, sr = torchaudio.load('foo.mp3')  # decoded and cached
+        >>> x, sr = torchaudio.load('foo.mp3')  # read from the cache
+        >>> torchaudio.cache_stats()['hits']
+        1
+    """
+    _torch_sox.set_audio_cache(directory or "", max_size)
+
+
+def cache_stats(reset=False):
+    """Gets the counters of the cache set by `set_cache`, counted over all the processes
+    that use it: `hits`, `misses`, `inserts`, `evictions`, `entries` and `bytes`.  Empty
+    if there is no cache.
+
+    Args:
+        reset (bool): zero the hit, miss, insert and eviction counters afterwards
+    """
+    stats = _torch_sox.audio_cache_stats()
+    if reset:
+        _torch_sox.reset_audio_cache_stats()
+    return stats
+
+
+def clear_cache():
+    """Removes every entry of the cache set by `set_cache`.
+    """
+    _torch_sox.clear_audio_cache()
+
+
+def set_stats_enabled(enabled=True):
+    """Turns the collection of timings and counters of the extension on or off (off by default).
+    Every thread counts on its own without locks, and a disabled timer costs a load and a
+    branch, so it can be left on in production.
+
+    Args:
+        enabled (bool): collect timings and counters
+    """
+    _torch_sox.set_stats_enabled(enabled)
+
+
+def get_stats(reset=False):
+    """Gets the timings and counters collected by the extension, from every thread, since the
+    last reset.  Stages are ``open`` (opening and probing files), ``seek``, ``decode``
+    (`sox_read`), ``convert`` (sample conversion into and out of tensors), ``resize`` (of
+    output tensors), ``effects`` (flowing effects chains), ``encode`` (`sox_write`) and
+    ``cache`` (lookups and insertions of `set_cache`).  Each has a `count`, a `total_ns`, a
+    `max_ns` and a `histogram` whose bucket `i` counts the calls of at least `2 ** i` and less
+    than `2 ** (i + 1)` ns.  Counters are `files`, `errors`, `fallbacks` (fast paths given up
+    for the general one), `samples_decoded`, `samples_encoded` and `bytes_converted`.
+
+    Args:
+        reset (bool): start again from zero afterwards
+
+    Example::
+
+        >>> torchaudio.set_stats_enabled()
+        >>> x, sr = torchaudio.load('foo.mp3')
+        >>> stats = torchaudio.get_stats()
+        >>> stats['stages']['decode']['total_ns'] / stats['counters']['samples_decoded']
+    """
+    stats = _torch_sox.get_stats()
+    if reset:
+        _torch_sox.reset_stats()
+    return stats
+
+
+def reset_stats():
+    """Starts the timings and counters of `get_stats` again from zero.
+    """
+    _torch_sox.reset_stats()
+
+
+def set_seek_index(enabled=True, directory=None):
+    """Sets how `load` reads MP3 files at an `offset`.  libsox seeks in an MP3 file by
+    scanning its frame headers from the start and decodes the first frame without the
+    bit reservoir it needs, so reads late in a long file are slow and their first samples
+    differ from those of a whole decode.  With seek indices (the default), the frames of
+    a file are indexed once and a read decodes only a few frames before the offset, giving
+    exactly the samples of a whole decode.  FLAC and Ogg files seek through libsox, which
+    already uses their seek tables.
+
+    Args:
+        enabled (bool): read MP3 files at an offset through seek indices
+        directory (string, optional): directory where indices are kept, for other
+                                      processes and later runs.  ``None`` keeps them in
+                                      memory only
+
+    Example::
+
+        >>> torchaudio.set_seek_index(directory='/tmp/torchaudio_seek')
+        >>> x, sr = torchaudio.load('foo.mp3', offset=44100 * 600, num_frames=44100)
+    """
+    if directory:
+        try:
+            os.makedirs(directory)
+        except OSError:
+            if not os.path.isdir(directory):
+                raise
+    _torch_sox.set_seek_index(enabled, directory or "")
+
+
 def sox_signalinfo_t():
     r"""Create a sox_signalinfo_t object. This object can be used to set the sample
     rate, number of channels, length, bit precision and headroom multiplier
@@ -317,19 +1464,66 @@ def get_sox_bool(i=0):
 
 def initialize_sox():
     """Initialize sox for use with effects chains.  This is not required for simple
-    loading.  Importantly, only run `initialize_sox` once and do not shutdown
-    after each effect chain, but rather once you are finished with all effects chains.
+    loading and effects chains initialize sox on first use as well; calling it more
+    than once is harmless.  Importantly, do not shutdown after each effect chain, but
+    rather once you are finished with all effects chains.
     """
     return _torch_sox.initialize_sox()
 
 
 def shutdown_sox():
-    """Showdown sox for effects chain.  Not required for simple loading.  Importantly,
-    only call once.  Attempting to re-initialize sox will result in seg faults.
+    """Showdown sox for effects chain.  Not required for simple loading.  Loading a file or
+    building an effects chain afterwards, or calling `initialize_sox`, initializes sox again.
+    Do not shutdown while other threads are still using sox.
     """
     return _torch_sox.shutdown_sox()
 
 
+def _prepare_save(src, channels_first):
+    """Checks a Tensor to save and makes it 2D.
+    """
+    check_input(src)
+    ch_idx = 0 if channels_first else 1
+    if src.dim() == 1:
+        # 1d tensors as assumed to be mono signals
+        src = src.unsqueeze(ch_idx)
+    elif src.dim() > 2 or src.size(ch_idx) > 16:
+        # assumes num_channels < 16
+        raise ValueError(
+            "Expected format where C < 16, but found {}".format(src.size()))
+    return src
+
+
+def _save_signalinfo(src, sample_rate, precision, channels_first):
+    si = sox_signalinfo_t()
+    si.rate = float(sample_rate)
+    si.channels = src.size(0 if channels_first else 1)
+    si.length = src.numel()
+    si.precision = precision
+    return si
+
+
+def _unnormalization_scale(src):
+    """Scale of a Tensor to save into SoX samples: programs such as librosa normalize the
+    signal, unnormalize if detected.
+    """
+    return float(1 << 31) if src.min() >= -1.0 and src.max() <= 1.0 else 1.
+
+
+def _split_normalization(out, normalization):
+    """Split `normalization` into a constant divisor that the extension can fuse
+    into the decode of a floating point `out`, and whatever is left for
+    `_audio_normalization` to apply afterwards.
+    """
+    if not out.dtype.is_floating_point or callable(normalization):
+        return 1., normalization
+    if not normalization:
+        return 1., None
+    if isinstance(normalization, bool):
+        return float(1 << 31), None
+    return float(normalization), None
+
+
 def _audio_normalization(signal, normalization):
     """Audio normalization of a tensor in-place.  The normalization can be a bool,
     a number, or a callable that takes the audio tensor as an input. SoX uses
@@ -349,3 +1543,15 @@ def _audio_normalization(signal, normalization):
     elif callable(normalization):
         a = normalization(signal)
         signal /= a
+
+
+def _padded_normalization(out, lengths, normalization, dim):
+    """`_audio_normalization` of a zero-padded batch `out` with `lengths[i]` valid entries along `dim`
+    of item `i`.  A callable sees every item on its own, without the padding, as if it was loaded alone.
+    """
+    if not callable(normalization):
+        _audio_normalization(out, normalization)
+        return
+    for i, n in enumerate(lengths.tolist()):
+        if n > 0:
+            _audio_normalization(out[i].narrow(dim, 0, n), normalization)
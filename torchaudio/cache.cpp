@@ -0,0 +1,503 @@
+#include <torch/extension.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+namespace torch {
+namespace audio {
+
+static_assert(
+    ATOMIC_LLONG_LOCK_FREE == 2,
+    "the cache counters are shared through memory between processes");
+
+struct CacheCounters {
+  char magic[8];
+  std::atomic<int64_t> hits;
+  std::atomic<int64_t> misses;
+  std::atomic<int64_t> inserts;
+  std::atomic<int64_t> evictions;
+  // only changed with the lock held
+  std::atomic<int64_t> entries;
+  std::atomic<int64_t> bytes;
+};
+
+namespace {
+
+constexpr char kMetaMagic[8] = {'T', 'A', 'C', 'M', 'E', 'T', 'A', '1'};
+constexpr char kEntryMagic[8] = {'T', 'A', 'C', 'E', 'N', 'T', 'R', '1'};
+constexpr char kEntrySuffix[] = ".entry";
+constexpr char kTempPrefix[] = ".tmp-";
+constexpr int64_t kMaxDims = 4;
+/// Tensor data starts at a multiple of the page size.
+constexpr int64_t kDataAlignment = 4096;
+/// Evictions go a bit below the limit so the next insertions do not evict.
+constexpr double kEvictionTarget = 0.9;
+/// Temporary files of writers that died are removed after an hour.
+constexpr time_t kStaleTempSeconds = 3600;
+
+struct EntryHeader {
+  char magic[8];
+  int32_t sample_rate;
+  int32_t scalar_type;
+  int64_t dim;
+  int64_t sizes[kMaxDims];
+  int64_t key_length;
+  int64_t data_offset;
+  int64_t data_bytes;
+};
+
+uint64_t fnv1a(const std::string& s, uint64_t hash) {
+  for (const char c : s) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string hex(uint64_t value) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string s(16, '0');
+  for (int i = 15; i >= 0; --i, value >>= 4) {
+    s[i] = kDigits[value & 0xf];
+  }
+  return s;
+}
+
+bool ends_with(const std::string& s, const char* suffix) {
+  const size_t n = std::strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+/// Writes all of `data`, false on errors.
+bool write_all(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// Creates `directory` and its parents, if missing.
+void make_directories(const std::string& directory) {
+  size_t pos = 0;
+  while (true) {
+    pos = directory.find('/', pos);
+    // the root of an absolute path is not created
+    if (pos != 0) {
+      const std::string prefix = directory.substr(0, pos);
+      if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error(
+            "Could not create the audio cache " + directory);
+      }
+    }
+    if (pos == std::string::npos) {
+      return;
+    }
+    ++pos;
+  }
+}
+
+/// Exclusive `flock` of the meta file for the scope. The lock belongs to the
+/// open file description, so every process must lock a descriptor of its
+/// own, see `AudioCache::meta_descriptor`.
+class FileLock {
+ public:
+  explicit FileLock(int fd) : fd_(fd) {
+    while (flock(fd_, LOCK_EX) != 0 && errno == EINTR) {
+    }
+  }
+  FileLock(const FileLock& other) = delete;
+  FileLock& operator=(const FileLock& other) = delete;
+  ~FileLock() {
+    flock(fd_, LOCK_UN);
+  }
+
+ private:
+  int fd_;
+};
+
+/// Copies the entry mapped at `begin` into `output` if it is a complete
+/// entry of `key`. Returns its sample rate, -1 otherwise.
+int read_entry(
+    const char* begin,
+    int64_t size,
+    const std::string& key,
+    at::Tensor& output) {
+  EntryHeader header;
+  std::memcpy(&header, begin, sizeof(header));
+  if (std::memcmp(header.magic, kEntryMagic, sizeof(kEntryMagic)) != 0 ||
+      header.dim < 0 || header.dim > kMaxDims ||
+      header.key_length != static_cast<int64_t>(key.size()) ||
+      header.data_offset < static_cast<int64_t>(sizeof(header)) +
+              header.key_length ||
+      header.data_offset + header.data_bytes > size ||
+      key.compare(0, key.size(), begin + sizeof(header), key.size()) != 0) {
+    return -1;
+  }
+  const at::ScalarType scalar_type = output.type().scalarType();
+  if (header.scalar_type != static_cast<int32_t>(scalar_type)) {
+    return -1;
+  }
+  std::vector<int64_t> sizes(header.sizes, header.sizes + header.dim);
+  int64_t numel = 1;
+  for (const int64_t n : sizes) {
+    numel *= n;
+  }
+  if (numel * static_cast<int64_t>(at::elementSize(scalar_type)) !=
+      header.data_bytes) {
+    return -1;
+  }
+  if (!output.is_contiguous()) {
+    output.resize_({0});
+  }
+  output.resize_(sizes);
+  std::memcpy(output.data_ptr(), begin + header.data_offset, header.data_bytes);
+  return header.sample_rate;
+}
+
+bool older(const struct stat& a, const struct stat& b) {
+  return a.st_mtim.tv_sec != b.st_mtim.tv_sec
+      ? a.st_mtim.tv_sec < b.st_mtim.tv_sec
+      : a.st_mtim.tv_nsec < b.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+AudioCache::AudioCache(const std::string& directory, int64_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes) {
+  while (directory_.size() > 1 && directory_.back() == '/') {
+    directory_.pop_back();
+  }
+  make_directories(directory_);
+  const std::string meta = directory_ + "/meta";
+  meta_fd_ = open(meta.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (meta_fd_ < 0) {
+    throw std::runtime_error("Could not open the audio cache " + directory_);
+  }
+  meta_pid_ = getpid();
+
+  FileLock lock(meta_fd_);
+  struct stat st;
+  const bool created = fstat(meta_fd_, &st) == 0 &&
+      st.st_size < static_cast<off_t>(sizeof(CacheCounters));
+  if (created && ftruncate(meta_fd_, sizeof(CacheCounters)) != 0) {
+    close(meta_fd_);
+    throw std::runtime_error("Could not open the audio cache " + directory_);
+  }
+  void* mapped = mmap(
+      nullptr,
+      sizeof(CacheCounters),
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED,
+      meta_fd_,
+      0);
+  if (mapped == MAP_FAILED) {
+    close(meta_fd_);
+    throw std::runtime_error("Could not open the audio cache " + directory_);
+  }
+  // the zeros of a new file are valid counters
+  counters_ = static_cast<CacheCounters*>(mapped);
+  if (created) {
+    std::memcpy(counters_->magic, kMetaMagic, sizeof(kMetaMagic));
+    // count what a previous cache left in the directory
+    evict(max_bytes_, /*count_evictions=*/false);
+  } else if (std::memcmp(
+                 counters_->magic, kMetaMagic, sizeof(kMetaMagic)) != 0) {
+    munmap(counters_, sizeof(CacheCounters));
+    close(meta_fd_);
+    throw std::runtime_error(directory_ + " is not an audio cache");
+  }
+}
+
+AudioCache::~AudioCache() {
+  munmap(counters_, sizeof(CacheCounters));
+  close(meta_fd_);
+}
+
+int AudioCache::meta_descriptor() {
+  // a forked child inherits the open file description of its parent, and
+  // with it the lock: it opens the meta file again before locking. The
+  // shared mapping of the counters stays valid across the fork.
+  if (meta_pid_ != getpid()) {
+    const std::string meta = directory_ + "/meta";
+    const int fd = open(meta.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      return -1;
+    }
+    close(meta_fd_);
+    meta_fd_ = fd;
+    meta_pid_ = getpid();
+  }
+  return meta_fd_;
+}
+
+std::string AudioCache::key(
+    const std::string& file_name,
+    const std::string& params) {
+  char* real = realpath(file_name.c_str(), nullptr);
+  if (real == nullptr) {
+    return std::string();
+  }
+  std::string key = real;
+  free(real);
+  struct stat st;
+  if (stat(key.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return std::string();
+  }
+  key += '\n' + std::to_string(st.st_size) + ' ' +
+      std::to_string(st.st_mtim.tv_sec) + '.' +
+      std::to_string(st.st_mtim.tv_nsec) + '\n' + params;
+  return key;
+}
+
+std::string AudioCache::entry_path(const std::string& key) const {
+  return directory_ + '/' + hex(fnv1a(key, 0xcbf29ce484222325ULL)) +
+      hex(fnv1a(key, 0x84222325cbf29ce4ULL)) + kEntrySuffix;
+}
+
+int AudioCache::lookup(const std::string& key, at::Tensor output) {
+  const int fd = open(entry_path(key).c_str(), O_RDONLY | O_CLOEXEC);
+  int sample_rate = -1;
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 &&
+        st.st_size >= static_cast<off_t>(sizeof(EntryHeader))) {
+      void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapped != MAP_FAILED) {
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        sample_rate = read_entry(
+            static_cast<const char*>(mapped), st.st_size, key, output);
+        munmap(mapped, st.st_size);
+      }
+    }
+    if (sample_rate >= 0) {
+      // the modification time is the last use for the eviction
+      futimens(fd, nullptr);
+    }
+    close(fd);
+  }
+  ++(sample_rate >= 0 ? counters_->hits : counters_->misses);
+  return sample_rate;
+}
+
+void AudioCache::insert(
+    const std::string& key,
+    const at::Tensor& data,
+    int sample_rate) {
+  if (data.dim() > kMaxDims) {
+    return;
+  }
+  const at::Tensor contiguous = data.contiguous();
+  EntryHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kEntryMagic, sizeof(kEntryMagic));
+  header.sample_rate = sample_rate;
+  header.scalar_type = static_cast<int32_t>(data.type().scalarType());
+  header.dim = data.dim();
+  for (int64_t d = 0; d < header.dim; ++d) {
+    header.sizes[d] = data.size(d);
+  }
+  header.key_length = key.size();
+  header.data_offset =
+      (sizeof(header) + key.size() + kDataAlignment - 1) / kDataAlignment *
+      kDataAlignment;
+  header.data_bytes = contiguous.numel() *
+      static_cast<int64_t>(at::elementSize(data.type().scalarType()));
+  const int64_t entry_bytes = header.data_offset + header.data_bytes;
+  if (entry_bytes > max_bytes_) {
+    return;
+  }
+
+  // written aside and renamed into place, so readers only see whole entries
+  static std::atomic<uint64_t> sequence{0};
+  const std::string temp = directory_ + '/' + kTempPrefix +
+      std::to_string(getpid()) + '-' + std::to_string(sequence++);
+  const int fd =
+      open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return;
+  }
+  std::vector<char> head(header.data_offset, 0);
+  std::memcpy(head.data(), &header, sizeof(header));
+  std::memcpy(head.data() + sizeof(header), key.data(), key.size());
+  bool ok = write_all(fd, head.data(), head.size()) &&
+      write_all(fd, contiguous.data_ptr(), header.data_bytes);
+  ok = close(fd) == 0 && ok;
+  if (!ok) {
+    unlink(temp.c_str());
+    return;
+  }
+
+  const std::string path = entry_path(key);
+  std::lock_guard<std::mutex> guard(mutex_);
+  const int meta_fd = meta_descriptor();
+  if (meta_fd < 0) {
+    unlink(temp.c_str());
+    return;
+  }
+  FileLock lock(meta_fd);
+  struct stat st;
+  const bool replaces = stat(path.c_str(), &st) == 0;
+  if (rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return;
+  }
+  if (replaces) {
+    // another process inserted the same entry meanwhile
+    counters_->bytes -= st.st_size;
+    --counters_->entries;
+  }
+  counters_->bytes += entry_bytes;
+  ++counters_->entries;
+  ++counters_->inserts;
+  if (counters_->bytes > max_bytes_) {
+    evict(static_cast<int64_t>(max_bytes_ * kEvictionTarget), true);
+  }
+}
+
+void AudioCache::evict(int64_t target_bytes, bool count_evictions) {
+  struct Entry {
+    std::string path;
+    struct stat st;
+  };
+  std::vector<Entry> entries;
+  DIR* dir = opendir(directory_.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  const time_t now = time(nullptr);
+  while (const dirent* e = readdir(dir)) {
+    const std::string name = e->d_name;
+    Entry entry;
+    entry.path = directory_ + '/' + name;
+    if (stat(entry.path.c_str(), &entry.st) != 0) {
+      continue;
+    }
+    if (ends_with(name, kEntrySuffix)) {
+      entries.push_back(std::move(entry));
+    } else if (
+        name.compare(0, std::strlen(kTempPrefix), kTempPrefix) == 0 &&
+        now - entry.st.st_mtim.tv_sec > kStaleTempSeconds) {
+      unlink(entry.path.c_str());
+    }
+  }
+  closedir(dir);
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    return older(a.st, b.st);
+  });
+  int64_t bytes = 0;
+  for (const Entry& entry : entries) {
+    bytes += entry.st.st_size;
+  }
+  size_t evicted = 0;
+  for (; evicted < entries.size() && bytes > target_bytes; ++evicted) {
+    // readers that mapped the entry keep their mapping
+    unlink(entries[evicted].path.c_str());
+    bytes -= entries[evicted].st.st_size;
+  }
+  if (count_evictions) {
+    counters_->evictions += evicted;
+  }
+  counters_->entries = entries.size() - evicted;
+  counters_->bytes = bytes;
+}
+
+void AudioCache::clear() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  const int meta_fd = meta_descriptor();
+  if (meta_fd < 0) {
+    throw std::runtime_error("Could not open the audio cache " + directory_);
+  }
+  FileLock lock(meta_fd);
+  evict(0, /*count_evictions=*/false);
+}
+
+std::map<std::string, int64_t> AudioCache::stats() const {
+  return {
+      {"hits", counters_->hits},
+      {"misses", counters_->misses},
+      {"inserts", counters_->inserts},
+      {"evictions", counters_->evictions},
+      {"entries", counters_->entries},
+      {"bytes", counters_->bytes},
+  };
+}
+
+void AudioCache::reset_stats() {
+  counters_->hits = 0;
+  counters_->misses = 0;
+  counters_->inserts = 0;
+  counters_->evictions = 0;
+}
+
+namespace {
+
+std::mutex& audio_cache_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::shared_ptr<AudioCache>& current_audio_cache() {
+  static std::shared_ptr<AudioCache> cache;
+  return cache;
+}
+
+} // namespace
+
+void set_audio_cache(const std::string& directory, int64_t max_bytes) {
+  std::shared_ptr<AudioCache> cache;
+  if (!directory.empty()) {
+    cache = std::make_shared<AudioCache>(directory, max_bytes);
+  }
+  std::lock_guard<std::mutex> lock(audio_cache_mutex());
+  current_audio_cache() = std::move(cache);
+}
+
+std::shared_ptr<AudioCache> audio_cache() {
+  std::lock_guard<std::mutex> lock(audio_cache_mutex());
+  return current_audio_cache();
+}
+
+std::map<std::string, int64_t> audio_cache_stats() {
+  const auto cache = audio_cache();
+  return cache ? cache->stats() : std::map<std::string, int64_t>();
+}
+
+void reset_audio_cache_stats() {
+  if (const auto cache = audio_cache()) {
+    cache->reset_stats();
+  }
+}
+
+void clear_audio_cache() {
+  if (const auto cache = audio_cache()) {
+    cache->clear();
+  }
+}
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/types.h>
+
+namespace at {
+struct Tensor;
+} // namespace at
+
+namespace torch {
+namespace audio {
+
+/// Counters of a cache directory, shared by every process that uses it.
+struct CacheCounters;
+
+/// An on-disk cache of decoded audio and features, shared by any number of
+/// processes (e.g. DataLoader workers). Every entry is a file named after
+/// the hash of its key, holding a small header, the full key (to rule out
+/// hash collisions) and the tensor data at a page-aligned offset, so a hit
+/// is a single copy out of the page cache. Entries are written to a
+/// temporary file and renamed into place, so readers never see partial
+/// entries, and readers keep a mapping valid while an entry is evicted.
+/// The total size and the counters live in a small mapped file whose
+/// `flock` serializes insertions and evictions, taken on a descriptor of
+/// each process's own (forked workers open the file again); hits take no
+/// lock. The modification time of an entry is its last use: entries are
+/// evicted least recently used first once the total exceeds `max_bytes`.
+class AudioCache {
+ public:
+  AudioCache(const std::string& directory, int64_t max_bytes);
+  AudioCache(const AudioCache& other) = delete;
+  AudioCache& operator=(const AudioCache& other) = delete;
+  ~AudioCache();
+
+  /// Key of the result of reading `file_name` with `params`, made of its
+  /// real path, size and modification time, so a changed file misses.
+  /// Returns an empty key if the file cannot be found.
+  static std::string key(const std::string& file_name, const std::string& params);
+
+  /// Loads the entry of `key` into `output`, resized to its sizes with
+  /// contiguous strides, and returns its sample rate, or -1 on a miss.
+  int lookup(const std::string& key, at::Tensor output);
+
+  /// Stores `data` as the entry of `key`, unless it exceeds the size limit.
+  /// Failures to write are not errors, the entry is just not cached.
+  void insert(const std::string& key, const at::Tensor& data, int sample_rate);
+
+  /// Removes every entry.
+  void clear();
+
+  /// `hits`, `misses`, `inserts`, `evictions`, `entries` and `bytes`.
+  std::map<std::string, int64_t> stats() const;
+
+  /// Zeroes the hit, miss, insert and eviction counters.
+  void reset_stats();
+
+  const std::string& directory() const {
+    return directory_;
+  }
+
+ private:
+  std::string entry_path(const std::string& key) const;
+  /// The descriptor of the meta file to lock, opened by this process, or -1
+  /// if it cannot be opened again after a fork. With `mutex_` held.
+  int meta_descriptor();
+  /// Removes the least recently used entries down to `target_bytes` and
+  /// recounts the entries, with the lock held.
+  void evict(int64_t target_bytes, bool count_evictions);
+
+  std::string directory_;
+  int64_t max_bytes_;
+  int meta_fd_;
+  // the process that opened `meta_fd_`
+  pid_t meta_pid_;
+  CacheCounters* counters_;
+  // flock does not exclude threads that share the descriptor
+  std::mutex mutex_;
+};
+
+/// Sets the process-wide cache used by `read_audio_file`, effects chains and
+/// `load_features` to `directory`, created if needed, or disables it for an
+/// empty `directory`.
+void set_audio_cache(const std::string& directory, int64_t max_bytes);
+
+/// The process-wide cache, null if disabled.
+std::shared_ptr<AudioCache> audio_cache();
+
+/// Counters of the process-wide cache, empty if disabled.
+std::map<std::string, int64_t> audio_cache_stats();
+
+/// Zeroes the counters of the process-wide cache, if any.
+void reset_audio_cache_stats();
+
+/// Removes every entry of the process-wide cache, if any.
+void clear_audio_cache();
+
+} // namespace audio
+} // namespace torch
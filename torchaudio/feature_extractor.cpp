@@ -0,0 +1,653 @@
+#include <torch/extension.h>
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+#include "feature_extractor.h"
+#include "sample_conversion.h"
+
+namespace torch {
+namespace audio {
+namespace detail {
+
+struct Complex {
+  float r;
+  float i;
+};
+
+inline Complex operator+(Complex a, Complex b) {
+  return {a.r + b.r, a.i + b.i};
+}
+
+inline Complex operator-(Complex a, Complex b) {
+  return {a.r - b.r, a.i - b.i};
+}
+
+inline Complex operator*(Complex a, Complex b) {
+  return {a.r * b.r - a.i * b.i, a.r * b.i + a.i * b.r};
+}
+
+/// Mixed radix (4, 2, 3, 5, then any) decimation in time FFT, in the style
+/// of KISS FFT, so that sizes like 400 need no padding.
+class FftPlan {
+ public:
+  explicit FftPlan(int64_t n) : n_(n), twiddles_(n) {
+    for (int64_t k = 0; k < n; ++k) {
+      const double phase = -2 * M_PI * k / n;
+      twiddles_[k] = {float(std::cos(phase)), float(std::sin(phase))};
+    }
+    // pairs of radix and remaining length, radix 4 first
+    int64_t p = 4;
+    const int64_t floor_sqrt = static_cast<int64_t>(std::sqrt(double(n)));
+    do {
+      while (n % p != 0) {
+        p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+        if (p > floor_sqrt) {
+          p = n;
+        }
+      }
+      n /= p;
+      factors_.push_back(p);
+      factors_.push_back(n);
+    } while (n > 1);
+  }
+
+  int64_t size() const {
+    return n_;
+  }
+
+  /// Out-of-place forward transform of `n` values.
+  void forward(const Complex* in, Complex* out) const {
+    work(out, in, 1, factors_.data());
+  }
+
+ private:
+  void work(
+      Complex* out,
+      const Complex* in,
+      int64_t fstride,
+      const int64_t* factors) const {
+    const int64_t p = factors[0];
+    const int64_t m = factors[1];
+    Complex* const begin = out;
+    Complex* const end = out + p * m;
+    if (m == 1) {
+      for (; out != end; ++out, in += fstride) {
+        *out = *in;
+      }
+    } else {
+      for (; out != end; out += m, in += fstride) {
+        work(out, in, fstride * p, factors + 2);
+      }
+    }
+    switch (p) {
+      case 2:
+        butterfly2(begin, fstride, m);
+        break;
+      case 3:
+        butterfly3(begin, fstride, m);
+        break;
+      case 4:
+        butterfly4(begin, fstride, m);
+        break;
+      case 5:
+        butterfly5(begin, fstride, m);
+        break;
+      default:
+        butterfly_generic(begin, fstride, m, p);
+        break;
+    }
+  }
+
+  void butterfly2(Complex* f, int64_t fstride, int64_t m) const {
+    for (int64_t k = 0; k < m; ++k) {
+      const Complex t = f[m + k] * twiddles_[k * fstride];
+      f[m + k] = f[k] - t;
+      f[k] = f[k] + t;
+    }
+  }
+
+  void butterfly3(Complex* f, int64_t fstride, int64_t m) const {
+    const float epi3 = twiddles_[fstride * m].i;
+    for (int64_t k = 0; k < m; ++k, ++f) {
+      const Complex s1 = f[m] * twiddles_[k * fstride];
+      const Complex s2 = f[2 * m] * twiddles_[2 * k * fstride];
+      const Complex s3 = s1 + s2;
+      Complex s0 = s1 - s2;
+      f[m] = {f[0].r - 0.5f * s3.r, f[0].i - 0.5f * s3.i};
+      s0 = {s0.r * epi3, s0.i * epi3};
+      f[0] = f[0] + s3;
+      f[2 * m] = {f[m].r + s0.i, f[m].i - s0.r};
+      f[m] = {f[m].r - s0.i, f[m].i + s0.r};
+    }
+  }
+
+  void butterfly4(Complex* f, int64_t fstride, int64_t m) const {
+    for (int64_t k = 0; k < m; ++k, ++f) {
+      const Complex s0 = f[m] * twiddles_[k * fstride];
+      const Complex s1 = f[2 * m] * twiddles_[2 * k * fstride];
+      const Complex s2 = f[3 * m] * twiddles_[3 * k * fstride];
+      const Complex s5 = f[0] - s1;
+      f[0] = f[0] + s1;
+      const Complex s3 = s0 + s2;
+      const Complex s4 = s0 - s2;
+      f[2 * m] = f[0] - s3;
+      f[0] = f[0] + s3;
+      f[m] = {s5.r + s4.i, s5.i - s4.r};
+      f[3 * m] = {s5.r - s4.i, s5.i + s4.r};
+    }
+  }
+
+  void butterfly5(Complex* f, int64_t fstride, int64_t m) const {
+    const Complex ya = twiddles_[fstride * m];
+    const Complex yb = twiddles_[fstride * 2 * m];
+    for (int64_t k = 0; k < m; ++k, ++f) {
+      const Complex s0 = f[0];
+      const Complex s1 = f[m] * twiddles_[k * fstride];
+      const Complex s2 = f[2 * m] * twiddles_[2 * k * fstride];
+      const Complex s3 = f[3 * m] * twiddles_[3 * k * fstride];
+      const Complex s4 = f[4 * m] * twiddles_[4 * k * fstride];
+      const Complex s7 = s1 + s4;
+      const Complex s10 = s1 - s4;
+      const Complex s8 = s2 + s3;
+      const Complex s9 = s2 - s3;
+      f[0] = {s0.r + s7.r + s8.r, s0.i + s7.i + s8.i};
+      const Complex s5 = {s0.r + s7.r * ya.r + s8.r * yb.r,
+                          s0.i + s7.i * ya.r + s8.i * yb.r};
+      const Complex s6 = {s10.i * ya.i + s9.i * yb.i,
+                          -s10.r * ya.i - s9.r * yb.i};
+      f[m] = s5 - s6;
+      f[4 * m] = s5 + s6;
+      const Complex s11 = {s0.r + s7.r * yb.r + s8.r * ya.r,
+                           s0.i + s7.i * yb.r + s8.i * ya.r};
+      const Complex s12 = {-s10.i * yb.i + s9.i * ya.i,
+                           s10.r * yb.i - s9.r * ya.i};
+      f[2 * m] = s11 + s12;
+      f[3 * m] = s11 - s12;
+    }
+  }
+
+  void butterfly_generic(Complex* f, int64_t fstride, int64_t m, int64_t p)
+      const {
+    // grows once per thread to the largest radix used
+    thread_local std::vector<Complex> scratch;
+    scratch.resize(std::max<size_t>(scratch.size(), p));
+    for (int64_t u = 0; u < m; ++u) {
+      for (int64_t q = 0, k = u; q < p; ++q, k += m) {
+        scratch[q] = f[k];
+      }
+      for (int64_t q1 = 0, k = u; q1 < p; ++q1, k += m) {
+        int64_t twiddle = 0;
+        f[k] = scratch[0];
+        for (int64_t q = 1; q < p; ++q) {
+          twiddle = (twiddle + fstride * k) % n_;
+          f[k] = f[k] + scratch[q] * twiddles_[twiddle];
+        }
+      }
+    }
+  }
+
+  int64_t n_;
+  std::vector<Complex> twiddles_;
+  std::vector<int64_t> factors_;
+};
+
+} // namespace detail
+
+namespace {
+
+using detail::Complex;
+using detail::FftPlan;
+
+/// Frames of samples that are no longer needed are only dropped from the
+/// history in batches of at least this many samples.
+constexpr int64_t kCompactSamples = 4096;
+
+/// Returns the shared instance of `T` built from `key`, creating it on first
+/// use. The instances are immutable and live as long as the process.
+template <typename T, typename Key>
+std::shared_ptr<const T> cached(const Key& key) {
+  static std::mutex mutex;
+  static std::map<Key, std::shared_ptr<const T>> instances;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& instance = instances[key];
+  if (!instance) {
+    instance.reset(new T(key));
+  }
+  return instance;
+}
+
+} // namespace
+
+/// Window, FFT plan and scale of the power spectrum of one frame, computed
+/// like `torch.stft(..., normalized=True)` divided by the window energy.
+class SpectrumPlan {
+ public:
+  /// `key` holds the window and FFT lengths.
+  explicit SpectrumPlan(const std::tuple<int64_t, int64_t>& key)
+      : n_fft_(std::get<1>(key)),
+        window_(n_fft_, 0.f),
+        // even sizes are transformed as n / 2 complex values
+        plan_(n_fft_ % 2 == 0 ? n_fft_ / 2 : n_fft_) {
+    const int64_t ws = std::get<0>(key);
+    // periodic Hann window, zero padded on both sides like torch.stft does
+    const int64_t left = (n_fft_ - ws) / 2;
+    double energy = 0;
+    for (int64_t i = 0; i < ws; ++i) {
+      const double w = ws == 1 ? 1. : 0.5 - 0.5 * std::cos(2 * M_PI * i / ws);
+      window_[left + i] = static_cast<float>(w);
+      energy += w * w;
+    }
+    scale_ = static_cast<float>(1. / (n_fft_ * energy));
+
+    const int64_t half = n_fft_ / 2;
+    for (int64_t k = 0; k < half / 2; ++k) {
+      const double phase = -M_PI * (double(k + 1) / half + 0.5);
+      split_twiddles_.push_back(
+          {float(std::cos(phase)), float(std::sin(phase))});
+    }
+  }
+
+  int64_t n_fft() const {
+    return n_fft_;
+  }
+
+  int64_t num_bins() const {
+    return n_fft_ / 2 + 1;
+  }
+
+  /// Power of the `num_bins()` frequencies of the windowed `frame` into
+  /// `power`, using `scratch` (`4 * n_fft + 2` floats).
+  void power(const float* frame, float* power, float* scratch) const {
+    Complex* in = reinterpret_cast<Complex*>(scratch);
+    Complex* out = in + n_fft_ / 2 + 1;
+    if (n_fft_ % 2 != 0) {
+      out = in + n_fft_;
+      for (int64_t i = 0; i < n_fft_; ++i) {
+        in[i] = {frame[i] * window_[i], 0.f};
+      }
+      plan_.forward(in, out);
+      for (int64_t k = 0; k < num_bins(); ++k) {
+        power[k] = (out[k].r * out[k].r + out[k].i * out[k].i) * scale_;
+      }
+      return;
+    }
+
+    // even samples as real and odd samples as imaginary parts, then split
+    // the spectrum into the spectra of the two halves
+    float* windowed = scratch;
+    for (int64_t i = 0; i < n_fft_; ++i) {
+      windowed[i] = frame[i] * window_[i];
+    }
+    const int64_t half = n_fft_ / 2;
+    plan_.forward(in, out);
+    const Complex dc = out[0];
+    power[0] = (dc.r + dc.i) * (dc.r + dc.i) * scale_;
+    power[half] = (dc.r - dc.i) * (dc.r - dc.i) * scale_;
+    for (int64_t k = 1; k <= half / 2; ++k) {
+      const Complex fpk = out[k];
+      const Complex fpnk = {out[half - k].r, -out[half - k].i};
+      const Complex f1k = fpk + fpnk;
+      const Complex tw = (fpk - fpnk) * split_twiddles_[k - 1];
+      const Complex lo = {0.5f * (f1k.r + tw.r), 0.5f * (f1k.i + tw.i)};
+      const Complex hi = {0.5f * (f1k.r - tw.r), 0.5f * (tw.i - f1k.i)};
+      power[k] = (lo.r * lo.r + lo.i * lo.i) * scale_;
+      power[half - k] = (hi.r * hi.r + hi.i * hi.i) * scale_;
+    }
+  }
+
+ private:
+  int64_t n_fft_;
+  std::vector<float> window_;
+  FftPlan plan_;
+  std::vector<Complex> split_twiddles_;
+  float scale_;
+};
+
+/// Triangular mel filters of `transforms.F2M`, stored as the range of
+/// frequency bins each one covers and its weights there.
+class MelFilterBank {
+ public:
+  /// `key` holds the number of mel bins, number of frequency bins, `f_min`
+  /// and `f_max`.
+  explicit MelFilterBank(
+      const std::tuple<int64_t, int64_t, double, double>& key) {
+    int64_t n_mels, n_stft;
+    double f_min, f_max;
+    std::tie(n_mels, n_stft, f_min, f_max) = key;
+    const auto hertz_to_mel = [](double f) {
+      return 2595. * std::log10(1. + f / 700.);
+    };
+    const double m_min = f_min == 0 ? 0. : hertz_to_mel(f_min);
+    const double m_max = hertz_to_mel(f_max);
+    std::vector<double> f_pts(n_mels + 2);
+    for (int64_t i = 0; i < n_mels + 2; ++i) {
+      const double mel = m_min + (m_max - m_min) * i / (n_mels + 1);
+      f_pts[i] = 700. * (std::pow(10., mel / 2595.) - 1.);
+    }
+    // the frequency of bin k is linearly spaced from f_min to f_max, as F2M
+    // assumes
+    for (int64_t m = 0; m < n_mels; ++m) {
+      Filter filter;
+      filter.begin = n_stft;
+      for (int64_t k = 0; k < n_stft; ++k) {
+        const double freq = n_stft == 1
+            ? f_min
+            : f_min + (f_max - f_min) * k / (n_stft - 1);
+        const double down = (freq - f_pts[m]) / (f_pts[m + 1] - f_pts[m]);
+        const double up = (f_pts[m + 2] - freq) / (f_pts[m + 2] - f_pts[m + 1]);
+        const double w = std::max(0., std::min(down, up));
+        if (w > 0) {
+          if (filter.weights.empty()) {
+            filter.begin = k;
+          }
+          filter.weights.resize(k - filter.begin + 1, 0.f);
+          filter.weights.back() = static_cast<float>(w);
+        }
+      }
+      filters_.push_back(std::move(filter));
+    }
+  }
+
+  int64_t size() const {
+    return filters_.size();
+  }
+
+  void apply(const float* power, float* dst) const {
+    for (const Filter& filter : filters_) {
+      const float* p = power + filter.begin;
+      float sum = 0;
+      for (size_t k = 0; k < filter.weights.size(); ++k) {
+        sum += p[k] * filter.weights[k];
+      }
+      *dst++ = sum;
+    }
+  }
+
+ private:
+  struct Filter {
+    int64_t begin;
+    std::vector<float> weights;
+  };
+  std::vector<Filter> filters_;
+};
+
+FrameFeatures::FrameFeatures(const FeatureOptions& options, double sample_rate)
+    : log_(options.log) {
+  if (options.n_fft <= 0 || options.ws <= 0 || options.ws > options.n_fft ||
+      options.hop <= 0 || options.pad < 0 || options.n_mels < 0) {
+    throw std::runtime_error("Invalid feature options");
+  }
+  spectrum_ = cached<SpectrumPlan>(std::make_tuple(options.ws, options.n_fft));
+  size_ = spectrum_->num_bins();
+  if (options.n_mels > 0) {
+    const double f_max = options.f_max > 0
+        ? options.f_max
+        : static_cast<double>(static_cast<int64_t>(sample_rate) / 2);
+    mel_ = cached<MelFilterBank>(std::make_tuple(
+        options.n_mels, size_, options.f_min, f_max));
+    size_ = options.n_mels;
+  }
+  scratch_.resize(4 * options.n_fft + 2);
+  power_.resize(spectrum_->num_bins());
+}
+
+void FrameFeatures::compute(const float* frame, float* dst) {
+  if (mel_) {
+    spectrum_->power(frame, power_.data(), scratch_.data());
+    mel_->apply(power_.data(), dst);
+  } else {
+    spectrum_->power(frame, dst, scratch_.data());
+  }
+  if (log_) {
+    for (int64_t i = 0; i < size_; ++i) {
+      dst[i] = 10.f * std::log10(dst[i]);
+    }
+  }
+}
+
+FeatureStream::FeatureStream(
+    const FeatureOptions& options,
+    double sample_rate,
+    unsigned channels)
+    : options_(options),
+      features_(options, sample_rate),
+      history_(std::max(channels, 1u), std::vector<float>(options.pad, 0.f)) {}
+
+int64_t FeatureStream::num_frames(int64_t length) const {
+  const int64_t padded = length + 2 * options_.pad;
+  if (padded < options_.n_fft) {
+    return 0;
+  }
+  return (padded - options_.n_fft) / options_.hop + 1;
+}
+
+void FeatureStream::push(const float* src, int64_t frames) {
+  push(src, frames, history_.size(), 1);
+}
+
+void FeatureStream::push(
+    const float* src,
+    int64_t frames,
+    int64_t frame_stride,
+    int64_t channel_stride) {
+  const int64_t channels = history_.size();
+  for (int64_t c = 0; c < channels; ++c) {
+    std::vector<float>& history = history_[c];
+    const size_t size = history.size();
+    history.resize(size + frames);
+    const float* channel = src + c * channel_stride;
+    for (int64_t i = 0; i < frames; ++i) {
+      history[size + i] = channel[i * frame_stride];
+    }
+  }
+}
+
+void FeatureStream::flush() {
+  if (flushed_) {
+    return;
+  }
+  for (std::vector<float>& history : history_) {
+    history.resize(history.size() + options_.pad, 0.f);
+  }
+  flushed_ = true;
+}
+
+int64_t FeatureStream::ready() const {
+  const int64_t size = history_[0].size();
+  if (position_ + options_.n_fft > size) {
+    return 0;
+  }
+  return (size - position_ - options_.n_fft) / options_.hop + 1;
+}
+
+void FeatureStream::reserve(int64_t frames) {
+  // what is left after a pull is less than a frame past the compaction
+  // threshold, so this bounds the history whatever the chunk sizes
+  const int64_t capacity = kCompactSamples + options_.n_fft + options_.hop +
+      std::max<int64_t>(frames, 0) + options_.pad;
+  for (std::vector<float>& history : history_) {
+    history.reserve(capacity);
+  }
+}
+
+void FeatureStream::reset() {
+  for (std::vector<float>& history : history_) {
+    history.assign(options_.pad, 0.f);
+  }
+  position_ = 0;
+  flushed_ = false;
+}
+
+int64_t FeatureStream::pull(
+    float* dst,
+    int64_t max_frames,
+    int64_t frame_stride,
+    int64_t channel_stride) {
+  const int64_t channels = history_.size();
+  const int64_t size = history_[0].size();
+  int64_t n = 0;
+  for (; n < max_frames && position_ + options_.n_fft <= size; ++n) {
+    for (int64_t c = 0; c < channels; ++c) {
+      features_.compute(
+          history_[c].data() + position_,
+          dst + n * frame_stride + c * channel_stride);
+    }
+    position_ += options_.hop;
+  }
+
+  const int64_t consumed = std::min(position_, size);
+  if (consumed >= kCompactSamples) {
+    for (std::vector<float>& history : history_) {
+      history.erase(history.begin(), history.begin() + consumed);
+    }
+    position_ -= consumed;
+  }
+  return n;
+}
+
+OnlineFeatureExtractor::OnlineFeatureExtractor(
+    const FeatureOptions& options,
+    double sample_rate,
+    unsigned channels,
+    int64_t max_chunk)
+    : stream_(options, sample_rate, channels),
+      channels_(std::max(channels, 1u)) {
+  stream_.reserve(max_chunk);
+}
+
+int64_t OnlineFeatureExtractor::accept(
+    const at::Tensor& chunk,
+    at::Tensor output,
+    bool ch_first) {
+  if (chunk.type().scalarType() != at::kFloat) {
+    throw std::runtime_error("Expected a float tensor of audio");
+  }
+  if (chunk.dim() == 1 && channels_ == 1) {
+    stream_.push(chunk.data<float>(), chunk.size(0), chunk.stride(0), 0);
+    return emit(output);
+  }
+  const int64_t frame_dim = ch_first ? 1 : 0;
+  if (chunk.dim() != 2 || chunk.size(1 - frame_dim) != channels_) {
+    throw std::runtime_error("Expected a chunk with the extractor's channels");
+  }
+  stream_.push(
+      chunk.data<float>(),
+      chunk.size(frame_dim),
+      chunk.stride(frame_dim),
+      chunk.stride(1 - frame_dim));
+  return emit(output);
+}
+
+int64_t OnlineFeatureExtractor::flush(at::Tensor output) {
+  stream_.flush();
+  return emit(output);
+}
+
+void OnlineFeatureExtractor::reset() {
+  stream_.reset();
+}
+
+int64_t OnlineFeatureExtractor::emit(at::Tensor& output) {
+  if (output.type().scalarType() != at::kFloat) {
+    throw std::runtime_error("Expected a float tensor for the features");
+  }
+  if (!output.is_contiguous()) {
+    output.resize_({0});
+  }
+  // shrinking keeps the storage, so a reused output is only ever
+  // reallocated by a chunk with more frames than the ones before
+  const int64_t frames = stream_.ready();
+  const int64_t size = stream_.num_features();
+  output.resize_({channels_, frames, size});
+  return stream_.pull(output.data<float>(), frames, size, frames * size);
+}
+
+int64_t extract_features(
+    const FeatureOptions& options,
+    const sox_signalinfo_t& signal,
+    const SampleReader& read,
+    at::Tensor output,
+    double normalization) {
+  const int64_t channels = std::max(signal.channels, 1u);
+  FeatureStream stream(options, signal.rate, channels);
+  const int64_t size = stream.num_features();
+
+  // the header length only sizes the first allocation (it is an estimate
+  // for e.g. mp3), the frames dimension grows as needed
+  int64_t capacity = std::max<int64_t>(
+      stream.num_frames(signal.length / channels), 16);
+  if (!output.is_contiguous()) {
+    output.resize_({0});
+  }
+  output.resize_({channels, capacity, size});
+  int64_t frames = 0;
+  const auto relayout = [&](int64_t new_capacity) {
+    if (channels == 1) {
+      // the frames are a prefix of the storage either way
+      output.resize_({1, new_capacity, size});
+      return;
+    }
+    at::Tensor kept = output.narrow(1, 0, frames).clone();
+    output.resize_({channels, new_capacity, size});
+    output.narrow(1, 0, frames).copy_(kept);
+  };
+  const auto drain = [&] {
+    for (;;) {
+      if (frames == capacity) {
+        capacity *= 2;
+        relayout(capacity);
+      }
+      const int64_t n = stream.pull(
+          output.data<float>() + frames * size,
+          capacity - frames,
+          size,
+          capacity * size);
+      if (n == 0) {
+        break;
+      }
+      frames += n;
+    }
+  };
+
+  sox_sample_t samples[kDecodeChunkSize];
+  float staging[kDecodeChunkSize];
+  const size_t chunk = kDecodeChunkSize / channels * channels;
+  for (;;) {
+    size_t n = read(samples, chunk);
+    n -= n % channels;
+    if (n == 0) {
+      break;
+    }
+    convert_samples(samples, staging, n, normalization);
+    stream.push(staging, n / channels);
+    drain();
+  }
+  stream.flush();
+  drain();
+  if (frames != capacity) {
+    relayout(frames);
+  }
+
+  if (options.log) {
+    // decibels relative to the maximum over all channels, like SPEC2DB
+    float* data = output.data<float>();
+    const int64_t numel = channels * frames * size;
+    const float reference =
+        numel > 0 ? *std::max_element(data, data + numel) : 0.f;
+    const float floor = -std::abs(static_cast<float>(options.top_db));
+    for (int64_t i = 0; i < numel; ++i) {
+      data[i] = std::max(data[i] - reference, floor);
+    }
+  }
+  return frames;
+}
+
+} // namespace audio
+} // namespace torch
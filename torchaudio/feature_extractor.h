@@ -0,0 +1,181 @@
+#pragma once
+
+#include <sox.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace at {
+struct Tensor;
+} // namespace at
+
+namespace torch {
+namespace audio {
+
+/// Parameters of the features, named and with the defaults of
+/// `transforms.MEL2` (`SPECTROGRAM`, `F2M` and `SPEC2DB`).
+struct FeatureOptions {
+  /// Length of the periodic Hann window, centred in the FFT frame.
+  int64_t ws = 400;
+  int64_t hop = 200;
+  int64_t n_fft = 400;
+  /// Number of zeros added to both ends of the signal.
+  int64_t pad = 0;
+  /// Number of mel bins, 0 for the power spectrogram.
+  int64_t n_mels = 40;
+  double f_min = 0;
+  /// Upper edge of the mel filters, 0 for half the sample rate.
+  double f_max = 0;
+  /// Decibels relative to the maximum (see `SPEC2DB`) instead of power.
+  bool log = true;
+  /// Floor of the decibels, below the maximum; -inf for none.
+  double top_db = -80;
+};
+
+class SpectrumPlan;
+class MelFilterBank;
+
+/// Features of single frames: windowed FFT, power, mel filters and log. The
+/// window, FFT plan and filter bank are cached and shared between instances
+/// with the same parameters; only the scratch buffers are per instance.
+class FrameFeatures {
+ public:
+  FrameFeatures(const FeatureOptions& options, double sample_rate);
+
+  /// Features per frame.
+  int64_t size() const {
+    return size_;
+  }
+
+  /// Computes the features of the `n_fft` samples at `frame` into `dst`. Log
+  /// features are `10 log10` of the power, not yet relative to the maximum.
+  void compute(const float* frame, float* dst);
+
+ private:
+  std::shared_ptr<const SpectrumPlan> spectrum_;
+  std::shared_ptr<const MelFilterBank> mel_;
+  bool log_;
+  int64_t size_;
+  std::vector<float> scratch_;
+  std::vector<float> power_;
+};
+
+/// Cuts interleaved audio into padded, overlapping frames per channel and
+/// computes their features as the samples arrive. Only the samples of
+/// frames that are not complete yet are kept, so the features of a signal
+/// are the same however it is split up.
+class FeatureStream {
+ public:
+  FeatureStream(
+      const FeatureOptions& options,
+      double sample_rate,
+      unsigned channels);
+
+  int64_t num_features() const {
+    return features_.size();
+  }
+
+  /// Number of frames of a signal of `length` frames.
+  int64_t num_frames(int64_t length) const;
+
+  /// Queues `frames` interleaved frames.
+  void push(const float* src, int64_t frames);
+
+  /// Queues `frames` frames; sample `c` of frame `t` is at
+  /// `src + t * frame_stride + c * channel_stride`.
+  void push(
+      const float* src,
+      int64_t frames,
+      int64_t frame_stride,
+      int64_t channel_stride);
+
+  /// Marks the end of the input, adding the padding at the end.
+  void flush();
+
+  /// Number of frames the next `pull` computes at most.
+  int64_t ready() const;
+
+  /// Reserves the buffers for pushes of up to `frames` frames between pulls,
+  /// after which pushing and pulling never allocate.
+  void reserve(int64_t frames);
+
+  /// Drops the queued samples and starts a new signal.
+  void reset();
+
+  /// Computes up to `max_frames` feature frames; the features of frame `t`
+  /// of channel `c` go to `dst + t * frame_stride + c * channel_stride`.
+  /// Returns the number of frames, 0 if more input is needed.
+  int64_t pull(
+      float* dst,
+      int64_t max_frames,
+      int64_t frame_stride,
+      int64_t channel_stride);
+
+ private:
+  FeatureOptions options_;
+  FrameFeatures features_;
+  std::vector<std::vector<float>> history_;
+  int64_t position_ = 0;
+  bool flushed_ = false;
+};
+
+/// Features of a live signal that arrives in chunks of any length, e.g.
+/// packets of a recognizer. The overlap of the frames, the FFT plan and the
+/// filter bank are kept between chunks and every call emits only the frames
+/// completed by its chunk, bit for bit the same as the frames of the whole
+/// signal. Log features are `10 log10` of the power: the offline features
+/// are relative to a maximum that is only known at the end. Once reserved
+/// for chunks of up to `max_chunk` frames, nothing is allocated per chunk.
+/// Not safe to share between threads.
+class OnlineFeatureExtractor {
+ public:
+  OnlineFeatureExtractor(
+      const FeatureOptions& options,
+      double sample_rate,
+      unsigned channels,
+      int64_t max_chunk);
+
+  int64_t num_features() const {
+    return stream_.num_features();
+  }
+
+  int64_t num_channels() const {
+    return channels_;
+  }
+
+  /// Queues the float tensor `chunk` (`C x L` if `ch_first`, else `L x C`,
+  /// or `L` for mono) and writes the frames it completes into the float
+  /// tensor `output`, resized to `C x N x F`. Returns `N`.
+  int64_t accept(const at::Tensor& chunk, at::Tensor output, bool ch_first);
+
+  /// Ends the signal like `accept`, writing the frames of the end padding.
+  int64_t flush(at::Tensor output);
+
+  /// Starts a new signal with the same options.
+  void reset();
+
+ private:
+  int64_t emit(at::Tensor& output);
+
+  FeatureStream stream_;
+  int64_t channels_;
+};
+
+/// Reads up to the given number of interleaved samples, 0 at the end.
+using SampleReader = std::function<size_t(sox_sample_t*, size_t)>;
+
+/// Decodes a signal with `read` in chunks, divided by `normalization`, and
+/// writes its features into the float tensor `output` as `C x L x F` like
+/// `transforms.MEL2` does. Neither the waveform nor the spectrogram is ever
+/// held in full. Returns the number of frames.
+int64_t extract_features(
+    const FeatureOptions& options,
+    const sox_signalinfo_t& signal,
+    const SampleReader& read,
+    at::Tensor output,
+    double normalization);
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,182 @@
+#include <sox.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "header_info.h"
+#include "wav_reader.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+/// Enough for the STREAMINFO block of a FLAC file and for the first frame
+/// of an MP3 file, with its Xing header.
+constexpr size_t kHeaderSize = 4096;
+
+/// What libsox reports for decoded MP3 samples.
+constexpr unsigned kMp3Precision = 24;
+
+uint32_t be32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) << 24 |
+      static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 |
+      static_cast<uint32_t>(p[3]);
+}
+
+/// File descriptor closed when it goes out of scope.
+struct File {
+  explicit File(const std::string& file_name)
+      : fd(open(file_name.c_str(), O_RDONLY | O_CLOEXEC)) {}
+  File(const File& other) = delete;
+  File& operator=(const File& other) = delete;
+  ~File() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  /// Reads up to `kHeaderSize` bytes at `offset`, returns how many.
+  size_t read_header(uint64_t offset, uint8_t* header) const {
+    const ssize_t n = pread(fd, header, kHeaderSize, offset);
+    return n > 0 ? n : 0;
+  }
+
+  int fd;
+};
+
+/// The STREAMINFO block, which must come first, right after "fLaC".
+bool parse_flac(const uint8_t* p, size_t size, sox_signalinfo_t* signal) {
+  if (size < 8 + 34 || (p[4] & 0x7F) != 0) {
+    return false;
+  }
+  const uint8_t* info = p + 8;
+  const uint32_t rate = static_cast<uint32_t>(info[10]) << 12 |
+      static_cast<uint32_t>(info[11]) << 4 | info[12] >> 4;
+  const unsigned channels = ((info[12] >> 1) & 0x7) + 1;
+  const unsigned bits = ((info[12] & 0x1) << 4 | info[13] >> 4) + 1;
+  const uint64_t frames =
+      static_cast<uint64_t>(info[13] & 0xF) << 32 | be32(info + 14);
+  if (rate == 0) {
+    return false;
+  }
+  signal->rate = rate;
+  signal->channels = channels;
+  signal->precision = bits;
+  // 0 when the encoder did not know the length, as libsox reports it
+  signal->length = frames * channels;
+  return true;
+}
+
+/// Size of an ID3v2 tag at `p`, 0 if there is none.
+uint64_t id3v2_size(const uint8_t* p, size_t size) {
+  if (size < 10 || std::memcmp(p, "ID3", 3) != 0) {
+    return 0;
+  }
+  // syncsafe integer, plus the header and the optional footer
+  const uint64_t body = static_cast<uint64_t>(p[6] & 0x7F) << 21 |
+      static_cast<uint64_t>(p[7] & 0x7F) << 14 | (p[8] & 0x7F) << 7 |
+      (p[9] & 0x7F);
+  return 10 + body + ((p[5] & 0x10) ? 10 : 0);
+}
+
+/// Whether the ID3v2 tag of `tag_size` bytes at the start of `file` holds a
+/// TLEN frame, whose length libsox reports instead of its own.
+bool id3v2_has_tlen(const File& file, const uint8_t* tag, uint64_t tag_size) {
+  const unsigned version = tag[3];
+  if (version < 3 || (tag[5] & 0x40)) {
+    // assume the worst for old tags and tags with an extended header
+    return true;
+  }
+  uint8_t frame[10];
+  for (uint64_t pos = 10; pos + 10 <= tag_size;) {
+    if (pread(file.fd, frame, 10, pos) != 10 || frame[0] == 0) {
+      break;
+    }
+    if (std::memcmp(frame, "TLEN", 4) == 0) {
+      return true;
+    }
+    // frame sizes are syncsafe from version 4 on
+    const uint64_t size = version >= 4
+        ? static_cast<uint64_t>(frame[4] & 0x7F) << 21 |
+            static_cast<uint64_t>(frame[5] & 0x7F) << 14 |
+            (frame[6] & 0x7F) << 7 | (frame[7] & 0x7F)
+        : be32(frame + 4);
+    pos += 10 + size;
+  }
+  return false;
+}
+
+/// The first frame of an MPEG layer III stream, if it is a Xing frame that
+/// counts the frames of the stream. The length is computed like libsox does:
+/// whole milliseconds, converted back to samples.
+bool parse_mp3(const uint8_t* p, size_t size, sox_signalinfo_t* signal) {
+  if (size < 4 || p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+    return false;
+  }
+  // 3 is MPEG-1, 2 MPEG-2 and 0 MPEG-2.5; layer 1 is layer III
+  const unsigned version = (p[1] >> 3) & 0x3;
+  const unsigned layer = (p[1] >> 1) & 0x3;
+  const unsigned rate_index = (p[2] >> 2) & 0x3;
+  if (version == 1 || layer != 1 || rate_index == 3 || (p[2] >> 4) == 0xF) {
+    return false;
+  }
+  static const uint32_t kRates[] = {44100, 48000, 32000};
+  const bool mpeg1 = version == 3;
+  const bool mono = (p[3] >> 6) == 3;
+  const unsigned rate_shift = mpeg1 ? 0 : version == 2 ? 1 : 2;
+  const uint32_t rate = kRates[rate_index] >> rate_shift;
+  const uint64_t samples_per_frame = mpeg1 ? 1152 : 576;
+
+  // the Xing header follows the side information; libsox ignores the Info
+  // header of constant bitrate files and VBRI headers
+  const size_t xing = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+  if (size < xing + 12 || std::memcmp(p + xing, "Xing", 4) != 0 ||
+      (be32(p + xing + 4) & 0x1) == 0) {
+    return false;
+  }
+  const uint64_t frames = be32(p + xing + 8);
+  const uint64_t milliseconds = frames * samples_per_frame * 1000 / rate;
+  signal->rate = rate;
+  signal->channels = mono ? 1 : 2;
+  signal->precision = kMp3Precision;
+  signal->length =
+      static_cast<uint64_t>(milliseconds * .001 * rate + .5) * signal->channels;
+  return true;
+}
+
+} // namespace
+
+bool read_header_info(const std::string& file_name, sox_signalinfo_t* signal) {
+  File file(file_name);
+  if (file.fd < 0) {
+    return false;
+  }
+  uint8_t header[kHeaderSize];
+  size_t size = file.read_header(0, header);
+  if (size >= 12 && std::memcmp(header, "RIFF", 4) == 0) {
+    // mapping is lazy, only the pages of the header are read
+    auto mapped = MappedPcmFile::open_wav(file_name);
+    if (mapped == nullptr) {
+      return false;
+    }
+    *signal = mapped->signal();
+    return true;
+  }
+  if (size >= 4 && std::memcmp(header, "fLaC", 4) == 0) {
+    return parse_flac(header, size, signal);
+  }
+  if (const uint64_t tag_size = id3v2_size(header, size)) {
+    if (id3v2_has_tlen(file, header, tag_size)) {
+      return false;
+    }
+    size = file.read_header(tag_size, header);
+  }
+  return parse_mp3(header, size, signal);
+}
+
+} // namespace audio
+} // namespace torch
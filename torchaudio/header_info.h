@@ -0,0 +1,20 @@
+#pragma once
+
+#include <sox.h>
+
+#include <string>
+
+namespace torch {
+namespace audio {
+
+/// Fills `signal` with the rate, channels, precision and length in samples
+/// of `file_name` from its header alone, without a libsox handle: WAVE
+/// files with PCM or float samples, FLAC files with their STREAMINFO block
+/// and MP3 files that start (after an ID3v2 tag without a length) with a
+/// Xing frame, with the values libsox reports for them. Returns false for
+/// anything else, including files that cannot be read, so that the caller
+/// can fall back to libsox and its error reporting.
+bool read_header_info(const std::string& file_name, sox_signalinfo_t* signal);
+
+} // namespace audio
+} // namespace torch
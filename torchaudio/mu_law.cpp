@@ -0,0 +1,164 @@
+#include <torch/extension.h>
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "mu_law.h"
+#include "stats.h"
+
+namespace torch {
+namespace audio {
+
+constexpr int MuLawTables::kBucketBits;
+
+MuLawTables::MuLawTables(int64_t quantization_channels)
+    : codes_(quantization_channels), values_(quantization_channels) {
+  for (int64_t code = 0; code < codes_; ++code) {
+    values_[code] = detail::mu_law_decode_value(code, codes_);
+  }
+  if (codes_ > kMuLawTableCodes) {
+    return;
+  }
+
+  // the first sample of every code but 0, where it starts
+  std::vector<int64_t> starts;
+  for (int64_t code = 1; code < codes_; ++code) {
+    const double boundary =
+        detail::mu_law_decode_value(code - 0.5, codes_) * 2147483648.;
+    starts.push_back(std::min<int64_t>(
+        std::max<int64_t>(std::ceil(boundary), SOX_SAMPLE_MIN),
+        static_cast<int64_t>(SOX_SAMPLE_MAX) + 1));
+  }
+
+  const int64_t buckets = int64_t(1) << kBucketBits;
+  const int64_t width = int64_t(1) << (32 - kBucketBits);
+  base_.resize(buckets);
+  change_.resize(buckets, SOX_SAMPLE_MAX);
+  size_t next = 0;
+  for (int64_t bucket = 0; bucket < buckets; ++bucket) {
+    const int64_t first = bucket * width + SOX_SAMPLE_MIN;
+    while (next < starts.size() && starts[next] <= first) {
+      ++next;
+    }
+    base_[bucket] = static_cast<uint8_t>(next);
+    if (next < starts.size() && starts[next] < first + width) {
+      if (next + 1 < starts.size() && starts[next + 1] < first + width) {
+        // codes too narrow for the buckets, encoded with the formula
+        base_.clear();
+        change_.clear();
+        return;
+      }
+      change_[bucket] = static_cast<sox_sample_t>(starts[next]);
+    }
+  }
+}
+
+std::shared_ptr<const MuLawTables> MuLawTables::get(
+    int64_t quantization_channels) {
+  if (quantization_channels < 2 ||
+      quantization_channels > kMuLawDecodeTableCodes) {
+    return nullptr;
+  }
+  // the tables are built once per number of codes and shared by all threads
+  static std::mutex mutex;
+  static std::map<int64_t, std::shared_ptr<const MuLawTables>> tables;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& entry = tables[quantization_channels];
+  if (!entry) {
+    entry.reset(new MuLawTables(quantization_channels));
+  }
+  return entry;
+}
+
+namespace {
+
+void check_quantization_channels(int64_t quantization_channels) {
+  if (quantization_channels < 2) {
+    throw std::runtime_error("Expected at least 2 quantization channels");
+  }
+}
+
+/// Resizes `output` like `input`, contiguous.
+void resize_like(at::Tensor& output, const at::Tensor& input) {
+  if (!output.is_contiguous()) {
+    output.resize_({0});
+  }
+  output.resize_(input.sizes());
+}
+
+} // namespace
+
+void check_code_type(const at::Tensor& codes, int64_t quantization_channels) {
+  bool holds = true;
+  AT_DISPATCH_ALL_TYPES(codes.type(), "check_code_type", [&] {
+    // the largest integer up to which every integer is held
+    const int digits = std::numeric_limits<scalar_t>::digits;
+    const double largest = std::is_integral<scalar_t>::value
+        ? std::ldexp(1., digits) - 1
+        : std::ldexp(1., digits);
+    holds = quantization_channels - 1 <= largest;
+  });
+  if (!holds) {
+    throw std::runtime_error(
+        "Expected a tensor type that holds " +
+        std::to_string(quantization_channels) + " mu-law codes");
+  }
+}
+
+void mu_law_encode(
+    const at::Tensor& input,
+    at::Tensor output,
+    int64_t quantization_channels) {
+  check_quantization_channels(quantization_channels);
+  check_code_type(output, quantization_channels);
+  const at::Tensor values = input.contiguous();
+  resize_like(output, values);
+  const auto tables = MuLawTables::get(quantization_channels);
+  StageTimer timer(Stage::kConvert);
+  AT_DISPATCH_FLOATING_TYPES(values.type(), "mu_law_encode", [&] {
+    using value_t = scalar_t;
+    const value_t* src = values.data<value_t>();
+    AT_DISPATCH_ALL_TYPES(output.type(), "mu_law_encode_codes", [&] {
+      mu_law_encode(
+          src,
+          output.data<scalar_t>(),
+          values.numel(),
+          tables.get(),
+          quantization_channels);
+    });
+  });
+}
+
+void mu_law_decode(
+    const at::Tensor& input,
+    at::Tensor output,
+    int64_t quantization_channels) {
+  check_quantization_channels(quantization_channels);
+  const at::Tensor codes = input.contiguous();
+  resize_like(output, codes);
+  const auto tables = MuLawTables::get(quantization_channels);
+  StageTimer timer(Stage::kConvert);
+  AT_DISPATCH_ALL_TYPES(codes.type(), "mu_law_decode", [&] {
+    using code_t = scalar_t;
+    const code_t* src = codes.data<code_t>();
+    AT_DISPATCH_FLOATING_TYPES(output.type(), "mu_law_decode_values", [&] {
+      mu_law_decode(
+          src,
+          output.data<scalar_t>(),
+          codes.numel(),
+          tables.get(),
+          quantization_channels);
+    });
+  });
+}
+
+} // namespace audio
+} // namespace torch
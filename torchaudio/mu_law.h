@@ -0,0 +1,239 @@
+#pragma once
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace at {
+struct Tensor;
+} // namespace at
+
+namespace torch {
+namespace audio {
+
+/// Most codes (8 bits) that mu-law encoding looks up in tables; more are
+/// encoded with the formula.
+constexpr int64_t kMuLawTableCodes = 256;
+
+/// Most codes (16 bits) that mu-law decoding looks up in a table.
+constexpr int64_t kMuLawDecodeTableCodes = 1 << 16;
+
+namespace detail {
+
+/// Encodes a value in [-1, 1] with the formula, in double precision; values
+/// out of range, and NaNs, are saturated.
+inline int64_t mu_law_encode_value(double x, int64_t quantization_channels) {
+  const double mu = quantization_channels - 1.;
+  x = x <= 1. ? (x >= -1. ? x : -1.) : 1.;
+  const double companded =
+      std::copysign(std::log1p(mu * std::abs(x)) / std::log1p(mu), x);
+  const double code = std::floor((companded + 1) / 2 * mu + 0.5);
+  return std::min<int64_t>(std::max<int64_t>(code, 0), mu);
+}
+
+inline double mu_law_decode_value(double code, int64_t quantization_channels) {
+  const double mu = quantization_channels - 1.;
+  const double companded = code / mu * 2 - 1;
+  return std::copysign(
+      std::expm1(std::abs(companded) * std::log1p(mu)) / mu, companded);
+}
+
+/// The SoX sample of a value, `floor(x * 2^31)` saturated to 32 bits.
+inline sox_sample_t to_mu_law_sample(double x) {
+  const double scaled = std::floor(x * 2147483648.);
+  return !(scaled < SOX_SAMPLE_MAX)
+      ? SOX_SAMPLE_MAX
+      : scaled <= SOX_SAMPLE_MIN ? SOX_SAMPLE_MIN
+                                 : static_cast<sox_sample_t>(scaled);
+}
+
+} // namespace detail
+
+/// The tables of mu-law companding with `quantization_channels` codes, i.e.
+/// `mu = quantization_channels - 1`. A value `x` in [-1, 1] is encoded into
+/// the code `floor((f(x) + 1) / 2 * mu + 0.5)`, with
+/// `f(x) = sign(x) * log1p(mu * |x|) / log1p(mu)`, like
+/// `transforms.MuLawEncoding`; codes are decoded into
+/// `f^-1(code / mu * 2 - 1)`.
+///
+/// Encoding goes through SoX samples: the code of a sample is that of the
+/// formula. It is constant within most runs of `2^(32 - kBucketBits)`
+/// samples, and changes at most once within the others; one table holds the
+/// code at the start of every run, the other the sample at which it changes,
+/// if it does. Values between two samples of different codes, which the
+/// table cannot tell apart, are encoded with the formula.
+class MuLawTables {
+ public:
+  static constexpr int kBucketBits = 14;
+
+  /// Returns the (shared, cached) tables for `quantization_channels` codes,
+  /// or null if there are more than `kMuLawDecodeTableCodes` or fewer than 2.
+  static std::shared_ptr<const MuLawTables> get(int64_t quantization_channels);
+
+  int64_t codes() const {
+    return codes_;
+  }
+
+  /// Whether `encode` may be used, i.e. there are at most `kMuLawTableCodes`
+  /// codes.
+  bool can_encode() const {
+    return !base_.empty();
+  }
+
+  int64_t encode(sox_sample_t sample) const {
+    const uint32_t bucket =
+        (static_cast<uint32_t>(sample) ^ 0x80000000u) >> (32 - kBucketBits);
+    // runs without a change hold the largest sample, only reached by the
+    // last run, which has the last code
+    return std::min<int64_t>(
+        base_[bucket] + (sample >= change_[bucket]), codes_ - 1);
+  }
+
+  /// Encodes a value `x` whose SoX sample `floor(x * 2^31)` is `sample`, with
+  /// the formula if it lies strictly between two samples of different codes.
+  int64_t encode(double x, sox_sample_t sample) const {
+    const int64_t code = encode(sample);
+    if (sample == SOX_SAMPLE_MAX || x * 2147483648. == sample ||
+        encode(sample + 1) == code) {
+      return code;
+    }
+    return detail::mu_law_encode_value(x, codes_);
+  }
+
+  /// The value of a code in [0, codes()).
+  double decode(int64_t code) const {
+    return values_[code];
+  }
+
+ private:
+  explicit MuLawTables(int64_t quantization_channels);
+
+  int64_t codes_;
+  std::vector<uint8_t> base_;
+  std::vector<sox_sample_t> change_;
+  std::vector<double> values_;
+};
+
+/// Mu-law encodes `n` SoX samples into codes, e.g. a chunk fresh from
+/// `sox_read`, scaled like `load` normalizes them.
+template <typename code_t>
+void mu_law_encode_samples(
+    const sox_sample_t* src,
+    code_t* dst,
+    int64_t n,
+    const MuLawTables* tables,
+    int64_t quantization_channels) {
+  if (tables != nullptr && tables->can_encode()) {
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<code_t>(tables->encode(src[i]));
+    }
+    return;
+  }
+  for (int64_t i = 0; i < n; ++i) {
+    dst[i] = static_cast<code_t>(detail::mu_law_encode_value(
+        src[i] / 2147483648., quantization_channels));
+  }
+}
+
+/// Mu-law encodes `n` values in [-1, 1] into codes, exactly like the
+/// formula. With tables, the values are turned into SoX samples four at a
+/// time, then looked up.
+template <typename scalar_t, typename code_t>
+void mu_law_encode(
+    const scalar_t* src,
+    code_t* dst,
+    int64_t n,
+    const MuLawTables* tables,
+    int64_t quantization_channels) {
+  if (tables == nullptr || !tables->can_encode()) {
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<code_t>(
+          detail::mu_law_encode_value(src[i], quantization_channels));
+    }
+    return;
+  }
+  int64_t i = 0;
+#ifdef __SSE2__
+  if (std::is_same<scalar_t, float>::value) {
+    const float* x = reinterpret_cast<const float*>(src);
+    // the largest float below 2^31, and floor(-1 * 2^31)
+    const __m128 high = _mm_set1_ps(2147483520.f);
+    const __m128 low = _mm_set1_ps(-2147483648.f);
+    alignas(16) sox_sample_t samples[4];
+    for (; i + 4 <= n; i += 4) {
+      // scaling by a power of two is exact; NaNs become the highest sample
+      const __m128 scaled = _mm_max_ps(
+          _mm_min_ps(
+              _mm_mul_ps(_mm_loadu_ps(x + i), _mm_set1_ps(2147483648.f)),
+              high),
+          low);
+      // truncation, then one less where that rounded a negative value up
+      const __m128i truncated = _mm_cvttps_epi32(scaled);
+      const __m128 rounded_up =
+          _mm_cmplt_ps(scaled, _mm_cvtepi32_ps(truncated));
+      _mm_store_si128(
+          reinterpret_cast<__m128i*>(samples),
+          _mm_add_epi32(truncated, _mm_castps_si128(rounded_up)));
+      dst[i] = static_cast<code_t>(tables->encode(x[i], samples[0]));
+      dst[i + 1] = static_cast<code_t>(tables->encode(x[i + 1], samples[1]));
+      dst[i + 2] = static_cast<code_t>(tables->encode(x[i + 2], samples[2]));
+      dst[i + 3] = static_cast<code_t>(tables->encode(x[i + 3], samples[3]));
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    dst[i] = static_cast<code_t>(
+        tables->encode(src[i], detail::to_mu_law_sample(src[i])));
+  }
+}
+
+/// Decodes `n` mu-law codes into values in [-1, 1]. Integral codes in range
+/// are looked up in the table; others are decoded with the formula.
+template <typename code_t, typename scalar_t>
+void mu_law_decode(
+    const code_t* src,
+    scalar_t* dst,
+    int64_t n,
+    const MuLawTables* tables,
+    int64_t quantization_channels) {
+  const int64_t codes = tables != nullptr ? tables->codes() : 0;
+  for (int64_t i = 0; i < n; ++i) {
+    const code_t code = src[i];
+    const bool in_table = code >= 0 && code < codes &&
+        static_cast<code_t>(static_cast<int64_t>(code)) == code;
+    dst[i] = static_cast<scalar_t>(
+        in_table ? tables->decode(static_cast<int64_t>(code))
+                 : detail::mu_law_decode_value(code, quantization_channels));
+  }
+}
+
+/// Mu-law encodes `input`, values in [-1, 1] of a floating point type, into
+/// `output`, resized to the sizes of `input` and contiguous, of any type
+/// that holds every code. Throws otherwise.
+void mu_law_encode(
+    const at::Tensor& input,
+    at::Tensor output,
+    int64_t quantization_channels);
+
+/// Throws unless the type of `codes` holds every one of
+/// `quantization_channels` codes, e.g. 256 codes in a `CharTensor`.
+void check_code_type(const at::Tensor& codes, int64_t quantization_channels);
+
+/// Decodes mu-law codes in `input`, of any type, into `output`, resized to
+/// the sizes of `input` and contiguous, of a floating point type.
+void mu_law_decode(
+    const at::Tensor& input,
+    at::Tensor output,
+    int64_t quantization_channels);
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,409 @@
+#include <torch/extension.h>
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "resample.h"
+#include "sample_conversion.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+/// Filter design: zero crossings of the sinc on either side of the centre,
+/// pass band edge relative to the lower of the two Nyquist frequencies, and
+/// the Kaiser window shape (about 90 dB of stop band attenuation).
+constexpr double kZeroCrossings = 32;
+constexpr double kRolloff = 0.9;
+constexpr double kKaiserBeta = 9.;
+
+/// Ratios with more phases than this are left to the SoX rate effect.
+constexpr int64_t kMaxPhases = 1024;
+
+/// Input samples that are no longer needed are only dropped from the
+/// history in batches of at least this many, to keep the moves cheap.
+constexpr int64_t kCompactFrames = 4096;
+
+int64_t gcd(int64_t a, int64_t b) {
+  while (b != 0) {
+    const int64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/// Zeroth order modified Bessel function of the first kind.
+double bessel_i0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 64 && term > sum * 1e-17; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+float dot(const float* w, const float* x, int64_t n) {
+#ifdef __SSE2__
+  // `n` is a multiple of 4
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_add_ps(
+        acc0, _mm_mul_ps(_mm_loadu_ps(w + i), _mm_loadu_ps(x + i)));
+    acc1 = _mm_add_ps(
+        acc1, _mm_mul_ps(_mm_loadu_ps(w + i + 4), _mm_loadu_ps(x + i + 4)));
+  }
+  if (i < n) {
+    acc0 = _mm_add_ps(
+        acc0, _mm_mul_ps(_mm_loadu_ps(w + i), _mm_loadu_ps(x + i)));
+  }
+  acc0 = _mm_add_ps(acc0, acc1);
+  acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+  acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+  return _mm_cvtss_f32(acc0);
+#else
+  float acc[4] = {0, 0, 0, 0};
+  for (int64_t i = 0; i < n; i += 4) {
+    for (int k = 0; k < 4; ++k) {
+      acc[k] += w[i + k] * x[i + k];
+    }
+  }
+  return (acc[0] + acc[2]) + (acc[1] + acc[3]);
+#endif
+}
+
+} // namespace
+
+PolyphaseFilterBank::PolyphaseFilterBank(int64_t up, int64_t down)
+    : up_(up), down_(down) {
+  // low-pass at the lower Nyquist frequency, in cycles per input sample
+  const double cutoff = 0.5 * kRolloff * std::min<double>(1, double(up) / down);
+  const double width = kZeroCrossings / (2 * cutoff);
+  half_ = static_cast<int64_t>(std::ceil(width));
+  taps_ = (2 * half_ + 3) / 4 * 4;
+  weights_.assign(up_ * taps_, 0.f);
+
+  const double i0_beta = bessel_i0(kKaiserBeta);
+  std::vector<double> phase(taps_);
+  for (int64_t p = 0; p < up_; ++p) {
+    // tap k multiplies the input sample k - half + 1 relative to the one at
+    // or left of the output position, which is p / up further right
+    double sum = 0;
+    for (int64_t k = 0; k < taps_; ++k) {
+      const double t = k - half_ + 1 - double(p) / up_;
+      double h = 0;
+      if (std::abs(t) < width) {
+        const double x = 2 * cutoff * t;
+        const double sinc = x == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+        const double r = t / width;
+        h = 2 * cutoff * sinc *
+            bessel_i0(kKaiserBeta * std::sqrt(1 - r * r)) / i0_beta;
+      }
+      phase[k] = h;
+      sum += h;
+    }
+    // unity gain at DC for every phase
+    for (int64_t k = 0; k < taps_; ++k) {
+      weights_[p * taps_ + k] = static_cast<float>(phase[k] / sum);
+    }
+  }
+}
+
+std::shared_ptr<const PolyphaseFilterBank> PolyphaseFilterBank::get(
+    double in_rate,
+    double out_rate) {
+  if (in_rate <= 0 || out_rate <= 0 || in_rate == out_rate ||
+      in_rate > 1e7 || out_rate > 1e7 || std::floor(in_rate) != in_rate ||
+      std::floor(out_rate) != out_rate) {
+    return nullptr;
+  }
+  const int64_t in = static_cast<int64_t>(in_rate);
+  const int64_t out = static_cast<int64_t>(out_rate);
+  const int64_t g = gcd(in, out);
+  const int64_t up = out / g;
+  const int64_t down = in / g;
+  if (up > kMaxPhases || down > kMaxPhases) {
+    return nullptr;
+  }
+
+  // the filter banks are built once per ratio and shared by all threads
+  static std::mutex mutex;
+  static std::map<std::pair<int64_t, int64_t>,
+                  std::shared_ptr<const PolyphaseFilterBank>>
+      banks;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& bank = banks[std::make_pair(up, down)];
+  if (!bank) {
+    bank.reset(new PolyphaseFilterBank(up, down));
+  }
+  return bank;
+}
+
+void PolyphaseFilterBank::compute(
+    const float* src,
+    int64_t src_offset,
+    int64_t first,
+    int64_t last,
+    float* dst,
+    int64_t stride) const {
+  for (int64_t j = first; j < last; ++j, dst += stride) {
+    const int64_t position = j * down_;
+    const float* w = weights_.data() + (position % up_) * taps_;
+    *dst = dot(w, src + position / up_ - src_offset, taps_);
+  }
+}
+
+PolyphaseResampler::PolyphaseResampler(
+    std::shared_ptr<const PolyphaseFilterBank> bank,
+    unsigned channels)
+    : bank_(std::move(bank)),
+      history_(std::max(channels, 1u),
+               std::vector<float>(bank_->half() - 1, 0.f)) {}
+
+void PolyphaseResampler::push(const float* src, int64_t frames) {
+  const int64_t channels = history_.size();
+  for (int64_t c = 0; c < channels; ++c) {
+    std::vector<float>& history = history_[c];
+    const size_t size = history.size();
+    history.resize(size + frames);
+    for (int64_t i = 0; i < frames; ++i) {
+      history[size + i] = src[i * channels + c];
+    }
+  }
+  frames_in_ += frames;
+}
+
+void PolyphaseResampler::flush() {
+  if (flushed_) {
+    return;
+  }
+  // enough zeros for the windows of the last output samples
+  for (std::vector<float>& history : history_) {
+    history.resize(history.size() + bank_->taps() - bank_->half() + 1, 0.f);
+  }
+  flushed_ = true;
+}
+
+int64_t PolyphaseResampler::pull(float* dst, int64_t max_frames) {
+  const int64_t channels = history_.size();
+  const int64_t up = bank_->up();
+  const int64_t down = bank_->down();
+  int64_t last = bank_->output_length(frames_in_);
+  if (!flushed_) {
+    // only the outputs whose whole window has been pushed
+    const int64_t last_base =
+        int64_t(history_[0].size()) + dropped_ - bank_->taps();
+    if (last_base < 0) {
+      return 0;
+    }
+    last = std::min(last, ((last_base + 1) * up - 1) / down + 1);
+  }
+  const int64_t n = std::min(last - frames_out_, max_frames);
+  if (n <= 0) {
+    return 0;
+  }
+  for (int64_t c = 0; c < channels; ++c) {
+    bank_->compute(
+        history_[c].data(),
+        dropped_,
+        frames_out_,
+        frames_out_ + n,
+        dst + c,
+        channels);
+  }
+  frames_out_ += n;
+
+  const int64_t next_base = frames_out_ * down / up;
+  if (next_base - dropped_ >= kCompactFrames) {
+    for (std::vector<float>& history : history_) {
+      history.erase(history.begin(), history.begin() + (next_base - dropped_));
+    }
+    dropped_ = next_base;
+  }
+  return n;
+}
+
+void resample(
+    const at::Tensor& input,
+    at::Tensor output,
+    double in_rate,
+    double out_rate,
+    bool ch_first) {
+  if (input.dim() != 1 && input.dim() != 2) {
+    throw std::runtime_error("Expected a 1D or 2D audio tensor");
+  }
+  if (in_rate == out_rate) {
+    output.resize_(input.sizes()).copy_(input);
+    return;
+  }
+  auto bank = PolyphaseFilterBank::get(in_rate, out_rate);
+  if (!bank) {
+    throw std::runtime_error("Unsupported resampling ratio");
+  }
+
+  // one contiguous row per channel
+  at::Tensor frames = input.dim() == 1
+      ? input.unsqueeze(0)
+      : ch_first ? input : input.transpose(0, 1);
+  frames = frames.to(at::kFloat).contiguous();
+  const int64_t channels = frames.size(0);
+  const int64_t length = frames.size(1);
+  const int64_t out_length = bank->output_length(length);
+  output.resize_({ch_first ? channels : out_length,
+                  ch_first ? out_length : channels});
+
+  // the input is zero padded on both sides for the windows at the edges
+  const int64_t front = bank->half() - 1;
+  std::vector<float> padded(length + bank->taps(), 0.f);
+  for (int64_t c = 0; c < channels; ++c) {
+    const float* src = frames.data<float>() + c * length;
+    std::copy(src, src + length, padded.begin() + front);
+    float* dst = output.data<float>() + (ch_first ? c * out_length : c);
+    bank->compute(
+        padded.data(), 0, 0, out_length, dst, ch_first ? 1 : channels);
+  }
+  if (input.dim() == 1) {
+    output.resize_({out_length});
+  }
+}
+
+namespace {
+
+struct PolyphaseRatePriv {
+  double out_rate;
+  PolyphaseResampler* resampler;
+};
+
+int polyphase_rate_getopts(sox_effect_t* effp, int argc, char** argv) {
+  if (argc != 2) {
+    return SOX_EOF;
+  }
+  char* end;
+  const double rate = std::strtod(argv[1], &end);
+  if (*end != '\0' || !(rate > 0)) {
+    return SOX_EOF;
+  }
+  auto* priv = static_cast<PolyphaseRatePriv*>(effp->priv);
+  priv->out_rate = rate;
+  effp->out_signal.rate = rate;
+  return SOX_SUCCESS;
+}
+
+int polyphase_rate_start(sox_effect_t* effp) {
+  auto* priv = static_cast<PolyphaseRatePriv*>(effp->priv);
+  if (effp->in_signal.rate == priv->out_rate) {
+    return SOX_EFF_NULL;
+  }
+  auto bank = PolyphaseFilterBank::get(effp->in_signal.rate, priv->out_rate);
+  if (!bank) {
+    return SOX_EOF;
+  }
+  delete priv->resampler;
+  priv->resampler = new PolyphaseResampler(bank, effp->in_signal.channels);
+  return SOX_SUCCESS;
+}
+
+/// Pulls up to `n` samples (whole frames) from the resampler into `dst`.
+size_t pull_samples(sox_effect_t* effp, sox_sample_t* dst, size_t n) {
+  auto* priv = static_cast<PolyphaseRatePriv*>(effp->priv);
+  const size_t channels = std::max(effp->in_signal.channels, 1u);
+  const int64_t chunk_frames = kDecodeChunkSize / channels;
+  float staging[kDecodeChunkSize];
+  size_t done = 0;
+  while (done + channels <= n) {
+    const int64_t frames = priv->resampler->pull(
+        staging, std::min<int64_t>(chunk_frames, (n - done) / channels));
+    if (frames == 0) {
+      break;
+    }
+    effp->clips += to_sox_samples(
+        staging, dst + done, frames * channels, SOX_SAMPLE_MAX + 1.);
+    done += frames * channels;
+  }
+  return done;
+}
+
+int polyphase_rate_flow(
+    sox_effect_t* effp,
+    const sox_sample_t* ibuf,
+    sox_sample_t* obuf,
+    size_t* isamp,
+    size_t* osamp) {
+  auto* priv = static_cast<PolyphaseRatePriv*>(effp->priv);
+  const size_t channels = std::max(effp->in_signal.channels, 1u);
+  // the output left over from the last input goes first, new input is only
+  // taken once that is all out so that the backlog stays bounded
+  size_t done = pull_samples(effp, obuf, *osamp);
+  if (done + channels > *osamp) {
+    *isamp = 0;
+    *osamp = done;
+    return SOX_SUCCESS;
+  }
+  const size_t n = *isamp - *isamp % channels;
+  const size_t chunk = kDecodeChunkSize / channels * channels;
+  float staging[kDecodeChunkSize];
+  for (size_t i = 0; i < n; i += chunk) {
+    const size_t m = std::min(chunk, n - i);
+    convert_samples(ibuf + i, staging, m, SOX_SAMPLE_MAX + 1.);
+    priv->resampler->push(staging, m / channels);
+  }
+  *isamp = n;
+  *osamp = done + pull_samples(effp, obuf + done, *osamp - done);
+  return SOX_SUCCESS;
+}
+
+int polyphase_rate_drain(
+    sox_effect_t* effp,
+    sox_sample_t* obuf,
+    size_t* osamp) {
+  auto* priv = static_cast<PolyphaseRatePriv*>(effp->priv);
+  priv->resampler->flush();
+  *osamp = pull_samples(effp, obuf, *osamp);
+  return *osamp > 0 ? SOX_SUCCESS : SOX_EOF;
+}
+
+int polyphase_rate_stop(sox_effect_t* effp) {
+  auto* priv = static_cast<PolyphaseRatePriv*>(effp->priv);
+  delete priv->resampler;
+  priv->resampler = nullptr;
+  return SOX_SUCCESS;
+}
+
+/// Frees the resampler of an effect that was started but never stopped,
+/// e.g. when a chain is deleted before it flowed.
+int polyphase_rate_kill(sox_effect_t* effp) {
+  return polyphase_rate_stop(effp);
+}
+
+} // namespace
+
+const sox_effect_handler_t* polyphase_rate_handler() {
+  static const sox_effect_handler_t handler = {
+      "polyphase_rate",
+      nullptr,
+      SOX_EFF_RATE | SOX_EFF_MCHAN,
+      polyphase_rate_getopts,
+      polyphase_rate_start,
+      polyphase_rate_flow,
+      polyphase_rate_drain,
+      polyphase_rate_stop,
+      polyphase_rate_kill,
+      sizeof(PolyphaseRatePriv)};
+  return &handler;
+}
+
+} // namespace audio
+} // namespace torch
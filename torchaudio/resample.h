@@ -0,0 +1,123 @@
+#pragma once
+
+#include <sox.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace at {
+struct Tensor;
+} // namespace at
+
+namespace torch {
+namespace audio {
+
+/// Windowed-sinc low-pass filter for resampling by the rational factor
+/// `up / down`, split into `up` phases. Output sample `j` sits at input
+/// position `j * down / up`; its phase is the fractional part of that
+/// position, so every output sample is one dot product of `taps()` weights
+/// with consecutive input samples.
+class PolyphaseFilterBank {
+ public:
+  /// Returns the (shared, cached) filter bank from `in_rate` to `out_rate`,
+  /// or null if the rates are not integers or their ratio needs too many
+  /// phases. All the usual rates (8k, 16k, 22.05k, 44.1k, 48k, ... in either
+  /// direction) are supported.
+  static std::shared_ptr<const PolyphaseFilterBank> get(
+      double in_rate,
+      double out_rate);
+
+  int64_t up() const {
+    return up_;
+  }
+
+  int64_t down() const {
+    return down_;
+  }
+
+  /// Weights per phase, a multiple of 4 so that the dot products need no
+  /// scalar tail.
+  int64_t taps() const {
+    return taps_;
+  }
+
+  /// Number of taps before (and including) the input sample at or left of
+  /// the output position.
+  int64_t half() const {
+    return half_;
+  }
+
+  /// Output length for `n` input samples, rounded like the SoX rate effect.
+  int64_t output_length(int64_t n) const {
+    return (2 * n * up_ + down_) / (2 * down_);
+  }
+
+  /// Computes the output samples `[first, last)` into `dst` (every
+  /// `stride`-th element) from `src`, where `src[i]` holds the input sample
+  /// `i - half() + 1 + src_offset`.
+  void compute(
+      const float* src,
+      int64_t src_offset,
+      int64_t first,
+      int64_t last,
+      float* dst,
+      int64_t stride) const;
+
+ private:
+  PolyphaseFilterBank(int64_t up, int64_t down);
+
+  int64_t up_;
+  int64_t down_;
+  int64_t half_;
+  int64_t taps_;
+  std::vector<float> weights_;
+};
+
+/// Streaming polyphase resampler for interleaved frames, keeping the input
+/// history it needs per channel. The output is the same as resampling the
+/// whole signal at once, however the input is split up.
+class PolyphaseResampler {
+ public:
+  PolyphaseResampler(
+      std::shared_ptr<const PolyphaseFilterBank> bank,
+      unsigned channels);
+
+  /// Queues `frames` interleaved input frames.
+  void push(const float* src, int64_t frames);
+
+  /// Marks the end of the input, so that the remaining output can be pulled.
+  void flush();
+
+  /// Writes up to `max_frames` interleaved output frames into `dst` and
+  /// returns how many were written, 0 if more input is needed (or, after
+  /// `flush`, at the end).
+  int64_t pull(float* dst, int64_t max_frames);
+
+ private:
+  std::shared_ptr<const PolyphaseFilterBank> bank_;
+  std::vector<std::vector<float>> history_;
+  int64_t frames_in_ = 0;
+  int64_t frames_out_ = 0;
+  int64_t dropped_ = 0;
+  bool flushed_ = false;
+};
+
+/// Resamples `input` (`C x L` if `ch_first`, else `L x C`, or 1D for mono)
+/// from `in_rate` to `out_rate` into the float tensor `output`, laid out the
+/// same way. Throws if the pair of rates is not supported.
+void resample(
+    const at::Tensor& input,
+    at::Tensor output,
+    double in_rate,
+    double out_rate,
+    bool ch_first);
+
+/// SoX effect resampling with a `PolyphaseResampler`, taking the output rate
+/// as its only option like `rate`. Chains only run it when asked for by name,
+/// as `polyphase_rate`, and for rate pairs `PolyphaseFilterBank::get`
+/// supports; the SoX `rate` effect runs otherwise.
+const sox_effect_handler_t* polyphase_rate_handler();
+
+} // namespace audio
+} // namespace torch
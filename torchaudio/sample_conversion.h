@@ -0,0 +1,303 @@
+#pragma once
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "stats.h"
+
+namespace torch {
+namespace audio {
+
+/// Number of samples requested from `sox_read` per call when decoding into a
+/// tensor. Small enough that the staging chunk stays in L1/L2.
+constexpr int64_t kDecodeChunkSize = 8192;
+
+/// Number of samples converted at a time when encoding from a tensor.
+constexpr int64_t kEncodeChunkSize = 8192;
+
+namespace detail {
+
+/// True if `x` is an exact power of two, in which case dividing by `x` and
+/// multiplying by `1 / x` give bit-identical results.
+inline bool is_power_of_two(double x) {
+  int exponent;
+  return x > 0 && std::frexp(x, &exponent) == 0.5;
+}
+
+template <typename scalar_t>
+inline void convert_samples_generic(
+    const sox_sample_t* src,
+    scalar_t* dst,
+    int64_t n,
+    double normalization) {
+  if (!std::is_floating_point<scalar_t>::value || normalization == 1.) {
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<scalar_t>(src[i]);
+    }
+  } else if (is_power_of_two(normalization)) {
+    const scalar_t inv = static_cast<scalar_t>(1. / normalization);
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<scalar_t>(src[i]) * inv;
+    }
+  } else {
+    const scalar_t div = static_cast<scalar_t>(normalization);
+    for (int64_t i = 0; i < n; ++i) {
+      dst[i] = static_cast<scalar_t>(src[i]) / div;
+    }
+  }
+}
+
+} // namespace detail
+
+/// Converts `n` SoX samples (signed 32-bit) into `dst`. Floating point outputs
+/// are divided by `normalization` in the same pass, with the same rounding as
+/// dividing the converted tensor afterwards; integral outputs are copied as-is.
+template <typename scalar_t>
+inline void convert_samples(
+    const sox_sample_t* src,
+    scalar_t* dst,
+    int64_t n,
+    double normalization) {
+  detail::convert_samples_generic(src, dst, n, normalization);
+}
+
+#ifdef __SSE2__
+/// float32 is by far the most common output type, so it gets an explicit SSE2
+/// kernel instead of relying on the auto-vectorizer.
+template <>
+inline void convert_samples<float>(
+    const sox_sample_t* src,
+    float* dst,
+    int64_t n,
+    double normalization) {
+  const bool divide = normalization != 1. &&
+      !detail::is_power_of_two(normalization);
+  const __m128 factor = _mm_set1_ps(
+      divide ? static_cast<float>(normalization)
+             : static_cast<float>(1. / normalization));
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 a = _mm_cvtepi32_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+    __m128 b = _mm_cvtepi32_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 4)));
+    if (divide) {
+      a = _mm_div_ps(a, factor);
+      b = _mm_div_ps(b, factor);
+    } else {
+      a = _mm_mul_ps(a, factor);
+      b = _mm_mul_ps(b, factor);
+    }
+    _mm_storeu_ps(dst + i, a);
+    _mm_storeu_ps(dst + i + 4, b);
+  }
+  detail::convert_samples_generic(src + i, dst + i, n - i, normalization);
+}
+#endif
+
+namespace detail {
+
+template <typename scalar_t>
+inline int64_t to_sox_samples_generic(
+    const scalar_t* src,
+    sox_sample_t* dst,
+    int64_t n,
+    double scale) {
+  int64_t clips = 0;
+  for (int64_t i = 0; i < n; ++i) {
+    const double v = static_cast<double>(src[i]) * scale;
+    if (v <= SOX_SAMPLE_MIN - 0.5) {
+      dst[i] = SOX_SAMPLE_MIN;
+      ++clips;
+    } else if (v >= SOX_SAMPLE_MAX + 0.5) {
+      dst[i] = SOX_SAMPLE_MAX;
+      ++clips;
+    } else {
+      dst[i] = static_cast<sox_sample_t>(v < 0 ? v - 0.5 : v + 0.5);
+    }
+  }
+  return clips;
+}
+
+#ifdef __SSE2__
+/// Rounds two scaled values half away from zero and saturates them to the
+/// 32-bit range, exactly like `to_sox_samples_generic`, and counts the ones
+/// that clipped. The clamp happens before the truncating conversion, which
+/// would turn anything out of range into `SOX_SAMPLE_MIN`.
+inline __m128i round_to_sox_samples(__m128d v, int64_t* clips) {
+  const int clipped = _mm_movemask_pd(_mm_or_pd(
+      _mm_cmple_pd(v, _mm_set1_pd(SOX_SAMPLE_MIN - 0.5)),
+      _mm_cmpge_pd(v, _mm_set1_pd(SOX_SAMPLE_MAX + 0.5))));
+  *clips += (clipped & 1) + (clipped >> 1);
+  const __m128d half =
+      _mm_or_pd(_mm_and_pd(v, _mm_set1_pd(-0.)), _mm_set1_pd(0.5));
+  const __m128d rounded = _mm_min_pd(
+      _mm_max_pd(_mm_add_pd(v, half), _mm_set1_pd(SOX_SAMPLE_MIN)),
+      _mm_set1_pd(SOX_SAMPLE_MAX));
+  return _mm_cvttpd_epi32(rounded);
+}
+#endif
+
+} // namespace detail
+
+/// Converts `n` values into SoX samples after multiplying them by `scale`,
+/// rounding half away from zero and clipping to the 32-bit range like
+/// libsox's `SOX_FLOAT_64BIT_TO_SAMPLE`. Returns the number of clipped
+/// samples.
+template <typename scalar_t>
+inline int64_t to_sox_samples(
+    const scalar_t* src,
+    sox_sample_t* dst,
+    int64_t n,
+    double scale) {
+  return detail::to_sox_samples_generic(src, dst, n, scale);
+}
+
+#ifdef __SSE2__
+/// Floating point samples are what gets written most, two values at a time
+/// in double precision so that the results match the generic loop exactly.
+template <>
+inline int64_t to_sox_samples<float>(
+    const float* src,
+    sox_sample_t* dst,
+    int64_t n,
+    double scale) {
+  const __m128d factor = _mm_set1_pd(scale);
+  int64_t clips = 0;
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 x = _mm_loadu_ps(src + i);
+    const __m128i low = detail::round_to_sox_samples(
+        _mm_mul_pd(_mm_cvtps_pd(x), factor), &clips);
+    const __m128i high = detail::round_to_sox_samples(
+        _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), factor), &clips);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi64(low, high));
+  }
+  return clips + detail::to_sox_samples_generic(src + i, dst + i, n - i, scale);
+}
+
+template <>
+inline int64_t to_sox_samples<double>(
+    const double* src,
+    sox_sample_t* dst,
+    int64_t n,
+    double scale) {
+  const __m128d factor = _mm_set1_pd(scale);
+  int64_t clips = 0;
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128i low = detail::round_to_sox_samples(
+        _mm_mul_pd(_mm_loadu_pd(src + i), factor), &clips);
+    const __m128i high = detail::round_to_sox_samples(
+        _mm_mul_pd(_mm_loadu_pd(src + i + 2), factor), &clips);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi64(low, high));
+  }
+  return clips + detail::to_sox_samples_generic(src + i, dst + i, n - i, scale);
+}
+#endif
+
+/// Rounds `n` SoX samples to `bits` bits of precision (8 to 31) with the
+/// rounding and clipping of libsox's `SOX_SAMPLE_TO_SIGNED`, and scales them
+/// back to the 32-bit range. This gives the values an encode to and decode
+/// from a `bits`-bit linear PCM format would.
+inline void quantize_samples(
+    const sox_sample_t* src,
+    sox_sample_t* dst,
+    int64_t n,
+    unsigned bits) {
+  const uint32_t half = 1u << (31 - bits);
+  const uint32_t mask = ~0u << (32 - bits);
+  const sox_sample_t threshold =
+      SOX_SAMPLE_MAX - static_cast<sox_sample_t>(half);
+  const sox_sample_t clipped = static_cast<sox_sample_t>(0x7FFFFFFFu & mask);
+  for (int64_t i = 0; i < n; ++i) {
+    const uint32_t rounded = (static_cast<uint32_t>(src[i]) + half) & mask;
+    dst[i] = src[i] > threshold ? clipped : static_cast<sox_sample_t>(rounded);
+  }
+}
+
+namespace detail {
+
+/// Samples requested from `sox_read` at a time: whole frames only, so that
+/// channels never get interleaved across chunk boundaries.
+inline int64_t decode_chunk_size(const sox_format_t* fd) {
+  const int64_t channels = std::max<int64_t>(fd->signal.channels, 1);
+  return std::max<int64_t>(
+      kDecodeChunkSize - kDecodeChunkSize % channels, channels);
+}
+
+} // namespace detail
+
+/// Decodes up to `length` samples from `fd` in chunks of at most
+/// `kDecodeChunkSize` whole frames, and calls `sink(samples, first, n)` with
+/// every chunk, the `n` samples from sample `first` of the range. Returns the
+/// number of samples read.
+template <typename Sink>
+int64_t decode_chunks(sox_format_t* fd, int64_t length, const Sink& sink) {
+  const int64_t chunk = detail::decode_chunk_size(fd);
+  sox_sample_t staging[kDecodeChunkSize];
+  int64_t total = 0;
+  while (total < length) {
+    const size_t request = std::min(chunk, length - total);
+    const size_t got =
+        timed(Stage::kDecode, [&] { return sox_read(fd, staging, request); });
+    if (got == 0) {
+      break;
+    }
+    {
+      StageTimer timer(Stage::kConvert);
+      sink(staging, total, static_cast<int64_t>(got));
+    }
+    total += got;
+  }
+  count(Counter::kSamplesDecoded, total);
+  return total;
+}
+
+/// Decodes up to `length` samples from `fd` straight into `dst`, in chunks of
+/// `kDecodeChunkSize`, and returns the number of samples read. Only a single
+/// chunk is ever staged; `sox_sample_t` outputs without normalization are read
+/// without staging at all.
+template <typename scalar_t>
+int64_t decode_into(
+    sox_format_t* fd,
+    scalar_t* dst,
+    int64_t length,
+    double normalization) {
+  if (std::is_same<scalar_t, sox_sample_t>::value && normalization == 1.) {
+    const int64_t chunk = detail::decode_chunk_size(fd);
+    auto* out = reinterpret_cast<sox_sample_t*>(dst);
+    int64_t total = 0;
+    while (total < length) {
+      const size_t request = std::min(chunk, length - total);
+      const size_t got = timed(
+          Stage::kDecode, [&] { return sox_read(fd, out + total, request); });
+      if (got == 0) {
+        break;
+      }
+      total += got;
+    }
+    count(Counter::kSamplesDecoded, total);
+    return total;
+  }
+
+  const int64_t total = decode_chunks(
+      fd, length, [&](const sox_sample_t* samples, int64_t first, int64_t n) {
+        convert_samples(samples, dst + first, n, normalization);
+      });
+  count(Counter::kBytesConverted, total * sizeof(scalar_t));
+  return total;
+}
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,471 @@
+#include <sox.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "seek_index.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+constexpr char kIndexMagic[8] = {'T', 'A', 'S', 'E', 'E', 'K', '1', '\0'};
+/// Indices kept in memory, the least recently used ones are dropped first.
+constexpr size_t kMaxIndices = 256;
+/// Frames decoded before the target at most, beyond that the span starts at
+/// the start of the file.
+constexpr size_t kMaxPrimingFrames = 32;
+
+struct IndexHeader {
+  char magic[8];
+  double rate;
+  uint32_t channels;
+  uint32_t precision;
+  uint64_t length;
+  int64_t samples_per_frame;
+  uint64_t end;
+  uint64_t key_length;
+  uint64_t frame_count;
+};
+
+/// Bitrates in kbit/s of layer III, MPEG-1 and MPEG-2/2.5.
+constexpr unsigned kBitrates[2][15] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}};
+constexpr unsigned kRates[3] = {44100, 48000, 32000};
+
+/// What seeking needs from a frame header.
+struct FrameHeader {
+  unsigned version;
+  unsigned rate;
+  bool mono;
+  uint64_t length;
+  uint64_t side_info_end;
+};
+
+/// Parses the layer III frame header at `p`, false for anything else and
+/// for free format frames, whose length is not in the header.
+bool parse_header(const uint8_t* p, FrameHeader* header) {
+  if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+    return false;
+  }
+  const unsigned version = (p[1] >> 3) & 0x3;
+  const unsigned layer = (p[1] >> 1) & 0x3;
+  const unsigned bitrate_index = p[2] >> 4;
+  const unsigned rate_index = (p[2] >> 2) & 0x3;
+  if (version == 1 || layer != 1 || bitrate_index == 0 ||
+      bitrate_index == 15 || rate_index == 3) {
+    return false;
+  }
+  const bool mpeg1 = version == 3;
+  const unsigned rate =
+      kRates[rate_index] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+  const unsigned bitrate = kBitrates[mpeg1 ? 0 : 1][bitrate_index] * 1000;
+  const bool padding = (p[2] >> 1) & 0x1;
+  header->version = version;
+  header->rate = rate;
+  header->mono = (p[3] >> 6) == 3;
+  header->length = (mpeg1 ? 144 : 72) * bitrate / rate + padding;
+  const bool crc = (p[1] & 0x1) == 0;
+  header->side_info_end = 4 + (crc ? 2 : 0) +
+      (mpeg1 ? (header->mono ? 17 : 32) : (header->mono ? 9 : 17));
+  return header->length > header->side_info_end;
+}
+
+/// Follows the bit reservoir of libmad (`mad_layer_III`) over the frames
+/// `[first, last)` fed to a fresh decoder and calls `decoded(j)` for every
+/// frame it decodes. The others fail with `MAD_ERROR_BADDATAPTR` because
+/// their main data begins before the first frame, and libsox drops them.
+template <typename Decoded>
+void follow_reservoir(
+    const std::vector<Mp3Frame>& frames,
+    size_t first,
+    size_t last,
+    const Decoded& decoded) {
+  // bytes of main data the decoder keeps for the next frames
+  unsigned kept = 0;
+  for (size_t j = first; j < last; ++j) {
+    const unsigned space = frames[j].space;
+    const unsigned begin = frames[j].main_data_begin;
+    unsigned next_begin = j + 1 < last ? frames[j + 1].main_data_begin : 0;
+    if (next_begin > begin + space) {
+      next_begin = 0;
+    }
+    const unsigned length = begin + space - next_begin;
+    unsigned used = 0;
+    bool ok = true;
+    if (begin == 0) {
+      kept = 0;
+      used = length;
+    } else if (begin > kept) {
+      ok = false;
+    } else if (length > begin) {
+      used = length - begin;
+      kept += used;
+    }
+
+    // the main data of the next frames that begins in this one
+    const unsigned free = space - used;
+    if (free >= next_begin) {
+      kept = next_begin;
+    } else {
+      if (length < begin) {
+        unsigned extra = begin - length;
+        if (extra + free > next_begin) {
+          extra = next_begin - free;
+        }
+        if (extra < kept) {
+          kept = extra;
+        }
+      } else {
+        kept = 0;
+      }
+      kept += free;
+    }
+    if (ok) {
+      decoded(j);
+    }
+  }
+}
+
+/// Read-only mapping of a whole file, unmapped when it goes out of scope.
+struct FileMapping {
+  explicit FileMapping(const std::string& file_name) {
+    const int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        data = static_cast<const uint8_t*>(mapped);
+        size = st.st_size;
+        madvise(mapped, size, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+  }
+  FileMapping(const FileMapping& other) = delete;
+  FileMapping& operator=(const FileMapping& other) = delete;
+  ~FileMapping() {
+    if (data != nullptr) {
+      munmap(const_cast<uint8_t*>(data), size);
+    }
+  }
+
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
+
+/// Whether `file_name` starts like an MP3 file: an ID3v2 tag or a frame.
+bool looks_like_mp3(const std::string& file_name) {
+  const int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  uint8_t p[4];
+  FrameHeader header;
+  const bool mp3 = pread(fd, p, sizeof(p), 0) == sizeof(p) &&
+      (std::memcmp(p, "ID3", 3) == 0 || parse_header(p, &header));
+  close(fd);
+  return mp3;
+}
+
+struct SeekIndexState {
+  std::mutex mutex;
+  bool enabled = true;
+  std::string directory;
+  /// Indices by key, null for files without one, most recently used first.
+  std::list<std::pair<std::string, std::shared_ptr<Mp3SeekIndex>>> indices;
+  std::map<std::string, decltype(indices)::iterator> by_key;
+};
+
+SeekIndexState& seek_index_state() {
+  static SeekIndexState state;
+  return state;
+}
+
+std::string index_path(const std::string& directory, const std::string& key) {
+  std::ostringstream path;
+  path << directory << '/' << std::hex << std::hash<std::string>()(key)
+       << ".seek";
+  return path.str();
+}
+
+} // namespace
+
+std::shared_ptr<Mp3SeekIndex> Mp3SeekIndex::build(
+    const std::string& file_name,
+    const sox_signalinfo_t& signal) {
+  FileMapping file(file_name);
+  if (file.data == nullptr || signal.channels == 0) {
+    return nullptr;
+  }
+  const uint8_t* p = file.data;
+  uint64_t position = 0;
+  // ID3v2 tags, with a syncsafe size and an optional footer
+  while (position + 10 <= file.size &&
+         std::memcmp(p + position, "ID3", 3) == 0) {
+    const uint8_t* tag = p + position;
+    position += 10 + (static_cast<uint64_t>(tag[6] & 0x7F) << 21 |
+                      static_cast<uint64_t>(tag[7] & 0x7F) << 14 |
+                      (tag[8] & 0x7F) << 7 | (tag[9] & 0x7F)) +
+        ((tag[5] & 0x10) ? 10 : 0);
+  }
+
+  std::shared_ptr<Mp3SeekIndex> index(new Mp3SeekIndex());
+  FrameHeader first;
+  FrameHeader header;
+  while (position + 4 <= file.size) {
+    if (!parse_header(p + position, &header)) {
+      // an ID3v1 or APE tag may end the stream, anything else is junk
+      if (std::memcmp(p + position, "TAG", 3) == 0 ||
+          (position + 8 <= file.size &&
+           std::memcmp(p + position, "APETAGEX", 8) == 0)) {
+        break;
+      }
+      return nullptr;
+    }
+    if (index->frames_.empty()) {
+      first = header;
+    } else if (
+        header.version != first.version || header.rate != first.rate ||
+        header.mono != first.mono) {
+      return nullptr;
+    }
+    if (position + header.length > file.size) {
+      // a truncated last frame is never decoded
+      break;
+    }
+    const uint8_t* side_info = p + position + header.side_info_end -
+        (first.version == 3 ? (header.mono ? 17 : 32)
+                            : (header.mono ? 9 : 17));
+    Mp3Frame frame = {};
+    frame.offset = position;
+    frame.space = header.length - header.side_info_end;
+    frame.main_data_begin = first.version == 3
+        ? (side_info[0] << 1 | side_info[1] >> 7)
+        : side_info[0];
+    index->frames_.push_back(frame);
+    position += header.length;
+  }
+  if (index->frames_.size() < 2 ||
+      static_cast<unsigned>(signal.rate) != first.rate ||
+      signal.channels != (first.mono ? 1u : 2u)) {
+    return nullptr;
+  }
+
+  // sample positions are only frame numbers if every frame decodes
+  size_t decoded = 0;
+  follow_reservoir(
+      index->frames_, 0, index->frames_.size(), [&](size_t) { ++decoded; });
+  if (decoded != index->frames_.size()) {
+    return nullptr;
+  }
+  index->end_ = position;
+  index->signal_ = signal;
+  index->signal_.mult = nullptr;
+  index->samples_per_frame_ = first.version == 3 ? 1152 : 576;
+  return index;
+}
+
+std::shared_ptr<Mp3SeekIndex> Mp3SeekIndex::load(
+    const std::string& path,
+    const std::string& key) {
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return nullptr;
+  }
+  std::shared_ptr<Mp3SeekIndex> index(new Mp3SeekIndex());
+  IndexHeader header;
+  std::string stored_key;
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+      std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) == 0 &&
+      header.key_length == key.size() && header.frame_count >= 2;
+  if (ok) {
+    stored_key.resize(key.size());
+    index->frames_.resize(header.frame_count);
+    ok = std::fread(&stored_key[0], 1, key.size(), file) == key.size() &&
+        stored_key == key &&
+        std::fread(
+            index->frames_.data(),
+            sizeof(Mp3Frame),
+            header.frame_count,
+            file) == header.frame_count;
+  }
+  std::fclose(file);
+  if (!ok) {
+    return nullptr;
+  }
+  index->signal_ = sox_signalinfo_t();
+  index->signal_.rate = header.rate;
+  index->signal_.channels = header.channels;
+  index->signal_.precision = header.precision;
+  index->signal_.length = header.length;
+  index->samples_per_frame_ = header.samples_per_frame;
+  index->end_ = header.end;
+  return index;
+}
+
+void Mp3SeekIndex::save(const std::string& path, const std::string& key)
+    const {
+  IndexHeader header = {};
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.rate = signal_.rate;
+  header.channels = signal_.channels;
+  header.precision = signal_.precision;
+  header.length = signal_.length;
+  header.samples_per_frame = samples_per_frame_;
+  header.end = end_;
+  header.key_length = key.size();
+  header.frame_count = frames_.size();
+
+  const std::string temp_path = path + ".tmp" + std::to_string(getpid());
+  std::FILE* file = std::fopen(temp_path.c_str(), "wb");
+  if (file == nullptr) {
+    return;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+      std::fwrite(key.data(), 1, key.size(), file) == key.size() &&
+      std::fwrite(frames_.data(), sizeof(Mp3Frame), frames_.size(), file) ==
+          frames_.size();
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+  }
+}
+
+Mp3Span Mp3SeekIndex::span(int64_t offset, int64_t nframes) const {
+  const int64_t channels = signal_.channels;
+  const size_t count = frames_.size();
+  const size_t target = std::min<size_t>(offset / samples_per_frame_, count);
+  size_t end = count;
+  if (nframes > 0) {
+    end = std::min<size_t>(
+        (offset + nframes + samples_per_frame_ - 1) / samples_per_frame_,
+        count);
+  }
+  // one more frame, libsox only decodes a frame once the next one is read
+  const size_t last = std::min(end + 1, count);
+
+  // the first frame from which the frames before the target that its
+  // overlap and filter state depend on, and every frame after them, decode:
+  // one for MPEG-1, whose frames hold two granules, and two for the single
+  // granule frames of MPEG-2 and 2.5. From the start of the file, every
+  // frame decodes
+  const size_t priming = samples_per_frame_ == 576 ? 2 : 1;
+  size_t first = 0;
+  if (target > priming) {
+    const size_t needed = target - priming;
+    const size_t lowest =
+        target > kMaxPrimingFrames ? target - kMaxPrimingFrames : 0;
+    for (size_t candidate = needed + 1; candidate-- > lowest;) {
+      size_t decoded = 0;
+      follow_reservoir(frames_, candidate, last, [&](size_t j) {
+        decoded += j >= needed;
+      });
+      if (decoded == last - needed) {
+        first = candidate;
+        break;
+      }
+    }
+  }
+
+  Mp3Span span = {};
+  span.offset = frames_[first].offset;
+  span.size = (last < count ? frames_[last].offset : end_) - span.offset;
+  const int64_t frame_samples = samples_per_frame_ * channels;
+  follow_reservoir(frames_, first, last, [&](size_t j) {
+    if (j < target) {
+      span.skip += frame_samples;
+    }
+    if (j + 1 < last) {
+      span.samples += frame_samples;
+    }
+    span.samples_with_last_frame += frame_samples;
+  });
+  span.skip += (offset - static_cast<int64_t>(target) * samples_per_frame_) *
+      channels;
+  return span;
+}
+
+void set_seek_index(bool enabled, const std::string& directory) {
+  SeekIndexState& state = seek_index_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.enabled = enabled;
+  state.directory = directory;
+  state.indices.clear();
+  state.by_key.clear();
+}
+
+std::shared_ptr<Mp3SeekIndex> mp3_seek_index(
+    const std::string& file_name,
+    const std::function<bool(sox_signalinfo_t*)>& open_signal) {
+  SeekIndexState& state = seek_index_state();
+  std::string directory;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (!state.enabled) {
+      return nullptr;
+    }
+    directory = state.directory;
+  }
+  const std::string key = AudioCache::key(file_name, "mp3 seek index");
+  if (key.empty()) {
+    return nullptr;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto it = state.by_key.find(key);
+    if (it != state.by_key.end()) {
+      state.indices.splice(state.indices.begin(), state.indices, it->second);
+      return it->second->second;
+    }
+  }
+
+  // built without the lock, two threads may build the same index
+  std::shared_ptr<Mp3SeekIndex> index;
+  if (looks_like_mp3(file_name)) {
+    const std::string path =
+        directory.empty() ? std::string() : index_path(directory, key);
+    if (!path.empty()) {
+      index = Mp3SeekIndex::load(path, key);
+    }
+    sox_signalinfo_t signal;
+    if (!index && open_signal(&signal)) {
+      index = Mp3SeekIndex::build(file_name, signal);
+      if (index && !path.empty()) {
+        index->save(path, key);
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.by_key.count(key) == 0) {
+    state.indices.emplace_front(key, index);
+    state.by_key[key] = state.indices.begin();
+    if (state.indices.size() > kMaxIndices) {
+      state.by_key.erase(state.indices.back().first);
+      state.indices.pop_back();
+    }
+  }
+  return index;
+}
+
+} // namespace audio
+} // namespace torch
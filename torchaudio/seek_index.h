@@ -0,0 +1,108 @@
+#pragma once
+
+#include <sox.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace torch {
+namespace audio {
+
+/// An MPEG layer III frame, as far as seeking is concerned.
+struct Mp3Frame {
+  /// Position of the frame in the file.
+  uint64_t offset;
+  /// Bytes after the header and the side information.
+  uint16_t space;
+  /// How far back before `space` the main data of the frame begins, in the
+  /// bit reservoir of earlier frames.
+  uint16_t main_data_begin;
+  uint32_t reserved;
+};
+
+/// The bytes of an MP3 file to decode for a range of samples.
+struct Mp3Span {
+  uint64_t offset;
+  uint64_t size;
+  /// Samples the span decodes to before the range starts.
+  int64_t skip;
+  /// Samples the span decodes to without its last frame, and with it: the
+  /// last frame is only there so that the one before it can be decoded.
+  int64_t samples;
+  int64_t samples_with_last_frame;
+};
+
+/// Frame-level seek table of an MP3 file: the position of every frame and
+/// how it uses the bit reservoir. A read at any offset decodes from a few
+/// frames before the frame that holds the offset, enough for the decoder to
+/// have the main data, overlap and filter state it would have after
+/// decoding the file from the start (the frame before the target for
+/// MPEG-1, the two before it for the single granule frames of MPEG-2 and
+/// 2.5), so the samples are exactly those of a whole decode. `sox_seek`
+/// instead scans frame headers from the start of the file and decodes the
+/// target frame without its reservoir.
+class Mp3SeekIndex {
+ public:
+  /// Scans the frame headers of `file_name`, whose whole file signal libsox
+  /// reports as `signal`. Returns null unless it is a plain layer III stream:
+  /// ID3v2 tags, then frames of a single MPEG version and rate without junk
+  /// in between, every one of which libmad decodes.
+  static std::shared_ptr<Mp3SeekIndex> build(
+      const std::string& file_name,
+      const sox_signalinfo_t& signal);
+
+  /// Loads the index written by `save` at `path` for `key`, null if there
+  /// is none or it is for another key.
+  static std::shared_ptr<Mp3SeekIndex> load(
+      const std::string& path,
+      const std::string& key);
+
+  /// Writes the index to `path` for `key`, atomically; failures are ignored.
+  void save(const std::string& path, const std::string& key) const;
+
+  /// The signal libsox reports for the whole file.
+  const sox_signalinfo_t& signal() const {
+    return signal_;
+  }
+
+  /// The span to decode for `nframes` frames (0 to the end) from `offset`.
+  Mp3Span span(int64_t offset, int64_t nframes) const;
+
+  /// Stops using the index, e.g. after a decode that did not match it.
+  void disable() {
+    enabled_ = false;
+  }
+  bool enabled() const {
+    return enabled_;
+  }
+
+ private:
+  Mp3SeekIndex() = default;
+
+  sox_signalinfo_t signal_;
+  int64_t samples_per_frame_;
+  std::vector<Mp3Frame> frames_;
+  /// Position after the last frame.
+  uint64_t end_;
+  std::atomic<bool> enabled_{true};
+};
+
+/// Sets whether `read_audio_file` reads MP3 files at an offset through seek
+/// indices, and the directory where indices are kept for other processes
+/// and later runs (none for an empty `directory`).
+void set_seek_index(bool enabled, const std::string& directory);
+
+/// The seek index of `file_name`, from memory, from the directory of indices
+/// or built with the whole file signal given by `open_signal`, which returns
+/// false if libsox cannot open the file. Null if indices are disabled or the
+/// file is not an MP3 file an index supports.
+std::shared_ptr<Mp3SeekIndex> mp3_seek_index(
+    const std::string& file_name,
+    const std::function<bool(sox_signalinfo_t*)>& open_signal);
+
+} // namespace audio
+} // namespace torch
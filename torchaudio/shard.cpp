@@ -0,0 +1,393 @@
+#include <torch/extension.h>
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sample_conversion.h"
+#include "shard.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+static_assert(sizeof(ShardEntry) == 48, "the index is stored as is");
+
+constexpr char kShardMagic[8] = {'T', 'A', 'S', 'H', 'A', 'R', 'D', '1'};
+constexpr char kIndexMagic[8] = {'T', 'A', 'S', 'H', 'I', 'D', 'X', '1'};
+constexpr uint64_t kHeaderSize = 16;
+constexpr uint64_t kPayloadAlignment = 16;
+
+struct ShardFooter {
+  char magic[8];
+  uint64_t count;
+  uint64_t index_offset;
+  uint64_t names_offset;
+};
+
+bool is_little_endian() {
+  const uint16_t one = 1;
+  uint8_t first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+/// Packs `n` SoX samples, already rounded to `format`, as little-endian.
+void encode_samples(
+    const sox_sample_t* src,
+    uint8_t* dst,
+    int64_t n,
+    PcmFormat format) {
+  switch (format) {
+    case PcmFormat::kUInt8:
+      for (int64_t i = 0; i < n; ++i) {
+        dst[i] = static_cast<uint8_t>((src[i] >> 24) + 128);
+      }
+      break;
+    case PcmFormat::kInt16:
+      for (int64_t i = 0; i < n; ++i) {
+        const int16_t v = static_cast<int16_t>(src[i] >> 16);
+        std::memcpy(dst + 2 * i, &v, sizeof(v));
+      }
+      break;
+    case PcmFormat::kInt24:
+      for (int64_t i = 0; i < n; ++i) {
+        const uint32_t v = static_cast<uint32_t>(src[i]);
+        dst[3 * i] = static_cast<uint8_t>(v >> 8);
+        dst[3 * i + 1] = static_cast<uint8_t>(v >> 16);
+        dst[3 * i + 2] = static_cast<uint8_t>(v >> 24);
+      }
+      break;
+    default:
+      std::memcpy(dst, src, n * sizeof(sox_sample_t));
+      break;
+  }
+}
+
+} // namespace
+
+ShardWriter::ShardWriter(const std::string& path)
+    : path_(path), temp_path_(path + ".tmp") {
+  if (!is_little_endian()) {
+    throw std::runtime_error("Shards are only supported on little-endian");
+  }
+  file_ = std::fopen(temp_path_.c_str(), "wb");
+  if (file_ == nullptr) {
+    throw std::runtime_error("Could not open shard " + temp_path_);
+  }
+  char header[kHeaderSize] = {};
+  std::memcpy(header, kShardMagic, sizeof(kShardMagic));
+  write(header, sizeof(header));
+}
+
+ShardWriter::~ShardWriter() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+    std::remove(temp_path_.c_str());
+  }
+}
+
+void ShardWriter::write(const void* data, size_t size) {
+  if (file_ == nullptr) {
+    throw std::runtime_error("The shard is closed");
+  }
+  if (size > 0 && std::fwrite(data, 1, size, file_) != size) {
+    throw std::runtime_error("Error writing shard " + temp_path_);
+  }
+  position_ += size;
+}
+
+void ShardWriter::align() {
+  static const char zeros[kPayloadAlignment] = {};
+  write(zeros, (kPayloadAlignment - position_ % kPayloadAlignment) %
+            kPayloadAlignment);
+}
+
+ShardEntry& ShardWriter::begin_entry(const std::string& name) {
+  align();
+  ShardEntry entry;
+  std::memset(&entry, 0, sizeof(entry));
+  entry.offset = position_;
+  entry.name_offset = names_.size();
+  entry.name_length = name.size();
+  names_ += name;
+  entries_.push_back(entry);
+  return entries_.back();
+}
+
+int64_t ShardWriter::add_samples(
+    const std::string& name,
+    const at::Tensor& samples,
+    double sample_rate,
+    int64_t bits,
+    double scale) {
+  PcmFormat format;
+  switch (bits) {
+    case 8:
+      format = PcmFormat::kUInt8;
+      break;
+    case 16:
+      format = PcmFormat::kInt16;
+      break;
+    case 24:
+      format = PcmFormat::kInt24;
+      break;
+    case 32:
+      format = PcmFormat::kInt32;
+      break;
+    default:
+      throw std::runtime_error("Expected 8, 16, 24 or 32 bits per sample");
+  }
+  if (samples.dim() != 2 || sample_rate <= 0) {
+    throw std::runtime_error("Expected L x C samples and a sample rate");
+  }
+  const at::Tensor contiguous = samples.contiguous();
+  const int64_t n = contiguous.numel();
+  ShardEntry& entry = begin_entry(name);
+  entry.frames = contiguous.size(0);
+  entry.channels = contiguous.size(1);
+  entry.rate = sample_rate;
+  entry.format = static_cast<uint8_t>(format);
+
+  sox_sample_t staging[kEncodeChunkSize];
+  uint8_t packed[kEncodeChunkSize * sizeof(sox_sample_t)];
+  AT_DISPATCH_ALL_TYPES(contiguous.type(), "shard_add_samples", [&] {
+    const scalar_t* data = contiguous.data<scalar_t>();
+    for (int64_t i = 0; i < n; i += kEncodeChunkSize) {
+      const int64_t m = std::min(kEncodeChunkSize, n - i);
+      to_sox_samples(data + i, staging, m, scale);
+      if (bits < 32) {
+        quantize_samples(staging, staging, m, bits);
+      }
+      encode_samples(staging, packed, m, format);
+      write(packed, m * bits / 8);
+    }
+  });
+  entries_.back().size = position_ - entries_.back().offset;
+  return entries_.size() - 1;
+}
+
+int64_t ShardWriter::add_pcm(
+    const std::string& name,
+    const MappedPcmFile& pcm) {
+  const sox_signalinfo_t& signal = pcm.signal();
+  ShardEntry& entry = begin_entry(name);
+  entry.frames = signal.length / std::max(signal.channels, 1u);
+  entry.channels = signal.channels;
+  entry.rate = signal.rate;
+  entry.format = static_cast<uint8_t>(pcm.format());
+  write(pcm.data(), pcm.data_size());
+  entries_.back().size = position_ - entries_.back().offset;
+  return entries_.size() - 1;
+}
+
+int64_t ShardWriter::add_encoded(
+    const std::string& name,
+    const std::string& file_name,
+    const std::string& file_type,
+    const sox_signalinfo_t& signal) {
+  if (file_type.empty() ||
+      file_type.size() >= sizeof(ShardEntry::file_type)) {
+    throw std::runtime_error("Unsupported file type in a shard: " + file_type);
+  }
+  std::FILE* input = std::fopen(file_name.c_str(), "rb");
+  if (input == nullptr) {
+    throw std::runtime_error("Error opening audio file " + file_name);
+  }
+  ShardEntry& entry = begin_entry(name);
+  entry.channels = signal.channels;
+  entry.frames = signal.length / std::max(signal.channels, 1u);
+  entry.rate = signal.rate;
+  entry.format = kEncodedPayload;
+  std::strcpy(entry.file_type, file_type.c_str());
+  std::vector<char> buffer(1 << 16);
+  size_t n;
+  while ((n = std::fread(buffer.data(), 1, buffer.size(), input)) > 0) {
+    write(buffer.data(), n);
+  }
+  const bool failed = std::ferror(input);
+  std::fclose(input);
+  if (failed) {
+    throw std::runtime_error("Error reading audio file " + file_name);
+  }
+  entries_.back().size = position_ - entries_.back().offset;
+  return entries_.size() - 1;
+}
+
+void ShardWriter::close() {
+  if (file_ == nullptr) {
+    return;
+  }
+  align();
+  ShardFooter footer;
+  std::memcpy(footer.magic, kIndexMagic, sizeof(kIndexMagic));
+  footer.count = entries_.size();
+  footer.index_offset = position_;
+  write(entries_.data(), entries_.size() * sizeof(ShardEntry));
+  footer.names_offset = position_;
+  write(names_.data(), names_.size());
+  write(&footer, sizeof(footer));
+  const bool failed = std::fclose(file_) != 0;
+  file_ = nullptr;
+  if (failed || std::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+    std::remove(temp_path_.c_str());
+    throw std::runtime_error("Error writing shard " + path_);
+  }
+}
+
+ShardReader::ShardReader(const std::string& path, bool sequential) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Error opening shard " + path);
+  }
+  struct stat st;
+  void* mapped = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    // private and writable, so tensor views can be written to
+    mapped = mmap(
+        nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    throw std::runtime_error("Error mapping shard " + path);
+  }
+  size_ = st.st_size;
+  const size_t size = size_;
+  mapping_.reset(static_cast<uint8_t*>(mapped), [size](uint8_t* p) {
+    munmap(p, size);
+  });
+  if (sequential) {
+    madvise(mapped, size_, MADV_SEQUENTIAL);
+  }
+
+  ShardFooter footer;
+  const uint8_t* begin = mapping_.get();
+  if (!is_little_endian() || size_ < kHeaderSize + sizeof(footer) ||
+      std::memcmp(begin, kShardMagic, sizeof(kShardMagic)) != 0) {
+    throw std::runtime_error(path + " is not a shard");
+  }
+  std::memcpy(&footer, begin + size_ - sizeof(footer), sizeof(footer));
+  const uint64_t footer_offset = size_ - sizeof(footer);
+  if (std::memcmp(footer.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+      footer.index_offset < kHeaderSize ||
+      footer.index_offset % alignof(ShardEntry) != 0 ||
+      footer.names_offset > footer_offset ||
+      (footer.names_offset - footer.index_offset) / sizeof(ShardEntry) !=
+          footer.count) {
+    throw std::runtime_error(path + " is not a shard");
+  }
+  entries_ = reinterpret_cast<const ShardEntry*>(begin + footer.index_offset);
+  names_ = reinterpret_cast<const char*>(begin + footer.names_offset);
+  names_size_ = footer_offset - footer.names_offset;
+  count_ = footer.count;
+  for (int64_t i = 0; i < count_; ++i) {
+    const ShardEntry& e = entries_[i];
+    if (e.offset < kHeaderSize || e.offset + e.size > footer.index_offset ||
+        uint64_t(e.name_offset) + e.name_length > names_size_) {
+      throw std::runtime_error(path + " has a corrupt index");
+    }
+  }
+}
+
+const ShardEntry& ShardReader::entry(int64_t i) const {
+  if (i < 0 || i >= count_) {
+    throw std::out_of_range("Utterance index out of range");
+  }
+  return entries_[i];
+}
+
+std::string ShardReader::name(int64_t i) const {
+  const ShardEntry& e = entry(i);
+  return std::string(names_ + e.name_offset, e.name_length);
+}
+
+std::vector<std::string> ShardReader::names() const {
+  std::vector<std::string> names;
+  names.reserve(count_);
+  for (int64_t i = 0; i < count_; ++i) {
+    names.push_back(name(i));
+  }
+  return names;
+}
+
+sox_signalinfo_t ShardReader::signal(int64_t i) const {
+  const ShardEntry& e = entry(i);
+  sox_signalinfo_t signal = {};
+  signal.rate = e.rate;
+  signal.channels = e.channels;
+  signal.length = e.frames * e.channels;
+  if (auto samples = pcm(i)) {
+    signal.precision = samples->signal().precision;
+  }
+  return signal;
+}
+
+std::unique_ptr<MappedPcmFile> ShardReader::pcm(int64_t i) const {
+  const ShardEntry& e = entry(i);
+  if (e.format == kEncodedPayload) {
+    return nullptr;
+  }
+  return MappedPcmFile::view(
+      payload(i),
+      e.size,
+      static_cast<PcmFormat>(e.format),
+      e.channels,
+      e.rate);
+}
+
+uint8_t* ShardReader::payload(int64_t i) const {
+  return mapping_.get() + entry(i).offset;
+}
+
+at::Tensor ShardReader::view(int64_t i) const {
+  const ShardEntry& e = entry(i);
+  at::ScalarType type;
+  switch (static_cast<PcmFormat>(e.format)) {
+    case PcmFormat::kUInt8:
+      type = at::kByte;
+      break;
+    case PcmFormat::kInt16:
+      type = at::kShort;
+      break;
+    case PcmFormat::kInt32:
+      type = at::kInt;
+      break;
+    case PcmFormat::kFloat32:
+      type = at::kFloat;
+      break;
+    default:
+      throw std::runtime_error(
+          "Only 8, 16 and 32-bit integer and float samples can be viewed");
+  }
+  // the tensor keeps the mapping alive
+  std::shared_ptr<uint8_t> mapping = mapping_;
+  return torch::from_blob(
+      payload(i),
+      {static_cast<int64_t>(e.frames), static_cast<int64_t>(e.channels)},
+      [mapping](void*) {},
+      at::dtype(type));
+}
+
+void ShardReader::prefetch(int64_t first, int64_t count) const {
+  first = std::max<int64_t>(first, 0);
+  const int64_t last = std::min(first + count, count_) - 1;
+  if (last < first) {
+    return;
+  }
+  const long page = sysconf(_SC_PAGESIZE);
+  const uint64_t begin = entries_[first].offset / page * page;
+  const uint64_t end = entries_[last].offset + entries_[last].size;
+  madvise(mapping_.get() + begin, end - begin, MADV_WILLNEED);
+}
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <sox.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wav_reader.h"
+
+namespace at {
+struct Tensor;
+} // namespace at
+
+namespace torch {
+namespace audio {
+
+/// Index entry of an utterance of a shard, stored little-endian.
+struct ShardEntry {
+  /// Position and size in bytes of the payload in the shard.
+  uint64_t offset;
+  uint64_t size;
+  /// Length in frames, 0 if the header of an encoded payload has none.
+  uint64_t frames;
+  double rate;
+  /// Position and size of the name in the names that follow the index.
+  uint32_t name_offset;
+  uint32_t name_length;
+  uint16_t channels;
+  /// A `PcmFormat`, or `kEncodedPayload` for a whole audio file.
+  uint8_t format;
+  /// libsox file type of an encoded payload, NUL terminated.
+  char file_type[5];
+};
+
+constexpr uint8_t kEncodedPayload = 0xFF;
+
+/// Writes a shard: many utterances concatenated into one file, either as
+/// PCM samples or as the bytes of whole audio files, followed by an index
+/// of their offsets, sizes and formats and by their names. The shard is
+/// written under a temporary name and renamed into place by `close`, so a
+/// shard that exists is complete.
+///
+/// Layout: a 16 byte header, the 16 byte aligned payloads, the `ShardEntry`
+/// of every utterance, the names and a 32 byte footer with the number of
+/// utterances and the positions of the index and the names.
+class ShardWriter {
+ public:
+  explicit ShardWriter(const std::string& path);
+  ShardWriter(const ShardWriter& other) = delete;
+  ShardWriter& operator=(const ShardWriter& other) = delete;
+  /// Discards the shard if it was not closed.
+  ~ShardWriter();
+
+  /// Adds `samples` (`L x C`), multiplied by `scale` to get SoX samples, as
+  /// `bits`-bit linear PCM (8, 16, 24 or 32). Returns the index.
+  int64_t add_samples(
+      const std::string& name,
+      const at::Tensor& samples,
+      double sample_rate,
+      int64_t bits,
+      double scale);
+
+  /// Adds the samples of a mapped wave or raw file as they are.
+  int64_t add_pcm(const std::string& name, const MappedPcmFile& pcm);
+
+  /// Adds the bytes of the audio file `file_name`, to be decoded by libsox
+  /// as `file_type` when read. `signal` is what libsox reports for it.
+  int64_t add_encoded(
+      const std::string& name,
+      const std::string& file_name,
+      const std::string& file_type,
+      const sox_signalinfo_t& signal);
+
+  /// Writes the index and moves the shard into place.
+  void close();
+
+  int64_t size() const {
+    return entries_.size();
+  }
+
+ private:
+  /// Pads the shard to the alignment of payloads and of the index.
+  void align();
+  /// Starts the payload of a new entry, aligned, and returns it.
+  ShardEntry& begin_entry(const std::string& name);
+  void write(const void* data, size_t size);
+
+  std::string path_;
+  std::string temp_path_;
+  std::FILE* file_;
+  uint64_t position_ = 0;
+  std::vector<ShardEntry> entries_;
+  std::string names_;
+};
+
+/// Reads a shard written by `ShardWriter`. The whole shard is mapped once,
+/// so getting at any utterance takes no system call: PCM utterances are
+/// decoded straight from the mapping and encoded ones are opened by libsox
+/// in memory. Safe to use from several threads at once.
+class ShardReader {
+ public:
+  /// Maps the shard at `path`; `sequential` tells the kernel to read ahead
+  /// aggressively and drop pages behind, for a scan in order.
+  ShardReader(const std::string& path, bool sequential);
+
+  int64_t size() const {
+    return count_;
+  }
+
+  /// The entry of utterance `i`, throws for a bad index.
+  const ShardEntry& entry(int64_t i) const;
+
+  std::string name(int64_t i) const;
+  std::vector<std::string> names() const;
+
+  /// Rate, channels, precision and length in samples (0 if unknown) of
+  /// utterance `i`, like `get_info` reports for a file.
+  sox_signalinfo_t signal(int64_t i) const;
+
+  /// The samples of a PCM utterance, valid while the reader lives; null for
+  /// encoded utterances.
+  std::unique_ptr<MappedPcmFile> pcm(int64_t i) const;
+
+  /// The payload of utterance `i`.
+  uint8_t* payload(int64_t i) const;
+
+  /// The samples of a PCM utterance as an `L x C` tensor over the mapping,
+  /// without a copy. Writes go to private copies of the pages. Only for 8,
+  /// 16 and 32-bit integer and 32-bit float samples.
+  at::Tensor view(int64_t i) const;
+
+  /// Asks the kernel to read the payloads of `count` utterances from `first`
+  /// in the background.
+  void prefetch(int64_t first, int64_t count) const;
+
+ private:
+  std::shared_ptr<uint8_t> mapping_;
+  size_t size_;
+  const ShardEntry* entries_;
+  const char* names_;
+  size_t names_size_;
+  int64_t count_;
+};
+
+} // namespace audio
+} // namespace torch
@@ -26,6 +26,51 @@ def SoxEffect():
     return _torch_sox.SoxEffect()
 
 
+def apply_effects_tensor(tensor, sample_rate, effects, normalization=True, channels_first=True, out=None):
+    """Apply a SoX effects chain to an audio Tensor in memory, without writing it to a file.
+
+    Args:
+        tensor (Tensor): audio of size `[C x L]` or `[L x C]` (see `channels_first`), or `[L]` for mono
+        sample_rate (int): sample rate of `tensor`
+        effects (SoxEffectsChain, CompiledEffectChain or list[SoxEffect]): the effects to apply,
+                                                                         the input file of a chain is ignored
+        normalization (bool or number, optional): If `True` (or a number), floating point inputs are
+                                                  multiplied by `1 << 31` (or that number) to get SoX samples
+                                                  and the output is divided by it, see `load`.  Integral
+                                                  inputs are taken as SoX samples.  Default: ``True``
+        channels_first (bool, optional): layout of both the input and the output.  Default: ``True``
+        out (Tensor, optional): an output Tensor to use instead of creating one
+
+    Returns: tuple(Tensor, int)
+       - Tensor: output Tensor of size `[C x L]` or `[L x C]`
+       - int: the sample rate of the output
+
+    Example::
+        >>> E = torchaudio.sox_effects.SoxEffectsChain()
+        >>> E.append_effect_to_chain("tempo", [1.1])
+        >>> y, sr = torchaudio.sox_effects.apply_effects_tensor(x, 16000, E)
+    """
+    if callable(normalization):
+        raise ValueError("callable normalization is not supported for tensor inputs")
+    if out is not None:
+        torchaudio.check_input(out)
+    else:
+        out = torch.FloatTensor()
+    if isinstance(effects, SoxEffectsChain):
+        effects = effects.compile()
+    elif not isinstance(effects, _torch_sox.CompiledEffectChain):
+        effects = _torch_sox.CompiledEffectChain(effects)
+
+    scale = 1.
+    if tensor.dtype.is_floating_point and normalization:
+        scale = float(1 << 31) if isinstance(normalization, bool) else float(normalization)
+    divisor, normalization = torchaudio._split_normalization(out, normalization)
+    sr = effects.apply_tensor(tensor, sample_rate, out, channels_first, scale, divisor)
+    torchaudio._audio_normalization(out, normalization)
+
+    return out, sr
+
+
 class SoxEffectsChain(object):
     """SoX effects chain class.
 
@@ -43,6 +88,12 @@ class SoxEffectsChain(object):
                                                     audio type cannot be automatically determined
         filetype (str, optional): a filetype or extension to be set if sox cannot determine it automatically
 
+    Besides the SoX effects, the chain has a ``polyphase_rate`` effect, which resamples to its only option,
+    the output rate, with the resampler of `torchaudio.resample` (the SoX ``rate`` effect for rate pairs it does
+    not support), and an ``energy_vad`` effect, which keeps the voiced part of the audio like
+    `torchaudio.load_voiced`, with the options ``[-t threshold_db] [-z zcr_threshold] [-s min_speech_ms]
+    [-g min_silence_ms] [-p pad_ms] [trim|segments]``.
+
     Returns: tuple(Tensor, int)
        - Tensor: output Tensor of size `[C x L]` or `[L x C]` where L is the number of audio frames and
                  C is the number of channels
@@ -78,7 +129,10 @@ class SoxEffectsChain(object):
 
     def __init__(self, normalization=True, channels_first=True, out_siginfo=None, out_encinfo=None, filetype="raw"):
         self.input_file = None
+        self.input_bytes = None
+        self.input_filetype = None
         self.chain = []
+        self._compiled = None
         self.MAX_EFFECT_OPTS = 20
         self.out_siginfo = out_siginfo
         self.out_encinfo = out_encinfo
@@ -104,6 +158,18 @@ class SoxEffectsChain(object):
         e.ename = ename
         e.eopts = eargs
         self.chain.append(e)
+        self._compiled = None
+
+    def compile(self):
+        """Resolve and validate the effects chain once so that it can be applied to many
+        files without re-parsing it.  Invalid effect options raise a `RuntimeError` here.
+        The compiled chain is cached until the chain is modified.
+
+        Returns: CompiledEffectChain
+        """
+        if self._compiled is None:
+            self._compiled = _torch_sox.CompiledEffectChain(self.chain)
+        return self._compiled
 
     def sox_build_flow_effects(self, out=None):
         """Build effects chain and flow effects from input file to output tensor
@@ -113,23 +179,26 @@ class SoxEffectsChain(object):
             torchaudio.check_input(out)
         else:
             out = torch.FloatTensor()
-        if not len(self.chain):
-            e = SoxEffect()
-            e.ename = "no_effects"
-            e.eopts = [""]
-            self.chain.append(e)
-
-        # print("effect options:", [x.eopts for x in self.chain])
-        sr = _torch_sox.build_flow_effects(self.input_file,
-                                           out,
-                                           self.channels_first,
-                                           self.out_siginfo,
-                                           self.out_encinfo,
-                                           self.filetype,
-                                           self.chain,
-                                           self.MAX_EFFECT_OPTS)
-
-        torchaudio._audio_normalization(out, self.normalization)
+        divisor, normalization = torchaudio._split_normalization(out, self.normalization)
+        if self.input_bytes is not None:
+            sr = self.compile().apply_bytes(self.input_bytes,
+                                            self.input_filetype,
+                                            out,
+                                            self.channels_first,
+                                            self.out_siginfo,
+                                            self.out_encinfo,
+                                            self.filetype,
+                                            divisor)
+        else:
+            sr = self.compile().apply(self.input_file,
+                                      out,
+                                      self.channels_first,
+                                      self.out_siginfo,
+                                      self.out_encinfo,
+                                      self.filetype,
+                                      divisor)
+
+        torchaudio._audio_normalization(out, normalization)
 
         return out, sr
 
@@ -137,11 +206,22 @@ class SoxEffectsChain(object):
         """Clear effects chain in python
         """
         self.chain = []
+        self._compiled = None
 
     def set_input_file(self, input_file):
         """Set input file for input of chain
         """
         self.input_file = input_file
+        self.input_bytes = None
+
+    def set_input_bytes(self, input_bytes, filetype=None):
+        """Set the contents of an audio file as input of chain, e.g. read from a tar shard or a
+        key-value store.  Any contiguous buffer (`bytes`, `bytearray`, `memoryview`, numpy array)
+        is used without a copy; `filetype` names its type if SoX cannot detect it.
+        """
+        self.input_bytes = input_bytes
+        self.input_filetype = filetype
+        self.input_file = None
 
     def _check_effect(self, e):
         if e.lower() in self.EFFECTS_UNIMPLEMENTED:
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "stats.h"
+
+namespace torch {
+namespace audio {
+namespace detail {
+
+std::atomic<bool> stats_enabled{false};
+
+} // namespace detail
+
+namespace {
+
+/// The statistics of one thread. Only the thread that owns the slot writes
+/// its counters, so a relaxed load and store make an increment; readers sum
+/// the slots of every thread.
+struct ThreadStats {
+  std::atomic<int64_t> stage_count[kStageCount];
+  std::atomic<int64_t> stage_ns[kStageCount];
+  std::atomic<int64_t> stage_max_ns[kStageCount];
+  std::atomic<int64_t> histogram[kStageCount][kStatsBuckets];
+  std::atomic<int64_t> counters[kCounterCount];
+  /// Whether a live thread owns the slot; slots of threads that exited are
+  /// given to new threads with their counts, which stay in the totals.
+  bool in_use = true;
+
+  ThreadStats() {
+    for (int s = 0; s < kStageCount; ++s) {
+      stage_count[s] = 0;
+      stage_ns[s] = 0;
+      stage_max_ns[s] = 0;
+      for (auto& bucket : histogram[s]) {
+        bucket = 0;
+      }
+    }
+    for (auto& counter : counters) {
+      counter = 0;
+    }
+  }
+};
+
+void add(std::atomic<int64_t>& value, int64_t increment) {
+  value.store(
+      value.load(std::memory_order_relaxed) + increment,
+      std::memory_order_relaxed);
+}
+
+struct StatsRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadStats>> slots;
+  /// Totals at the last `reset_stats`, subtracted from the sums so that
+  /// writers never race with a reset.
+  Stats baseline = {};
+};
+
+StatsRegistry& registry() {
+  // never destroyed: threads may record while the process exits
+  static StatsRegistry* registry = new StatsRegistry();
+  return *registry;
+}
+
+/// Owns the slot of a thread and gives it back when the thread exits.
+struct SlotOwner {
+  SlotOwner() {
+    StatsRegistry& stats = registry();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    for (auto& candidate : stats.slots) {
+      if (!candidate->in_use) {
+        candidate->in_use = true;
+        slot = candidate.get();
+        return;
+      }
+    }
+    stats.slots.emplace_back(new ThreadStats());
+    slot = stats.slots.back().get();
+  }
+  ~SlotOwner() {
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    slot->in_use = false;
+  }
+
+  ThreadStats* slot;
+};
+
+ThreadStats& thread_stats() {
+  thread_local SlotOwner owner;
+  return *owner.slot;
+}
+
+int bucket_of(int64_t ns) {
+  int bucket = 0;
+  while (ns > 1 && bucket < kStatsBuckets - 1) {
+    ns >>= 1;
+    ++bucket;
+  }
+  return bucket;
+}
+
+/// Sums the slots, with the registry locked.
+Stats sum_slots(const StatsRegistry& stats) {
+  Stats total = {};
+  for (const auto& slot : stats.slots) {
+    for (int s = 0; s < kStageCount; ++s) {
+      StageStats& stage = total.stages[s];
+      stage.count += slot->stage_count[s].load(std::memory_order_relaxed);
+      stage.total_ns += slot->stage_ns[s].load(std::memory_order_relaxed);
+      stage.max_ns = std::max<int64_t>(
+          stage.max_ns, slot->stage_max_ns[s].load(std::memory_order_relaxed));
+      for (int b = 0; b < kStatsBuckets; ++b) {
+        stage.histogram[b] +=
+            slot->histogram[s][b].load(std::memory_order_relaxed);
+      }
+    }
+    for (int c = 0; c < kCounterCount; ++c) {
+      total.counters[c] += slot->counters[c].load(std::memory_order_relaxed);
+    }
+  }
+  return total;
+}
+
+} // namespace
+
+namespace detail {
+
+void record_stage(Stage stage, int64_t ns) {
+  ThreadStats& stats = thread_stats();
+  const int s = static_cast<int>(stage);
+  add(stats.stage_count[s], 1);
+  add(stats.stage_ns[s], ns);
+  add(stats.histogram[s][bucket_of(ns)], 1);
+  if (ns > stats.stage_max_ns[s].load(std::memory_order_relaxed)) {
+    stats.stage_max_ns[s].store(ns, std::memory_order_relaxed);
+  }
+}
+
+void add_to_counter(Counter counter, int64_t value) {
+  add(thread_stats().counters[static_cast<int>(counter)], value);
+}
+
+} // namespace detail
+
+void set_stats_enabled(bool enabled) {
+  detail::stats_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+Stats get_stats() {
+  StatsRegistry& stats = registry();
+  std::lock_guard<std::mutex> lock(stats.mutex);
+  Stats total = sum_slots(stats);
+  total.enabled = stats_enabled();
+  for (int s = 0; s < kStageCount; ++s) {
+    StageStats& stage = total.stages[s];
+    const StageStats& base = stats.baseline.stages[s];
+    stage.count -= base.count;
+    stage.total_ns -= base.total_ns;
+    for (int b = 0; b < kStatsBuckets; ++b) {
+      stage.histogram[b] -= base.histogram[b];
+    }
+  }
+  for (int c = 0; c < kCounterCount; ++c) {
+    total.counters[c] -= stats.baseline.counters[c];
+  }
+  return total;
+}
+
+void reset_stats() {
+  StatsRegistry& stats = registry();
+  std::lock_guard<std::mutex> lock(stats.mutex);
+  stats.baseline = sum_slots(stats);
+  // maxima cannot be subtracted; a store racing with a new maximum loses
+  // either, which is harmless
+  for (auto& slot : stats.slots) {
+    for (auto& max_ns : slot->stage_max_ns) {
+      max_ns.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+const char* stage_name(Stage stage) {
+  switch (stage) {
+    case Stage::kOpen:
+      return "open";
+    case Stage::kSeek:
+      return "seek";
+    case Stage::kDecode:
+      return "decode";
+    case Stage::kConvert:
+      return "convert";
+    case Stage::kResize:
+      return "resize";
+    case Stage::kEffects:
+      return "effects";
+    case Stage::kEncode:
+      return "encode";
+    case Stage::kCache:
+      return "cache";
+    default:
+      return "unknown";
+  }
+}
+
+const char* counter_name(Counter counter) {
+  switch (counter) {
+    case Counter::kFiles:
+      return "files";
+    case Counter::kErrors:
+      return "errors";
+    case Counter::kFallbacks:
+      return "fallbacks";
+    case Counter::kSamplesDecoded:
+      return "samples_decoded";
+    case Counter::kSamplesEncoded:
+      return "samples_encoded";
+    case Counter::kBytesConverted:
+      return "bytes_converted";
+    default:
+      return "unknown";
+  }
+}
+
+} // namespace audio
+} // namespace torch
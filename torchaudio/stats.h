@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+
+#if !defined(__cpp_lib_uncaught_exceptions) && !defined(_MSC_VER)
+#include <cxxabi.h>
+#endif
+
+namespace torch {
+namespace audio {
+
+/// Steps of reading and writing audio that are timed.
+enum class Stage : int {
+  /// Opening a file or buffer, including format detection and probing.
+  kOpen,
+  kSeek,
+  /// `sox_read`, i.e. decoding.
+  kDecode,
+  /// Converting and normalizing samples into tensors, and out of them.
+  kConvert,
+  /// Resizing output tensors.
+  kResize,
+  /// Flowing samples through an effects chain.
+  kEffects,
+  /// `sox_write`, i.e. encoding.
+  kEncode,
+  /// Looking up and inserting entries of the audio cache.
+  kCache,
+  kCount
+};
+
+/// Events and amounts that are counted.
+enum class Counter : int {
+  /// Files and buffers read or written through the entry points.
+  kFiles,
+  /// Those of them that ended with an exception.
+  kErrors,
+  /// Fast paths given up for the general one, e.g. a seek index that did not
+  /// match the decode, or a header that had to be read by libsox.
+  kFallbacks,
+  kSamplesDecoded,
+  kSamplesEncoded,
+  /// Bytes written into output tensors by sample conversion.
+  kBytesConverted,
+  kCount
+};
+
+constexpr int kStageCount = static_cast<int>(Stage::kCount);
+constexpr int kCounterCount = static_cast<int>(Counter::kCount);
+
+/// Buckets of the duration histograms: bucket `i` counts the durations of at
+/// least `2^i` and less than `2^(i + 1)` nanoseconds (bucket 0 includes 0),
+/// the last one everything longer.
+constexpr int kStatsBuckets = 40;
+
+struct StageStats {
+  int64_t count;
+  int64_t total_ns;
+  int64_t max_ns;
+  std::array<int64_t, kStatsBuckets> histogram;
+};
+
+struct Stats {
+  bool enabled;
+  std::array<StageStats, kStageCount> stages;
+  std::array<int64_t, kCounterCount> counters;
+};
+
+namespace detail {
+
+extern std::atomic<bool> stats_enabled;
+
+void record_stage(Stage stage, int64_t ns);
+void add_to_counter(Counter counter, int64_t value);
+
+inline int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace detail
+
+inline bool stats_enabled() {
+  return detail::stats_enabled.load(std::memory_order_relaxed);
+}
+
+/// Turns the collection of statistics on or off, off by default. When off,
+/// every timer and counter costs a relaxed load and a branch.
+void set_stats_enabled(bool enabled);
+
+/// Statistics of every thread since the last `reset_stats`. Threads update
+/// their own counters without locks or read-modify-write operations; this
+/// sums them, so it may miss the updates of the last few nanoseconds.
+Stats get_stats();
+
+/// Starts the statistics again from zero.
+void reset_stats();
+
+const char* stage_name(Stage stage);
+const char* counter_name(Counter counter);
+
+inline void count(Counter counter, int64_t value = 1) {
+  if (stats_enabled()) {
+    detail::add_to_counter(counter, value);
+  }
+}
+
+/// Times its scope as `stage`.
+class StageTimer {
+ public:
+  explicit StageTimer(Stage stage)
+      : stage_(stage), start_(stats_enabled() ? detail::now_ns() : -1) {}
+  StageTimer(const StageTimer& other) = delete;
+  StageTimer& operator=(const StageTimer& other) = delete;
+  ~StageTimer() {
+    if (start_ >= 0) {
+      detail::record_stage(stage_, detail::now_ns() - start_);
+    }
+  }
+
+ private:
+  Stage stage_;
+  int64_t start_;
+};
+
+/// Calls `fn` timed as `stage` and returns its result.
+template <typename Fn>
+auto timed(Stage stage, const Fn& fn) -> decltype(fn()) {
+  StageTimer timer(stage);
+  return fn();
+}
+
+/// `std::uncaught_exceptions` of C++17, which strict C++11 builds lack.
+inline int uncaught_exceptions() {
+#if defined(__cpp_lib_uncaught_exceptions) || defined(_MSC_VER)
+  return std::uncaught_exceptions();
+#else
+  // the layout of `__cxa_eh_globals` is fixed by the Itanium C++ ABI
+  struct EhGlobals {
+    void* caught_exceptions;
+    unsigned int uncaught_exceptions;
+  };
+  return static_cast<int>(
+      reinterpret_cast<const EhGlobals*>(abi::__cxa_get_globals())
+          ->uncaught_exceptions);
+#endif
+}
+
+/// Counts a file read or written in its scope, and an error if the scope is
+/// left by an exception.
+class FileScope {
+ public:
+  FileScope() : exceptions_(uncaught_exceptions()) {
+    count(Counter::kFiles);
+  }
+  FileScope(const FileScope& other) = delete;
+  FileScope& operator=(const FileScope& other) = delete;
+  ~FileScope() {
+    // a scope opened while another exception unwinds only fails if a new
+    // one leaves it
+    if (uncaught_exceptions() > exceptions_) {
+      count(Counter::kErrors);
+    }
+  }
+
+ private:
+  const int exceptions_;
+};
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,187 @@
+#include <torch/extension.h>
+
+#include <sox.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "sample_conversion.h"
+#include "stats.h"
+#include "stream_writer.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+/// Blocks queued to the writer thread at most, before `write` waits.
+constexpr size_t kMaxPendingBlocks = 8;
+
+} // namespace
+
+StreamWriter::StreamWriter(sox_format_t* fd, bool background)
+    : fd_(fd), channels_(fd->signal.channels), background_(background) {
+  if (channels_ <= 0 || channels_ > kEncodeChunkSize) {
+    sox_close(fd_);
+    throw std::runtime_error("Error writing audio file: invalid channels");
+  }
+  if (background_) {
+    writer_ = std::thread([this] { writer_loop(); });
+  }
+}
+
+StreamWriter::~StreamWriter() {
+  if (fd_ != nullptr) {
+    finish();
+    sox_close(fd_);
+  }
+}
+
+int64_t StreamWriter::write(
+    const at::Tensor& samples,
+    bool ch_first,
+    double scale) {
+  if (fd_ == nullptr) {
+    throw std::runtime_error("Error writing audio file: the file is closed");
+  }
+  throw_if_failed();
+  const int64_t frame_dim = ch_first ? 1 : 0;
+  const int64_t channel_dim = ch_first ? 0 : 1;
+  if (samples.dim() != 2 || samples.size(channel_dim) != channels_) {
+    throw std::runtime_error(
+        "Error writing audio file: expected samples of " +
+        std::to_string(channels_) + " channels");
+  }
+  const int64_t frames = samples.size(frame_dim);
+  const int64_t frame_stride = samples.stride(frame_dim);
+  const int64_t channel_stride = samples.stride(channel_dim);
+  const int64_t block_frames = kEncodeChunkSize / channels_;
+
+  int64_t clips = 0;
+  AT_DISPATCH_ALL_TYPES(samples.type(), "stream_writer_write", [&] {
+    const scalar_t* data = samples.data<scalar_t>();
+    // interleaved samples are converted where they are, others are gathered
+    // into a staging block first
+    const bool interleaved =
+        channel_stride == 1 && (frame_stride == channels_ || frames == 1);
+    scalar_t staging[kEncodeChunkSize];
+    for (int64_t first = 0; first < frames; first += block_frames) {
+      const int64_t n = std::min(block_frames, frames - first);
+      std::vector<sox_sample_t> block = take_block();
+      block.resize(n * channels_);
+      {
+        StageTimer timer(Stage::kConvert);
+        const scalar_t* src = data + first * frame_stride;
+        if (!interleaved) {
+          for (int64_t i = 0; i < n; ++i) {
+            for (int64_t c = 0; c < channels_; ++c) {
+              staging[i * channels_ + c] =
+                  src[i * frame_stride + c * channel_stride];
+            }
+          }
+          src = staging;
+        }
+        clips += to_sox_samples(src, block.data(), n * channels_, scale);
+      }
+      submit(std::move(block));
+    }
+  });
+  samples_ += frames * channels_;
+  throw_if_failed();
+  return clips;
+}
+
+void StreamWriter::close() {
+  if (fd_ == nullptr) {
+    return;
+  }
+  finish();
+  const int status = sox_close(fd_);
+  fd_ = nullptr;
+  throw_if_failed();
+  if (status != SOX_SUCCESS) {
+    throw std::runtime_error("Error writing audio file: could not close it");
+  }
+}
+
+void StreamWriter::submit(std::vector<sox_sample_t> block) {
+  if (!background_) {
+    write_block(block);
+    spare_.push_back(std::move(block));
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] {
+    return pending_.size() < kMaxPendingBlocks || !error_.empty();
+  });
+  pending_.push_back(std::move(block));
+  cv_.notify_all();
+}
+
+void StreamWriter::write_block(const std::vector<sox_sample_t>& block) {
+  const size_t written = timed(Stage::kEncode, [&] {
+    return sox_write(fd_, block.data(), block.size());
+  });
+  count(Counter::kSamplesEncoded, written);
+  if (written != block.size()) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_.empty()) {
+      error_ = "Error writing audio file: could not write entire buffer";
+    }
+  }
+}
+
+std::vector<sox_sample_t> StreamWriter::take_block() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (spare_.empty()) {
+    std::vector<sox_sample_t> block;
+    block.reserve(kEncodeChunkSize);
+    return block;
+  }
+  std::vector<sox_sample_t> block = std::move(spare_.back());
+  spare_.pop_back();
+  return block;
+}
+
+void StreamWriter::writer_loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return !pending_.empty() || finishing_; });
+    if (pending_.empty()) {
+      return;
+    }
+    std::vector<sox_sample_t> block = std::move(pending_.front());
+    pending_.pop_front();
+    // after an error, the blocks left are dropped
+    const bool failed = !error_.empty();
+    lock.unlock();
+    if (!failed) {
+      write_block(block);
+    }
+    lock.lock();
+    spare_.push_back(std::move(block));
+    cv_.notify_all();
+  }
+}
+
+void StreamWriter::throw_if_failed() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!error_.empty()) {
+    throw std::runtime_error(error_);
+  }
+}
+
+void StreamWriter::finish() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finishing_ = true;
+  }
+  cv_.notify_all();
+  writer_.join();
+}
+
+} // namespace audio
+} // namespace torch
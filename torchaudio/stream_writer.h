@@ -0,0 +1,77 @@
+#pragma once
+
+#include <sox.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace at {
+struct Tensor;
+} // namespace at
+
+namespace torch {
+namespace audio {
+
+/// Writes an audio file a chunk of samples at a time, so that generated or
+/// augmented audio of any length is written with memory for a few blocks
+/// only. Chunks of any type and strides are converted into SoX samples one
+/// block of `kEncodeChunkSize` samples at a time, with the SIMD kernels of
+/// `to_sox_samples`, and written by `sox_write`; with `background`, blocks
+/// are queued to a thread of their own that writes them while the next ones
+/// are converted. Not safe to use from several threads at once.
+class StreamWriter {
+ public:
+  /// Takes over `fd`, opened by `sox_open_write`.
+  StreamWriter(sox_format_t* fd, bool background);
+  StreamWriter(const StreamWriter& other) = delete;
+  StreamWriter& operator=(const StreamWriter& other) = delete;
+  /// Closes the file if `close` was not called, ignoring errors.
+  ~StreamWriter();
+
+  /// Appends `samples`, `L x C` (`C x L` if `ch_first`) with any strides,
+  /// multiplied by `scale` to get SoX samples. Returns the number of samples
+  /// that clipped. Throws if an earlier block could not be written.
+  int64_t write(const at::Tensor& samples, bool ch_first, double scale);
+
+  /// Writes the blocks left and closes the file, which gets its final
+  /// header. Throws if any block could not be written.
+  void close();
+
+  /// Frames accepted by `write` so far.
+  int64_t frames() const {
+    return samples_ / channels_;
+  }
+
+ private:
+  /// Writes a full or final block, directly or through the queue.
+  void submit(std::vector<sox_sample_t> block);
+  /// Writes `block` to the file, or records why it could not.
+  void write_block(const std::vector<sox_sample_t>& block);
+  /// Takes a block to convert into, recycled from the writer thread.
+  std::vector<sox_sample_t> take_block();
+  void writer_loop();
+  void throw_if_failed();
+  /// Stops the writer thread once the queue is empty.
+  void finish();
+
+  sox_format_t* fd_;
+  int64_t channels_;
+  int64_t samples_ = 0;
+  bool background_;
+
+  std::thread writer_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::vector<sox_sample_t>> pending_;
+  std::vector<std::vector<sox_sample_t>> spare_;
+  bool finishing_ = false;
+  std::string error_;
+};
+
+} // namespace audio
+} // namespace torch
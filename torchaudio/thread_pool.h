@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+namespace torch {
+namespace audio {
+
+/// Fixed-size pool of worker threads used by the batch entry points. None of
+/// its methods touch Python, so they are meant to be called with the GIL
+/// released.
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t num_threads) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      workers_.emplace_back([this] { worker_loop(); });
+    }
+  }
+  ThreadPool(const ThreadPool& other) = delete;
+  ThreadPool& operator=(const ThreadPool& other) = delete;
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  size_t size() const {
+    return workers_.size();
+  }
+
+  /// Process-wide pool with one worker per hardware thread. A forked child,
+  /// e.g. a data loader worker, starts a pool of its own on first use: the
+  /// workers of the parent do not exist in it.
+  static ThreadPool& global() {
+    std::lock_guard<std::mutex> lock(global_mutex());
+    ThreadPool*& pool = global_pool();
+    if (pool == nullptr) {
+      static std::once_flag registered;
+      std::call_once(registered, [] {
+        pthread_atfork(
+            [] { global_mutex().lock(); },
+            [] { global_mutex().unlock(); },
+            [] {
+              // the pool of the parent is left as it is, joining or
+              // destroying it would wait for threads that never run
+              global_pool() = nullptr;
+              global_mutex().unlock();
+            });
+      });
+      pool = new ThreadPool(
+          std::max<unsigned>(std::thread::hardware_concurrency(), 1));
+    }
+    return *pool;
+  }
+
+  /// Calls `fn(i)` for every `i` in `[0, n)` on at most `num_threads` threads
+  /// (the calling thread included, `num_threads <= 0` uses the whole pool)
+  /// and blocks until all calls returned. The first exception thrown by `fn`
+  /// is rethrown here once every index has been processed.
+  /// Nested calls from inside `fn` are safe: the caller always works through
+  /// the indices itself, helpers only speed it up.
+  void parallel_for(
+      int64_t n,
+      const std::function<void(int64_t)>& fn,
+      int num_threads = 0) {
+    if (n <= 0) {
+      return;
+    }
+    const int64_t max_threads =
+        num_threads > 0 ? num_threads : static_cast<int64_t>(size()) + 1;
+    const int64_t helpers = std::min<int64_t>(max_threads, n) - 1;
+
+    auto state = std::make_shared<ForState>(n, fn);
+    for (int64_t i = 0; i < helpers; ++i) {
+      submit([state] { state->run(); });
+    }
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->finished == state->n; });
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+ private:
+  struct ForState {
+    ForState(int64_t n, const std::function<void(int64_t)>& fn)
+        : n(n), fn(fn) {}
+
+    void run() {
+      for (int64_t i = next++; i < n; i = next++) {
+        try {
+          fn(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finished == n) {
+          cv.notify_all();
+        }
+      }
+    }
+
+    const int64_t n;
+    // only dereferenced while the caller of parallel_for is still waiting
+    const std::function<void(int64_t)>& fn;
+    std::atomic<int64_t> next{0};
+    int64_t finished = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+
+  // never destroyed, workers may still wait for tasks when the process exits
+  static ThreadPool*& global_pool() {
+    static ThreadPool* pool = nullptr;
+    return pool;
+  }
+
+  static std::mutex& global_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  void worker_loop() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (stopping_ && tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+};
+
+} // namespace audio
+} // namespace torch
@@ -3,14 +3,46 @@
 #include <sox.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <stdexcept>
 #include <vector>
 #include <cstring>
-#include <assert.h>
+
+#include "cache.h"
+#include "feature_extractor.h"
+#include "header_info.h"
+#include "mu_law.h"
+#include "resample.h"
+#include "sample_conversion.h"
+#include "seek_index.h"
+#include "shard.h"
+#include "stats.h"
+#include "stream_writer.h"
+#include "thread_pool.h"
+#include "vad.h"
+#include "wav_reader.h"
 
 namespace torch {
 namespace audio {
+
+struct SoxEffect {
+  SoxEffect() : ename(""), eopts({""})  { }
+  std::string ename;
+  std::vector<std::string> eopts;
+};
+
 namespace {
 
 struct ds_audio_buffer {
@@ -28,7 +60,15 @@ struct SoxDescriptor {
   SoxDescriptor& operator=(const SoxDescriptor& other) = delete;
   SoxDescriptor& operator=(SoxDescriptor&& other) = delete;
   ~SoxDescriptor() {
-    sox_close(fd_);
+    close();
+  }
+  /// Closes the file before the descriptor goes out of scope, e.g. to have
+  /// a memstream write its buffer.
+  void close() noexcept {
+    if (fd_ != nullptr) {
+      sox_close(fd_);
+      fd_ = nullptr;
+    }
   }
   sox_format_t* operator->() noexcept {
     return fd_;
@@ -41,464 +81,2968 @@ struct SoxDescriptor {
   sox_format_t* fd_;
 };
 
-int64_t write_audio(SoxDescriptor& fd, at::Tensor tensor) {
-  std::vector<sox_sample_t> buffer(tensor.numel());
+/// `sox_open_read`, timed.
+sox_format_t* timed_open_read(
+    const char* path,
+    const sox_signalinfo_t* si,
+    const sox_encodinginfo_t* ei,
+    const char* ft) {
+  return timed(Stage::kOpen, [&] { return sox_open_read(path, si, ei, ft); });
+}
 
-  AT_DISPATCH_ALL_TYPES(tensor.type(), "write_audio_buffer", [&] {
-    auto* data = tensor.data<scalar_t>();
-    std::copy(data, data + tensor.numel(), buffer.begin());
+/// `sox_open_mem_read`, timed.
+sox_format_t* timed_open_mem_read(
+    void* buffer,
+    size_t size,
+    const sox_signalinfo_t* si,
+    const sox_encodinginfo_t* ei,
+    const char* ft) {
+  return timed(Stage::kOpen, [&] {
+    return sox_open_mem_read(buffer, size, si, ei, ft);
   });
+}
+
+/// Resizes `output` to `sizes` with contiguous strides, so that it can be
+/// filled through a raw pointer without an intermediate copy.
+void resize_contiguous(at::Tensor& output, at::IntList sizes) {
+  StageTimer timer(Stage::kResize);
+  if (!output.is_contiguous()) {
+    output.resize_({0});
+  }
+  output.resize_(sizes);
+}
 
-  const auto samples_written =
-      sox_write(fd.get(), buffer.data(), buffer.size());
+/// Appends what `si`, `ei` and `ft` change about reading a file to the
+/// parameters of a cache key.
+void describe_format(
+    std::ostream& params,
+    const sox_signalinfo_t* si,
+    const sox_encodinginfo_t* ei,
+    const char* ft) {
+  if (si != nullptr) {
+    params << " si " << si->rate << ' ' << si->channels << ' '
+           << si->precision << ' ' << si->length;
+  }
+  if (ei != nullptr) {
+    params << " ei " << ei->encoding << ' ' << ei->bits_per_sample << ' '
+           << ei->compression << ' ' << ei->reverse_bytes << ' '
+           << ei->reverse_nibbles << ' ' << ei->reverse_bits << ' '
+           << ei->opposite_endian;
+  }
+  if (ft != nullptr) {
+    params << " ft " << ft;
+  }
+}
 
-  return samples_written;
+/// Produces `output` with `read`, which returns the sample rate, through the
+/// process-wide audio cache if one is set. `params` holds everything but
+/// the file that the result depends on; the tensor type is added here.
+template <typename Read>
+int read_through_cache(
+    const std::string& file_name,
+    const std::string& params,
+    at::Tensor& output,
+    const Read& read) {
+  const std::shared_ptr<AudioCache> cache = audio_cache();
+  const std::string key = cache
+      ? AudioCache::key(
+            file_name,
+            params + " type " +
+                std::to_string(static_cast<int>(output.type().scalarType())))
+      : std::string();
+  if (key.empty()) {
+    return read();
+  }
+  const int cached_rate =
+      timed(Stage::kCache, [&] { return cache->lookup(key, output); });
+  if (cached_rate >= 0) {
+    return cached_rate;
+  }
+  const int sample_rate = read();
+  timed(Stage::kCache, [&] { cache->insert(key, output, sample_rate); });
+  return sample_rate;
 }
 
 void read_audio(
     SoxDescriptor& fd,
     at::Tensor output,
-    int64_t buffer_length) {
-  std::vector<sox_sample_t> buffer(buffer_length);
+    int64_t buffer_length,
+    double normalization) {
+  const int64_t number_of_channels = fd->signal.channels;
 
-  int number_of_channels = fd->signal.channels;
-  const int64_t samples_read = sox_read(fd.get(), buffer.data(), buffer_length);
+  // size the output once from the signal length and decode straight into it
+  resize_contiguous(
+      output, {buffer_length / number_of_channels, number_of_channels});
+
+  int64_t samples_read = 0;
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_buffer", [&] {
+    samples_read = decode_into(
+        fd.get(), output.data<scalar_t>(), buffer_length, normalization);
+  });
   if (samples_read == 0) {
     throw std::runtime_error(
         "Error reading audio file: empty file or read failed in sox_read");
   }
 
-  output.resize_({samples_read / number_of_channels, number_of_channels});
-  output = output.contiguous();
+  // the header length can overestimate (e.g. mp3), shrinking keeps the storage
+  if (samples_read < buffer_length) {
+    output.resize_({samples_read / number_of_channels, number_of_channels});
+  }
+}
 
-  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_buffer", [&] {
-    auto* data = output.data<scalar_t>();
-    std::copy(buffer.begin(), buffer.begin() + samples_read, data);
+/// Validates `offset` and `nframes` (in frames) against a signal of
+/// `total_length` samples and returns the number of samples to read.
+int64_t range_length(
+    int64_t total_length,
+    int64_t number_of_channels,
+    int64_t offset,
+    int64_t nframes) {
+  // multiply offset and number of frames by number of channels
+  offset *= number_of_channels;
+  nframes *= number_of_channels;
+
+  if (total_length == 0) {
+    throw std::runtime_error("Error reading audio file: unknown length");
+  }
+  if (offset > total_length) {
+    throw std::runtime_error("Offset past EOF");
+  }
+
+  // calculate buffer length
+  int64_t buffer_length = total_length;
+  if (offset > 0) {
+      buffer_length -= offset;
+  }
+  if (nframes > 0 && buffer_length > nframes) {
+      buffer_length = nframes;
+  }
+  return buffer_length;
+}
+
+/// Validates `offset` and `nframes` (in frames) against the signal length of
+/// `fd`, seeks to `offset` and returns the number of samples to read.
+int64_t seek_to_range(SoxDescriptor& fd, int64_t offset, int64_t nframes) {
+  const int number_of_channels = fd->signal.channels;
+  const int64_t buffer_length =
+      range_length(fd->signal.length, number_of_channels, offset, nframes);
+  offset *= number_of_channels;
+
+  // seek to offset point before reading data
+  if (timed(Stage::kSeek, [&] { return sox_seek(fd.get(), offset, 0); }) ==
+      SOX_EOF) {
+    throw std::runtime_error("sox_seek reached EOF, try reducing offset or num_samples");
+  }
+  return buffer_length;
+}
+
+/// Decodes the samples of `fd` selected by `offset` and `nframes` (in frames)
+/// into `output`, sized `L x C`, like `seek_to_range` and `read_audio` do for
+/// libsox. Only the selected range of the mapping is touched.
+void read_mapped(
+    const MappedPcmFile& fd,
+    at::Tensor output,
+    int64_t offset,
+    int64_t nframes,
+    double normalization) {
+  if (offset < 0) {
+    throw std::runtime_error("Offset must not be negative");
+  }
+  const int64_t number_of_channels = fd.signal().channels;
+  const int64_t buffer_length = range_length(
+      fd.signal().length, number_of_channels, offset, nframes);
+  if (buffer_length == 0) {
+    throw std::runtime_error(
+        "Error reading audio file: empty file or read failed in sox_read");
+  }
+  resize_contiguous(
+      output, {buffer_length / number_of_channels, number_of_channels});
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_mapped", [&] {
+    fd.read(
+        offset * number_of_channels,
+        buffer_length,
+        output.data<scalar_t>(),
+        normalization);
+  });
+}
+
+/// The samples of an MP3 file from an offset, decoded by libsox in memory
+/// from the few frames of it that a seek index says are needed. libsox
+/// formats must be loaded.
+class IndexedMp3 {
+ public:
+  /// Opens the span of `index` for `nframes` frames (0 to the end) from
+  /// `offset` and decodes up to `offset`; `get` is null if that fails.
+  IndexedMp3(
+      const std::string& file_name,
+      const Mp3SeekIndex& index,
+      int64_t offset,
+      int64_t nframes)
+      : span_(index.span(offset, nframes)),
+        channels_(index.signal().channels),
+        scratch_(kDecodeChunkSize - kDecodeChunkSize % channels_) {
+    bytes_.resize(span_.size);
+    std::FILE* file = std::fopen(file_name.c_str(), "rb");
+    if (file == nullptr) {
+      return;
+    }
+    const bool complete = fseeko(file, span_.offset, SEEK_SET) == 0 &&
+        std::fread(bytes_.data(), 1, bytes_.size(), file) == bytes_.size();
+    std::fclose(file);
+    if (!complete) {
+      return;
+    }
+
+    // the span has no length for libsox to find, nor to truncate reads at
+    sox_signalinfo_t signal = index.signal();
+    signal.length = SOX_IGNORE_LENGTH;
+    fd_.reset(new SoxDescriptor(timed_open_mem_read(
+        bytes_.data(), bytes_.size(), &signal, nullptr, "mp3")));
+    while (fd_->get() != nullptr && read_ < span_.skip) {
+      const size_t got = sox_read(
+          fd_->get(),
+          scratch_.data(),
+          std::min<int64_t>(scratch_.size(), span_.skip - read_));
+      if (got == 0) {
+        break;
+      }
+      read_ += got;
+    }
+  }
+
+  sox_format_t* get() {
+    return fd_ ? fd_->get() : nullptr;
+  }
+
+  /// Decodes the rest of the span after `samples_read` samples were read
+  /// from the offset, and tells whether libsox decoded the frames to the
+  /// samples the index expects.
+  bool finish(int64_t samples_read) {
+    int64_t total = read_ + samples_read;
+    while (const size_t got =
+               sox_read(fd_->get(), scratch_.data(), scratch_.size())) {
+      total += got;
+    }
+    return read_ == span_.skip &&
+        (total == span_.samples || total == span_.samples_with_last_frame);
+  }
+
+ private:
+  Mp3Span span_;
+  int64_t channels_;
+  std::vector<uint8_t> bytes_;
+  std::vector<sox_sample_t> scratch_;
+  std::unique_ptr<SoxDescriptor> fd_;
+  int64_t read_ = 0;
+};
+
+/// The seek index to read `file_name` at `offset` with, or null if it is
+/// read by libsox as it is: at the start, for other formats than MP3, for
+/// overridden signal or encoding, or if indices are disabled.
+std::shared_ptr<Mp3SeekIndex> seek_index_for(
+    const std::string& file_name,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft) {
+  if (offset <= 0 || si != nullptr || ei != nullptr ||
+      (ft != nullptr && std::strcmp(ft, "mp3") != 0)) {
+    return nullptr;
+  }
+  auto index = mp3_seek_index(file_name, [&](sox_signalinfo_t* signal) {
+    SoxDescriptor fd(timed_open_read(file_name.c_str(), si, ei, ft));
+    if (fd.get() == nullptr) {
+      return false;
+    }
+    *signal = fd->signal;
+    return true;
+  });
+  return index && index->enabled() ? index : nullptr;
+}
+
+/// Decodes the samples of the MP3 file `file_name` selected by `offset` and
+/// `nframes` (in frames) into `output`, sized `L x C`, through `index`.
+/// Returns false, with `output` in any state, if libsox decodes the frames
+/// to other than the index expects.
+bool read_indexed_mp3(
+    const std::string& file_name,
+    const Mp3SeekIndex& index,
+    at::Tensor output,
+    int64_t offset,
+    int64_t nframes,
+    double normalization) {
+  const int64_t number_of_channels = index.signal().channels;
+  const int64_t buffer_length = range_length(
+      index.signal().length, number_of_channels, offset, nframes);
+  IndexedMp3 mp3(file_name, index, offset, nframes);
+  if (mp3.get() == nullptr) {
+    return false;
+  }
+
+  resize_contiguous(
+      output, {buffer_length / number_of_channels, number_of_channels});
+  int64_t samples_read = 0;
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_indexed_mp3", [&] {
+    samples_read = decode_into(
+        mp3.get(), output.data<scalar_t>(), buffer_length, normalization);
+  });
+  if (!mp3.finish(samples_read)) {
+    return false;
+  }
+  if (samples_read == 0) {
+    throw std::runtime_error(
+        "Error reading audio file: empty file or read failed in sox_read");
+  }
+  if (samples_read < buffer_length) {
+    output.resize_({samples_read / number_of_channels, number_of_channels});
+  }
+  return true;
+}
+
+/// What of libsox is initialized. `shutdown_sox` quits both the effects
+/// library and the format handlers, so either is initialized again when next
+/// needed rather than only once per process.
+struct SoxState {
+  std::mutex mutex;
+  std::atomic<bool> formats{false};
+  bool effects = false;
+  int status = SOX_EOF;
+};
+
+SoxState& sox_state() {
+  static SoxState state;
+  return state;
+}
+
+/// Loads the format handlers before files are opened from several threads;
+/// lazy initialization inside libsox is not thread-safe.
+void ensure_sox_formats() {
+  SoxState& state = sox_state();
+  if (state.formats.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.formats.load(std::memory_order_relaxed)) {
+    sox_format_init();
+    state.formats.store(true, std::memory_order_release);
+  }
+}
+
+/// Initializes the effects library, whichever thread gets here first.
+/// Effects chains need it, so `initialize_sox` is optional and calling it
+/// more than once is harmless. SoX only reports errors, which are raised as
+/// exceptions as well.
+int ensure_sox_effects() {
+  ensure_sox_formats();
+  SoxState& state = sox_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.effects) {
+    sox_get_globals()->verbosity = 1;
+    state.status = sox_init();
+    state.effects = true;
+  }
+  return state.status;
+}
+
+/// Quits libsox; the next file or effects chain initializes it again.
+int quit_sox() {
+  SoxState& state = sox_state();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  const int status = sox_quit();
+  state.effects = false;
+  state.formats.store(false, std::memory_order_release);
+  return status;
+}
+
+/// Effects of libsox that use its process-wide DFT cache (`lsx_safe_rdft`),
+/// which libsox only locks in OpenMP builds.
+const char* const kSharedDftEffects[] = {"fir",
+                                         "hilbert",
+                                         "loudness",
+                                         "noiseprof",
+                                         "noisered",
+                                         "rate",
+                                         "sinc",
+                                         "spectrogram"};
+
+/// Held by every call into a handler of `kSharedDftEffects`, across all
+/// chains and threads.
+std::mutex& shared_dft_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+/// A copy of a libsox handler whose calls hold `shared_dft_mutex`.
+struct SerializedHandler {
+  sox_effect_handler_t handler;
+  const sox_effect_handler_t* original;
+};
+
+/// Every serialized handler made, never freed as effects keep pointing at
+/// them. Only used with `shared_dft_mutex` held.
+std::vector<std::unique_ptr<SerializedHandler>>& serialized_handlers() {
+  static std::vector<std::unique_ptr<SerializedHandler>> handlers;
+  return handlers;
+}
+
+/// Calls `fn` with the libsox handler of the serialized effect `effp` while
+/// holding the mutex; effects keep the name pointer of their handler.
+template <typename Fn>
+int call_serialized(const sox_effect_t* effp, const Fn& fn) {
+  std::lock_guard<std::mutex> lock(shared_dft_mutex());
+  for (const auto& serialized : serialized_handlers()) {
+    if (serialized->handler.name == effp->handler.name) {
+      return fn(*serialized->original);
+    }
+  }
+  return SOX_EOF;
+}
+
+int serialized_start(sox_effect_t* effp) {
+  return call_serialized(effp, [effp](const sox_effect_handler_t& handler) {
+    return handler.start(effp);
+  });
+}
+
+int serialized_flow(
+    sox_effect_t* effp,
+    const sox_sample_t* ibuf,
+    sox_sample_t* obuf,
+    size_t* isamp,
+    size_t* osamp) {
+  return call_serialized(effp, [&](const sox_effect_handler_t& handler) {
+    return handler.flow(effp, ibuf, obuf, isamp, osamp);
+  });
+}
+
+int serialized_drain(sox_effect_t* effp, sox_sample_t* obuf, size_t* osamp) {
+  return call_serialized(effp, [&](const sox_effect_handler_t& handler) {
+    return handler.drain(effp, obuf, osamp);
+  });
+}
+
+int serialized_stop(sox_effect_t* effp) {
+  return call_serialized(effp, [effp](const sox_effect_handler_t& handler) {
+    return handler.stop(effp);
   });
 }
+
+int serialized_kill(sox_effect_t* effp) {
+  return call_serialized(effp, [effp](const sox_effect_handler_t& handler) {
+    return handler.kill(effp);
+  });
+}
+
+/// `handler`, or for the effects of `kSharedDftEffects` a handler that runs
+/// one call into any of them at a time, so that chains may flow on several
+/// threads at once. Everything else of libsox an effect touches while it
+/// runs is its own state.
+const sox_effect_handler_t* serialize_shared_dft(
+    const sox_effect_handler_t* handler) {
+  if (handler == nullptr ||
+      std::none_of(
+          std::begin(kSharedDftEffects),
+          std::end(kSharedDftEffects),
+          [handler](const char* name) {
+            return std::strcmp(name, handler->name) == 0;
+          })) {
+    return handler;
+  }
+  std::lock_guard<std::mutex> lock(shared_dft_mutex());
+  auto& handlers = serialized_handlers();
+  for (const auto& serialized : handlers) {
+    if (serialized->original == handler) {
+      return &serialized->handler;
+    }
+  }
+  std::unique_ptr<SerializedHandler> serialized(new SerializedHandler);
+  serialized->original = handler;
+  serialized->handler = *handler;
+  // null handlers are filled in with the defaults of libsox
+  sox_effect_handler_t& wrapped = serialized->handler;
+  wrapped.start = handler->start ? serialized_start : nullptr;
+  wrapped.flow = handler->flow ? serialized_flow : nullptr;
+  wrapped.drain = handler->drain ? serialized_drain : nullptr;
+  wrapped.stop = handler->stop ? serialized_stop : nullptr;
+  wrapped.kill = handler->kill ? serialized_kill : nullptr;
+  handlers.push_back(std::move(serialized));
+  return &handlers.back()->handler;
+}
+
+/// Opens `file_name` for reading once the format handlers are loaded.
+sox_format_t* open_read(const std::string& file_name) {
+  ensure_sox_formats();
+  return timed_open_read(
+      file_name.c_str(),
+      /*signal=*/nullptr,
+      /*encoding=*/nullptr,
+      /*filetype=*/nullptr);
+}
+
+/// Adds the builtin "input" effect reading from `input` to `chain`.
+void add_input_effect(
+    sox_effects_chain_t* chain,
+    sox_format_t* input,
+    sox_signalinfo_t* interm_signal) {
+  sox_effect_t* e = sox_create_effect(sox_find_effect("input"));
+  char* io_args[1];
+  io_args[0] = (char*)input;
+  sox_effect_options(e, 1, io_args);
+  const int status = sox_add_effect(chain, e, interm_signal, &input->signal);
+  free(e);
+  if (status != SOX_SUCCESS) {
+    throw std::runtime_error("Could not add effect: input");
+  }
+}
+
+/// Called with every buffer that reaches the end of an effects chain; return
+/// false to stop the flow.
+using SampleCallback = std::function<bool(const sox_sample_t*, size_t)>;
+
+struct CallbackSinkPriv {
+  SampleCallback* callback;
+};
+
+int callback_sink_getopts(sox_effect_t* effp, int argc, char** argv) {
+  if (argc != 2) {
+    return SOX_EOF;
+  }
+  auto* priv = static_cast<CallbackSinkPriv*>(effp->priv);
+  priv->callback = reinterpret_cast<SampleCallback*>(argv[1]);
+  return SOX_SUCCESS;
+}
+
+int callback_sink_flow(
+    sox_effect_t* effp,
+    const sox_sample_t* ibuf,
+    sox_sample_t* /*obuf*/,
+    size_t* isamp,
+    size_t* osamp) {
+  auto* priv = static_cast<CallbackSinkPriv*>(effp->priv);
+  *osamp = 0;
+  if (*isamp > 0 && !(*priv->callback)(ibuf, *isamp)) {
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+/// Output effect that hands the samples leaving a chain to a `SampleCallback`
+/// instead of encoding them into a `sox_format_t`.
+const sox_effect_handler_t* callback_sink_handler() {
+  static const sox_effect_handler_t handler = {
+      "callback_sink",
+      nullptr,
+      SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+      callback_sink_getopts,
+      nullptr,
+      callback_sink_flow,
+      nullptr,
+      nullptr,
+      nullptr,
+      sizeof(CallbackSinkPriv)};
+  return &handler;
+}
+
+/// Adds a `callback_sink` effect calling `callback` to the end of `chain`.
+/// `callback` must outlive the chain.
+void add_callback_sink(
+    sox_effects_chain_t* chain,
+    SampleCallback* callback,
+    sox_signalinfo_t* interm_signal) {
+  sox_effect_t* e = sox_create_effect(callback_sink_handler());
+  char* sink_args[1];
+  sink_args[0] = reinterpret_cast<char*>(callback);
+  sox_effect_options(e, 1, sink_args);
+  const int status = sox_add_effect(chain, e, interm_signal, interm_signal);
+  free(e);
+  if (status != SOX_SUCCESS) {
+    throw std::runtime_error("Could not add effect: callback_sink");
+  }
+}
+
+/// Growable tensor the samples leaving an effects chain are appended to. The
+/// samples are quantized to `bits` of precision as encoding them would (not
+/// at all for `bits` 0 or 32), converted and normalized on arrival, so the
+/// chain output never goes through an encoded buffer.
+class TensorSink {
+ public:
+  TensorSink(
+      at::Tensor output,
+      int64_t capacity,
+      unsigned bits,
+      double normalization)
+      : output_(output),
+        bits_(bits >= 8 && bits < 32 ? bits : 0),
+        normalization_(normalization) {
+    capacity_ = std::max<int64_t>(capacity, kDecodeChunkSize);
+    resize_contiguous(output_, {capacity_});
+  }
+
+  /// `SampleCallback` interface, never throws into libsox: errors are kept
+  /// and rethrown by `finish`.
+  bool append(const sox_sample_t* samples, size_t n) {
+    try {
+      const int64_t count = n;
+      if (size_ + count > capacity_) {
+        capacity_ = std::max(2 * capacity_, size_ + count);
+        output_.resize_({capacity_});
+      }
+      AT_DISPATCH_ALL_TYPES(output_.type(), "tensor_sink", [&] {
+        scalar_t* dst = output_.data<scalar_t>() + size_;
+        if (bits_ == 0) {
+          convert_samples(samples, dst, count, normalization_);
+          return;
+        }
+        sox_sample_t staging[kDecodeChunkSize];
+        for (int64_t i = 0; i < count; i += kDecodeChunkSize) {
+          const int64_t m = std::min(kDecodeChunkSize, count - i);
+          quantize_samples(samples + i, staging, m, bits_);
+          convert_samples(staging, dst + i, m, normalization_);
+        }
+      });
+      size_ += count;
+      return true;
+    } catch (...) {
+      error_ = std::current_exception();
+      return false;
+    }
+  }
+
+  /// Shrinks the output to exactly the samples received, as `L x C`.
+  void finish(int64_t channels) {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    channels = std::max<int64_t>(channels, 1);
+    output_.resize_({size_ / channels, channels});
+  }
+
+ private:
+  at::Tensor output_;
+  const unsigned bits_;
+  const double normalization_;
+  int64_t capacity_;
+  int64_t size_ = 0;
+  std::exception_ptr error_;
+};
+
+/// Interleaved samples of a `L x C` tensor read as SoX samples, the values
+/// multiplied by `scale` first (e.g. `1 << 31` for audio in `[-1, 1]`).
+class TensorSource {
+ public:
+  TensorSource(at::Tensor frames, double scale)
+      : frames_(frames.contiguous()), scale_(scale) {}
+
+  /// Converts up to `n` samples into `dst`, returns 0 at the end.
+  size_t read(sox_sample_t* dst, size_t n) {
+    const int64_t count = std::min<int64_t>(n, frames_.numel() - position_);
+    AT_DISPATCH_ALL_TYPES(frames_.type(), "tensor_source", [&] {
+      to_sox_samples(
+          frames_.data<scalar_t>() + position_, dst, count, scale_);
+    });
+    position_ += count;
+    return count;
+  }
+
+ private:
+  at::Tensor frames_;
+  const double scale_;
+  int64_t position_ = 0;
+};
+
+/// Fills a buffer with up to the given number of samples for the start of an
+/// effects chain and returns how many it wrote, 0 at the end.
+using SampleSource = std::function<size_t(sox_sample_t*, size_t)>;
+
+struct SampleSourcePriv {
+  SampleSource* source;
+};
+
+int sample_source_getopts(sox_effect_t* effp, int argc, char** argv) {
+  if (argc != 2) {
+    return SOX_EOF;
+  }
+  auto* priv = static_cast<SampleSourcePriv*>(effp->priv);
+  priv->source = reinterpret_cast<SampleSource*>(argv[1]);
+  return SOX_SUCCESS;
+}
+
+int sample_source_drain(sox_effect_t* effp, sox_sample_t* obuf, size_t* osamp) {
+  auto* priv = static_cast<SampleSourcePriv*>(effp->priv);
+  // whole frames only, so that channels stay aligned
+  *osamp -= *osamp % std::max<unsigned>(effp->out_signal.channels, 1);
+  *osamp = (*priv->source)(obuf, *osamp);
+  return *osamp > 0 ? SOX_SUCCESS : SOX_EOF;
+}
+
+/// Input effect that feeds a chain from a `SampleSource` (e.g. a tensor)
+/// instead of decoding a `sox_format_t`.
+const sox_effect_handler_t* sample_source_handler() {
+  static const sox_effect_handler_t handler = {
+      "sample_source",
+      nullptr,
+      SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+      sample_source_getopts,
+      nullptr,
+      nullptr,
+      sample_source_drain,
+      nullptr,
+      nullptr,
+      sizeof(SampleSourcePriv)};
+  return &handler;
+}
+
+/// Adds a `sample_source` effect reading from `source`, whose samples have
+/// the format `signal`, to the start of `chain`. `source` must outlive the
+/// chain.
+void add_sample_source(
+    sox_effects_chain_t* chain,
+    SampleSource* source,
+    const sox_signalinfo_t* signal,
+    sox_signalinfo_t* interm_signal) {
+  sox_effect_t* e = sox_create_effect(sample_source_handler());
+  char* source_args[1];
+  source_args[0] = reinterpret_cast<char*>(source);
+  sox_effect_options(e, 1, source_args);
+  const int status = sox_add_effect(chain, e, interm_signal, signal);
+  free(e);
+  if (status != SOX_SUCCESS) {
+    throw std::runtime_error("Could not add effect: sample_source");
+  }
+}
+
+/// Bounded single-producer/single-consumer queue of samples between an
+/// effects chain running on a background thread and its reader.
+class SampleFifo {
+ public:
+  explicit SampleFifo(size_t capacity) : buffer_(capacity) {}
+
+  /// Blocks until all of `src` is queued; returns false if cancelled.
+  bool push(const sox_sample_t* src, size_t n) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (n > 0) {
+      cv_.wait(lock, [&] { return cancelled_ || size_ < buffer_.size(); });
+      if (cancelled_) {
+        return false;
+      }
+      const size_t tail = (head_ + size_) % buffer_.size();
+      const size_t count =
+          std::min({n, buffer_.size() - size_, buffer_.size() - tail});
+      std::copy(src, src + count, buffer_.begin() + tail);
+      size_ += count;
+      src += count;
+      n -= count;
+      cv_.notify_all();
+    }
+    return true;
+  }
+
+  /// Blocks until `n` samples are available or the producer closed the
+  /// queue, and returns the number of samples copied into `dst`.
+  size_t pop(sox_sample_t* dst, size_t n) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t copied = 0;
+    while (copied < n) {
+      cv_.wait(lock, [&] { return closed_ || size_ > 0; });
+      if (size_ == 0) {
+        break;
+      }
+      const size_t count =
+          std::min({n - copied, size_, buffer_.size() - head_});
+      std::copy(
+          buffer_.begin() + head_,
+          buffer_.begin() + head_ + count,
+          dst + copied);
+      head_ = (head_ + count) % buffer_.size();
+      size_ -= count;
+      copied += count;
+      cv_.notify_all();
+    }
+    return copied;
+  }
+
+  /// Called by the producer once it will not push anymore.
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    cv_.notify_all();
+  }
+
+  /// Called by the consumer to unblock and stop the producer.
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    cv_.notify_all();
+  }
+
+ private:
+  std::vector<sox_sample_t> buffer_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+  bool closed_ = false;
+  bool cancelled_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
 } // namespace
 
-int read_audio_file_augment(const std::string& file_name, at::Tensor output, const std::vector<std::string>& augment_params){
+int read_audio_file(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    double normalization);
+
+/// An effects chain that is resolved and validated once and then added to any
+/// number of SoX chains. Handlers are looked up and options are checked by
+/// libsox at construction, so an invalid chain fails there instead of halfway
+/// through a flow, and applying it needs no lookups or string parsing.
+/// libsox cannot clone parsed effect state safely (`kill` frees option
+/// buffers), so the pre-split options are handed to `sox_effect_options`
+/// again for every chain built.
+class CompiledEffectChain {
+ public:
+  explicit CompiledEffectChain(const std::vector<SoxEffect>& effects) {
+    if (ensure_sox_effects() != SOX_SUCCESS) {
+      throw std::runtime_error("Could not initialize SoX effects");
+    }
+    for (const SoxEffect& se : effects) {
+      if (se.ename == "no_effects") break;
+      CompiledEffect ce;
+      ce.name = se.ename;
+      ce.handler = find_handler(se.ename);
+      if (ce.handler == nullptr) {
+        throw std::runtime_error("Unknown effect: " + se.ename);
+      }
+      if (!se.eopts.empty() && se.eopts[0] != "") {
+        ce.options = se.eopts;
+      }
+      // `polyphase_rate` falls back to `rate` for pairs it does not support
+      if (ce.name == "polyphase_rate" && ce.options.size() == 1) {
+        char* end;
+        const double rate = std::strtod(ce.options[0].c_str(), &end);
+        if (*end == '\0' && rate > 0) {
+          ce.polyphase_rate = rate;
+        }
+      }
 
+      // let libsox parse the options once to validate them
+      sox_effect_t* e = sox_create_effect(ce.handler);
+      const int status = set_options(e, ce);
+      delete_effect(e);
+      if (status != SOX_SUCCESS) {
+        throw std::runtime_error(
+            "invalid effect options, see SoX docs for details");
+      }
 
-  char*  buffer;
-  size_t buffer_size;
-  sox_format_t* in = sox_open_read(
-          file_name.c_str(),
-          /*signal=*/NULL,
-          /*encoding=*/NULL,
-          /*filetype=*/NULL);
-  sox_effect_t * e;
-  if (in==nullptr)
-  {
-      throw std::runtime_error("Error opening audio file");
+      // the rate and channels effects determine the output signal
+      try {
+        if ((se.ename == "rate" || se.ename == "polyphase_rate") &&
+            !ce.options.empty()) {
+          // the rate comes after any quality flags
+          rate_ = std::stod(ce.options.back());
+        } else if (se.ename == "channels" && !ce.options.empty()) {
+          channels_ = std::stoi(ce.options[0]);
+        }
+      } catch (const std::logic_error&) {
+        throw std::runtime_error(
+            "invalid effect options for " + se.ename + ": expected a number");
+      }
+      effects_.push_back(std::move(ce));
+    }
   }
 
-  sox_format_t* out = sox_open_memstream_write(&buffer, &buffer_size, &in->signal, &in->encoding, "raw", NULL);
+  size_t size() const {
+    return effects_.size();
+  }
 
-  //std::cout << "Input Sample rate : " << (int)in->signal.rate << std::endl;
-  //std::cout << "Sample rate : " << res->sample_rate << std::endl;
-  sox_effects_chain_t* chain = sox_create_effects_chain(&in->encoding, &out->encoding);
+  /// Updates `target_signal` for the rate and channels effects of the chain.
+  void apply_target(sox_signalinfo_t* target_signal) const {
+    if (rate_ > 0) {
+      target_signal->rate = rate_;
+    }
+    if (channels_ > 0) {
+      target_signal->channels = channels_;
+    }
+  }
 
+  /// Appends the effects to `chain`, updating `interm_signal` in-place. A
+  /// `polyphase_rate` effect becomes a SoX `rate` effect if the resampler
+  /// does not support the pair of rates.
+  void add_to(
+      sox_effects_chain_t* chain,
+      sox_signalinfo_t* interm_signal,
+      const sox_signalinfo_t* out_signal) const {
+    for (const CompiledEffect& ce : effects_) {
+      const bool fallback = ce.polyphase_rate > 0 &&
+          !PolyphaseFilterBank::get(interm_signal->rate, ce.polyphase_rate);
+      sox_effect_t* e = sox_create_effect(
+          fallback ? find_handler("rate") : ce.handler);
+      int status = set_options(e, ce);
+      if (status == SOX_SUCCESS) {
+        status = sox_add_effect(chain, e, interm_signal, out_signal);
+      }
+      if (status != SOX_SUCCESS) {
+        // the chain only takes over the options and state of added effects
+        delete_effect(e);
+        throw std::runtime_error("Could not add effect: " + ce.name);
+      }
+      free(e);
+    }
+  }
 
-  char* sox_args[10];
-    //input effect
-    e = sox_create_effect(sox_find_effect("input"));
-    sox_args[0] = (char*)in;
-    if(sox_effect_options(e, 1, sox_args) != SOX_SUCCESS)
-        std::cout << "Coult not create effect options" << std::endl;
-    if(sox_add_effect(chain, e,  &in->signal, &in->signal) !=
-         SOX_SUCCESS)
-        std::cout << "Could not add effect" << std::endl;
-    free(e);
+  /// Flows the audio file `file_name` through the chain into `otensor` and
+  /// returns the output sample rate, see `build_flow_effects`. Floating point
+  /// outputs are divided by `normalization`.
+  /// Linear PCM and float targets are collected straight into `otensor`, with
+  /// the values encoding to the target precision would give; other encodings
+  /// (e.g. u-law) are encoded into a buffer and decoded again. Goes through
+  /// the audio cache, if one is set.
+  int apply(
+      const std::string& file_name,
+      at::Tensor otensor,
+      bool ch_first,
+      sox_signalinfo_t* target_signal,
+      sox_encodinginfo_t* target_encoding,
+      const char* file_type,
+      double normalization) const {
+    std::ostringstream params;
+    FileScope file;
+    params.precision(17);
+    params << "effects " << ch_first << ' ' << normalization;
+    describe_format(params, target_signal, target_encoding, file_type);
+    for (const CompiledEffect& ce : effects_) {
+      params << "\n" << ce.name;
+      for (const std::string& option : ce.options) {
+        params << ' ' << option;
+      }
+    }
+    return read_through_cache(file_name, params.str(), otensor, [&] {
+      return apply_uncached(
+          file_name,
+          otensor,
+          ch_first,
+          target_signal,
+          target_encoding,
+          file_type,
+          normalization);
+    });
+  }
+
+  /// `apply` without the cache.
+  int apply_uncached(
+      const std::string& file_name,
+      at::Tensor otensor,
+      bool ch_first,
+      sox_signalinfo_t* target_signal,
+      sox_encodinginfo_t* target_encoding,
+      const char* file_type,
+      double normalization) const {
+
+    ensure_sox_formats();
+    SoxDescriptor input(
+        timed_open_read(file_name.c_str(), nullptr, nullptr, nullptr));
+    if (input.get() == nullptr) {
+      throw std::runtime_error("Error opening audio file");
+    }
+    return apply_input(
+        input,
+        otensor,
+        ch_first,
+        target_signal,
+        target_encoding,
+        file_type,
+        normalization);
+  }
+
+  /// `apply_uncached` for a whole audio file of `size` bytes at `data`, of
+  /// libsox type `input_type` (null to detect it from the data).
+  int apply_memory(
+      const void* data,
+      size_t size,
+      const char* input_type,
+      at::Tensor otensor,
+      bool ch_first,
+      sox_signalinfo_t* target_signal,
+      sox_encodinginfo_t* target_encoding,
+      const char* file_type,
+      double normalization) const {
+    FileScope file;
+    ensure_sox_formats();
+    // libsox only reads from the buffer
+    SoxDescriptor input(timed_open_mem_read(
+        const_cast<void*>(data), size, nullptr, nullptr, input_type));
+    if (input.get() == nullptr) {
+      throw std::runtime_error("Error opening audio data");
+    }
+    return apply_input(
+        input,
+        otensor,
+        ch_first,
+        target_signal,
+        target_encoding,
+        file_type,
+        normalization);
+  }
+
+  /// Flows the opened `input` through the chain, see `apply`.
+  int apply_input(
+      SoxDescriptor& input,
+      at::Tensor otensor,
+      bool ch_first,
+      sox_signalinfo_t* target_signal,
+      sox_encodinginfo_t* target_encoding,
+      const char* file_type,
+      double normalization) const {
+
+    /* This function builds an effects flow and puts the results into a tensor.
+       It can also be used to re-encode audio using any of the available encoding
+       options in SoX including sample rate and channel re-encoding.              */
+
+    // only used if target signal or encoding are null
+    sox_signalinfo_t empty_signal;
+    sox_encodinginfo_t empty_encoding;
+
+    // set signalinfo and encodinginfo if blank
+    if(target_signal == nullptr) {
+      target_signal = &empty_signal;
+      target_signal->rate = input->signal.rate;
+      target_signal->channels = input->signal.channels;
+      target_signal->length = SOX_UNSPEC;
+      target_signal->precision = input->signal.precision;
+#if SOX_LIB_VERSION_CODE >= 918272 // >= 14.3.0
+      target_signal->mult = nullptr;
+#endif
+    }
+    if(target_encoding == nullptr) {
+      empty_encoding = linear_encoding(input->signal.precision);
+      target_encoding = &empty_encoding;
+    }
+
+    // check for rate or channels effect and change the output signalinfo accordingly
+    apply_target(target_signal);
+
+    if (target_encoding->encoding != SOX_ENCODING_SIGN2 &&
+        target_encoding->encoding != SOX_ENCODING_UNSIGNED &&
+        target_encoding->encoding != SOX_ENCODING_FLOAT) {
+      const int sr = apply_encoded(
+          input, otensor, ch_first, target_signal, target_encoding, file_type);
+      if (normalization != 1. &&
+          at::isFloatingType(otensor.type().scalarType())) {
+        otensor.div_(normalization);
+      }
+      return sr;
+    }
+
+    const int sr = flow_into(
+        [&input](sox_effects_chain_t* chain, sox_signalinfo_t* interm_signal) {
+          add_input_effect(chain, input.get(), interm_signal);
+        },
+        input->signal,
+        input->encoding,
+        otensor,
+        ch_first,
+        target_signal,
+        target_encoding,
+        normalization);
+    // the input effect ends the flow on read errors as if the file ended
+    if (input->sox_errno != 0) {
+      throw std::runtime_error(
+          std::string("Error reading audio file: ") + input->sox_errstr);
+    }
+    return sr;
+  }
+
+  /// Flows the samples of `input` (`C x L` if `ch_first`, else `L x C`, or
+  /// 1D for mono) at `sample_rate` through the chain into `otensor`, laid
+  /// out the same way, and returns the output sample rate. Input values are
+  /// multiplied by `scale` and outputs divided by `normalization`, so audio
+  /// in `[-1, 1]` takes `1 << 31` for both. The output is not quantized.
+  int apply_tensor(
+      at::Tensor input,
+      double sample_rate,
+      at::Tensor otensor,
+      bool ch_first,
+      double scale,
+      double normalization) const {
+    if (input.dim() == 1) {
+      input = input.unsqueeze(ch_first ? 0 : 1);
+    }
+    if (input.dim() != 2) {
+      throw std::runtime_error("Expected a 1D or 2D audio tensor");
+    }
+    TensorSource frames(ch_first ? input.transpose(0, 1) : input, scale);
+    SampleSource source = [&frames](sox_sample_t* dst, size_t n) {
+      return frames.read(dst, n);
+    };
+
+    sox_signalinfo_t signal = {};
+    signal.rate = sample_rate;
+    signal.channels = input.size(ch_first ? 0 : 1);
+    signal.precision = 32;
+    signal.length = input.numel();
+    return apply_source(
+        &source,
+        signal,
+        linear_encoding(32),
+        otensor,
+        ch_first,
+        normalization);
+  }
+
+  /// Flows the samples produced by `source`, in the format `signal` and
+  /// `encoding`, through the chain into `otensor` (see `apply_tensor`) and
+  /// returns the output sample rate. The output keeps the precision of
+  /// `signal`, like `apply` with a null target does.
+  int apply_source(
+      SampleSource* source,
+      const sox_signalinfo_t& signal,
+      const sox_encodinginfo_t& encoding,
+      at::Tensor otensor,
+      bool ch_first,
+      double normalization) const {
+    sox_signalinfo_t target_signal = signal;
+    target_signal.length = SOX_UNSPEC;
+    apply_target(&target_signal);
+    sox_encodinginfo_t target_encoding = linear_encoding(signal.precision);
+    return flow_into(
+        [&](sox_effects_chain_t* chain, sox_signalinfo_t* interm_signal) {
+          add_sample_source(chain, source, &signal, interm_signal);
+        },
+        signal,
+        encoding,
+        otensor,
+        ch_first,
+        &target_signal,
+        &target_encoding,
+        normalization);
+  }
+
+ private:
+  /// Signed linear PCM with `bits` bits per sample.
+  static sox_encodinginfo_t linear_encoding(unsigned bits) {
+    sox_encodinginfo_t encoding;
+    encoding.encoding = SOX_ENCODING_SIGN2; // Sample format
+    encoding.bits_per_sample = bits; // Bits per sample
+    encoding.compression = 0.0; // Compression factor
+    encoding.reverse_bytes = sox_option_default; // Should bytes be reversed
+    encoding.reverse_nibbles = sox_option_default; // Should nibbles be reversed
+    encoding.reverse_bits = sox_option_default; // Should bits be reversed (pairs of bits?)
+    encoding.opposite_endian = sox_false; // Reverse endianness
+    return encoding;
+  }
+
+  /// Builds a chain from the input effect added by `add_input`, producing
+  /// `in_signal`, through the effects into a `TensorSink` on `otensor`.
+  int flow_into(
+      const std::function<void(sox_effects_chain_t*, sox_signalinfo_t*)>&
+          add_input,
+      const sox_signalinfo_t& in_signal,
+      const sox_encodinginfo_t& in_encoding,
+      at::Tensor otensor,
+      bool ch_first,
+      sox_signalinfo_t* target_signal,
+      sox_encodinginfo_t* target_encoding,
+      double normalization) const {
+    // create interm_signal for effects, intermediate steps change this in-place
+    sox_signalinfo_t interm_signal = in_signal;
+    std::unique_ptr<sox_effects_chain_t, void (*)(sox_effects_chain_t*)> chain(
+        sox_create_effects_chain(&in_encoding, target_encoding),
+        sox_delete_effects_chain);
+    add_input(chain.get(), &interm_signal);
+    add_to(chain.get(), &interm_signal, target_signal);
+
+    // the length estimated by the effects only sizes the first allocation,
+    // the output grows as needed and is trimmed to the samples produced
+    const size_t estimate =
+        interm_signal.length < (size_t{1} << 27) ? interm_signal.length : 0;
+    const unsigned bits = target_encoding->encoding == SOX_ENCODING_FLOAT
+        ? 0
+        : target_encoding->bits_per_sample != 0
+            ? target_encoding->bits_per_sample
+            : target_signal->precision;
+    TensorSink sink(otensor, estimate, bits, normalization);
+    SampleCallback callback = [&sink](const sox_sample_t* samples, size_t n) {
+      return sink.append(samples, n);
+    };
+    add_callback_sink(chain.get(), &callback, &interm_signal);
+
+    {
+      StageTimer timer(Stage::kEffects);
+      sox_flow_effects(chain.get(), nullptr, nullptr);
+    }
+    chain.reset();
+    sink.finish(interm_signal.channels);
+
+    if (ch_first) {
+      otensor.transpose_(1, 0);
+    }
+    return target_signal->rate;
+  }
+
+  /// Fallback of `apply` for targets that are not linear PCM: flows `input`
+  /// into an in-memory file (a temporary file on OSX) in the target encoding
+  /// and decodes that again.
+  int apply_encoded(
+      SoxDescriptor& input,
+      at::Tensor otensor,
+      bool ch_first,
+      sox_signalinfo_t* target_signal,
+      sox_encodinginfo_t* target_encoding,
+      const char* file_type) const {
+    // create interm_signal for effects, intermediate steps change this in-place
+    sox_signalinfo_t interm_signal = input->signal;
+
+#ifdef __APPLE__
+    // According to Mozilla Deepspeech sox_open_memstream_write doesn't work
+    // with OSX
+    char tmp_name[] = "/tmp/fileXXXXXX";
+    int tmp_fd = mkstemp(tmp_name);
+    close(tmp_fd);
+    // removed however this returns, after the output is closed
+    std::unique_ptr<char, int (*)(const char*)> tmp_file(tmp_name, std::remove);
+    SoxDescriptor output(sox_open_write(tmp_name, target_signal,
+                                        target_encoding, "wav", nullptr, nullptr));
+#else
+    // create buffer and buffer_size for output in memwrite
+    char* buffer = nullptr;
+    size_t buffer_size = 0;
+    // libsox allocates the buffer when the stream is closed, also on errors;
+    // declared first, so that it is freed after the output is closed
+    std::unique_ptr<char*, void (*)(char**)> owner(
+        &buffer, [](char** b) { std::free(*b); });
+    // in-memory descriptor (this may not work for OSX)
+    SoxDescriptor output(sox_open_memstream_write(&buffer,
+                                                  &buffer_size,
+                                                  target_signal,
+                                                  target_encoding,
+                                                  file_type, nullptr));
+#endif
+    if (output.get() == nullptr) {
+      throw std::runtime_error("Error opening output memstream/temporary file");
+    }
+    // Setup the effects chain to decode/resample; deleted before the output
+    // is closed, also when adding an effect throws
+    std::unique_ptr<sox_effects_chain_t, void (*)(sox_effects_chain_t*)> chain(
+        sox_create_effects_chain(&input->encoding, &output->encoding),
+        sox_delete_effects_chain);
+
+    add_input_effect(chain.get(), input.get(), &interm_signal);
+    add_to(chain.get(), &interm_signal, &output->signal);
+
+    sox_effect_t* e = sox_create_effect(sox_find_effect("output"));
+    char* io_args[1];
+    io_args[0] = (char*)output.get();
+    sox_effect_options(e, 1, io_args);
+    sox_add_effect(chain.get(), e, &interm_signal, &output->signal);
+    free(e);
+
+    // Finally run the effects chain
+    {
+      StageTimer timer(Stage::kEffects);
+      sox_flow_effects(chain.get(), nullptr, nullptr);
+    }
+    chain.reset();
+
+    // Close the output, buffer does not get properly sized until it is closed
+#ifndef __APPLE__
+    const sox_signalinfo_t output_signal = output->signal;
+#endif
+    output.close();
+
+    int sr;
+    // Read the in-memory audio buffer or temp file that we just wrote.
+#ifdef __APPLE__
+    /*
+       Temporary filetype must have a valid header.  Wav seems to work here while
+       raw does not.  Certain effects like chorus caused strange behavior on the mac.
+    */
+    // read_audio_file reads the temporary file and returns the sr and otensor
+    sr = read_audio_file(tmp_name, otensor, ch_first, 0, 0,
+                         target_signal, target_encoding, "wav", 1.);
+#else
+    // neither the lengths of the signals nor the buffer size tell how many
+    // samples the buffer holds, so it is decoded to its end into a sink that
+    // grows as needed
+    SoxDescriptor encoded(timed_open_mem_read(
+        buffer, buffer_size, target_signal, target_encoding, file_type));
+    if (encoded.get() == nullptr) {
+      throw std::runtime_error("Error reading the encoded audio");
+    }
+    const size_t estimate =
+        output_signal.length < (size_t{1} << 27) ? output_signal.length : 0;
+    TensorSink sink(otensor, estimate, /*bits=*/0, /*normalization=*/1.);
+    decode_chunks(
+        encoded.get(),
+        std::numeric_limits<int64_t>::max(),
+        [&sink](const sox_sample_t* samples, int64_t, int64_t n) {
+          sink.append(samples, n);
+        });
+    sink.finish(encoded->signal.channels);
+
+    if (ch_first) {
+      otensor.transpose_(1, 0);
+    }
+    sr = target_signal->rate;
+
+#endif
+    // return sample rate, output tensor modified in-place
+    return sr;
+  }
+
+  struct CompiledEffect {
+    std::string name;
+    const sox_effect_handler_t* handler;
+    std::vector<std::string> options;
+    // output rate of a `polyphase_rate` effect, 0 for anything else
+    double polyphase_rate = 0;
+  };
+
+  /// The handler of effect `name`: `polyphase_rate` and `energy_vad` are
+  /// implemented here, anything else by libsox, serialized where it shares
+  /// state across chains.
+  static const sox_effect_handler_t* find_handler(const std::string& name) {
+    if (name == "polyphase_rate") {
+      return polyphase_rate_handler();
+    }
+    if (name == "energy_vad") {
+      return energy_vad_handler();
+    }
+    return serialize_shared_dft(sox_find_effect(name.c_str()));
+  }
+
+  static int set_options(sox_effect_t* e, const CompiledEffect& ce) {
+    std::vector<char*> sox_args;
+    for (const std::string& opt : ce.options) {
+      sox_args.push_back(const_cast<char*>(opt.c_str()));
+    }
+    return sox_effect_options(e, sox_args.size(), sox_args.data());
+  }
+
+  /// Frees an effect that no chain took over, with whatever its options and
+  /// a failed start allocated.
+  static void delete_effect(sox_effect_t* e) {
+    e->handler.kill(e);
+    free(e->priv);
+    free(e);
+  }
+
+  std::vector<CompiledEffect> effects_;
+  double rate_ = 0;
+  int channels_ = 0;
+};
+
+int read_audio_file_augment(
+    const std::string& file_name,
+    at::Tensor output,
+    const CompiledEffectChain& chain) {
+  FileScope file;
+  // samples of all channels end up in a single column; augmentations are
+  // random, so they would only fill the cache
+  const int sample_rate = chain.apply_uncached(
+      file_name,
+      output,
+      /*ch_first=*/false,
+      /*target_signal=*/nullptr,
+      /*target_encoding=*/nullptr,
+      "raw",
+      /*normalization=*/1.);
+  output.resize_({output.numel(), 1});
+  return sample_rate;
+}
+
+/// Turns a flat list of `name, value` augmentation parameters into effects,
+/// skipping anything that is not a supported augmentation.
+CompiledEffectChain compile_augment_params(
+    const std::vector<std::string>& augment_params) {
+  static const std::vector<std::string> supported = {
+      "volume", "tempo", "pitch", "speed", "gain"};
+  std::vector<SoxEffect> effects;
+  for (size_t i = 0; i < augment_params.size(); ++i) {
+    const std::string& aug_param = augment_params[i];
+    if (i + 1 < augment_params.size() &&
+        std::find(supported.begin(), supported.end(), aug_param) !=
+            supported.end()) {
+      SoxEffect se;
+      // the SoX effect is called "vol"
+      se.ename = aug_param == "volume" ? "vol" : aug_param;
+      se.eopts = {augment_params[++i]};
+      effects.push_back(se);
+    }
+  }
+  return CompiledEffectChain(effects);
+}
+
+namespace {
+
+/// Samples a decode buffer keeps between calls; a longer file releases it
+/// once a shorter one comes along.
+constexpr size_t kPooledSamples = size_t(1) << 24;
+
+/// The decode buffer of the calling thread, sized to `length` samples.
+/// Loading one file after another reuses it instead of allocating per file.
+std::vector<sox_sample_t>& decode_buffer(int64_t length) {
+  thread_local std::vector<sox_sample_t> buffer;
+  if (buffer.capacity() > kPooledSamples &&
+      static_cast<size_t>(length) <= kPooledSamples) {
+    std::vector<sox_sample_t>().swap(buffer);
+  }
+  buffer.resize(length);
+  return buffer;
+}
+
+/// Decodes `file_name` once and flows it through every chain of `chains` in
+/// parallel, into the matching tensor of `outputs` of size `L x 1`. Returns
+/// the sample rate.
+int augment_multi(
+    const std::string& file_name,
+    const std::vector<at::Tensor>& outputs,
+    const std::vector<CompiledEffectChain>& chains,
+    double normalization,
+    int num_threads) {
+  SoxDescriptor fd(open_read(file_name));
+  if (fd.get() == nullptr) {
+    throw std::runtime_error("Error opening audio file");
+  }
+
+  // decode once, every chain reads the same samples; the header length only
+  // sizes the first allocation, as it can be unknown or wrong (e.g. mp3)
+  const int64_t chunk = detail::decode_chunk_size(fd.get());
+  std::vector<sox_sample_t>& samples =
+      decode_buffer(static_cast<int64_t>(fd->signal.length) + chunk);
+  size_t decoded = 0;
+  for (;;) {
+    if (samples.size() - decoded < static_cast<size_t>(chunk)) {
+      samples.resize(std::max(2 * samples.size(), decoded + chunk));
+    }
+    const int64_t request = samples.size() - decoded;
+    const int64_t got =
+        decode_into(fd.get(), samples.data() + decoded, request, 1.);
+    decoded += got;
+    if (got < request) {
+      break;
+    }
+  }
+  samples.resize(decoded);
+  if (samples.empty()) {
+    throw std::runtime_error(
+        "Error reading audio file: empty file or read failed in sox_read");
+  }
+  sox_signalinfo_t signal = fd->signal;
+  signal.length = samples.size();
+  const sox_encodinginfo_t encoding = fd->encoding;
+
+  ThreadPool::global().parallel_for(chains.size(), [&](int64_t i) {
+    size_t position = 0;
+    SampleSource source = [&](sox_sample_t* dst, size_t n) {
+      n = std::min(n, samples.size() - position);
+      std::copy_n(samples.data() + position, n, dst);
+      position += n;
+      return n;
+    };
+    at::Tensor output = outputs[i];
+    chains[i].apply_source(
+        &source, signal, encoding, output, /*ch_first=*/false, normalization);
+    // samples of all channels end up in a single column
+    output.resize_({output.numel(), 1});
+  }, num_threads);
+  return signal.rate;
+}
+
+} // namespace
+
+int read_audio_file_augment_multi(
+    const std::string& file_name,
+    const std::vector<at::Tensor>& outputs,
+    const std::vector<CompiledEffectChain>& chains,
+    double normalization,
+    int num_threads) {
+  if (outputs.size() != chains.size()) {
+    throw std::runtime_error("Expected one output tensor per chain");
+  }
+  return augment_multi(
+      file_name, outputs, chains, normalization, num_threads);
+}
+
+int read_audio_file_augment_multi_padded(
+    const std::string& file_name,
+    const std::vector<CompiledEffectChain>& chains,
+    at::Tensor output,
+    at::Tensor lengths,
+    double normalization,
+    int num_threads) {
+  const int64_t variants = chains.size();
+  std::vector<at::Tensor> outputs;
+  for (int64_t i = 0; i < variants; ++i) {
+    outputs.push_back(at::empty({0}, output.options()));
+  }
+  const int sample_rate =
+      augment_multi(file_name, outputs, chains, normalization, num_threads);
+  int64_t max_length = 0;
+  for (const auto& x : outputs) {
+    max_length = std::max(max_length, x.numel());
+  }
+
+  // K x L, every variant copied into its row and zero-padded
+  resize_contiguous(output, {variants, max_length});
+  resize_contiguous(lengths, {variants});
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_file_augment_multi", [&] {
+    scalar_t* row = output.data<scalar_t>();
+    for (const auto& x : outputs) {
+      const scalar_t* data = x.data<scalar_t>();
+      std::copy_n(data, x.numel(), row);
+      std::fill(row + x.numel(), row + max_length, static_cast<scalar_t>(0));
+      row += max_length;
+    }
+  });
+  AT_DISPATCH_ALL_TYPES(lengths.type(), "read_audio_file_augment_lengths", [&] {
+    scalar_t* length = lengths.data<scalar_t>();
+    for (int64_t i = 0; i < variants; ++i) {
+      length[i] = static_cast<scalar_t>(outputs[i].numel());
+    }
+  });
+  return sample_rate;
+}
+
+std::tuple<sox_signalinfo_t, sox_encodinginfo_t> get_info(
+    const std::string& file_name
+  ) {
+  FileScope file;
+  ensure_sox_formats();
+  SoxDescriptor fd(timed_open_read(
+      file_name.c_str(),
+      /*signal=*/nullptr,
+      /*encoding=*/nullptr,
+      /*filetype=*/nullptr));
+  if (fd.get() == nullptr) {
+    throw std::runtime_error("Error opening audio file");
+  }
+  return std::make_tuple(fd->signal, fd->encoding);
+}
+
+void get_info_batch(
+    const std::vector<std::string>& file_names,
+    at::Tensor output,
+    int num_threads) {
+  const int64_t batch_size = file_names.size();
+  std::vector<sox_signalinfo_t> signals(batch_size);
+  ThreadPool::global().parallel_for(batch_size, [&](int64_t i) {
+    FileScope file;
+    if (read_header_info(file_names[i], &signals[i])) {
+      return;
+    }
+    count(Counter::kFallbacks);
+    ensure_sox_formats();
+    SoxDescriptor fd(timed_open_read(
+        file_names[i].c_str(),
+        /*signal=*/nullptr,
+        /*encoding=*/nullptr,
+        /*filetype=*/nullptr));
+    if (fd.get() == nullptr) {
+      throw std::runtime_error("Error opening audio file: " + file_names[i]);
+    }
+    signals[i] = fd->signal;
+  }, num_threads);
+
+  // B x 4, one row of rate, channels, length and precision per file
+  resize_contiguous(output, {batch_size, 4});
+  AT_DISPATCH_ALL_TYPES(output.type(), "get_info_batch", [&] {
+    scalar_t* row = output.data<scalar_t>();
+    for (const auto& signal : signals) {
+      row[0] = static_cast<scalar_t>(std::lround(signal.rate));
+      row[1] = static_cast<scalar_t>(signal.channels);
+      row[2] = static_cast<scalar_t>(signal.length);
+      row[3] = static_cast<scalar_t>(signal.precision);
+      row += 4;
+    }
+  });
+}
+
+std::vector<std::string> get_effect_names() {
+  sox_effect_fn_t const * fns = sox_get_effect_fns();
+  std::vector<std::string> sv;
+  for(int i = 0; fns[i]; ++i) {
+    const sox_effect_handler_t *eh = fns[i] ();
+    if(eh && eh->name)
+      sv.push_back(eh->name);
+  }
+  sv.push_back(polyphase_rate_handler()->name);
+  sv.push_back(energy_vad_handler()->name);
+  return sv;
+}
+
+int read_audio_file(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    double normalization) {
+  FileScope file;
+  // plain wave and raw files are decoded straight from a memory mapping
+  if (auto mapped = MappedPcmFile::open(file_name, si, ei, ft)) {
+    read_mapped(*mapped, output, offset, nframes, normalization);
+    if (ch_first) {
+      output.transpose_(1, 0);
+    }
+    return mapped->signal().rate;
+  }
+
+  // anything else is decoded by libsox, or found in the cache, as L x C
+  std::ostringstream params;
+  params.precision(17);
+  params << "read_audio_file " << nframes << ' ' << offset << ' '
+         << normalization;
+  describe_format(params, si, ei, ft);
+  const int sample_rate =
+      read_through_cache(file_name, params.str(), output, [&] {
+        ensure_sox_formats();
+        // MP3 files are read at an offset through a seek index, if any
+        if (auto index = seek_index_for(file_name, offset, si, ei, ft)) {
+          if (read_indexed_mp3(
+                  file_name, *index, output, offset, nframes, normalization)) {
+            return static_cast<int>(index->signal().rate);
+          }
+          index->disable();
+          count(Counter::kFallbacks);
+        }
+
+        SoxDescriptor fd(timed_open_read(file_name.c_str(), si, ei, ft));
+        if (fd.get() == nullptr) {
+          throw std::runtime_error("Error opening audio file");
+        }
+
+        const int64_t buffer_length = seek_to_range(fd, offset, nframes);
+
+        // read data and fill output tensor
+        read_audio(fd, output, buffer_length, normalization);
+        return static_cast<int>(fd->signal.rate);
+      });
+
+  // L x C -> C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 0);
+  }
+
+  return sample_rate;
+}
+
+int read_audio_file_mu_law(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    int64_t quantization_channels) {
+  FileScope file;
+  if (quantization_channels < 2) {
+    throw std::runtime_error("Expected at least 2 quantization channels");
+  }
+  check_code_type(output, quantization_channels);
+  if (offset < 0) {
+    throw std::runtime_error("Offset must not be negative");
+  }
+  const auto tables = MuLawTables::get(quantization_channels);
+  // every chunk is encoded where it is decoded, so the samples never reach
+  // memory as values
+  int64_t number_of_channels;
+  int64_t buffer_length;
+  int64_t samples_read = 0;
+  int sample_rate;
+  if (auto mapped = MappedPcmFile::open(file_name, si, ei, ft)) {
+    number_of_channels = mapped->signal().channels;
+    sample_rate = mapped->signal().rate;
+    buffer_length = range_length(
+        mapped->signal().length, number_of_channels, offset, nframes);
+    resize_contiguous(
+        output, {buffer_length / number_of_channels, number_of_channels});
+    AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_file_mu_law", [&] {
+      scalar_t* dst = output.data<scalar_t>();
+      StageTimer timer(Stage::kConvert);
+      mapped->decode_chunks(
+          offset * number_of_channels,
+          buffer_length,
+          [&](const sox_sample_t* samples, int64_t first, int64_t n) {
+            mu_law_encode_samples(
+                samples, dst + first, n, tables.get(), quantization_channels);
+          });
+    });
+    samples_read = buffer_length;
+    count(Counter::kSamplesDecoded, samples_read);
+  } else {
+    ensure_sox_formats();
+    SoxDescriptor fd(timed_open_read(file_name.c_str(), si, ei, ft));
+    if (fd.get() == nullptr) {
+      throw std::runtime_error("Error opening audio file");
+    }
+    number_of_channels = fd->signal.channels;
+    sample_rate = fd->signal.rate;
+    buffer_length = seek_to_range(fd, offset, nframes);
+    resize_contiguous(
+        output, {buffer_length / number_of_channels, number_of_channels});
+    AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_file_mu_law", [&] {
+      scalar_t* dst = output.data<scalar_t>();
+      samples_read = decode_chunks(
+          fd.get(),
+          buffer_length,
+          [&](const sox_sample_t* samples, int64_t first, int64_t n) {
+            mu_law_encode_samples(
+                samples, dst + first, n, tables.get(), quantization_channels);
+          });
+    });
+  }
+  if (samples_read == 0) {
+    throw std::runtime_error(
+        "Error reading audio file: empty file or read failed in sox_read");
+  }
+  // the header length can overestimate (e.g. mp3), shrinking keeps the storage
+  if (samples_read < buffer_length) {
+    output.resize_({samples_read / number_of_channels, number_of_channels});
+  }
+
+  // L x C -> C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 0);
+  }
+  return sample_rate;
+}
+
+std::tuple<int, std::vector<std::tuple<int64_t, int64_t>>> read_audio_file_vad(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    double normalization,
+    const VadOptions& options) {
+  FileScope file;
+  if (offset < 0) {
+    throw std::runtime_error("Offset must not be negative");
+  }
+  auto mapped = MappedPcmFile::open(file_name, si, ei, ft);
+  if (!mapped) {
+    ensure_sox_formats();
+  }
+  SoxDescriptor fd(
+      mapped ? nullptr : timed_open_read(file_name.c_str(), si, ei, ft));
+  if (!mapped && fd.get() == nullptr) {
+    throw std::runtime_error("Error opening audio file");
+  }
+  const sox_signalinfo_t& signal = mapped ? mapped->signal() : fd->signal;
+  const int64_t number_of_channels = signal.channels;
+  const int sample_rate = signal.rate;
+
+  // every chunk goes through the filter as soon as it is decoded, and only
+  // the samples it keeps are collected
+  VadFilter filter(options, signal.rate, number_of_channels);
+  std::vector<sox_sample_t> kept;
+  const auto sink = [&](const sox_sample_t* samples, int64_t, int64_t n) {
+    filter.push(samples, n, &kept);
+  };
+  int64_t samples_read;
+  if (mapped) {
+    const int64_t buffer_length = range_length(
+        signal.length, number_of_channels, offset, nframes);
+    {
+      StageTimer timer(Stage::kConvert);
+      mapped->decode_chunks(offset * number_of_channels, buffer_length, sink);
+    }
+    samples_read = buffer_length;
+    count(Counter::kSamplesDecoded, samples_read);
+  } else {
+    const int64_t buffer_length = seek_to_range(fd, offset, nframes);
+    samples_read = decode_chunks(fd.get(), buffer_length, sink);
+  }
+  if (samples_read == 0) {
+    throw std::runtime_error(
+        "Error reading audio file: empty file or read failed in sox_read");
+  }
+  filter.flush(&kept);
+
+  const int64_t length = kept.size();
+  resize_contiguous(
+      output, {length / number_of_channels, number_of_channels});
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_file_vad", [&] {
+    StageTimer timer(Stage::kConvert);
+    convert_samples(
+        kept.data(), output.data<scalar_t>(), length, normalization);
+  });
+
+  // L x C -> C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 0);
+  }
+  std::vector<std::tuple<int64_t, int64_t>> segments;
+  for (const VadSegment& segment : filter.segments()) {
+    segments.emplace_back(segment.start + offset, segment.end + offset);
+  }
+  return std::make_tuple(sample_rate, std::move(segments));
+}
+
+int read_audio_bytes(
+    const void* data,
+    size_t size,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    double normalization) {
+  FileScope file;
+  int sample_rate;
+  if (auto pcm = MappedPcmFile::from_memory(
+          static_cast<const uint8_t*>(data), size, si, ei, ft)) {
+    read_mapped(*pcm, output, offset, nframes, normalization);
+    sample_rate = pcm->signal().rate;
+  } else {
+    ensure_sox_formats();
+    // libsox only reads from the buffer
+    SoxDescriptor fd(
+        timed_open_mem_read(const_cast<void*>(data), size, si, ei, ft));
+    if (fd.get() == nullptr) {
+      throw std::runtime_error("Error opening audio data");
+    }
+    const int64_t buffer_length = seek_to_range(fd, offset, nframes);
+    read_audio(fd, output, buffer_length, normalization);
+    sample_rate = fd->signal.rate;
+  }
+
+  // L x C -> C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 0);
+  }
+  return sample_rate;
+}
+
+namespace {
+
+enum class PadMode { kConstant, kWrap, kEdge };
+
+PadMode parse_pad_mode(const std::string& pad_mode) {
+  if (pad_mode == "constant") {
+    return PadMode::kConstant;
+  }
+  if (pad_mode == "wrap") {
+    return PadMode::kWrap;
+  }
+  if (pad_mode == "edge") {
+    return PadMode::kEdge;
+  }
+  throw std::runtime_error(
+      "Unknown pad mode '" + pad_mode + "', expected constant, wrap or edge");
+}
+
+/// The frames of a 2-D tensor with any strides, as seen by a reader of
+/// interleaved samples.
+template <typename scalar_t>
+struct StridedFrames {
+  scalar_t* data;
+  int64_t frames;
+  int64_t channels;
+  int64_t frame_stride;
+  int64_t channel_stride;
+
+  scalar_t& at(int64_t frame, int64_t channel) const {
+    return data[frame * frame_stride + channel * channel_stride];
+  }
+
+  bool interleaved() const {
+    return channel_stride == 1 && (frame_stride == channels || frames == 1);
+  }
+
+  /// Writes `count` frames of interleaved `samples` from frame `first`.
+  void scatter(int64_t first, const scalar_t* samples, int64_t count) const {
+    for (int64_t i = 0; i < count; ++i) {
+      for (int64_t c = 0; c < channels; ++c) {
+        at(first + i, c) = samples[i * channels + c];
+      }
+    }
+  }
+
+  /// Fills the frames from `first` on, the ones before are samples; "wrap"
+  /// repeats those frames, i.e. the file from the offset read.
+  void pad(int64_t first, PadMode mode, scalar_t fill_value) const {
+    for (int64_t i = first; i < frames; ++i) {
+      for (int64_t c = 0; c < channels; ++c) {
+        if (first == 0 || mode == PadMode::kConstant) {
+          at(i, c) = fill_value;
+        } else {
+          at(i, c) = at(mode == PadMode::kWrap ? i % first : first - 1, c);
+        }
+      }
+    }
+  }
+};
+
+/// `read_audio_into` without the statistics of a file.
+std::tuple<int, int64_t> read_frames_into(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t offset,
+    const std::string& pad_mode,
+    double fill_value,
+    double normalization) {
+  if (output.dim() != 2) {
+    throw std::runtime_error("Expected a 2-D output tensor");
+  }
+  if (offset < 0) {
+    throw std::runtime_error("Offset must not be negative");
+  }
+  ensure_sox_formats();
+  const PadMode mode = parse_pad_mode(pad_mode);
+  const int64_t frame_dim = ch_first ? 1 : 0;
+  const int64_t channel_dim = ch_first ? 0 : 1;
+  const int64_t number_of_frames = output.size(frame_dim);
+  const int64_t number_of_channels = output.size(channel_dim);
+
+  // plain wave files are read from a memory mapping, MP3 files at an offset
+  // through a seek index, anything else by libsox
+  std::unique_ptr<MappedPcmFile> mapped = MappedPcmFile::open_wav(file_name);
+  std::shared_ptr<Mp3SeekIndex> index;
+  std::unique_ptr<IndexedMp3> indexed;
+  std::unique_ptr<SoxDescriptor> fd;
+  sox_signalinfo_t signal;
+  if (mapped) {
+    signal = mapped->signal();
+  } else if (
+      number_of_frames > 0 &&
+      (index = seek_index_for(file_name, offset, nullptr, nullptr, nullptr))) {
+    signal = index->signal();
+    if (signal.channels == number_of_channels) {
+      indexed.reset(
+          new IndexedMp3(file_name, *index, offset, number_of_frames));
+    }
+    if (indexed && indexed->get() == nullptr) {
+      index->disable();
+      count(Counter::kFallbacks);
+      return read_frames_into(
+          file_name, output, ch_first, offset, pad_mode, fill_value,
+          normalization);
+    }
+  } else {
+    fd.reset(new SoxDescriptor(timed_open_read(
+        file_name.c_str(),
+        /*signal=*/nullptr,
+        /*encoding=*/nullptr,
+        /*filetype=*/nullptr)));
+    if (fd->get() == nullptr) {
+      throw std::runtime_error("Error opening audio file: " + file_name);
+    }
+    signal = (*fd)->signal;
+  }
+  if (signal.channels != number_of_channels) {
+    throw std::runtime_error(
+        "Error reading audio file: the output has " +
+        std::to_string(number_of_channels) + " channels, " + file_name +
+        " has " + std::to_string(signal.channels));
+  }
+  int64_t buffer_length = 0;
+  if (number_of_frames > 0) {
+    buffer_length = fd
+        ? seek_to_range(*fd, offset, number_of_frames)
+        : range_length(
+              signal.length, number_of_channels, offset, number_of_frames);
+  }
+  sox_format_t* source = fd ? fd->get() : indexed ? indexed->get() : nullptr;
+
+  int64_t samples_read = 0;
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_into", [&] {
+    const StridedFrames<scalar_t> frames = {
+        output.data<scalar_t>(),
+        number_of_frames,
+        number_of_channels,
+        output.stride(frame_dim),
+        output.stride(channel_dim)};
+    // decoded straight into an interleaved output, else one chunk at a time
+    // into a staging buffer and from there to the frames
+    if (frames.interleaved()) {
+      if (mapped) {
+        mapped->read(
+            offset * number_of_channels,
+            buffer_length,
+            frames.data,
+            normalization);
+        samples_read = buffer_length;
+      } else {
+        samples_read =
+            decode_into(source, frames.data, buffer_length, normalization);
+      }
+    } else {
+      scalar_t staging[kDecodeChunkSize];
+      const int64_t chunk =
+          kDecodeChunkSize - kDecodeChunkSize % number_of_channels;
+      while (samples_read < buffer_length) {
+        const int64_t request = std::min(chunk, buffer_length - samples_read);
+        int64_t got = request;
+        if (mapped) {
+          mapped->read(
+              offset * number_of_channels + samples_read,
+              request,
+              staging,
+              normalization);
+        } else {
+          got = decode_into(source, staging, request, normalization);
+        }
+        frames.scatter(
+            samples_read / number_of_channels,
+            staging,
+            got / number_of_channels);
+        samples_read += got;
+        if (got < request) {
+          break;
+        }
+      }
+    }
+    if (indexed && !indexed->finish(samples_read)) {
+      return;
+    }
+    if (samples_read == 0 && buffer_length > 0) {
+      throw std::runtime_error(
+          "Error reading audio file: empty file or read failed in sox_read");
+    }
+    frames.pad(
+        samples_read / number_of_channels,
+        mode,
+        static_cast<scalar_t>(fill_value));
+    indexed.reset();
+  });
+  if (indexed) {
+    // the frames did not decode as the index expects, read them again
+    index->disable();
+    count(Counter::kFallbacks);
+    return read_frames_into(
+        file_name, output, ch_first, offset, pad_mode, fill_value,
+        normalization);
+  }
+  return std::make_tuple(
+      static_cast<int>(signal.rate), samples_read / number_of_channels);
+}
+
+} // namespace
+
+std::tuple<int, int64_t> read_audio_into(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t offset,
+    const std::string& pad_mode,
+    double fill_value,
+    double normalization) {
+  FileScope file;
+  return read_frames_into(
+      file_name, output, ch_first, offset, pad_mode, fill_value, normalization);
+}
+
+std::vector<int> read_audio_files_batch(
+    const std::vector<std::string>& file_names,
+    at::Tensor output,
+    at::Tensor lengths,
+    bool ch_first,
+    const std::vector<int64_t>& nframes,
+    const std::vector<int64_t>& offsets,
+    double normalization,
+    int num_threads) {
+  const int64_t batch_size = file_names.size();
+  if (!nframes.empty() && nframes.size() != file_names.size()) {
+    throw std::runtime_error("Expected one num_frames value per file");
+  }
+  if (!offsets.empty() && offsets.size() != file_names.size()) {
+    throw std::runtime_error("Expected one offset value per file");
+  }
+  ensure_sox_formats();
+  auto& pool = ThreadPool::global();
+
+  // size the range of every file, the longest one sizes the batch; wave
+  // files are mapped, which keeps no descriptor open, anything else is only
+  // opened again to be decoded so that at most one descriptor per thread is
+  // open however large the batch
+  std::vector<std::unique_ptr<MappedPcmFile>> mapped(batch_size);
+  std::vector<sox_signalinfo_t> signals(batch_size);
+  std::vector<int64_t> buffer_lengths(batch_size);
+  pool.parallel_for(batch_size, [&](int64_t i) {
+    FileScope file;
+    const int64_t offset = offsets.empty() ? 0 : offsets[i];
+    const int64_t frames = nframes.empty() ? 0 : nframes[i];
+    mapped[i] = MappedPcmFile::open_wav(file_names[i]);
+    if (mapped[i] && offset >= 0) {
+      signals[i] = mapped[i]->signal();
+    } else {
+      mapped[i].reset();
+      if (!read_header_info(file_names[i], &signals[i])) {
+        count(Counter::kFallbacks);
+        SoxDescriptor fd(timed_open_read(
+            file_names[i].c_str(),
+            /*signal=*/nullptr,
+            /*encoding=*/nullptr,
+            /*filetype=*/nullptr));
+        if (fd.get() == nullptr) {
+          throw std::runtime_error(
+              "Error opening audio file: " + file_names[i]);
+        }
+        signals[i] = fd->signal;
+      }
+      if (offset < 0) {
+        throw std::runtime_error("Offset must not be negative");
+      }
+    }
+    buffer_lengths[i] =
+        range_length(signals[i].length, signals[i].channels, offset, frames);
+  }, num_threads);
+
+  int64_t number_of_channels = batch_size > 0 ? signals[0].channels : 1;
+  int64_t max_frames = 0;
+  std::vector<int> sample_rates(batch_size);
+  for (int64_t i = 0; i < batch_size; ++i) {
+    if (signals[i].channels != number_of_channels) {
+      throw std::runtime_error(
+          "Error reading audio files: all files in a batch must have the same "
+          "number of channels");
+    }
+    sample_rates[i] = signals[i].rate;
+    max_frames = std::max(max_frames, buffer_lengths[i] / number_of_channels);
+  }
+
+  // B x L x C, every file is decoded straight into its own row
+  resize_contiguous(output, {batch_size, max_frames, number_of_channels});
+  resize_contiguous(lengths, {batch_size});
+  const int64_t row_size = max_frames * number_of_channels;
+  std::vector<int64_t> frames_read(batch_size);
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_files_batch", [&] {
+    scalar_t* data = output.data<scalar_t>();
+    pool.parallel_for(batch_size, [&](int64_t i) {
+      scalar_t* row = data + i * row_size;
+      int64_t samples_read = buffer_lengths[i];
+      if (mapped[i]) {
+        const int64_t offset = offsets.empty() ? 0 : offsets[i];
+        mapped[i]->read(
+            offset * number_of_channels, samples_read, row, normalization);
+        mapped[i].reset();
+      } else {
+        SoxDescriptor fd(timed_open_read(
+            file_names[i].c_str(),
+            /*signal=*/nullptr,
+            /*encoding=*/nullptr,
+            /*filetype=*/nullptr));
+        if (fd.get() == nullptr) {
+          throw std::runtime_error(
+              "Error opening audio file: " + file_names[i]);
+        }
+        const int64_t offset = offsets.empty() ? 0 : offsets[i];
+        const int64_t frames = nframes.empty() ? 0 : nframes[i];
+        // never past the row, should libsox disagree with the header
+        const int64_t length =
+            std::min(seek_to_range(fd, offset, frames), buffer_lengths[i]);
+        samples_read = decode_into(fd.get(), row, length, normalization);
+      }
+      if (samples_read == 0) {
+        throw std::runtime_error(
+            "Error reading audio file: empty file or read failed in sox_read");
+      }
+      frames_read[i] = samples_read / number_of_channels;
+      std::fill(
+          row + frames_read[i] * number_of_channels,
+          row + row_size,
+          static_cast<scalar_t>(0));
+    }, num_threads);
+  });
+
+  AT_DISPATCH_ALL_TYPES(lengths.type(), "read_audio_files_batch_lengths", [&] {
+    std::copy(
+        frames_read.begin(), frames_read.end(), lengths.data<scalar_t>());
+  });
+
+  // B x L x C -> B x C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 2);
+  }
+
+  return sample_rates;
+}
+
+namespace {
+
+/// Gaps between segments shorter than this many samples are decoded and
+/// dropped instead of seeked over: a seek restarts compressed decoders at a
+/// frame boundary, which costs more than decoding a short gap.
+constexpr int64_t kMinSeekGap = 1 << 18;
+
+/// Reads several ranges of one audio file, opened once. Wave files are
+/// mapped and every range is decoded directly; anything else is decoded in
+/// a single forward pass over the ranges sorted by offset, seeking over
+/// long gaps if the format can seek and decoding overlapping ranges once.
+class SegmentReader {
+ public:
+  /// Opens `file_name` and validates the ranges given by `offsets` and
+  /// `nframes` (in frames, `nframes` is empty or holds one value per range,
+  /// 0 reads to the end) like `seek_to_range` does.
+  SegmentReader(
+      const std::string& file_name,
+      const std::vector<int64_t>& offsets,
+      const std::vector<int64_t>& nframes) {
+    if (!nframes.empty() && nframes.size() != offsets.size()) {
+      throw std::runtime_error("Expected one num_frames value per segment");
+    }
+    mapped_ = MappedPcmFile::open_wav(file_name);
+    if (mapped_) {
+      signal_ = mapped_->signal();
+    } else {
+      fd_.reset(new SoxDescriptor(open_read(file_name)));
+      if (fd_->get() == nullptr) {
+        throw std::runtime_error("Error opening audio file " + file_name);
+      }
+      signal_ = (*fd_)->signal;
+    }
+    const int64_t channels = signal_.channels;
+    for (size_t i = 0; i < offsets.size(); ++i) {
+      if (offsets[i] < 0) {
+        throw std::runtime_error("Offset must not be negative");
+      }
+      const int64_t begin = offsets[i] * channels;
+      const int64_t length = range_length(
+          signal_.length,
+          channels,
+          offsets[i],
+          nframes.empty() ? 0 : nframes[i]);
+      ranges_.push_back({begin, begin + length});
+    }
+  }
+
+  const sox_signalinfo_t& signal() const {
+    return signal_;
+  }
+
+  /// Length in samples of range `i`.
+  int64_t length(size_t i) const {
+    return ranges_[i].second - ranges_[i].first;
+  }
+
+  /// Decodes range `i` into `dsts[i]`, converted and normalized like
+  /// `decode_into`, and stores the number of samples read in `read[i]`,
+  /// less than its length if the file ended early.
+  template <typename scalar_t>
+  void read(
+      const std::vector<scalar_t*>& dsts,
+      std::vector<int64_t>* read,
+      double normalization) {
+    read->assign(ranges_.size(), 0);
+    if (mapped_) {
+      for (size_t i = 0; i < ranges_.size(); ++i) {
+        mapped_->read(ranges_[i].first, length(i), dsts[i], normalization);
+        (*read)[i] = length(i);
+      }
+      return;
+    }
+
+    std::vector<size_t> order(ranges_.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+      return ranges_[a].first < ranges_[b].first;
+    });
+
+    // keep every request frame aligned, like decode_into
+    sox_format_t* fd = fd_->get();
+    const int64_t channels = std::max<int64_t>(signal_.channels, 1);
+    const int64_t chunk = std::max<int64_t>(
+        kDecodeChunkSize - kDecodeChunkSize % channels, channels);
+    sox_sample_t staging[kDecodeChunkSize];
+
+    // `position` is the next sample of the file, `frontier` the end of the
+    // ranges begun so far and `active` those that are not complete yet
+    int64_t position = 0;
+    int64_t frontier = 0;
+    size_t next = 0;
+    std::vector<size_t> active;
+    while (true) {
+      if (position >= frontier) {
+        while (next < order.size() && length(order[next]) == 0) {
+          ++next;
+        }
+        if (next == order.size()) {
+          return;
+        }
+        position = skip_to(ranges_[order[next]].first, position, staging);
+        if (position < ranges_[order[next]].first) {
+          return;
+        }
+      }
+      while (next < order.size() && ranges_[order[next]].first <= position) {
+        frontier = std::max(frontier, ranges_[order[next]].second);
+        active.push_back(order[next++]);
+      }
+
+      // stop at the start of the next range, so that it is begun in time
+      int64_t request = std::min(chunk, frontier - position);
+      if (next < order.size()) {
+        request = std::min(request, ranges_[order[next]].first - position);
+      }
+      const int64_t got = sox_read(fd, staging, request);
+      if (got == 0) {
+        return;
+      }
+      const int64_t end = position + got;
+      for (size_t i : active) {
+        const int64_t lo = std::max(ranges_[i].first, position);
+        const int64_t hi = std::min(ranges_[i].second, end);
+        if (lo < hi) {
+          convert_samples(
+              staging + (lo - position),
+              dsts[i] + (lo - ranges_[i].first),
+              hi - lo,
+              normalization);
+          (*read)[i] = hi - ranges_[i].first;
+        }
+      }
+      position = end;
+      active.erase(
+          std::remove_if(
+              active.begin(),
+              active.end(),
+              [&](size_t i) { return ranges_[i].second <= position; }),
+          active.end());
+    }
+  }
+
+ private:
+  /// Moves forward from `position` to sample `target`, by seeking for long
+  /// gaps in seekable formats and by decoding otherwise. Returns the new
+  /// position, short of `target` at the end of the file.
+  int64_t skip_to(int64_t target, int64_t position, sox_sample_t* staging) {
+    sox_format_t* fd = fd_->get();
+    if (target - position >= kMinSeekGap && fd->seekable &&
+        fd->handler.seek != nullptr) {
+      if (timed(Stage::kSeek, [&] {
+            return sox_seek(fd, target, SOX_SEEK_SET);
+          }) == SOX_EOF) {
+        throw std::runtime_error(
+            "sox_seek reached EOF, try reducing offset or num_samples");
+      }
+      return target;
+    }
+    while (position < target) {
+      const size_t got =
+          sox_read(fd, staging, std::min(kDecodeChunkSize, target - position));
+      if (got == 0) {
+        break;
+      }
+      position += got;
+    }
+    return position;
+  }
+
+  std::unique_ptr<MappedPcmFile> mapped_;
+  std::unique_ptr<SoxDescriptor> fd_;
+  sox_signalinfo_t signal_;
+  /// Begin and end in samples.
+  std::vector<std::pair<int64_t, int64_t>> ranges_;
+};
+
+} // namespace
 
-    std::vector<std::string>::const_iterator it;
-    bool flag = false;
-    for(it = augment_params.begin(); it != augment_params.end(); it++)
-    {
-        const std::string& aug_param = *it;
-        if ((aug_param.compare("volume") == 0) || (aug_param.compare("tempo") == 0) || (aug_param.compare("pitch") == 0) || (aug_param.compare("speed")==0) || (aug_param.compare("gain") == 0))
-        { 
-            //std::cout << "add effect" << aug_param << std::endl;
-            e = sox_create_effect(sox_find_effect((char*)aug_param.c_str()));
-            //e->global_info = sox_get_effects_globals();
-            e->global_info->global_info->verbosity = 0;            
-
-            it++;
-            const std::string& effect_value = *it;
-            sox_args[0] = (char*)(effect_value.c_str());
-            if (sox_effect_options(e, 1, sox_args) != SOX_SUCCESS)
-                std::cout << "Coult not create effect options" << std::endl;
-            if (sox_add_effect(chain, e,  &in->signal,  &in->signal) !=
-                 SOX_SUCCESS)
-                std::cout << "Coult not add effect" << std::endl;
-            free(e);
-            if ((aug_param.compare("tempo") == 0) || (aug_param.compare("speed") == 0)  )
-            {
-                if (std::stof(effect_value.c_str()) >= 1.0 )
-                    flag = true;                
-            }
-        }
+int read_audio_segments(
+    const std::string& file_name,
+    const std::vector<int64_t>& offsets,
+    const std::vector<int64_t>& nframes,
+    const std::vector<at::Tensor>& outputs,
+    bool ch_first,
+    double normalization) {
+  FileScope file;
+  if (outputs.size() != offsets.size()) {
+    throw std::runtime_error("Expected one output tensor per segment");
+  }
+  SegmentReader reader(file_name, offsets, nframes);
+  const int64_t number_of_channels = reader.signal().channels;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    if (outputs[i].type() != outputs[0].type()) {
+      throw std::runtime_error("Expected output tensors of a single type");
     }
-    
-    e = sox_create_effect(sox_find_effect("output"));
-    sox_args[0] = (char*)out;
-    if(sox_effect_options(e, 1, sox_args) != SOX_SUCCESS)
-        std::cout << "Coult not create effect options output" << std::endl;
-    if(sox_add_effect(chain, e,  &in->signal,  &in->signal) !=
-         SOX_SUCCESS)
-        std::cout << "Coult not add effect output" << std::endl;
-    free(e);
-
-    sox_flow_effects(chain, NULL, NULL);
+    at::Tensor output = outputs[i];
+    resize_contiguous(
+        output,
+        {reader.length(i) / number_of_channels, number_of_channels});
+  }
 
+  std::vector<int64_t> samples_read;
+  if (!outputs.empty()) {
+    AT_DISPATCH_ALL_TYPES(outputs[0].type(), "read_audio_segments", [&] {
+      std::vector<scalar_t*> dsts;
+      for (const at::Tensor& output : outputs) {
+        dsts.push_back(output.data<scalar_t>());
+      }
+      reader.read(dsts, &samples_read, normalization);
+    });
+  }
 
-    int sample_rate = out->signal.rate;
-    static const size_t maxSamples=2048;
-    sox_sample_t samples[maxSamples];
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    at::Tensor output = outputs[i];
+    // the header length can overestimate (e.g. mp3)
+    if (samples_read[i] < reader.length(i)) {
+      output.resize_(
+          {samples_read[i] / number_of_channels, number_of_channels});
+    }
+    // L x C -> C x L, if desired
+    if (ch_first) {
+      output.transpose_(1, 0);
+    }
+  }
+  return reader.signal().rate;
+}
 
-    std::vector<sox_sample_t> audio_buffer;
-    if (flag)
-         out->olength = 0;
-    for (size_t r; 0 != (r=sox_read(out,samples,maxSamples));)
-        for(int i=0;i<r ;i++)
-            audio_buffer.push_back(samples[i]);
+int read_audio_segments_padded(
+    const std::string& file_name,
+    const std::vector<int64_t>& offsets,
+    const std::vector<int64_t>& nframes,
+    at::Tensor output,
+    at::Tensor lengths,
+    bool ch_first,
+    double normalization) {
+  FileScope file;
+  SegmentReader reader(file_name, offsets, nframes);
+  const int64_t batch_size = offsets.size();
+  const int64_t number_of_channels = reader.signal().channels;
+  int64_t max_frames = 0;
+  for (int64_t i = 0; i < batch_size; ++i) {
+    max_frames = std::max(max_frames, reader.length(i) / number_of_channels);
+  }
 
-    output.resize_({audio_buffer.size(), 1});
-    output = output.contiguous();
+  // B x L x C, every segment is decoded straight into its own row
+  resize_contiguous(output, {batch_size, max_frames, number_of_channels});
+  resize_contiguous(lengths, {batch_size});
+  const int64_t row_size = max_frames * number_of_channels;
+  std::vector<int64_t> samples_read;
+  AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_segments_padded", [&] {
+    scalar_t* data = output.data<scalar_t>();
+    std::vector<scalar_t*> dsts;
+    for (int64_t i = 0; i < batch_size; ++i) {
+      dsts.push_back(data + i * row_size);
+    }
+    reader.read(dsts, &samples_read, normalization);
+    for (int64_t i = 0; i < batch_size; ++i) {
+      std::fill(
+          dsts[i] + samples_read[i],
+          dsts[i] + row_size,
+          static_cast<scalar_t>(0));
+    }
+  });
 
+  AT_DISPATCH_ALL_TYPES(lengths.type(), "read_audio_segments_lengths", [&] {
+    scalar_t* frames = lengths.data<scalar_t>();
+    for (int64_t i = 0; i < batch_size; ++i) {
+      frames[i] = static_cast<scalar_t>(samples_read[i] / number_of_channels);
+    }
+  });
 
-    AT_DISPATCH_ALL_TYPES(output.type(), "read_audio_buffer", [&] {
-        auto* data = output.data<scalar_t>();
-        std::copy(audio_buffer.begin(), audio_buffer.begin() + audio_buffer.size(), data);
-    });
-    //TODO: CLEAR MEMORY
-    //free(buffer);
-    sox_delete_effects_chain(chain);
-    sox_close(out);
-    sox_close(in);
-    free(buffer);
-    return sample_rate;
+  // B x L x C -> B x C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 2);
+  }
+  return reader.signal().rate;
 }
 
-int read_audio_file(const std::string& file_name, at::Tensor output) {
+namespace {
 
-struct SoxEffect {
-  SoxEffect() : ename(""), eopts({""})  { }
-  std::string ename;
-  std::vector<std::string> eopts;
-};
+/// Computes the features of `load_features` without the cache.
+int compute_features(
+    const std::string& file_name,
+    const FeatureOptions& options,
+    at::Tensor output,
+    double normalization) {
+  // wave files are decoded from a memory mapping, anything else by libsox
+  if (auto mapped = MappedPcmFile::open_wav(file_name)) {
+    const sox_signalinfo_t& signal = mapped->signal();
+    int64_t position = 0;
+    extract_features(
+        options,
+        signal,
+        [&](sox_sample_t* dst, size_t n) {
+          const int64_t count =
+              std::min<int64_t>(n, int64_t(signal.length) - position);
+          mapped->decode(position, count, dst);
+          position += count;
+          return static_cast<size_t>(count);
+        },
+        output,
+        normalization);
+    return signal.rate;
+  }
 
-std::tuple<sox_signalinfo_t, sox_encodinginfo_t> get_info(
-    const std::string& file_name
-  ) {
-SoxDescriptor fd(sox_open_read(
-      file_name.c_str(),
-      /*signal=*/nullptr,
-      /*encoding=*/nullptr,
-      /*filetype=*/nullptr));
+  SoxDescriptor fd(open_read(file_name));
   if (fd.get() == nullptr) {
     throw std::runtime_error("Error opening audio file");
   }
-  return std::make_tuple(fd->signal, fd->encoding);
-}
-
-std::vector<std::string> get_effect_names() {
-  sox_effect_fn_t const * fns = sox_get_effect_fns();
-  std::vector<std::string> sv;
-  for(int i = 0; fns[i]; ++i) {
-    const sox_effect_handler_t *eh = fns[i] ();
-    if(eh && eh->name)
-      sv.push_back(eh->name);
+  extract_features(
+      options,
+      fd->signal,
+      [&fd](sox_sample_t* dst, size_t n) { return sox_read(fd.get(), dst, n); },
+      output,
+      normalization);
+  if (fd->sox_errno != 0) {
+    throw std::runtime_error(
+        std::string("Error reading audio file: ") + fd->sox_errstr);
   }
-  return sv;
+  return fd->signal.rate;
 }
 
-int read_audio_file(
+} // namespace
+
+int load_features(
     const std::string& file_name,
     at::Tensor output,
+    int64_t ws,
+    int64_t hop,
+    int64_t n_fft,
+    int64_t pad,
+    int64_t n_mels,
+    double f_min,
+    double f_max,
+    bool log,
+    double top_db,
+    double normalization) {
+  FeatureOptions options;
+  options.ws = ws;
+  options.hop = hop;
+  options.n_fft = n_fft;
+  options.pad = pad;
+  options.n_mels = n_mels;
+  options.f_min = f_min;
+  options.f_max = f_max;
+  options.log = log;
+  options.top_db = top_db;
+
+  std::ostringstream params;
+  params.precision(17);
+  params << "load_features " << ws << ' ' << hop << ' ' << n_fft << ' ' << pad
+         << ' ' << n_mels << ' ' << f_min << ' ' << f_max << ' ' << log << ' '
+         << top_db << ' ' << normalization;
+  return read_through_cache(file_name, params.str(), output, [&] {
+    return compute_features(file_name, options, output, normalization);
+  });
+}
+
+int read_shard_utterance(
+    const ShardReader& shard,
+    int64_t index,
+    at::Tensor output,
     bool ch_first,
     int64_t nframes,
     int64_t offset,
-    sox_signalinfo_t* si,
-    sox_encodinginfo_t* ei,
-    const char* ft) {
+    double normalization) {
+  const ShardEntry& entry = shard.entry(index);
+  if (auto pcm = shard.pcm(index)) {
+    read_mapped(*pcm, output, offset, nframes, normalization);
+  } else {
+    ensure_sox_formats();
+    SoxDescriptor fd(timed_open_mem_read(
+        shard.payload(index), entry.size, nullptr, nullptr, entry.file_type));
+    if (fd.get() == nullptr) {
+      throw std::runtime_error("Error opening utterance " + shard.name(index));
+    }
+    const int64_t buffer_length = seek_to_range(fd, offset, nframes);
+    read_audio(fd, output, buffer_length, normalization);
+  }
 
-  SoxDescriptor fd(sox_open_read(file_name.c_str(), si, ei, ft));
-  if (fd.get() == nullptr) {
-    throw std::runtime_error("Error opening audio file");
+  // L x C -> C x L, if desired
+  if (ch_first) {
+    output.transpose_(1, 0);
   }
+  return entry.rate;
+}
 
-  // signal info
+int64_t add_file_to_shard(
+    ShardWriter& writer,
+    const std::string& name,
+    const std::string& file_name) {
+  // the samples of wave files are copied as they are
+  if (auto mapped = MappedPcmFile::open_wav(file_name)) {
+    return writer.add_pcm(name, *mapped);
+  }
+  SoxDescriptor fd(open_read(file_name));
+  if (fd.get() == nullptr) {
+    throw std::runtime_error("Error opening audio file " + file_name);
+  }
+  return writer.add_encoded(name, file_name, fd->filetype, fd->signal);
+}
 
-  const int number_of_channels = fd->signal.channels;
-  const int sample_rate = fd->signal.rate;
-  const int64_t total_length = fd->signal.length;
+/// Reads an audio file block by block into a reusable buffer, optionally
+/// through an effects chain that is flowed incrementally on a background
+/// thread. Memory use is bounded by the block size, whatever the length of
+/// the file.
+class StreamReader {
+ public:
+  StreamReader(
+      const std::string& file_name,
+      at::Tensor buffer,
+      int64_t block_frames,
+      const std::vector<SoxEffect>& effects,
+      bool ch_first,
+      double normalization)
+      : fd_(open_read(file_name)),
+        buffer_(buffer),
+        block_frames_(block_frames),
+        ch_first_(ch_first),
+        normalization_(normalization) {
+    if (fd_.get() == nullptr) {
+      throw std::runtime_error("Error opening audio file");
+    }
+    if (block_frames <= 0) {
+      throw std::runtime_error("Expected a positive block size");
+    }
 
-  // multiply offset and number of frames by number of channels
-  offset *= number_of_channels;
-  nframes *= number_of_channels;
+    sox_signalinfo_t interm_signal = fd_->signal;
+    const bool has_effects = std::any_of(
+        effects.begin(), effects.end(), [](const SoxEffect& se) {
+          return se.ename != "no_effects";
+        });
+    if (has_effects) {
+      const CompiledEffectChain compiled(effects);
+      sox_signalinfo_t target_signal = fd_->signal;
+      compiled.apply_target(&target_signal);
+      chain_.reset(
+          sox_create_effects_chain(&fd_->encoding, &fd_->encoding));
+      add_input_effect(chain_.get(), fd_.get(), &interm_signal);
+      compiled.add_to(chain_.get(), &interm_signal, &target_signal);
+      add_callback_sink(chain_.get(), &sink_callback_, &interm_signal);
+
+      // two blocks of slack let the chain run ahead of the reader
+      fifo_.reset(new SampleFifo(2 * block_frames * interm_signal.channels));
+      sink_callback_ = [this](const sox_sample_t* samples, size_t n) {
+        return fifo_->push(samples, n);
+      };
+    }
 
-  if (total_length == 0) {
-    throw std::runtime_error("Error reading audio file: unknown length");
+    sample_rate_ = interm_signal.rate;
+    channels_ = interm_signal.channels;
+    resize_contiguous(buffer_, {block_frames_, channels_});
+
+    // started last: once it runs, nothing here may throw, as a joinable
+    // thread would terminate the process when the members are destroyed
+    if (chain_) {
+      producer_ = std::thread([this] {
+        {
+          StageTimer timer(Stage::kEffects);
+          sox_flow_effects(chain_.get(), nullptr, nullptr);
+        }
+        fifo_->close();
+      });
+    }
   }
-  if (offset > total_length) {
-    throw std::runtime_error("Offset past EOF");
+  StreamReader(const StreamReader& other) = delete;
+  StreamReader& operator=(const StreamReader& other) = delete;
+  ~StreamReader() {
+    if (producer_.joinable()) {
+      fifo_->cancel();
+      producer_.join();
+    }
   }
 
-  // calculate buffer length
-  int64_t buffer_length = total_length;
-  if (offset > 0) {
-      buffer_length -= offset;
-  }
-  if (nframes > 0 && buffer_length > nframes) {
-      buffer_length = nframes;
+  /// Fills the buffer with the next block and returns it (`C x L` if
+  /// `ch_first`), or an empty tensor at the end of the stream. The block is
+  /// a view that the next call overwrites. The last block may be shorter.
+  at::Tensor read() {
+    const int64_t length = block_frames_ * channels_;
+    int64_t samples_read = 0;
+    AT_DISPATCH_ALL_TYPES(buffer_.type(), "stream_read", [&] {
+      scalar_t* data = buffer_.data<scalar_t>();
+      if (!fifo_) {
+        samples_read = decode_into(fd_.get(), data, length, normalization_);
+        return;
+      }
+      sox_sample_t staging[kDecodeChunkSize];
+      while (samples_read < length) {
+        const size_t got = fifo_->pop(
+            staging, std::min(kDecodeChunkSize, length - samples_read));
+        if (got == 0) {
+          break;
+        }
+        convert_samples(staging, data + samples_read, got, normalization_);
+        samples_read += got;
+      }
+    });
+    at::Tensor block = buffer_.narrow(0, 0, samples_read / channels_);
+    return ch_first_ ? block.transpose(0, 1) : block;
   }
 
-  // seek to offset point before reading data
-  if (sox_seek(fd.get(), offset, 0) == SOX_EOF) {
-    throw std::runtime_error("sox_seek reached EOF, try reducing offset or num_samples");
+  int sample_rate() const {
+    return sample_rate_;
   }
 
-  // read data and fill output tensor
-  read_audio(fd, output, buffer_length);
-
-  // L x C -> C x L, if desired
-  if (ch_first) {
-    output.transpose_(1, 0);
+  int64_t channels() const {
+    return channels_;
   }
 
-  return sample_rate;
-}
+ private:
+  SoxDescriptor fd_;
+  at::Tensor buffer_;
+  const int64_t block_frames_;
+  const bool ch_first_;
+  const double normalization_;
+  int sample_rate_;
+  int64_t channels_;
+  // only set when flowing effects
+  std::unique_ptr<sox_effects_chain_t, void (*)(sox_effects_chain_t*)> chain_{
+      nullptr,
+      sox_delete_effects_chain};
+  std::unique_ptr<SampleFifo> fifo_;
+  SampleCallback sink_callback_;
+  std::thread producer_;
+};
 
-void write_audio_file(
+namespace {
+
+/// Opens `file_name` for writing, for a `StreamWriter` to take over.
+sox_format_t* open_write(
     const std::string& file_name,
-    const at::Tensor& tensor,
     sox_signalinfo_t* si,
     sox_encodinginfo_t* ei,
     const char* file_type) {
-  if (!tensor.is_contiguous()) {
-    throw std::runtime_error(
-        "Error writing audio file: input tensor must be contiguous");
-  }
-
+  ensure_sox_formats();
 #if SOX_LIB_VERSION_CODE >= 918272 // >= 14.3.0
   si->mult = nullptr;
 #endif
 
-  SoxDescriptor fd(sox_open_write(
-      file_name.c_str(),
-      si,
-      ei,
-      file_type,
-      /*oob=*/nullptr,
-      /*overwrite=*/nullptr));
-
-  if (fd.get() == nullptr) {
+  sox_format_t* fd = timed(Stage::kOpen, [&] {
+    return sox_open_write(
+        file_name.c_str(),
+        si,
+        ei,
+        file_type,
+        /*oob=*/nullptr,
+        /*overwrite=*/nullptr);
+  });
+  if (fd == nullptr) {
     throw std::runtime_error(
         "Error writing audio file: could not open file for writing");
   }
+  return fd;
+}
 
-  const auto samples_written = write_audio(fd, tensor);
+#ifndef __APPLE__
+/// Opens a memory stream for writing, which libsox allocates into `buffer`
+/// when it is closed.
+sox_format_t* open_memstream_write(
+    char** buffer,
+    size_t* buffer_size,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* file_type) {
+  ensure_sox_formats();
+#if SOX_LIB_VERSION_CODE >= 918272 // >= 14.3.0
+  si->mult = nullptr;
+#endif
 
-  if (samples_written != tensor.numel()) {
+  sox_format_t* fd = timed(Stage::kOpen, [&] {
+    return sox_open_memstream_write(
+        buffer, buffer_size, si, ei, file_type, /*oob=*/nullptr);
+  });
+  if (fd == nullptr) {
     throw std::runtime_error(
-        "Error writing audio file: could not write entire buffer");
+        "Error encoding audio: could not open memory stream for writing");
   }
+  return fd;
 }
+#endif
 
-int initialize_sox() {
-  /* Initializion for sox effects.  Only initialize once  */
-  return sox_init();
-}
+} // namespace
 
-int shutdown_sox() {
-  /* Shutdown for sox effects.  Do not shutdown between multiple calls  */
-  return sox_quit();
+void write_audio_file(
+    const std::string& file_name,
+    const at::Tensor& tensor,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* file_type,
+    bool ch_first,
+    double scale) {
+  FileScope file;
+  StreamWriter writer(
+      open_write(file_name, si, ei, file_type), /*background=*/false);
+  writer.write(tensor, ch_first, scale);
+  writer.close();
 }
 
-int build_flow_effects(const std::string& file_name,
-                       at::Tensor otensor,
-                       bool ch_first,
-                       sox_signalinfo_t* target_signal,
-                       sox_encodinginfo_t* target_encoding,
-                       const char* file_type,
-                       std::vector<SoxEffect> pyeffs,
-                       int max_num_eopts) {
-
-  /* This function builds an effects flow and puts the results into a tensor.
-     It can also be used to re-encode audio using any of the available encoding
-     options in SoX including sample rate and channel re-encoding.              */
-
-  // open input
-  sox_format_t* input = sox_open_read(file_name.c_str(), nullptr, nullptr, nullptr);
-  if (input == nullptr) {
-    throw std::runtime_error("Error opening audio file");
-  }
-
-  // only used if target signal or encoding are null
-  sox_signalinfo_t empty_signal;
-  sox_encodinginfo_t empty_encoding;
-
-  // set signalinfo and encodinginfo if blank
-  if(target_signal == nullptr) {
-    target_signal = &empty_signal;
-    target_signal->rate = input->signal.rate;
-    target_signal->channels = input->signal.channels;
-    target_signal->length = SOX_UNSPEC;
-    target_signal->precision = input->signal.precision;
-#if SOX_LIB_VERSION_CODE >= 918272 // >= 14.3.0
-    target_signal->mult = nullptr;
-#endif
+void write_audio_files_batch(
+    const std::vector<std::string>& file_names,
+    const std::vector<at::Tensor>& tensors,
+    std::vector<sox_signalinfo_t> signals,
+    sox_encodinginfo_t* ei,
+    const std::vector<std::string>& file_types,
+    bool ch_first,
+    const std::vector<double>& scales,
+    int num_threads) {
+  const size_t batch_size = file_names.size();
+  if (tensors.size() != batch_size || signals.size() != batch_size ||
+      scales.size() != batch_size) {
+    throw std::runtime_error(
+        "Expected one tensor, signal info and scale per file");
   }
-  if(target_encoding == nullptr) {
-    target_encoding = &empty_encoding;
-    target_encoding->encoding = SOX_ENCODING_SIGN2; // Sample format
-    target_encoding->bits_per_sample = input->signal.precision; // Bits per sample
-    target_encoding->compression = 0.0; // Compression factor
-    target_encoding->reverse_bytes = sox_option_default; // Should bytes be reversed
-    target_encoding->reverse_nibbles = sox_option_default; // Should nibbles be reversed
-    target_encoding->reverse_bits = sox_option_default; // Should bits be reversed (pairs of bits?)
-    target_encoding->opposite_endian = sox_false; // Reverse endianness
+  if (!file_types.empty() && file_types.size() != batch_size) {
+    throw std::runtime_error("Expected one file type per file");
   }
-
-  // check for rate or channels effect and change the output signalinfo accordingly
-  for (SoxEffect se : pyeffs) {
-    if (se.ename == "rate") {
-      target_signal->rate = std::stod(se.eopts[0]);
-    } else if (se.ename == "channels") {
-      target_signal->channels = std::stoi(se.eopts[0]);
+  ensure_sox_formats();
+  ThreadPool::global().parallel_for(batch_size, [&](int64_t i) {
+    const char* file_type = file_types.empty() || file_types[i].empty()
+        ? nullptr
+        : file_types[i].c_str();
+    try {
+      write_audio_file(
+          file_names[i],
+          tensors[i],
+          &signals[i],
+          ei,
+          file_type,
+          ch_first,
+          scales[i]);
+    } catch (const std::runtime_error& e) {
+      throw std::runtime_error(std::string(e.what()) + ": " + file_names[i]);
     }
-  }
-
-  // create interm_signal for effects, intermediate steps change this in-place
-  sox_signalinfo_t interm_signal = input->signal;
+  }, num_threads);
+}
 
+std::string encode_audio(
+    const at::Tensor& tensor,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* file_type,
+    bool ch_first,
+    double scale) {
+  FileScope file;
+  if (file_type == nullptr) {
+    throw std::runtime_error("Error encoding audio: a file type is required");
+  }
 #ifdef __APPLE__
-  // According to Mozilla Deepspeech sox_open_memstream_write doesn't work
-  // with OSX
+  // sox_open_memstream_write doesn't work with OSX, go through a file
   char tmp_name[] = "/tmp/fileXXXXXX";
   int tmp_fd = mkstemp(tmp_name);
   close(tmp_fd);
-  sox_format_t* output = sox_open_write(tmp_name, target_signal,
-                                        target_encoding, "wav", nullptr, nullptr);
+  std::string encoded;
+  try {
+    StreamWriter writer(
+        open_write(tmp_name, si, ei, file_type), /*background=*/false);
+    writer.write(tensor, ch_first, scale);
+    writer.close();
+    std::unique_ptr<FILE, int (*)(FILE*)> in(
+        std::fopen(tmp_name, "rb"), std::fclose);
+    char chunk[1 << 16];
+    size_t n;
+    while (in && (n = std::fread(chunk, 1, sizeof(chunk), in.get())) > 0) {
+      encoded.append(chunk, n);
+    }
+  } catch (...) {
+    std::remove(tmp_name);
+    throw;
+  }
+  std::remove(tmp_name);
+  return encoded;
 #else
-  // create buffer and buffer_size for output in memwrite
-  char* buffer;
-  size_t buffer_size;
-  // in-memory descriptor (this may not work for OSX)
-  sox_format_t* output = sox_open_memstream_write(&buffer,
-                                                  &buffer_size,
-                                                  target_signal,
-                                                  target_encoding,
-                                                  file_type, nullptr);
+  char* buffer = nullptr;
+  size_t buffer_size = 0;
+  // libsox allocates the buffer when the stream is closed, also on errors;
+  // declared first, so that it is freed after the writer closed the stream
+  std::unique_ptr<char*, void (*)(char**)> owner(
+      &buffer, [](char** b) { std::free(*b); });
+  StreamWriter writer(
+      open_memstream_write(&buffer, &buffer_size, si, ei, file_type),
+      /*background=*/false);
+  writer.write(tensor, ch_first, scale);
+  writer.close();
+  return std::string(buffer, buffer_size);
 #endif
-  if (output == nullptr) {
-    throw std::runtime_error("Error opening output memstream/temporary file");
-  }
-  // Setup the effects chain to decode/resample
-  sox_effects_chain_t* chain =
-    sox_create_effects_chain(&input->encoding, &output->encoding);
+}
 
-  sox_effect_t* e = sox_create_effect(sox_find_effect("input"));
-  char* io_args[1];
-  io_args[0] = (char*)input;
-  sox_effect_options(e, 1, io_args);
-  sox_add_effect(chain, e, &interm_signal, &input->signal);
-  free(e);
+int initialize_sox() {
+  /* Initializion for sox effects, only happens once until shutdown */
+  return ensure_sox_effects();
+}
 
-  for(SoxEffect tae : pyeffs) {
-    if(tae.ename == "no_effects") break;
-    e = sox_create_effect(sox_find_effect(tae.ename.c_str()));
-    e->global_info->global_info->verbosity = 1;
-    if(tae.eopts[0] == "") {
-      sox_effect_options(e, 0, nullptr);
-    } else {
-      int num_opts = tae.eopts.size();
-      char* sox_args[max_num_eopts];
-      for(std::vector<std::string>::size_type i = 0; i != tae.eopts.size(); i++) {
-        sox_args[i] = (char*) tae.eopts[i].c_str();
-      }
-      if(sox_effect_options(e, num_opts, sox_args) != SOX_SUCCESS) {
-#ifdef __APPLE__
-        unlink(tmp_name);
-#endif
-        throw std::runtime_error("invalid effect options, see SoX docs for details");
-      }
-    }
-    sox_add_effect(chain, e, &interm_signal, &output->signal);
-    free(e);
-  }
+int shutdown_sox() {
+  /* Shutdown for sox effects, which are initialized again when next used */
+  return quit_sox();
+}
 
-  e = sox_create_effect(sox_find_effect("output"));
-  io_args[0] = (char*)output;
-  sox_effect_options(e, 1, io_args);
-  sox_add_effect(chain, e, &interm_signal, &output->signal);
-  free(e);
+int build_flow_effects(const std::string& file_name,
+                       at::Tensor otensor,
+                       bool ch_first,
+                       sox_signalinfo_t* target_signal,
+                       sox_encodinginfo_t* target_encoding,
+                       const char* file_type,
+                       std::vector<SoxEffect> pyeffs) {
+  return CompiledEffectChain(pyeffs).apply(
+      file_name,
+      otensor,
+      ch_first,
+      target_signal,
+      target_encoding,
+      file_type,
+      /*normalization=*/1.);
+}
+
+int build_flow_effects_bytes(
+    const void* data,
+    size_t size,
+    const char* input_type,
+    at::Tensor otensor,
+    bool ch_first,
+    sox_signalinfo_t* target_signal,
+    sox_encodinginfo_t* target_encoding,
+    const char* file_type,
+    const std::vector<SoxEffect>& effects,
+    double normalization) {
+  return CompiledEffectChain(effects).apply_memory(
+      data,
+      size,
+      input_type,
+      otensor,
+      ch_first,
+      target_signal,
+      target_encoding,
+      file_type,
+      normalization);
+}
 
-  // Finally run the effects chain
-  sox_flow_effects(chain, nullptr, nullptr);
-  sox_delete_effects_chain(chain);
+int apply_effects_tensor(
+    at::Tensor input,
+    double sample_rate,
+    const std::vector<SoxEffect>& effects,
+    at::Tensor output,
+    bool ch_first,
+    double scale,
+    double normalization) {
+  return CompiledEffectChain(effects).apply_tensor(
+      input, sample_rate, output, ch_first, scale, normalization);
+}
 
-  // Close sox handles, buffer does not get properly sized until these are closed
-  sox_close(output);
-  sox_close(input);
+namespace {
 
-  int sr;
-  // Read the in-memory audio buffer or temp file that we just wrote.
-#ifdef __APPLE__
-  /*
-     Temporary filetype must have a valid header.  Wav seems to work here while
-     raw does not.  Certain effects like chorus caused strange behavior on the mac.
-  */
-  // read_audio_file reads the temporary file and returns the sr and otensor
-  sr = read_audio_file(tmp_name, otensor, ch_first, 0, 0,
-                       target_signal, target_encoding, "wav");
-  // delete temporary audio file
-  unlink(tmp_name);
-#else
-  // Resize output tensor to desired dimensions, different effects result in output->signal.length,
-  // interm_signal.length and buffer size being inconsistent with the result of the file output.
-  // We prioritize in the order: output->signal.length > interm_signal.length > buffer_size
-  // Could be related to: https://sourceforge.net/p/sox/bugs/314/
-  int nc, ns;
-  if (output->signal.length == 0) {
-    // sometimes interm_signal length is extremely large, but the buffer_size
-    // is double the length of the output signal
-    if (interm_signal.length > (buffer_size * 10)) {
-      ns = buffer_size / 2;
-    } else {
-      ns = interm_signal.length;
+/// Requests the bytes of a buffer-protocol object (e.g. `bytes`, `bytearray`,
+/// `memoryview` or a numpy array) without a copy; they must be contiguous.
+py::buffer_info request_bytes(const py::buffer& buffer) {
+  py::buffer_info info = buffer.request();
+  ssize_t stride = info.itemsize;
+  for (ssize_t i = info.ndim - 1; i >= 0; --i) {
+    if (info.shape[i] != 1 && info.strides[i] != stride) {
+      throw std::runtime_error("Expected a contiguous buffer");
     }
-    nc = interm_signal.channels;
-  } else {
-    nc = output->signal.channels;
-    ns = output->signal.length;
-  }
-  otensor.resize_({ns/nc, nc});
-  otensor = otensor.contiguous();
-
-  input = sox_open_mem_read(buffer, buffer_size, target_signal, target_encoding, file_type);
-  std::vector<sox_sample_t> samples(buffer_size);
-  const int64_t samples_read = sox_read(input, samples.data(), buffer_size);
-  assert(samples_read != nc * ns && samples_read != 0);
-  AT_DISPATCH_ALL_TYPES(otensor.type(), "effects_buffer", [&] {
-    auto* data = otensor.data<scalar_t>();
-    std::copy(samples.begin(), samples.begin() + samples_read, data);
-  });
-  // free buffer and close mem_read
-  sox_close(input);
-  free(buffer);
-
-  if (ch_first) {
-    otensor.transpose_(1, 0);
+    stride *= info.shape[i];
   }
-  sr = target_signal->rate;
-
-#endif
-  // return sample rate, output tensor modified in-place
-  return sr;
+  return info;
 }
+
+} // namespace
 } // namespace audio
 } // namespace torch
 
@@ -598,22 +3142,359 @@ PYBIND11_MODULE(_torch_sox, m) {
        .value("sox_false", sox_bool::sox_false)
        .value("sox_true", sox_bool::sox_true)
        .export_values();
+  py::class_<torch::audio::StreamReader>(m, "StreamReader")
+       .def(
+           py::init<
+               const std::string&,
+               at::Tensor,
+               int64_t,
+               const std::vector<torch::audio::SoxEffect>&,
+               bool,
+               double>(),
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "read",
+           &torch::audio::StreamReader::read,
+           py::call_guard<py::gil_scoped_release>())
+       .def_property_readonly(
+           "sample_rate", &torch::audio::StreamReader::sample_rate)
+       .def_property_readonly(
+           "channels", &torch::audio::StreamReader::channels);
+  py::class_<torch::audio::OnlineFeatureExtractor>(m, "OnlineFeatureExtractor")
+       .def(py::init([](double sample_rate,
+                        unsigned channels,
+                        int64_t ws,
+                        int64_t hop,
+                        int64_t n_fft,
+                        int64_t pad,
+                        int64_t n_mels,
+                        double f_min,
+                        double f_max,
+                        bool log,
+                        int64_t max_chunk) {
+         torch::audio::FeatureOptions options;
+         options.ws = ws;
+         options.hop = hop;
+         options.n_fft = n_fft;
+         options.pad = pad;
+         options.n_mels = n_mels;
+         options.f_min = f_min;
+         options.f_max = f_max;
+         options.log = log;
+         return new torch::audio::OnlineFeatureExtractor(
+             options, sample_rate, channels, max_chunk);
+       }))
+       .def(
+           "accept",
+           &torch::audio::OnlineFeatureExtractor::accept,
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "flush",
+           &torch::audio::OnlineFeatureExtractor::flush,
+           py::call_guard<py::gil_scoped_release>())
+       .def("reset", &torch::audio::OnlineFeatureExtractor::reset)
+       .def_property_readonly(
+           "num_features",
+           &torch::audio::OnlineFeatureExtractor::num_features)
+       .def_property_readonly(
+           "channels", &torch::audio::OnlineFeatureExtractor::num_channels);
+  py::class_<torch::audio::StreamWriter>(m, "StreamWriter")
+       .def(
+           py::init([](const std::string& file_name,
+                       sox_signalinfo_t si,
+                       sox_encodinginfo_t* ei,
+                       const char* file_type,
+                       bool background) {
+             return new torch::audio::StreamWriter(
+                 torch::audio::open_write(file_name, &si, ei, file_type),
+                 background);
+           }),
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "write",
+           &torch::audio::StreamWriter::write,
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "close",
+           &torch::audio::StreamWriter::close,
+           py::call_guard<py::gil_scoped_release>())
+       .def_property_readonly("frames", &torch::audio::StreamWriter::frames);
+  py::class_<torch::audio::ShardWriter>(m, "ShardWriter")
+       .def(py::init<const std::string&>())
+       .def(
+           "add_samples",
+           &torch::audio::ShardWriter::add_samples,
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "add_file",
+           &torch::audio::add_file_to_shard,
+           py::call_guard<py::gil_scoped_release>())
+       .def("close", &torch::audio::ShardWriter::close)
+       .def("__len__", &torch::audio::ShardWriter::size);
+  py::class_<torch::audio::ShardReader>(m, "ShardReader")
+       .def(py::init<const std::string&, bool>())
+       .def("__len__", &torch::audio::ShardReader::size)
+       .def("name", &torch::audio::ShardReader::name)
+       .def("names", &torch::audio::ShardReader::names)
+       .def("signal", &torch::audio::ShardReader::signal)
+       .def("view", &torch::audio::ShardReader::view)
+       .def("prefetch", &torch::audio::ShardReader::prefetch);
+  m.def(
+      "read_shard",
+      &torch::audio::read_shard_utterance,
+      "Reads an utterance of a shard into a tensor",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "set_audio_cache",
+      &torch::audio::set_audio_cache,
+      "Sets the on-disk cache of decoded audio, or disables it");
+  m.def(
+      "set_seek_index",
+      &torch::audio::set_seek_index,
+      "Sets whether MP3 files are read at an offset through seek indices");
+  m.def(
+      "set_stats_enabled",
+      &torch::audio::set_stats_enabled,
+      "Turns the collection of timings and counters on or off");
+  m.def(
+      "get_stats",
+      [] {
+        const torch::audio::Stats stats = torch::audio::get_stats();
+        py::dict stages;
+        for (int s = 0; s < torch::audio::kStageCount; ++s) {
+          const torch::audio::StageStats& stage = stats.stages[s];
+          py::dict entry;
+          entry["count"] = stage.count;
+          entry["total_ns"] = stage.total_ns;
+          entry["max_ns"] = stage.max_ns;
+          entry["histogram"] = py::cast(std::vector<int64_t>(
+              stage.histogram.begin(), stage.histogram.end()));
+          stages[torch::audio::stage_name(
+              static_cast<torch::audio::Stage>(s))] = entry;
+        }
+        py::dict counters;
+        for (int c = 0; c < torch::audio::kCounterCount; ++c) {
+          counters[torch::audio::counter_name(
+              static_cast<torch::audio::Counter>(c))] = stats.counters[c];
+        }
+        py::dict result;
+        result["enabled"] = stats.enabled;
+        result["stages"] = stages;
+        result["counters"] = counters;
+        return result;
+      },
+      "Gets the timings and counters collected since the last reset");
+  m.def(
+      "reset_stats",
+      &torch::audio::reset_stats,
+      "Starts the timings and counters again from zero");
+  m.def(
+      "audio_cache_stats",
+      &torch::audio::audio_cache_stats,
+      "Gets the counters of the on-disk cache");
+  m.def(
+      "reset_audio_cache_stats",
+      &torch::audio::reset_audio_cache_stats,
+      "Zeroes the counters of the on-disk cache");
+  m.def(
+      "clear_audio_cache",
+      &torch::audio::clear_audio_cache,
+      "Removes every entry of the on-disk cache",
+      py::call_guard<py::gil_scoped_release>());
   m.def(
       "read_audio_file",
       &torch::audio::read_audio_file,
-      "Reads an audio file into a tensor");
+      "Reads an audio file into a tensor",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_bytes",
+      [](const py::buffer& buffer,
+         at::Tensor output,
+         bool ch_first,
+         int64_t nframes,
+         int64_t offset,
+         sox_signalinfo_t* si,
+         sox_encodinginfo_t* ei,
+         const char* ft,
+         double normalization) {
+        const py::buffer_info info = torch::audio::request_bytes(buffer);
+        py::gil_scoped_release no_gil;
+        return torch::audio::read_audio_bytes(
+            info.ptr,
+            info.size * info.itemsize,
+            output,
+            ch_first,
+            nframes,
+            offset,
+            si,
+            ei,
+            ft,
+            normalization);
+      },
+      "Reads an audio file in a buffer into a tensor");
+  m.def(
+      "read_audio_file_mu_law",
+      &torch::audio::read_audio_file_mu_law,
+      "Reads an audio file into a tensor of mu-law codes",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "mu_law_encode",
+      static_cast<void (*)(const at::Tensor&, at::Tensor, int64_t)>(
+          &torch::audio::mu_law_encode),
+      "Mu-law encodes a tensor of values into codes",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "mu_law_decode",
+      static_cast<void (*)(const at::Tensor&, at::Tensor, int64_t)>(
+          &torch::audio::mu_law_decode),
+      "Decodes a tensor of mu-law codes into values",
+      py::call_guard<py::gil_scoped_release>());
+  py::enum_<torch::audio::VadMode>(m, "VadMode")
+      .value("trim", torch::audio::VadMode::kTrim)
+      .value("segments", torch::audio::VadMode::kSegments);
+  py::class_<torch::audio::VadOptions>(m, "VadOptions")
+      .def(py::init<>())
+      .def_readwrite("mode", &torch::audio::VadOptions::mode)
+      .def_readwrite("threshold_db", &torch::audio::VadOptions::threshold_db)
+      .def_readwrite(
+          "weak_margin_db", &torch::audio::VadOptions::weak_margin_db)
+      .def_readwrite("zcr_threshold", &torch::audio::VadOptions::zcr_threshold)
+      .def_readwrite("frame_ms", &torch::audio::VadOptions::frame_ms)
+      .def_readwrite("min_speech_ms", &torch::audio::VadOptions::min_speech_ms)
+      .def_readwrite(
+          "min_silence_ms", &torch::audio::VadOptions::min_silence_ms)
+      .def_readwrite("pad_ms", &torch::audio::VadOptions::pad_ms)
+      .def_readwrite("max_onset_ms", &torch::audio::VadOptions::max_onset_ms);
   m.def(
-  "read_audio_file_augment",
-  &torch::audio::read_audio_file_augment,
-  "Reads an audio file and applies augmentations");
+      "read_audio_file_vad",
+      &torch::audio::read_audio_file_vad,
+      "Reads the voiced frames of an audio file into a tensor",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_segments",
+      &torch::audio::read_audio_segments,
+      "Reads several segments of an audio file into tensors",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_into",
+      &torch::audio::read_audio_into,
+      "Reads frames of an audio file into a tensor of a fixed size",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_segments_padded",
+      &torch::audio::read_audio_segments_padded,
+      "Reads several segments of an audio file into a padded batch tensor",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "get_info_batch",
+      &torch::audio::get_info_batch,
+      "Gets the signal info of a list of audio files in parallel",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_files_batch",
+      &torch::audio::read_audio_files_batch,
+      "Reads a list of audio files into a padded batch tensor in parallel",
+      py::call_guard<py::gil_scoped_release>());
+  py::class_<torch::audio::CompiledEffectChain>(m, "CompiledEffectChain")
+       .def(py::init<const std::vector<torch::audio::SoxEffect>&>())
+       .def(
+           "apply",
+           &torch::audio::CompiledEffectChain::apply,
+           "flow an audio file through the chain into a tensor",
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "apply_tensor",
+           &torch::audio::CompiledEffectChain::apply_tensor,
+           "flow an audio tensor through the chain into a tensor",
+           py::call_guard<py::gil_scoped_release>())
+       .def(
+           "apply_bytes",
+           [](const torch::audio::CompiledEffectChain& self,
+              const py::buffer& buffer,
+              const char* input_type,
+              at::Tensor otensor,
+              bool ch_first,
+              sox_signalinfo_t* target_signal,
+              sox_encodinginfo_t* target_encoding,
+              const char* file_type,
+              double normalization) {
+             const py::buffer_info info = torch::audio::request_bytes(buffer);
+             py::gil_scoped_release no_gil;
+             return self.apply_memory(
+                 info.ptr,
+                 info.size * info.itemsize,
+                 input_type,
+                 otensor,
+                 ch_first,
+                 target_signal,
+                 target_encoding,
+                 file_type,
+                 normalization);
+           },
+           "flow an audio file in a buffer through the chain into a tensor")
+       .def("__len__", &torch::audio::CompiledEffectChain::size);
+  m.def(
+      "read_audio_file_augment",
+      &torch::audio::read_audio_file_augment,
+      "Reads an audio file and applies a compiled augmentation chain",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_file_augment_multi",
+      &torch::audio::read_audio_file_augment_multi,
+      "Decodes an audio file once and applies several augmentation chains",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "read_audio_file_augment_multi_padded",
+      &torch::audio::read_audio_file_augment_multi_padded,
+      "Decodes an audio file once into several zero-padded augmented variants",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "compile_augment_params",
+      &torch::audio::compile_augment_params,
+      "Compiles a list of name, value augmentation parameters",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "load_features",
+      &torch::audio::load_features,
+      "Decodes an audio file into (mel) spectrogram features",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "resample",
+      &torch::audio::resample,
+      "Resamples an audio tensor with the polyphase resampler",
+      py::call_guard<py::gil_scoped_release>());
   m.def(
       "write_audio_file",
       &torch::audio::write_audio_file,
-      "Writes data from a tensor into an audio file");
+      "Writes data from a tensor into an audio file",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "write_audio_files_batch",
+      &torch::audio::write_audio_files_batch,
+      "Writes a list of tensors into audio files in parallel",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "encode_audio",
+      [](const at::Tensor& tensor,
+         sox_signalinfo_t* si,
+         sox_encodinginfo_t* ei,
+         const char* file_type,
+         bool ch_first,
+         double scale) {
+        std::string encoded;
+        {
+          py::gil_scoped_release no_gil;
+          encoded = torch::audio::encode_audio(
+              tensor, si, ei, file_type, ch_first, scale);
+        }
+        return py::bytes(encoded.data(), encoded.size());
+      },
+      "Encodes a tensor into the bytes of an audio file");
   m.def(
       "get_info",
       &torch::audio::get_info,
-      "Gets information about an audio file");
+      "Gets information about an audio file",
+      py::call_guard<py::gil_scoped_release>());
   m.def(
       "get_effect_names",
       &torch::audio::get_effect_names,
@@ -621,7 +3502,39 @@ PYBIND11_MODULE(_torch_sox, m) {
   m.def(
       "build_flow_effects",
       &torch::audio::build_flow_effects,
-      "build effects and flow chain into tensors");
+      "build effects and flow chain into tensors",
+      py::call_guard<py::gil_scoped_release>());
+  m.def(
+      "build_flow_effects_bytes",
+      [](const py::buffer& buffer,
+         const char* input_type,
+         at::Tensor otensor,
+         bool ch_first,
+         sox_signalinfo_t* target_signal,
+         sox_encodinginfo_t* target_encoding,
+         const char* file_type,
+         const std::vector<torch::audio::SoxEffect>& effects,
+         double normalization) {
+        const py::buffer_info info = torch::audio::request_bytes(buffer);
+        py::gil_scoped_release no_gil;
+        return torch::audio::build_flow_effects_bytes(
+            info.ptr,
+            info.size * info.itemsize,
+            input_type,
+            otensor,
+            ch_first,
+            target_signal,
+            target_encoding,
+            file_type,
+            effects,
+            normalization);
+      },
+      "build effects and flow an audio file in a buffer into tensors");
+  m.def(
+      "apply_effects_tensor",
+      &torch::audio::apply_effects_tensor,
+      "flow an audio tensor through an effects chain into a tensor",
+      py::call_guard<py::gil_scoped_release>());
   m.def(
       "initialize_sox",
       &torch::audio::initialize_sox,
@@ -7,7 +7,9 @@ struct Tensor;
 namespace torch { namespace audio {
 
 /// Reads an audio file from the given `path` into the `output` `Tensor` and
-/// returns the sample rate of the audio file.
+/// returns the sample rate of the audio file. Samples are decoded in chunks
+/// straight into `output`; floating point outputs are divided by
+/// `normalization` in the same pass (pass 1 to keep the raw SoX values).
 /// Throws `std::runtime_error` if the audio file could not be opened, or an
 /// error ocurred during reading of the audio data.
 int read_audio_file(
@@ -18,20 +20,247 @@ int read_audio_file(
     int64_t offset,
     sox_signalinfo_t* si,
     sox_encodinginfo_t* ei,
-    const char* ft)
+    const char* ft,
+    double normalization);
 
-int read_audio_file_tempo_augment(const std::string& file_name, at::Tensor output, const std::string& new_tempo);
+/// Reads an audio file like `read_audio_file`, without normalization, into
+/// mu-law codes with `quantization_channels` codes (see `MuLawTables`) in
+/// `output`, of any type. Every chunk of samples is encoded as soon as it is
+/// decoded, in a single pass. Files are decoded from the memory mapping or by
+/// libsox, never through the audio cache or an MP3 seek index.
+int read_audio_file_mu_law(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    int64_t quantization_channels);
+
+struct VadOptions;
+
+/// Reads the range of an audio file that `read_audio_file` would into
+/// `output`, keeping only the frames that voice activity detection with
+/// `options` finds voiced (see `VadFilter`): the span from the first voiced
+/// interval to the last one, or the intervals themselves, back to back.
+/// Every chunk is analyzed as soon as it is decoded, so dropped samples are
+/// never converted, and only those that may still be kept are held back.
+/// Returns the sample rate and the voiced intervals `(start, end)` in frames
+/// of the file. Files are decoded from the memory mapping or by libsox,
+/// never through the audio cache or an MP3 seek index.
+std::tuple<int, std::vector<std::tuple<int64_t, int64_t>>> read_audio_file_vad(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    double normalization,
+    const VadOptions& options);
+
+/// Reads exactly as many frames of an audio file as `output` holds, from
+/// frame `offset`, into `output`: a `C x L` (`L x C` unless `ch_first`)
+/// tensor with any strides, e.g. a slice of a preallocated batch, which is
+/// neither resized nor reallocated. The frames past the end of the file are
+/// padded in place: with `fill_value` for a `pad_mode` of "constant", with
+/// the frames read from `offset` on repeated for "wrap", and with the last
+/// frame for "edge". Returns the sample rate and the number of frames read
+/// from the file. Nothing is cached.
+std::tuple<int, int64_t> read_audio_into(
+    const std::string& file_name,
+    at::Tensor output,
+    bool ch_first,
+    int64_t offset,
+    const std::string& pad_mode,
+    double fill_value,
+    double normalization);
+
+/// Reads the segments of an audio file that start at `offsets` and are
+/// `nframes` long (in frames; `nframes` is empty or holds one value per
+/// segment, 0 reads to the end) into `outputs`, one `L x C` (`C x L` if
+/// `ch_first`) tensor per segment, and returns the sample rate. The file is
+/// opened once and decoded in a single forward pass over the segments in
+/// order of offset, whatever order they are given in; segments may overlap.
+int read_audio_segments(
+    const std::string& file_name,
+    const std::vector<int64_t>& offsets,
+    const std::vector<int64_t>& nframes,
+    const std::vector<at::Tensor>& outputs,
+    bool ch_first,
+    double normalization);
+
+/// `read_audio_segments` into a single zero-padded `output` of size
+/// `B x L x C` (`B x C x L` if `ch_first`), with the number of frames read
+/// of every segment in `lengths`, like `read_audio_files_batch`.
+int read_audio_segments_padded(
+    const std::string& file_name,
+    const std::vector<int64_t>& offsets,
+    const std::vector<int64_t>& nframes,
+    at::Tensor output,
+    at::Tensor lengths,
+    bool ch_first,
+    double normalization);
+
+/// `read_audio_file` for a whole audio file of `size` bytes at `data`, e.g.
+/// the contents of a Python `bytes` object, without a copy or a temporary
+/// file. Wave and raw data are decoded directly, anything else is opened by
+/// libsox in memory; `ft` names the type if it cannot be detected. Nothing
+/// is cached.
+int read_audio_bytes(
+    const void* data,
+    size_t size,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* ft,
+    double normalization);
+
+/// Reads a batch of audio files in parallel on an internal thread pool into a
+/// single zero-padded `output` of size `B x L x C` (`B x C x L` if `ch_first`)
+/// and writes the number of frames read from each file into `lengths`.
+/// `nframes` and `offsets` are either empty or hold one value per file. Does
+/// not touch Python state, so it is bound with the GIL released. Returns the
+/// sample rate of every file; all files must have the same number of channels.
+/// Files are opened for decoding one per thread at a time, so batches of any
+/// size stay within the limit of open file descriptors.
+std::vector<int> read_audio_files_batch(
+    const std::vector<std::string>& file_names,
+    at::Tensor output,
+    at::Tensor lengths,
+    bool ch_first,
+    const std::vector<int64_t>& nframes,
+    const std::vector<int64_t>& offsets,
+    double normalization,
+    int num_threads);
+
+/// Decodes an audio file in chunks, divided by `normalization`, into the
+/// features of `transforms.MEL2` (or `SPECTROGRAM` if `n_mels` is 0, in
+/// power instead of decibels if not `log`) and writes them into the float
+/// tensor `output` as `C x L x F`. Frames are computed as the samples arrive,
+/// so neither the waveform nor the spectrogram is held in full. Windows, FFT
+/// plans and filter banks are cached. `f_max` 0 stands for half the sample
+/// rate and a `top_db` of -inf for no floor. Returns the sample rate.
+int load_features(
+    const std::string& file_name,
+    at::Tensor output,
+    int64_t ws,
+    int64_t hop,
+    int64_t n_fft,
+    int64_t pad,
+    int64_t n_mels,
+    double f_min,
+    double f_max,
+    bool log,
+    double top_db,
+    double normalization);
+
+class ShardReader;
+class ShardWriter;
+
+/// Reads utterance `index` of `shard` into `output` like `read_audio_file`
+/// reads a file: PCM utterances are decoded from the mapping of the shard,
+/// encoded ones by libsox from memory. Returns the sample rate.
+int read_shard_utterance(
+    const ShardReader& shard,
+    int64_t index,
+    at::Tensor output,
+    bool ch_first,
+    int64_t nframes,
+    int64_t offset,
+    double normalization);
+
+/// Adds the audio file `file_name` to `writer` as utterance `name`: the
+/// samples of wave files as they are, anything else as the encoded file.
+/// Returns its index.
+int64_t add_file_to_shard(
+    ShardWriter& writer,
+    const std::string& name,
+    const std::string& file_name);
+
+class CompiledEffectChain;
+
+/// Reads an audio file through a chain of augmentation effects compiled by
+/// `compile_augment_params` into `output` of size `L x 1` and returns the
+/// sample rate. Compiled chains are immutable, so one chain may be applied
+/// from several threads at once; libsox effects that use its shared DFT
+/// cache (`rate`, `sinc`, ...) run one call at a time across all threads.
+int read_audio_file_augment(
+    const std::string& file_name,
+    at::Tensor output,
+    const CompiledEffectChain& chain);
+
+/// Decodes a whole audio file once, to its end whatever the header says, and
+/// flows it through every chain of `chains` in parallel, into the matching
+/// `L x 1` tensor of `outputs`. Floating point outputs are divided by
+/// `normalization`. Returns the sample rate.
+int read_audio_file_augment_multi(
+    const std::string& file_name,
+    const std::vector<at::Tensor>& outputs,
+    const std::vector<CompiledEffectChain>& chains,
+    double normalization,
+    int num_threads);
+
+/// `read_audio_file_augment_multi` into a single zero-padded `output` of
+/// size `K x L`, with the number of samples of every variant in `lengths`.
+int read_audio_file_augment_multi_padded(
+    const std::string& file_name,
+    const std::vector<CompiledEffectChain>& chains,
+    at::Tensor output,
+    at::Tensor lengths,
+    double normalization,
+    int num_threads);
 
 /// Writes the data of a `Tensor` into an audio file at the given `path`, with
-/// a certain extension (e.g. `wav`or `mp3`) and sample rate.
+/// a certain extension (e.g. `wav`or `mp3`) and sample rate. The tensor is
+/// `L x C` (`C x L` if `ch_first`) with any strides and type, and multiplied
+/// by `scale` into SoX samples, which are rounded and saturated.
 /// Throws `std::runtime_error` when the audio file could not be opened for
 /// writing, or an error ocurred during writing of the audio data.
 void write_audio_file(
     const std::string& file_name,
-    at::Tensor& tensor,
+    const at::Tensor& tensor,
     sox_signalinfo_t* si,
     sox_encodinginfo_t* ei,
-    const char* file_type)
+    const char* file_type,
+    bool ch_first,
+    double scale);
+
+/// Writes every tensor of `tensors` into the file of the same index, like
+/// `write_audio_file` with the signal info and scale of the same index, in
+/// parallel on the internal thread pool. `file_types` is either empty or
+/// holds one type per file, empty to guess it from the extension. Does not
+/// touch Python state, so it is bound with the GIL released. Throws
+/// `std::runtime_error` naming a file that could not be written, after every
+/// other file was.
+void write_audio_files_batch(
+    const std::vector<std::string>& file_names,
+    const std::vector<at::Tensor>& tensors,
+    std::vector<sox_signalinfo_t> signals,
+    sox_encodinginfo_t* ei,
+    const std::vector<std::string>& file_types,
+    bool ch_first,
+    const std::vector<double>& scales,
+    int num_threads);
+
+/// Encodes a `Tensor` like `write_audio_file` into an audio file of type
+/// `file_type` in memory, and returns its bytes. Nothing is written to disk,
+/// except on OSX where memory streams are not supported by libsox. The
+/// stream cannot seek, so `si->length` must be set for formats whose header
+/// holds the length, e.g. wave.
+std::string encode_audio(
+    const at::Tensor& tensor,
+    sox_signalinfo_t* si,
+    sox_encodinginfo_t* ei,
+    const char* file_type,
+    bool ch_first,
+    double scale);
 
 /// Reads an audio file from the given `path` and returns a tuple of
 /// sox_signalinfo_t and sox_encodinginfo_t, which contain information about
@@ -41,6 +270,17 @@ void write_audio_file(
 std::tuple<sox_signalinfo_t, sox_encodinginfo_t> get_info(
     const std::string& file_name);
 
+/// Gets the rate (rounded), channels, length in samples and precision of a
+/// list of audio files in parallel on the internal thread pool, into a
+/// `B x 4` `output`. Headers of wave, FLAC and MP3 files are parsed without
+/// libsox where possible (see `read_header_info`), other files are opened
+/// like `get_info` does. Does not touch Python state, so it is bound with the
+/// GIL released. Throws `std::runtime_error` if a file could not be opened.
+void get_info_batch(
+    const std::vector<std::string>& file_names,
+    at::Tensor output,
+    int num_threads);
+
 // get names of all sox effects
 std::vector<std::string> get_effect_names();
 
@@ -57,16 +297,44 @@ struct SoxEffect {
 
 /// Build a SoX chain, flow the effects, and capture the results in a tensor.
 /// An audio file from the given `path` flows through an effects chain given
-/// by a list of effects and effect options to an output buffer which is encoded
-/// into memory to a target signal type and target signal encoding.  The resulting
-/// buffer is then placed into a tensor.  This function returns the output tensor
-/// and the sample rate of the output tensor.
+/// by a list of effects and effect options into the output tensor, with the
+/// values the target signal type and target signal encoding give.  Linear PCM
+/// targets are collected straight into the tensor, other encodings are encoded
+/// into memory and decoded again.  This function returns the sample rate of the
+/// output tensor.
 int build_flow_effects(const std::string& file_name,
                        at::Tensor otensor,
                        bool ch_first,
                        sox_signalinfo_t* target_signal,
                        sox_encodinginfo_t* target_encoding,
                        const char* file_type,
-                       std::vector<SoxEffect> pyeffs,
-                       int max_num_eopts);
+                       std::vector<SoxEffect> pyeffs);
+
+/// `build_flow_effects` for a whole audio file of `size` bytes at `data`, of
+/// libsox type `input_type` (null to detect it). Floating point outputs are
+/// divided by `normalization`. Nothing is cached.
+int build_flow_effects_bytes(
+    const void* data,
+    size_t size,
+    const char* input_type,
+    at::Tensor otensor,
+    bool ch_first,
+    sox_signalinfo_t* target_signal,
+    sox_encodinginfo_t* target_encoding,
+    const char* file_type,
+    const std::vector<SoxEffect>& effects,
+    double normalization);
+
+/// Flow the audio tensor `input` (`C x L` if `ch_first`, else `L x C`) at
+/// `sample_rate` through an effects chain into `output`, laid out the same
+/// way, and return the output sample rate.  Input values are multiplied by
+/// `scale` to get SoX samples and floating point outputs are divided by
+/// `normalization`.
+int apply_effects_tensor(at::Tensor input,
+                         double sample_rate,
+                         const std::vector<SoxEffect>& effects,
+                         at::Tensor output,
+                         bool ch_first,
+                         double scale,
+                         double normalization);
 }} // namespace torch::audio
@@ -1,6 +1,7 @@
 from __future__ import division, print_function
 import torch
 import numpy as np
+import _torch_sox
 try:
     import librosa
 except ImportError:
@@ -411,7 +412,9 @@ class MuLawEncoding(object):
     `Wikipedia Entry <https://en.wikipedia.org/wiki/%CE%9C-law_algorithm>`_
 
     This algorithm assumes the signal has been scaled to between -1 and 1 and
-    returns a signal encoded with values from 0 to quantization_channels - 1
+    returns a signal encoded with values from 0 to quantization_channels - 1.
+    CPU Tensors are encoded by the extension in one pass, in double precision,
+    with values out of range saturated.  See also `torchaudio.load_mu_law`.
 
     Args:
         quantization_channels (int): Number of channels. default: 256
@@ -438,6 +441,10 @@ class MuLawEncoding(object):
         elif isinstance(x, torch.Tensor):
             if not x.dtype.is_floating_point:
                 x = x.to(torch.float)
+            if not x.is_cuda:
+                x_mu = torch.empty(0, dtype=torch.long)
+                _torch_sox.mu_law_encode(x, x_mu, self.qc)
+                return x_mu
             mu = torch.tensor(mu, dtype=x.dtype)
             x_mu = torch.sign(x) * torch.log1p(mu *
                                                torch.abs(x)) / torch.log1p(mu)
@@ -453,7 +460,8 @@ class MuLawExpanding(object):
     `Wikipedia Entry <https://en.wikipedia.org/wiki/%CE%9C-law_algorithm>`_
 
     This expects an input with values between 0 and quantization_channels - 1
-    and returns a signal scaled between -1 and 1.
+    and returns a signal scaled between -1 and 1.  Codes of CPU Tensors are
+    looked up in a table by the extension.
 
     Args:
         quantization_channels (int): Number of channels. default: 256
@@ -478,6 +486,10 @@ class MuLawExpanding(object):
             x = ((x_mu) / mu) * 2 - 1.
             x = np.sign(x) * (np.exp(np.abs(x) * np.log1p(mu)) - 1.) / mu
         elif isinstance(x_mu, torch.Tensor):
+            if not x_mu.is_cuda:
+                x = torch.empty(0, dtype=x_mu.dtype if x_mu.dtype.is_floating_point else torch.float)
+                _torch_sox.mu_law_decode(x_mu, x, self.qc)
+                return x
             if not x_mu.dtype.is_floating_point:
                 x_mu = x_mu.to(torch.float)
             mu = torch.tensor(mu, dtype=x_mu.dtype)
@@ -0,0 +1,332 @@
+#include <sox.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "vad.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+/// A duration in milliseconds as a number of analysis frames.
+int64_t to_frames(double ms, double frame_ms) {
+  return std::max<int64_t>(std::llround(ms / frame_ms), 0);
+}
+
+} // namespace
+
+VadFilter::VadFilter(const VadOptions& options, double rate, int64_t channels)
+    : mode_(options.mode), channels_(channels) {
+  if (!(rate > 0) || channels <= 0) {
+    throw std::runtime_error("Voice activity detection: invalid signal");
+  }
+  if (!(options.frame_ms > 0) || !(options.min_speech_ms >= 0) ||
+      !(options.min_silence_ms >= 0) || !(options.pad_ms >= 0) ||
+      !(options.max_onset_ms >= 0) || !(options.weak_margin_db >= 0) ||
+      std::isnan(options.threshold_db) || std::isnan(options.zcr_threshold)) {
+    throw std::runtime_error("Voice activity detection: invalid options");
+  }
+  frame_length_ =
+      std::max<int64_t>(std::llround(options.frame_ms * rate / 1000), 1);
+  min_speech_ = to_frames(options.min_speech_ms, options.frame_ms);
+  min_silence_ =
+      std::max<int64_t>(to_frames(options.min_silence_ms, options.frame_ms), 1);
+  // the padding after an interval is only known once it has ended
+  pad_ = std::min(to_frames(options.pad_ms, options.frame_ms), min_silence_);
+  max_onset_ = to_frames(options.max_onset_ms, options.frame_ms);
+  voiced_power_ = std::pow(10., options.threshold_db / 10);
+  weak_power_ =
+      std::pow(10., (options.threshold_db - options.weak_margin_db) / 10);
+  zcr_threshold_ = options.zcr_threshold;
+  scale_ = 1. / (2147483648. * channels);
+}
+
+void VadFilter::push(
+    const sox_sample_t* samples,
+    int64_t n,
+    std::vector<sox_sample_t>* out) {
+  pending_.insert(pending_.end(), samples, samples + n);
+  for (int64_t i = 0; i < n; ++i) {
+    mix_ += samples[i];
+    if (++channel_ < channels_) {
+      continue;
+    }
+    const double value = mix_ * scale_;
+    const bool negative = value < 0;
+    power_sum_ += value * value;
+    crossings_ += negative != negative_;
+    negative_ = negative;
+    channel_ = 0;
+    mix_ = 0;
+    ++frames_;
+    if (++frame_fill_ == frame_length_) {
+      end_frame(out);
+    }
+  }
+
+  // drop what no interval can start at any more, moving the rest to the
+  // front once that is most of the buffer
+  const int64_t keep = keep_from();
+  if (keep > pending_start_) {
+    pending_head_ += (keep - pending_start_) * channels_;
+    pending_start_ = keep;
+  }
+  if (pending_head_ > 0 &&
+      pending_head_ >= static_cast<int64_t>(pending_.size()) / 2) {
+    pending_.erase(pending_.begin(), pending_.begin() + pending_head_);
+    pending_head_ = 0;
+  }
+}
+
+void VadFilter::flush(std::vector<sox_sample_t>* out) {
+  // a trailing partial frame of the input is dropped
+  if (frame_fill_ > 0) {
+    end_frame(out);
+  }
+  if (in_segment_) {
+    close_segment(out);
+  }
+  pending_.clear();
+  pending_head_ = 0;
+  pending_start_ = frames_;
+}
+
+void VadFilter::end_frame(std::vector<sox_sample_t>* out) {
+  const double power = power_sum_ / frame_fill_;
+  const double zcr = static_cast<double>(crossings_) / frame_fill_;
+  power_sum_ = 0;
+  crossings_ = 0;
+  frame_fill_ = 0;
+  const int64_t frame = frame_index_++;
+
+  if (power >= voiced_power_) {
+    if (!in_segment_) {
+      in_segment_ = true;
+      segment_start_ = weak_start_ >= 0
+          ? std::max(weak_start_, frame - max_onset_)
+          : frame;
+      weak_start_ = -1;
+    }
+    last_active_ = frame;
+  } else if (power >= weak_power_ && zcr >= zcr_threshold_) {
+    if (in_segment_) {
+      last_active_ = frame;
+    } else if (weak_start_ < 0) {
+      weak_start_ = frame;
+    }
+  } else if (in_segment_) {
+    if (frame - last_active_ >= min_silence_) {
+      close_segment(out);
+    }
+  } else {
+    weak_start_ = -1;
+  }
+}
+
+void VadFilter::close_segment(std::vector<sox_sample_t>* out) {
+  in_segment_ = false;
+  if (last_active_ + 1 - segment_start_ < min_speech_) {
+    return;
+  }
+  const int64_t start = std::max<int64_t>(
+      (segment_start_ - pad_) * frame_length_, emitted_end_);
+  const int64_t end =
+      std::min((last_active_ + 1 + pad_) * frame_length_, frames_);
+  if (!segments_.empty() && start <= segments_.back().end) {
+    segments_.back().end = end;
+    emit(emitted_end_, end, out);
+  } else {
+    segments_.push_back({start, end});
+    // trimming keeps the silence between intervals
+    const bool gap = mode_ == VadMode::kTrim && segments_.size() > 1;
+    emit(gap ? emitted_end_ : start, end, out);
+  }
+  emitted_end_ = end;
+}
+
+void VadFilter::emit(
+    int64_t start,
+    int64_t end,
+    std::vector<sox_sample_t>* out) {
+  if (start < pending_start_ || end <= start) {
+    return;
+  }
+  const auto first = pending_.begin() + pending_head_ +
+      (start - pending_start_) * channels_;
+  out->insert(out->end(), first, first + (end - start) * channels_);
+}
+
+int64_t VadFilter::keep_from() const {
+  if (mode_ == VadMode::kTrim && !segments_.empty()) {
+    return emitted_end_;
+  }
+  const int64_t start = in_segment_
+      ? segment_start_
+      : weak_start_ >= 0 ? std::max(weak_start_, frame_index_ - max_onset_)
+                         : frame_index_;
+  return std::max((start - pad_) * frame_length_, emitted_end_);
+}
+
+namespace {
+
+struct EnergyVadPriv {
+  VadOptions options;
+  VadFilter* filter;
+  // output of the filter not taken by the chain yet
+  std::vector<sox_sample_t>* backlog;
+  size_t backlog_head;
+  bool flushed;
+};
+
+int energy_vad_getopts(sox_effect_t* effp, int argc, char** argv) {
+  auto* priv = static_cast<EnergyVadPriv*>(effp->priv);
+  new (&priv->options) VadOptions();
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "trim") {
+      priv->options.mode = VadMode::kTrim;
+      continue;
+    }
+    if (arg == "segments") {
+      priv->options.mode = VadMode::kSegments;
+      continue;
+    }
+    if (arg.size() != 2 || arg[0] != '-' || i + 1 == argc) {
+      return SOX_EOF;
+    }
+    char* end;
+    const double value = std::strtod(argv[++i], &end);
+    if (*end != '\0' || !std::isfinite(value)) {
+      return SOX_EOF;
+    }
+    switch (arg[1]) {
+      case 't':
+        priv->options.threshold_db = value;
+        break;
+      case 'z':
+        priv->options.zcr_threshold = value;
+        break;
+      case 's':
+        priv->options.min_speech_ms = value;
+        break;
+      case 'g':
+        priv->options.min_silence_ms = value;
+        break;
+      case 'p':
+        priv->options.pad_ms = value;
+        break;
+      default:
+        return SOX_EOF;
+    }
+    if (arg[1] != 't' && arg[1] != 'z' && value < 0) {
+      return SOX_EOF;
+    }
+  }
+  return SOX_SUCCESS;
+}
+
+int energy_vad_start(sox_effect_t* effp) {
+  auto* priv = static_cast<EnergyVadPriv*>(effp->priv);
+  try {
+    priv->filter = new VadFilter(
+        priv->options, effp->in_signal.rate, effp->in_signal.channels);
+  } catch (const std::runtime_error&) {
+    return SOX_EOF;
+  }
+  priv->backlog = new std::vector<sox_sample_t>();
+  priv->backlog_head = 0;
+  priv->flushed = false;
+  effp->out_signal.length = SOX_UNKNOWN_LEN;
+  return SOX_SUCCESS;
+}
+
+/// Moves up to `n` samples (whole frames) of the backlog into `dst`.
+size_t pull_backlog(sox_effect_t* effp, sox_sample_t* dst, size_t n) {
+  auto* priv = static_cast<EnergyVadPriv*>(effp->priv);
+  const size_t channels = std::max(effp->in_signal.channels, 1u);
+  std::vector<sox_sample_t>& backlog = *priv->backlog;
+  size_t done = std::min(n, backlog.size() - priv->backlog_head);
+  done -= done % channels;
+  std::memcpy(
+      dst, backlog.data() + priv->backlog_head, done * sizeof(sox_sample_t));
+  priv->backlog_head += done;
+  if (priv->backlog_head == backlog.size()) {
+    backlog.clear();
+    priv->backlog_head = 0;
+  }
+  return done;
+}
+
+int energy_vad_flow(
+    sox_effect_t* effp,
+    const sox_sample_t* ibuf,
+    sox_sample_t* obuf,
+    size_t* isamp,
+    size_t* osamp) {
+  auto* priv = static_cast<EnergyVadPriv*>(effp->priv);
+  const size_t channels = std::max(effp->in_signal.channels, 1u);
+  // like `polyphase_rate`, new input is only taken once the output left over
+  // from the last is all out
+  size_t done = pull_backlog(effp, obuf, *osamp);
+  if (priv->backlog_head != 0 || done + channels > *osamp) {
+    *isamp = 0;
+    *osamp = done;
+    return SOX_SUCCESS;
+  }
+  const size_t n = *isamp - *isamp % channels;
+  priv->filter->push(ibuf, n, priv->backlog);
+  *isamp = n;
+  *osamp = done + pull_backlog(effp, obuf + done, *osamp - done);
+  return SOX_SUCCESS;
+}
+
+int energy_vad_drain(sox_effect_t* effp, sox_sample_t* obuf, size_t* osamp) {
+  auto* priv = static_cast<EnergyVadPriv*>(effp->priv);
+  if (!priv->flushed) {
+    priv->filter->flush(priv->backlog);
+    priv->flushed = true;
+  }
+  *osamp = pull_backlog(effp, obuf, *osamp);
+  return *osamp > 0 ? SOX_SUCCESS : SOX_EOF;
+}
+
+int energy_vad_stop(sox_effect_t* effp) {
+  auto* priv = static_cast<EnergyVadPriv*>(effp->priv);
+  delete priv->filter;
+  priv->filter = nullptr;
+  delete priv->backlog;
+  priv->backlog = nullptr;
+  return SOX_SUCCESS;
+}
+
+/// Frees the state of an effect that was started but never stopped.
+int energy_vad_kill(sox_effect_t* effp) {
+  return energy_vad_stop(effp);
+}
+
+} // namespace
+
+const sox_effect_handler_t* energy_vad_handler() {
+  static const sox_effect_handler_t handler = {
+      "energy_vad",
+      "[-t threshold_db] [-z zcr_threshold] [-s min_speech_ms] "
+      "[-g min_silence_ms] [-p pad_ms] [trim|segments]",
+      SOX_EFF_MCHAN | SOX_EFF_LENGTH,
+      energy_vad_getopts,
+      energy_vad_start,
+      energy_vad_flow,
+      energy_vad_drain,
+      energy_vad_stop,
+      energy_vad_kill,
+      sizeof(EnergyVadPriv)};
+  return &handler;
+}
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <sox.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace torch {
+namespace audio {
+
+/// What a `VadFilter` keeps of its input.
+enum class VadMode {
+  /// Everything from the start of the first voiced interval to the end of
+  /// the last one, i.e. the input without leading and trailing silence.
+  kTrim,
+  /// The voiced intervals only, back to back.
+  kSegments,
+};
+
+/// Options of voice activity detection. An analysis frame is voiced if its
+/// energy reaches `threshold_db`; it is weak, e.g. an unvoiced consonant, if
+/// its energy is at most `weak_margin_db` below that and it crosses zero
+/// at least `zcr_threshold` times per sample.
+struct VadOptions {
+  VadMode mode = VadMode::kTrim;
+  /// Energy of voiced frames, in dB relative to a full scale square wave.
+  double threshold_db = -40.;
+  double weak_margin_db = 15.;
+  double zcr_threshold = 0.25;
+  double frame_ms = 10.;
+  /// Voiced intervals shorter than this are dropped.
+  double min_speech_ms = 100.;
+  /// Shorter silences do not end a voiced interval.
+  double min_silence_ms = 300.;
+  /// Silence kept on either side of every voiced interval, at most
+  /// `min_silence_ms`.
+  double pad_ms = 50.;
+  /// Most weak frames before a voiced one that start its interval.
+  double max_onset_ms = 200.;
+};
+
+/// An interval of frames `[start, end)` of the input.
+struct VadSegment {
+  int64_t start;
+  int64_t end;
+};
+
+/// Energy and zero-crossing rate voice activity detection over a stream of
+/// interleaved samples, which keeps the samples of the voiced intervals
+/// (all channels, classified on their mean) as they come and drops the
+/// rest. Only the samples that a voiced interval may still start at are
+/// held back: the padding and onset before the current frame, the interval
+/// being detected, and in trim mode the silence after the last interval.
+class VadFilter {
+ public:
+  VadFilter(const VadOptions& options, double rate, int64_t channels);
+
+  /// Analyzes `n` samples, which need not end on a whole frame, and appends
+  /// the samples kept so far to `out`.
+  void push(
+      const sox_sample_t* samples,
+      int64_t n,
+      std::vector<sox_sample_t>* out);
+
+  /// Ends the stream, appending the rest of the samples kept to `out`.
+  void flush(std::vector<sox_sample_t>* out);
+
+  /// The voiced intervals found so far, padded, in frames of the input.
+  /// Intervals whose padding touches are merged.
+  const std::vector<VadSegment>& segments() const {
+    return segments_;
+  }
+
+ private:
+  /// Classifies the analysis frame that was accumulated and advances the
+  /// detection by one frame.
+  void end_frame(std::vector<sox_sample_t>* out);
+  void close_segment(std::vector<sox_sample_t>* out);
+  /// Keeps the frames `[start, end)` of the input.
+  void emit(int64_t start, int64_t end, std::vector<sox_sample_t>* out);
+  /// The first frame that may still be kept.
+  int64_t keep_from() const;
+
+  VadMode mode_;
+  int64_t channels_;
+  // in analysis frames, but for `frame_length_` in frames of the input
+  int64_t frame_length_;
+  int64_t min_speech_;
+  int64_t min_silence_;
+  int64_t pad_;
+  int64_t max_onset_;
+  // mean square of the frames, relative to full scale
+  double voiced_power_;
+  double weak_power_;
+  double zcr_threshold_;
+  // from a sum of samples of all channels to their mean in [-1, 1]
+  double scale_;
+
+  // the frame and the analysis frame being accumulated
+  int64_t channel_ = 0;
+  int64_t mix_ = 0;
+  int64_t frame_fill_ = 0;
+  double power_sum_ = 0;
+  int64_t crossings_ = 0;
+  bool negative_ = false;
+
+  // detection, in analysis frames: the frame to come, the interval being
+  // detected and the run of weak frames outside of one, if any
+  int64_t frame_index_ = 0;
+  bool in_segment_ = false;
+  int64_t segment_start_ = 0;
+  int64_t last_active_ = 0;
+  int64_t weak_start_ = -1;
+
+  // the samples held back from `pending_head_` on, from frame
+  // `pending_start_` of the input, and the whole frames seen
+  std::vector<sox_sample_t> pending_;
+  int64_t pending_head_ = 0;
+  int64_t pending_start_ = 0;
+  int64_t frames_ = 0;
+  int64_t emitted_end_ = 0;
+  std::vector<VadSegment> segments_;
+};
+
+/// SoX effect running a `VadFilter` on the audio flowing through it, with
+/// the options `[-t threshold_db] [-z zcr_threshold] [-s min_speech_ms]
+/// [-g min_silence_ms] [-p pad_ms] [trim|segments]` (trim by default).
+const sox_effect_handler_t* energy_vad_handler();
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,428 @@
+#include <sox.h>
+
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wav_reader.h"
+
+namespace torch {
+namespace audio {
+namespace {
+
+constexpr uint16_t kWaveFormatPcm = 0x0001;
+constexpr uint16_t kWaveFormatIeeeFloat = 0x0003;
+constexpr uint16_t kWaveFormatExtensible = 0xFFFE;
+
+/// Everything is decoded as little-endian.
+bool is_little_endian() {
+  const uint16_t one = 1;
+  uint8_t first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+uint16_t le16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+uint32_t le32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+      static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+int bytes_per_sample(PcmFormat format) {
+  switch (format) {
+    case PcmFormat::kUInt8:
+      return 1;
+    case PcmFormat::kInt16:
+      return 2;
+    case PcmFormat::kInt24:
+      return 3;
+    case PcmFormat::kInt32:
+    case PcmFormat::kFloat32:
+      return 4;
+    case PcmFormat::kFloat64:
+      return 8;
+  }
+  return 0;
+}
+
+/// The precision libsox reports for `format`.
+unsigned precision(PcmFormat format) {
+  switch (format) {
+    case PcmFormat::kFloat32:
+      return 24;
+    case PcmFormat::kFloat64:
+      return 53;
+    default:
+      return 8 * bytes_per_sample(format);
+  }
+}
+
+/// Maps a format tag and sample size to a `PcmFormat`, false if unsupported.
+bool to_pcm_format(uint16_t tag, unsigned bits, PcmFormat* format) {
+  if (tag == kWaveFormatPcm) {
+    switch (bits) {
+      case 8:
+        *format = PcmFormat::kUInt8;
+        return true;
+      case 16:
+        *format = PcmFormat::kInt16;
+        return true;
+      case 24:
+        *format = PcmFormat::kInt24;
+        return true;
+      case 32:
+        *format = PcmFormat::kInt32;
+        return true;
+    }
+  } else if (tag == kWaveFormatIeeeFloat) {
+    switch (bits) {
+      case 32:
+        *format = PcmFormat::kFloat32;
+        return true;
+      case 64:
+        *format = PcmFormat::kFloat64;
+        return true;
+    }
+  }
+  return false;
+}
+
+/// Read-only private mapping of a whole file.
+struct Mapping {
+  Mapping() = default;
+  Mapping(const Mapping& other) = delete;
+  Mapping& operator=(const Mapping& other) = delete;
+  ~Mapping() {
+    if (addr != nullptr) {
+      munmap(addr, size);
+    }
+  }
+
+  bool map(const std::string& file_name) {
+    const int fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        addr = mapped;
+        size = st.st_size;
+      }
+    }
+    close(fd);
+    return addr != nullptr;
+  }
+
+  /// Hands the mapping over to the caller.
+  void* release() {
+    void* mapped = addr;
+    addr = nullptr;
+    return mapped;
+  }
+
+  void* addr = nullptr;
+  size_t size = 0;
+};
+
+/// Decodes `n` `format` samples at `src` with libsox's conversions.
+void decode_samples(
+    PcmFormat format,
+    const uint8_t* src,
+    int64_t n,
+    sox_sample_t* dst) {
+  switch (format) {
+    case PcmFormat::kUInt8:
+      for (int64_t i = 0; i < n; ++i) {
+        dst[i] = (static_cast<sox_sample_t>(src[i]) - 128) * (1 << 24);
+      }
+      break;
+    case PcmFormat::kInt16:
+      for (int64_t i = 0; i < n; ++i) {
+        int16_t v;
+        std::memcpy(&v, src + 2 * i, sizeof(v));
+        dst[i] = static_cast<sox_sample_t>(v) * (1 << 16);
+      }
+      break;
+    case PcmFormat::kInt24:
+      for (int64_t i = 0; i < n; ++i) {
+        const uint8_t* p = src + 3 * i;
+        const uint32_t v = static_cast<uint32_t>(p[0]) << 8 |
+            static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 24;
+        dst[i] = static_cast<sox_sample_t>(v);
+      }
+      break;
+    case PcmFormat::kInt32:
+      std::memcpy(dst, src, n * sizeof(sox_sample_t));
+      break;
+    case PcmFormat::kFloat32:
+    case PcmFormat::kFloat64: {
+      // floats are staged so that they are read with the right alignment
+      const int64_t chunk = 1024;
+      double staging[chunk];
+      float staging_float[chunk];
+      for (int64_t i = 0; i < n; i += chunk) {
+        const int64_t m = std::min(chunk, n - i);
+        if (format == PcmFormat::kFloat32) {
+          std::memcpy(staging_float, src + 4 * i, m * sizeof(float));
+          to_sox_samples(staging_float, dst + i, m, SOX_SAMPLE_MAX + 1.);
+        } else {
+          std::memcpy(staging, src + 8 * i, m * sizeof(double));
+          to_sox_samples(staging, dst + i, m, SOX_SAMPLE_MAX + 1.);
+        }
+      }
+      break;
+    }
+  }
+}
+
+/// Finds the samples of the RIFF/WAVE file of `size` bytes at `begin`,
+/// false if it is not one with PCM or IEEE float samples.
+bool parse_wav(
+    const uint8_t* begin,
+    size_t size,
+    const uint8_t** samples,
+    PcmFormat* format,
+    sox_signalinfo_t* signal) {
+  const uint8_t* end = begin + size;
+  if (size < 12 || std::memcmp(begin, "RIFF", 4) != 0 ||
+      std::memcmp(begin + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+
+  // walk the chunks for "fmt " and "data", the data chunk may be cut short
+  const uint8_t* fmt = nullptr;
+  uint32_t fmt_size = 0;
+  const uint8_t* data = nullptr;
+  uint64_t data_size = 0;
+  for (uint64_t pos = 12; pos + 8 <= size;) {
+    const uint8_t* chunk = begin + pos;
+    const uint32_t chunk_size = le32(chunk + 4);
+    if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      fmt = chunk + 8;
+      fmt_size = chunk_size;
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      data = chunk + 8;
+      data_size = std::min<uint64_t>(chunk_size, end - data);
+      break;
+    }
+    pos += 8 + static_cast<uint64_t>(chunk_size) + (chunk_size & 1);
+  }
+  if (fmt == nullptr || data == nullptr || fmt_size < 16 ||
+      fmt_size > static_cast<uint64_t>(end - fmt)) {
+    return false;
+  }
+
+  uint16_t tag = le16(fmt);
+  const unsigned channels = le16(fmt + 2);
+  const uint32_t rate = le32(fmt + 4);
+  const unsigned block_align = le16(fmt + 12);
+  const unsigned bits = le16(fmt + 14);
+  if (tag == kWaveFormatExtensible) {
+    // the sub-format GUID starts with the format tag
+    if (fmt_size < 40) {
+      return false;
+    }
+    tag = le16(fmt + 24);
+  }
+  if (channels == 0 || rate == 0 || !to_pcm_format(tag, bits, format) ||
+      block_align != channels * bytes_per_sample(*format)) {
+    return false;
+  }
+
+  *signal = sox_signalinfo_t();
+  signal->rate = rate;
+  signal->channels = channels;
+  signal->precision = precision(*format);
+  signal->length = data_size / block_align * channels;
+  *samples = data;
+  return signal->length > 0;
+}
+
+/// The format of raw samples of encoding `ei`, false if not decoded here.
+bool raw_format(const sox_encodinginfo_t* ei, PcmFormat* format) {
+  if (ei->reverse_bytes == sox_option_yes || ei->opposite_endian) {
+    return false;
+  }
+  const unsigned bits = ei->bits_per_sample;
+  switch (ei->encoding) {
+    case SOX_ENCODING_UNSIGNED:
+      *format = PcmFormat::kUInt8;
+      return bits == 8;
+    case SOX_ENCODING_SIGN2:
+      // 8-bit wave samples are unsigned
+      return bits != 8 && to_pcm_format(kWaveFormatPcm, bits, format);
+    case SOX_ENCODING_FLOAT:
+      return to_pcm_format(kWaveFormatIeeeFloat, bits, format);
+    default:
+      return false;
+  }
+}
+
+enum class PcmFileKind { kNone, kWave, kRaw };
+
+/// What `MappedPcmFile::open` and `from_memory` decode themselves for the
+/// arguments of `read_audio_file`: wave files without signal or encoding
+/// overrides, and raw files with a signal and a linear or float encoding.
+PcmFileKind pcm_file_kind(
+    const sox_signalinfo_t* si,
+    const sox_encodinginfo_t* ei,
+    const char* ft,
+    PcmFormat* format) {
+  const std::string file_type = ft != nullptr ? ft : "";
+  if (si == nullptr && ei == nullptr &&
+      (file_type.empty() || file_type == "wav")) {
+    return PcmFileKind::kWave;
+  }
+  if (file_type == "raw" && si != nullptr && ei != nullptr &&
+      raw_format(ei, format)) {
+    return PcmFileKind::kRaw;
+  }
+  return PcmFileKind::kNone;
+}
+
+} // namespace
+
+std::unique_ptr<MappedPcmFile> MappedPcmFile::open_wav(
+    const std::string& file_name) {
+  Mapping mapping;
+  if (!is_little_endian() || !mapping.map(file_name)) {
+    return nullptr;
+  }
+  const uint8_t* data;
+  PcmFormat format;
+  sox_signalinfo_t signal;
+  if (!parse_wav(
+          static_cast<const uint8_t*>(mapping.addr),
+          mapping.size,
+          &data,
+          &format,
+          &signal)) {
+    return nullptr;
+  }
+  const size_t mapping_size = mapping.size;
+  return std::unique_ptr<MappedPcmFile>(new MappedPcmFile(
+      mapping.release(), mapping_size, data, format, signal));
+}
+
+std::unique_ptr<MappedPcmFile> MappedPcmFile::open_raw(
+    const std::string& file_name,
+    PcmFormat format,
+    unsigned channels,
+    double rate) {
+  Mapping mapping;
+  if (!is_little_endian() || channels == 0 || rate <= 0 ||
+      !mapping.map(file_name)) {
+    return nullptr;
+  }
+  const uint64_t block_align = channels * bytes_per_sample(format);
+
+  sox_signalinfo_t signal = {};
+  signal.rate = rate;
+  signal.channels = channels;
+  signal.precision = precision(format);
+  signal.length = mapping.size / block_align * channels;
+  if (signal.length == 0) {
+    return nullptr;
+  }
+  const uint8_t* data = static_cast<const uint8_t*>(mapping.addr);
+  const size_t mapping_size = mapping.size;
+  return std::unique_ptr<MappedPcmFile>(new MappedPcmFile(
+      mapping.release(), mapping_size, data, format, signal));
+}
+
+std::unique_ptr<MappedPcmFile> MappedPcmFile::open(
+    const std::string& file_name,
+    const sox_signalinfo_t* si,
+    const sox_encodinginfo_t* ei,
+    const char* ft) {
+  PcmFormat format;
+  switch (pcm_file_kind(si, ei, ft, &format)) {
+    case PcmFileKind::kWave:
+      return open_wav(file_name);
+    case PcmFileKind::kRaw:
+      return open_raw(file_name, format, si->channels, si->rate);
+    case PcmFileKind::kNone:
+      break;
+  }
+  return nullptr;
+}
+
+std::unique_ptr<MappedPcmFile> MappedPcmFile::from_memory(
+    const uint8_t* data,
+    size_t size,
+    const sox_signalinfo_t* si,
+    const sox_encodinginfo_t* ei,
+    const char* ft) {
+  PcmFormat format;
+  switch (pcm_file_kind(si, ei, ft, &format)) {
+    case PcmFileKind::kWave: {
+      const uint8_t* samples;
+      sox_signalinfo_t signal;
+      if (!is_little_endian() ||
+          !parse_wav(data, size, &samples, &format, &signal)) {
+        return nullptr;
+      }
+      return std::unique_ptr<MappedPcmFile>(
+          new MappedPcmFile(nullptr, 0, samples, format, signal));
+    }
+    case PcmFileKind::kRaw: {
+      auto pcm = view(data, size, format, si->channels, si->rate);
+      if (pcm == nullptr || pcm->signal().length == 0) {
+        return nullptr;
+      }
+      return pcm;
+    }
+    case PcmFileKind::kNone:
+      break;
+  }
+  return nullptr;
+}
+
+std::unique_ptr<MappedPcmFile> MappedPcmFile::view(
+    const uint8_t* data,
+    size_t size,
+    PcmFormat format,
+    unsigned channels,
+    double rate) {
+  if (!is_little_endian() || channels == 0 || rate <= 0) {
+    return nullptr;
+  }
+  const uint64_t block_align = channels * bytes_per_sample(format);
+  sox_signalinfo_t signal = {};
+  signal.rate = rate;
+  signal.channels = channels;
+  signal.precision = precision(format);
+  signal.length = size / block_align * channels;
+  return std::unique_ptr<MappedPcmFile>(
+      new MappedPcmFile(nullptr, 0, data, format, signal));
+}
+
+MappedPcmFile::~MappedPcmFile() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+}
+
+size_t MappedPcmFile::data_size() const {
+  return signal_.length * bytes_per_sample(format_);
+}
+
+void MappedPcmFile::decode(
+    int64_t offset,
+    int64_t length,
+    sox_sample_t* dst) const {
+  decode_samples(
+      format_, data_ + offset * bytes_per_sample(format_), length, dst);
+}
+
+} // namespace audio
+} // namespace torch
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <sox.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "sample_conversion.h"
+
+namespace torch {
+namespace audio {
+
+/// Little-endian sample formats that `MappedPcmFile` decodes itself.
+enum class PcmFormat { kUInt8, kInt16, kInt24, kInt32, kFloat32, kFloat64 };
+
+/// A RIFF/WAVE or headerless raw PCM file mapped into memory. Samples are
+/// decoded straight from the mapping into the values libsox would give, so
+/// reading a range of a file costs the size of the range, not of the file,
+/// and needs neither a libsox handle nor an intermediate buffer.
+class MappedPcmFile {
+ public:
+  /// Maps `file_name` if it is a RIFF/WAVE file with PCM or IEEE float
+  /// samples (`WAVE_FORMAT_EXTENSIBLE` included). Returns null for anything
+  /// else, including files that cannot be opened, so that the caller can
+  /// fall back to libsox and its error reporting.
+  static std::unique_ptr<MappedPcmFile> open_wav(const std::string& file_name);
+
+  /// Maps a headerless file of `channels` interleaved `format` samples.
+  static std::unique_ptr<MappedPcmFile> open_raw(
+      const std::string& file_name,
+      PcmFormat format,
+      unsigned channels,
+      double rate);
+
+  /// Picks `open_wav` or `open_raw` for the arguments of `read_audio_file`:
+  /// WAVE files without signal or encoding overrides, and raw files with a
+  /// signal and a linear or float encoding. Returns null otherwise.
+  static std::unique_ptr<MappedPcmFile> open(
+      const std::string& file_name,
+      const sox_signalinfo_t* si,
+      const sox_encodinginfo_t* ei,
+      const char* ft);
+
+  /// Like `open`, for a whole file of `size` bytes at `data` that the caller
+  /// keeps valid, e.g. a file read into a Python `bytes` object.
+  static std::unique_ptr<MappedPcmFile> from_memory(
+      const uint8_t* data,
+      size_t size,
+      const sox_signalinfo_t* si,
+      const sox_encodinginfo_t* ei,
+      const char* ft);
+
+  /// Wraps `size` bytes of `channels` interleaved `format` samples at `data`
+  /// that the caller keeps mapped, e.g. an utterance of a shard.
+  static std::unique_ptr<MappedPcmFile> view(
+      const uint8_t* data,
+      size_t size,
+      PcmFormat format,
+      unsigned channels,
+      double rate);
+
+  MappedPcmFile(const MappedPcmFile& other) = delete;
+  MappedPcmFile& operator=(const MappedPcmFile& other) = delete;
+  ~MappedPcmFile();
+
+  /// Rate, channels, precision and length (in samples) like libsox reports.
+  const sox_signalinfo_t& signal() const {
+    return signal_;
+  }
+
+  PcmFormat format() const {
+    return format_;
+  }
+
+  /// The encoded samples and their size in bytes.
+  const uint8_t* data() const {
+    return data_;
+  }
+  size_t data_size() const;
+
+  /// Decodes the `length` samples starting at sample `offset` into `dst`.
+  void decode(int64_t offset, int64_t length, sox_sample_t* dst) const;
+
+  /// Decodes the `length` samples starting at sample `offset` into `dst`,
+  /// converted and normalized like `decode_into`.
+  template <typename scalar_t>
+  void read(
+      int64_t offset,
+      int64_t length,
+      scalar_t* dst,
+      double normalization) const {
+    // straight out of the mapping, so decoding is converting
+    StageTimer timer(Stage::kConvert);
+    count(Counter::kSamplesDecoded, length);
+    count(Counter::kBytesConverted, length * sizeof(scalar_t));
+    if (std::is_same<scalar_t, sox_sample_t>::value && normalization == 1.) {
+      decode(offset, length, reinterpret_cast<sox_sample_t*>(dst));
+      return;
+    }
+    decode_chunks(
+        offset,
+        length,
+        [&](const sox_sample_t* samples, int64_t first, int64_t n) {
+          convert_samples(samples, dst + first, n, normalization);
+        });
+  }
+
+  /// Decodes the `length` samples starting at sample `offset` a chunk of
+  /// `kDecodeChunkSize` at a time, and calls `sink(samples, first, n)` with
+  /// every chunk, like `torch::audio::decode_chunks`.
+  template <typename Sink>
+  void decode_chunks(int64_t offset, int64_t length, const Sink& sink) const {
+    sox_sample_t staging[kDecodeChunkSize];
+    for (int64_t i = 0; i < length; i += kDecodeChunkSize) {
+      const int64_t n = std::min(kDecodeChunkSize, length - i);
+      decode(offset + i, n, staging);
+      sink(staging, i, n);
+    }
+  }
+
+ private:
+  MappedPcmFile(
+      void* mapping,
+      size_t mapping_size,
+      const uint8_t* data,
+      PcmFormat format,
+      const sox_signalinfo_t& signal)
+      : mapping_(mapping),
+        mapping_size_(mapping_size),
+        data_(data),
+        format_(format),
+        signal_(signal) {}
+
+  // null for views
+  void* mapping_;
+  size_t mapping_size_;
+  const uint8_t* data_;
+  PcmFormat format_;
+  sox_signalinfo_t signal_;
+};
+
+} // namespace audio
+} // namespace torch